@@ -1,8 +1,9 @@
 TEMPLATE = subdirs
 
-SUBDIRS += src tests app
+SUBDIRS += src tests app bench
 CONFIG += ordered
 CONFIG += c++11
 
 tests.depends = src
 app.depends = tests
+bench.depends = src
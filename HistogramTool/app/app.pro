@@ -16,3 +16,6 @@ TARGET = HistogramTool
 HISTO_LIB = ../src/libHistogramTool.a
 LIBS += $${HISTO_LIB}
 PRE_TARGETDEPS += $${HISTO_LIB}
+
+# qmake CONFIG+=notrace compiles tracing out
+notrace: DEFINES += HISTOGRAM_NO_TRACE
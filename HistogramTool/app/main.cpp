@@ -3,38 +3,120 @@
 #include <QImage>
 #include <QStringList>
 #include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
 
+#include <csignal>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 #include "histogram.h"
+#include "histogram_writer.h"
 #include "histogram_tool.h"
+#include "streaming_histogram.h"
+#include "batch_histogram.h"
+#include "mapped_raster.h"
+#include "tiled_histogram.h"
+#include "region_histogram_index.h"
+#include "sampled_histogram.h"
+#include "trace.h"
+#include "cpu_topology.h"
+#include "auto_tuner.h"
+#include "histogram_server.h"
+#include "histogram_client.h"
+#include "histogram_reader.h"
+#include "joint_histogram.h"
+#include "histogram_stats.h"
 
 const int ERR_NO_ERROR = 0;
 const int ERR_IMAGE_FILE_NOT_FOUND = 1;
 const int ERR_COULDNT_WRITE_FILE = 2;
 const int ERR_ILLEGAL_ARGS= 3;
+const int ERR_CONNECTION_FAILED = 4;
+
+
+/*
+ * Settings for a run, populated from the command line
+ */
+struct Options {
+    std::string imageFileName = "";
+    std::string outputFileName = "";
+    HistogramWriter::Format outputFormat = HistogramWriter::Format::Text;
+    bool        runSelfTest = false;
+    uint32_t    numThreads = 0;
+    KernelType  kernel = KernelType::Auto;
+    uint32_t    chunkRows = 0;
+    bool        stream = false;
+    uint32_t    bandRows = 0;
+    bool        batch = false;
+    std::string inputListFileName = "";
+    uint32_t    numDecoders = 1;
+    uint32_t    numCounters = 1;
+    uint32_t    queueDepth = BatchHistogram::DEFAULT_QUEUE_CAPACITY;
+    bool        map = true;
+    uint32_t    rawWidth = 0;
+    uint32_t    rawHeight = 0;
+    uint32_t    rawStride = 0;
+    PixelFormat rawFormat = PixelFormat::RGBA8888;
+    uint32_t    memoryBudgetMB = 0;
+    std::string regionsFileName = "";
+    double      sampleFraction = 0;
+    double      sampleError = 0;
+    SampledHistogram::Method sampleMethod = SampledHistogram::Method::Jittered;
+    uint32_t    channels = HistogramKernel::AllChannels;
+    uint32_t    derivedChannels = 0;
+    uint32_t    jointBins = 0;
+    bool        stats = false;
+    bool        profile = false;
+    std::string traceFileName = "";
+    bool        hardwareCounters = false;
+    bool        numa = false;
+    bool        calibrate = false;
+    std::string tuningFileName = "";
+    std::string serveSocket = "";
+    std::string connectSocket = "";
+    std::vector<std::string> clientFileNames;
+};
+
+
+/*
+ * Parse a positive integer option value. Shows help and exits if it is set but not positive.
+ */
+void parsePositive( QCommandLineParser& parser, const QString& name, const char * description, uint32_t& value ) {
+    QString text = parser.value( name );
+    if( text.length() > 0 ) {
+        value = text.toUInt();
+        if( value == 0 ) {
+            std::cerr << "If specified, " << description << " must be a positive integer" << std::endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+    }
+}
 
 
 /*
  * Self test checks that the total number of red, green and blue samples
  * in the histograms match each other and the total number of pixels
  * Displays results to stdout.
- * It writes the results to stdout.
+ * It writes the results to stdout. Only the channels in the mask are checked.
  */
-void selfTest( QImage& img, Histogram& red, Histogram& green, Histogram& blue ) {
+void selfTest( uint64_t numPixels, Histogram& red, Histogram& green, Histogram& blue, uint32_t channels = HistogramKernel::AllChannels ) {
     using namespace std;
 
-    uint32_t redSamples = red.total();
-    uint32_t greenSamples = green.total();
-    uint32_t blueSamples = blue.total();
-    uint32_t numPixels = static_cast<uint32_t>( img.width() * img.height() );
+    uint64_t redSamples = red.total();
+    uint64_t greenSamples = green.total();
+    uint64_t blueSamples = blue.total();
 
     cout << "   Red samples : " << redSamples << endl;
     cout << " Green samples : " << greenSamples << endl;
     cout << "  Blue samples : " << blueSamples << endl;
     cout << "  Image Pixels : " << numPixels << endl;
-    if( redSamples == greenSamples && redSamples == blueSamples && redSamples == numPixels ) {
+    bool passed = ( ! ( channels & HistogramKernel::Red ) || redSamples == numPixels )
+               && ( ! ( channels & HistogramKernel::Green ) || greenSamples == numPixels )
+               && ( ! ( channels & HistogramKernel::Blue ) || blueSamples == numPixels );
+    if( passed ) {
         cout << "PASSED" << endl;
     }
     else {
@@ -48,12 +130,75 @@ void selfTest( QImage& img, Histogram& red, Histogram& green, Histogram& blue )
  * -h, --help                   Displays this help.
  * -s, --self-test              Show self test results
  * -o, --output-file <file>     Write output to file
+ * --output-format <format>     Format of the output; one of text, binary or delta.
+ *                              Binary formats need an output file. Defaults to text
  * -t, --num-threads <threads>  Use specified number of threads. Overrides
  *                              automatic setting
+ * --calibrate                  Measure the fastest threads and kernel for each
+ *                              image size again rather than using saved tuning
+ * --tuning-file <file>         Where tuning is saved. Defaults to
+ *                              ~/.cache/histogramtool/tuning
+ * -k, --kernel <kernel>        Use specified histogram kernel; one of auto,
+ *                              scalar, sse4.2, avx2 or avx512. Defaults to auto
+ * -c, --chunk-rows <rows>      Number of scanlines handed to a thread at a time.
+ *                              Defaults to automatic sizing
+ * --numa                       Pin threads across NUMA nodes, count each chunk on
+ *                              the node holding it and merge counts in a tree
+ * --stream                     Decode and count the image in bands rather than
+ *                              loading it whole
+ * --band-rows <rows>           Number of scanlines per band when streaming.
+ *                              Defaults to automatic sizing
+ * --input-list <file>          Compute histograms for every image named in file,
+ *                              one per line
+ * --decoders <threads>         Batch mode: number of threads decoding images
+ * --counters <threads>         Batch mode: number of threads counting images
+ * --queue-depth <images>       Batch mode: most images waiting between stages
+ * --no-map                     Load PPM, PAM and BMP files through QImage rather
+ *                              than mapping them
+ * --raw-width <pixels>         Image file is headerless pixel data of this width
+ * --raw-height <rows>          Number of scanlines of raw pixel data
+ * --raw-stride <bytes>         Bytes from one raw scanline to the next. Defaults
+ *                              to unpadded
+ * --raw-format <format>        Layout of raw pixels; one of rgba, argb32, rgb,
+ *                              bgr or grey. Defaults to rgba
+ * --memory-budget <MB>         Count mapped images in tiles of at most this many
+ *                              megabytes, releasing each band once counted.
+ *                              Other images are streamed in bands of this size
+ * --regions <file>             Index the image and write the histogram of each
+ *                              rectangle in file, one "x y width height" per line
+ * --sample <fraction>          Estimate the histogram from this fraction of the
+ *                              pixels, with 95% confidence intervals
+ * --sample-error <error>       Estimate the histogram from enough pixels for each
+ *                              bucket to be within this fraction of the pixels
+ * --sample-method <method>     How pixels are sampled; one of strided, jittered or
+ *                              tiles. Defaults to jittered
+ * --channels <channels>        Count only these of red, green and blue, as
+ *                              letters r, g and b such as rg. Defaults to rgb
+ * --derived <channels>         Also count these channels in the same pass,
+ *                              written after blue; comma separated from alpha,
+ *                              luma601, luma709, cb, cr, hue and saturation
+ * --joint <bins>               Write the joint red, green and blue histogram with
+ *                              16, 32 or 64 bins per channel instead; only the
+ *                              bins hit are written
+ * --stats                      Write the total, mean, standard deviation, 1st and
+ *                              99th percentiles and Otsu threshold of each
+ *                              histogram instead of its counts
+ * --profile                    Print the time spent in each phase and the rate
+ *                              each thread counted at
+ * --trace <file>               Write the phases on each thread to file as a
+ *                              Chrome trace
+ * --hardware-counters          Also count cycles, instructions and cache misses
+ *                              in each phase. Linux only
+ * --serve <socket>             Stay resident and answer histogram requests on
+ *                              this Unix domain socket until interrupted
+ * --connect <socket>           Send the images to a server started with --serve
+ *                              and write the histograms it returns
  * Arguments:
- * image                        Image file to compute histogram for.
+ * image                        Image file, or directory of images, to compute
+ *                              histogram for. Several files may be given with
+ *                              --connect; none with --serve.
  */
-void parseCommandLine( int argc, char * argv[], std::string& imageFileName, std::string& outputFileName, bool& runSelfTest, uint32_t& numThreads ) {
+void parseCommandLine( int argc, char * argv[], Options& options ) {
 
     using namespace std;
 
@@ -68,9 +213,40 @@ void parseCommandLine( int argc, char * argv[], std::string& imageFileName, std:
         // Self test option, t
         { {"s", "self-test"},  "Show self test results" },
         { {"o", "output-file"}, "Write output to file", "file" },
-        { {"t", "num-threads"}, "Use specified number of threads. Overrides automatic setting", "threads" }
+        { "output-format", "Format of the output; one of text, binary or delta. Binary formats need an output file. Defaults to text", "format" },
+        { {"t", "num-threads"}, "Use specified number of threads. Overrides automatic setting", "threads" },
+        { "calibrate", "Measure the fastest threads and kernel for each image size again rather than using saved tuning" },
+        { "tuning-file", "Where tuning is saved. Defaults to ~/.cache/histogramtool/tuning", "file" },
+        { {"k", "kernel"}, "Use specified histogram kernel; one of auto, scalar, sse4.2, avx2 or avx512. Defaults to auto", "kernel" },
+        { {"c", "chunk-rows"}, "Number of scanlines handed to a thread at a time. Defaults to automatic sizing", "rows" },
+        { "numa", "Pin threads across NUMA nodes, count each chunk on the node holding it and merge counts in a tree" },
+        { "stream", "Decode and count the image in bands rather than loading it whole" },
+        { "band-rows", "Number of scanlines per band when streaming. Defaults to automatic sizing", "rows" },
+        { "input-list", "Compute histograms for every image named in file, one per line", "file" },
+        { "decoders", "Batch mode: number of threads decoding images", "threads" },
+        { "counters", "Batch mode: number of threads counting images", "threads" },
+        { "queue-depth", "Batch mode: most images waiting between stages", "images" },
+        { "no-map", "Load PPM, PAM and BMP files through QImage rather than mapping them" },
+        { "raw-width", "Image file is headerless pixel data of this width", "pixels" },
+        { "raw-height", "Number of scanlines of raw pixel data", "rows" },
+        { "raw-stride", "Bytes from one raw scanline to the next. Defaults to unpadded", "bytes" },
+        { "raw-format", "Layout of raw pixels; one of rgba, argb32, rgb, bgr or grey. Defaults to rgba", "format" },
+        { "memory-budget", "Count mapped images in tiles of at most this many megabytes, releasing each band once counted. Other images are streamed in bands of this size", "MB" },
+        { "regions", "Index the image and write the histogram of each rectangle in file, one \"x y width height\" per line", "file" },
+        { "sample", "Estimate the histogram from this fraction of the pixels, with 95% confidence intervals", "fraction" },
+        { "sample-error", "Estimate the histogram from enough pixels for each bucket to be within this fraction of the pixels", "error" },
+        { "sample-method", "How pixels are sampled; one of strided, jittered or tiles. Defaults to jittered", "method" },
+        { "channels", "Count only these of red, green and blue, as letters r, g and b such as rg. Only their histograms are written. Defaults to rgb", "channels" },
+        { "derived", "Also count these channels in the same pass, written after blue; comma separated from alpha, luma601, luma709, cb, cr, hue and saturation", "channels" },
+        { "joint", "Write the joint red, green and blue histogram with this many bins per channel instead; 16, 32 or 64. Only the bins hit are written", "bins" },
+        { "stats", "Write the total, mean, standard deviation, 1st and 99th percentiles and Otsu threshold of each histogram instead of its counts" },
+        { "profile", "Print the time spent in each phase and the rate each thread counted at" },
+        { "trace", "Write the phases on each thread to file as a Chrome trace", "file" },
+        { "hardware-counters", "Also count cycles, instructions and cache misses in each phase. Linux only" },
+        { "serve", "Stay resident and answer histogram requests on this Unix domain socket until interrupted", "socket" },
+        { "connect", "Send the images to a server started with --serve and write the histograms it returns", "socket" }
     });
-    parser.addPositionalArgument( "image", "Image file to compute histogram for.");
+    parser.addPositionalArgument( "image", "Image file, or directory of images, to compute histogram for. Several files may be given with --connect; none with --serve.");
 
 
     // Parse the arguments
@@ -81,35 +257,833 @@ void parseCommandLine( int argc, char * argv[], std::string& imageFileName, std:
 
     // Do self test ?
     if( parser.isSet( "s" ) ) {
-        runSelfTest = true;
+        options.runSelfTest = true;
     }
 
     // Number of threads specified ? Should be non-zero
     QString threadCount = parser.value( "t" );
     if( threadCount.length() > 0 ) {
-        numThreads = threadCount.toUInt();
-        if( numThreads == 0 ) {
+        options.numThreads = threadCount.toUInt();
+        if( options.numThreads == 0 ) {
             cerr << "If specified, threads must be a positive integer" << endl;
             parser.showHelp(ERR_ILLEGAL_ARGS );
         }
     }
 
 
+    // Automatic configuration; optional
+    options.calibrate = parser.isSet( "calibrate" );
+    options.tuningFileName = parser.value( "tuning-file" ).toStdString();
+    if( options.tuningFileName.length() == 0 ) {
+        options.tuningFileName = AutoTuner::defaultCacheFile();
+    }
+
+
+    // Kernel specified ? Must be known and supported by this CPU
+    QString kernelName = parser.value( "k" );
+    if( kernelName.length() > 0 ) {
+        try {
+            options.kernel = HistogramKernel::fromName( kernelName.toStdString() );
+        } catch( const std::invalid_argument& e ) {
+            cerr << e.what() << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+        if( ! HistogramKernel::isSupported( options.kernel ) ) {
+            cerr << "Kernel " << kernelName.toStdString() << " is not supported on this CPU" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+    }
+
+
+    // Chunk size specified ? Should be non-zero
+    parsePositive( parser, "c", "chunk rows", options.chunkRows );
+
+
+    // NUMA placement ?
+    options.numa = parser.isSet( "numa" );
+
+
+    // Streaming ? Band size is optional but should be non-zero
+    if( parser.isSet( "stream" ) ) {
+        options.stream = true;
+    }
+    parsePositive( parser, "band-rows", "band rows", options.bandRows );
+
+
+    // Batch mode concurrency
+    parsePositive( parser, "decoders", "decoders", options.numDecoders );
+    parsePositive( parser, "counters", "counters", options.numCounters );
+    parsePositive( parser, "queue-depth", "queue depth", options.queueDepth );
+
+
+    // Memory mapping. Raw data needs both dimensions
+    if( parser.isSet( "no-map" ) ) {
+        options.map = false;
+    }
+    parsePositive( parser, "raw-width", "raw width", options.rawWidth );
+    parsePositive( parser, "raw-height", "raw height", options.rawHeight );
+    parsePositive( parser, "raw-stride", "raw stride", options.rawStride );
+    if( ( options.rawWidth > 0 ) != ( options.rawHeight > 0 ) ) {
+        cerr << "Raw data needs both a width and a height" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+    parsePositive( parser, "memory-budget", "memory budget", options.memoryBudgetMB );
+    QString rawFormat = parser.value( "raw-format" );
+    if( rawFormat.length() > 0 ) {
+        const QString names[] = { "rgba", "argb32", "rgb", "bgr", "grey" };
+        const PixelFormat formats[] = { PixelFormat::RGBA8888, PixelFormat::ARGB32, PixelFormat::RGB888, PixelFormat::BGR888, PixelFormat::Grayscale8 };
+        size_t i = 0;
+        while( i < 5 && ! ( names[i] == rawFormat ) ) {
+            i++;
+        }
+        if( i == 5 ) {
+            cerr << "Unknown raw format " << rawFormat.toStdString() << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+        options.rawFormat = formats[i];
+    }
+
+
+    // Regions file; optional
+    options.regionsFileName = parser.value( "regions" ).toStdString();
+
+
+    // Sampling; optional
+    if( parser.isSet( "sample" ) ) {
+        bool ok;
+        options.sampleFraction = parser.value( "sample" ).toDouble( &ok );
+        if( ! ok || ! ( options.sampleFraction > 0 && options.sampleFraction <= 1 ) ) {
+            cerr << "Sample fraction must be more than 0 and at most 1" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+    }
+    if( parser.isSet( "sample-error" ) ) {
+        bool ok;
+        options.sampleError = parser.value( "sample-error" ).toDouble( &ok );
+        if( ! ok || ! ( options.sampleError > 0 && options.sampleError < 1 ) ) {
+            cerr << "Sample error must be between 0 and 1" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+    }
+    if( options.sampleFraction > 0 && options.sampleError > 0 ) {
+        cerr << "Specify a sample fraction or a sample error, not both" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+    QString sampleMethod = parser.value( "sample-method" );
+    if( sampleMethod.length() > 0 ) {
+        if( sampleMethod == "strided" ) {
+            options.sampleMethod = SampledHistogram::Method::Strided;
+        } else if( sampleMethod == "jittered" ) {
+            options.sampleMethod = SampledHistogram::Method::Jittered;
+        } else if( sampleMethod == "tiles" ) {
+            options.sampleMethod = SampledHistogram::Method::RandomTiles;
+        } else {
+            cerr << "Unknown sample method " << sampleMethod.toStdString() << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+    }
+
+
+    // Instrumentation; optional
+    options.profile = parser.isSet( "profile" );
+    options.traceFileName = parser.value( "trace" ).toStdString();
+    options.hardwareCounters = parser.isSet( "hardware-counters" );
+    if( options.hardwareCounters && ! options.profile && options.traceFileName.length() == 0 ) {
+        cerr << "Hardware counters need --profile or --trace" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+
+
     // Output file name; optional
     QString fileName = parser.value( "o");
     if( fileName.length() > 0 ) {
-        outputFileName = fileName.toStdString();
+        options.outputFileName = fileName.toStdString();
+    }
+
+    // Output format; optional. Binary can't share stdout with progress messages
+    QString outputFormat = parser.value( "output-format" );
+    if( outputFormat.length() > 0 ) {
+        try {
+            options.outputFormat = HistogramWriter::formatFromName( outputFormat.toStdString() );
+        } catch( const std::invalid_argument& e ) {
+            cerr << e.what() << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+        if( options.outputFormat != HistogramWriter::Format::Text && options.outputFileName.length() == 0 ) {
+            cerr << "Binary output needs an output file" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
     }
 
 
-    // Image file name is mandatory
+    // Server or client; optional
+    options.serveSocket = parser.value( "serve" ).toStdString();
+    options.connectSocket = parser.value( "connect" ).toStdString();
+    if( options.serveSocket.length() > 0 && options.connectSocket.length() > 0 ) {
+        cerr << "Can't serve and connect at once" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+
+
+    // Image file or directory name is mandatory unless a list of images is given or serving
+    QString inputList = parser.value( "input-list" );
     QStringList positionalArguments = parser.positionalArguments();
-    if( positionalArguments.length() != 1 ) {
+    if( options.serveSocket.length() > 0 ) {
+        if( positionalArguments.length() != 0 || inputList.length() > 0 ) {
+            cerr << "A server is sent its images by clients" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+        bool wholeImageModes = options.stream || options.rawWidth > 0 || options.memoryBudgetMB > 0
+            || options.regionsFileName.length() > 0 || options.sampleFraction > 0 || options.sampleError > 0;
+        if( wholeImageModes ) {
+            cerr << "A server only computes whole histograms" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+    } else if( inputList.length() > 0 ) {
+        options.batch = true;
+        options.inputListFileName = inputList.toStdString();
+        if( positionalArguments.length() != 0 ) {
+            cerr << "Can't specify an image file with an input list" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+    } else if( options.connectSocket.length() > 0 && positionalArguments.length() > 1 ) {
+        for( const QString& argument : positionalArguments ) {
+            options.clientFileNames.push_back( argument.toStdString() );
+        }
+    } else if( positionalArguments.length() != 1 ) {
         cerr << "Must specify input image file" << endl;
         parser.showHelp( ERR_ILLEGAL_ARGS );
     } else {
-        imageFileName = positionalArguments[0].toStdString();
+        options.imageFileName = positionalArguments[0].toStdString();
+        options.batch = QFileInfo( positionalArguments[0] ).isDir();
+        if( options.connectSocket.length() > 0 && ! options.batch ) {
+            options.clientFileNames.push_back( options.imageFileName );
+        }
+    }
+
+    if( options.connectSocket.length() > 0 && ( options.stream || options.rawWidth > 0 || options.regionsFileName.length() > 0
+                                                || options.sampleFraction > 0 || options.sampleError > 0 ) ) {
+        cerr << "A server only computes whole histograms" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+    if( options.batch && options.numa ) {
+        cerr << "NUMA placement is for a single image" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+    if( options.batch && options.stream ) {
+        cerr << "Can't stream in batch mode" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+    if( options.rawWidth > 0 && ( options.batch || options.stream ) ) {
+        cerr << "Raw data can only be read from a single file" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+    if( options.regionsFileName.length() > 0 && ( options.batch || options.stream ) ) {
+        cerr << "Regions can only be read from a single, whole image" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+    bool sampling = options.sampleFraction > 0 || options.sampleError > 0;
+    if( sampling && ( options.batch || options.stream || options.regionsFileName.length() > 0 ) ) {
+        cerr << "Sampling needs a single, whole image" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+
+    // Options which change how a single image is counted in one pass, so not with modes which count it otherwise
+    bool singleWholeImage = ! ( options.batch || options.stream || options.memoryBudgetMB > 0
+                                || options.regionsFileName.length() > 0 || sampling
+                                || options.serveSocket.length() > 0 || options.connectSocket.length() > 0 );
+
+
+    // Only some channels ?
+    QString channelNames = parser.value( "channels" );
+    if( channelNames.length() > 0 ) {
+        try {
+            options.channels = HistogramKernel::channelsFromName( channelNames.toStdString() );
+        } catch( const std::invalid_argument& e ) {
+            cerr << e.what() << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+        if( ! singleWholeImage ) {
+            cerr << "--channels needs a single, whole image" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+    }
+
+
+    // Derived channels ? Counted in the same pass
+    QString derivedNames = parser.value( "derived" );
+    if( derivedNames.length() > 0 ) {
+        try {
+            options.derivedChannels = DerivedChannels::maskFromNames( derivedNames.toStdString() );
+        } catch( const std::invalid_argument& e ) {
+            cerr << e.what() << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+        if( ! singleWholeImage ) {
+            cerr << "--derived needs a single, whole image" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+    }
+
+    // Joint histogram ? Counted instead of the channel histograms
+    QString jointBins = parser.value( "joint" );
+    if( jointBins.length() > 0 ) {
+        try {
+            options.jointBins = JointHistogram::binsFromName( jointBins.toStdString() );
+        } catch( const std::invalid_argument& e ) {
+            cerr << e.what() << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+        if( ! singleWholeImage ) {
+            cerr << "--joint needs a single, whole image" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+        if( options.channels != HistogramKernel::AllChannels || options.derivedChannels != 0 ) {
+            cerr << "--joint replaces the channel histograms, so can't be used with --channels or --derived" << endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+    }
+
+    // Statistics ? Of the histograms which would be written, so not of estimates, joint histograms or a server's
+    options.stats = parser.isSet( "stats" );
+    if( options.stats && ( sampling || options.jointBins > 0 || options.serveSocket.length() > 0 ) ) {
+        cerr << "Statistics are written for counted channel histograms" << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+}
+
+
+/*
+ * Open the output file, if one was given, in binary mode for binary formats.
+ * Returns false, having reported it, if the file can't be opened.
+ */
+bool openOutput( const Options& options, std::ofstream& outputFile ) {
+    if( options.outputFileName.length() == 0 ) {
+        return true;
+    }
+
+    std::ios::openmode mode = std::ios::out;
+    if( options.outputFormat != HistogramWriter::Format::Text ) {
+        mode |= std::ios::binary;
+    }
+    outputFile.open( options.outputFileName, mode );
+    if( ! outputFile.good() ) {
+        std::cerr << "Couldn't write histogram to " << options.outputFileName << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+/*
+ * Build the list of images for a batch, either from the input list file or the directory
+ * named on the command line. Returns false if the list or directory can't be read.
+ */
+bool batchFiles( const Options& options, QStringList& files ) {
+    if( options.inputListFileName.length() > 0 ) {
+        std::ifstream list{ options.inputListFileName };
+        if( ! list.good() ) {
+            return false;
+        }
+
+        std::string line;
+        while( std::getline( list, line ) ) {
+            if( line.length() > 0 ) {
+                files.push_back( QString::fromStdString( line ) );
+            }
+        }
+        return true;
+    }
+
+    QDir directory{ QString::fromStdString( options.imageFileName ) };
+    for( const QString& name : directory.entryList( QDir::Files, QDir::Name ) ) {
+        files.push_back( directory.filePath( name ) );
+    }
+    return true;
+}
+
+
+/*
+ * Write the statistics of histograms of 256 buckets in place of their counts, worked out in one batch
+ */
+void writeStats( HistogramWriter& writer, const std::vector<const uint64_t*>& counts ) {
+    HistogramStats stats;
+    std::vector<HistogramStats::Summary> summaries;
+    stats.compute( counts, 256, summaries );
+    for( const HistogramStats::Summary& summary : summaries ) {
+        writer.write( summary );
+    }
+}
+
+
+/*
+ * Compute histograms for a batch of images through a decode, count and write pipeline.
+ * Each record is the image file name followed by its red, green and blue histograms.
+ * Images which can't be read are reported to stderr and the batch continues.
+ */
+int runBatch( const Options& options, uint32_t numThreads ) {
+    using namespace std;
+
+    QStringList files;
+    if( ! batchFiles( options, files ) ) {
+        cerr << "Unable to read input list " << options.inputListFileName << endl;
+        return ERR_IMAGE_FILE_NOT_FOUND;
+    }
+
+    // Share the threads between the counters unless a thread count was given for each
+    uint32_t threadsPerCounter = ( options.numThreads > 0 )
+        ? options.numThreads
+        : std::max<uint32_t>( 1, numThreads / options.numCounters );
+
+    BatchHistogram batch{ options.numDecoders, options.numCounters, threadsPerCounter, options.kernel, options.queueDepth };
+    cout << "Using " << batch.kernel().name() << " kernel." << endl;
+    cout << " Batch : " << files.size() << " images, " << batch.numDecoders() << " decoders, "
+         << batch.numCounters() << " counters of " << threadsPerCounter << " threads" << endl;
+
+    ofstream outputFile;
+    if( ! openOutput( options, outputFile ) ) {
+        return ERR_COULDNT_WRITE_FILE;
+    }
+    ostream& output = outputFile.is_open() ? static_cast<ostream&>( outputFile ) : cout;
+    HistogramWriter writer{ output, options.outputFormat };
+
+    QTime time;
+    time.start();
+
+    uint32_t failures = batch.run( files, [&]( BatchRecord& record ) {
+        if( ! record.ok() ) {
+            cerr << record.error << endl;
+            return;
+        }
+        writer.writeLabel( record.fileName.toStdString() );
+        if( options.stats ) {
+            writeStats( writer, { record.red.data(), record.green.data(), record.blue.data() } );
+        } else {
+            writer.write( record.red );
+            writer.write( record.green );
+            writer.write( record.blue );
+        }
+
+        if( options.runSelfTest ) {
+            selfTest( record.numPixels, record.red, record.green, record.blue );
+        }
+    } );
+
+    int time_taken = time.elapsed();
+    cout << " Time Taken : " << time_taken << "ms (including decode)" << endl;
+    cout << " Queue depth : decoded " << batch.peakDecodedDepth() << ", counted " << batch.peakCountedDepth()
+         << " (of " << batch.queueCapacity() << ")" << endl;
+
+    if( ! writer.flush() ) {
+        cerr << "Couldn't write histogram to " << options.outputFileName << endl;
+        return ERR_COULDNT_WRITE_FILE;
+    }
+    return ( failures > 0 ) ? ERR_IMAGE_FILE_NOT_FOUND : ERR_NO_ERROR;
+}
+
+
+// The server to stop on SIGINT or SIGTERM
+static HistogramServer *gServer = nullptr;
+
+/*
+ * Signal handler asking the server to wind down
+ */
+void stopServer( int ) {
+    if( gServer != nullptr ) {
+        gServer->stop();
+    }
+}
+
+
+/*
+ * Keep the tool resident and answer requests on a Unix domain socket until interrupted or terminated.
+ * Requests already queued are answered before returning.
+ */
+int runServer( const Options& options, HistogramTool& tool ) {
+    using namespace std;
+
+    HistogramServer server{ tool, options.numDecoders, options.queueDepth };
+    if( ! server.listen( options.serveSocket ) ) {
+        cerr << server.errorString() << endl;
+        return ERR_CONNECTION_FAILED;
+    }
+    cout << " Serving : " << options.serveSocket << ", " << options.numDecoders << " decoders, queue depth "
+         << options.queueDepth << endl;
+
+    gServer = &server;
+    signal( SIGINT, stopServer );
+    signal( SIGTERM, stopServer );
+    server.run();
+    signal( SIGINT, SIG_DFL );
+    signal( SIGTERM, SIG_DFL );
+    gServer = nullptr;
+
+    cout << " Answered : " << server.requestsAnswered() << " requests" << endl;
+    return ERR_NO_ERROR;
+}
+
+
+/*
+ * Send images to a server and write the histograms it returns, as batch mode would.
+ * Requests are sent from another thread so that responses are read while requests are still going out;
+ * the server stops reading when it is busy. Histograms come back compactly and are rewritten in the output format.
+ */
+int runClient( const Options& options ) {
+    using namespace std;
+
+    QStringList files;
+    if( options.batch ) {
+        if( ! batchFiles( options, files ) ) {
+            cerr << "Unable to read input list " << options.inputListFileName << endl;
+            return ERR_IMAGE_FILE_NOT_FOUND;
+        }
+    } else {
+        for( const std::string& fileName : options.clientFileNames ) {
+            files.push_back( QString::fromStdString( fileName ) );
+        }
+    }
+
+    HistogramClient client;
+    if( ! client.connect( options.connectSocket ) ) {
+        cerr << client.errorString() << endl;
+        return ERR_CONNECTION_FAILED;
     }
+
+    ofstream outputFile;
+    if( ! openOutput( options, outputFile ) ) {
+        return ERR_COULDNT_WRITE_FILE;
+    }
+    ostream& output = outputFile.is_open() ? static_cast<ostream&>( outputFile ) : cout;
+    HistogramWriter writer{ output, options.outputFormat };
+
+    QTime time;
+    time.start();
+
+    thread sender( [&]{
+        for( int i = 0; i < files.size(); ++i ) {
+            // The server may not share our working directory
+            string fileName = QFileInfo( files[i] ).absoluteFilePath().toStdString();
+            try {
+                if( ! client.requestFile( to_string( i ), fileName, HistogramWriter::Format::BinaryDelta ) ) {
+                    break;
+                }
+            } catch( const std::invalid_argument& e ) {
+                cerr << fileName << ": " << e.what() << endl;
+            }
+        }
+        client.finishRequests();
+    } );
+
+    uint32_t failures = 0;
+    int received = 0;
+    HistogramClient::Response response;
+    while( received < files.size() && client.receive( response ) ) {
+        received++;
+        if( ! response.ok ) {
+            cerr << response.body << endl;
+            failures++;
+            continue;
+        }
+
+        istringstream body{ response.body };
+        HistogramReader reader{ body };
+        Histogram histogram;
+        for( bool first = true; reader.read( histogram ); first = false ) {
+            if( first ) {
+                writer.writeLabel( reader.label() );
+            }
+            if( options.stats ) {
+                writeStats( writer, { histogram.data() } );
+            } else {
+                writer.write( histogram );
+            }
+        }
+    }
+    sender.join();
+    if( received < files.size() ) {
+        cerr << client.errorString() << endl;
+        failures += static_cast<uint32_t>( files.size() - received );
+    }
+
+    int time_taken = time.elapsed();
+    cout << " Time Taken : " << time_taken << "ms for " << files.size() << " images" << endl;
+
+    if( ! writer.flush() ) {
+        cerr << "Couldn't write histogram to " << options.outputFileName << endl;
+        return ERR_COULDNT_WRITE_FILE;
+    }
+    return ( failures > 0 ) ? ERR_IMAGE_FILE_NOT_FOUND : ERR_NO_ERROR;
+}
+
+
+/*
+ * Read the rectangles in a regions file, one "x y width height" per line. Blank lines are skipped.
+ * Returns false if the file can't be read or a line isn't four numbers.
+ */
+bool readRegions( const std::string& fileName, std::vector<Rect>& rects ) {
+    std::ifstream file{ fileName };
+    if( ! file.good() ) {
+        return false;
+    }
+
+    std::string line;
+    while( std::getline( file, line ) ) {
+        if( line.find_first_not_of( " \t\r" ) == std::string::npos ) {
+            continue;
+        }
+        std::istringstream fields{ line };
+        Rect rect;
+        if( ! ( fields >> rect.x >> rect.y >> rect.width >> rect.height ) ) {
+            return false;
+        }
+        rects.push_back( rect );
+    }
+    return true;
+}
+
+
+/*
+ * Index an image and write the histogram of each rectangle in the regions file.
+ * Each record is the rectangle followed by its red, green and blue histograms.
+ */
+int runRegions( const Options& options, const HistogramTool& htool, const ImageView& image ) {
+    using namespace std;
+
+    vector<Rect> rects;
+    if( ! readRegions( options.regionsFileName, rects ) ) {
+        cerr << "Unable to read regions from " << options.regionsFileName << endl;
+        return ERR_ILLEGAL_ARGS;
+    }
+    for( const Rect& rect : rects ) {
+        if( ! image.contains( rect ) ) {
+            cerr << "Region " << rect.x << " " << rect.y << " " << rect.width << " " << rect.height
+                 << " is outside the image" << endl;
+            return ERR_ILLEGAL_ARGS;
+        }
+    }
+
+    size_t memoryBudget = ( options.memoryBudgetMB > 0 )
+        ? static_cast<size_t>( options.memoryBudgetMB ) * 1024 * 1024
+        : RegionHistogramIndex::DEFAULT_MEMORY_BUDGET;
+    RegionHistogramIndex index{ htool, RegionHistogramIndex::blockSizeFor( image.width, image.height, memoryBudget ) };
+
+    QTime time;
+    time.start();
+    index.build( image );
+    int build_time = time.elapsed();
+
+    time.start();
+    vector<RegionHistogram> results = index.query( rects );
+    int query_time = time.elapsed();
+
+    cout << " Index : " << index.blockSize() << " pixel blocks, " << index.memoryBytes() << " bytes, built in "
+         << build_time << "ms" << endl;
+    cout << " Regions : " << rects.size() << " in " << query_time << "ms" << endl;
+
+    ofstream outputFile;
+    if( ! openOutput( options, outputFile ) ) {
+        return ERR_COULDNT_WRITE_FILE;
+    }
+    ostream& output = outputFile.is_open() ? static_cast<ostream&>( outputFile ) : cout;
+    HistogramWriter writer{ output, options.outputFormat };
+
+    // Statistics of every region are worked out together
+    vector<HistogramStats::Summary> summaries;
+    if( options.stats ) {
+        vector<const uint64_t*> counts;
+        for( const RegionHistogram& result : results ) {
+            counts.insert( counts.end(), { result.red.data(), result.green.data(), result.blue.data() } );
+        }
+        HistogramStats stats;
+        stats.compute( counts, 256, summaries );
+    }
+
+    for( size_t i = 0; i < rects.size(); ++i ) {
+        writer.writeLabel( to_string( rects[i].x ) + " " + to_string( rects[i].y ) + " "
+                           + to_string( rects[i].width ) + " " + to_string( rects[i].height ) );
+        if( options.stats ) {
+            writer.write( summaries[i * 3] );
+            writer.write( summaries[i * 3 + 1] );
+            writer.write( summaries[i * 3 + 2] );
+        } else {
+            writer.write( results[i].red );
+            writer.write( results[i].green );
+            writer.write( results[i].blue );
+        }
+    }
+
+    if( ! writer.flush() ) {
+        cerr << "Couldn't write histogram to " << options.outputFileName << endl;
+        return ERR_COULDNT_WRITE_FILE;
+    }
+    return ERR_NO_ERROR;
+}
+
+
+/*
+ * Estimate the histogram of an image from a sample of its pixels. The estimates are written as usual,
+ * followed by the lower and upper bounds of the red, green and blue estimates.
+ */
+int runSampled( const Options& options, HistogramTool& htool, const ImageView& image ) {
+    using namespace std;
+
+    double fraction = ( options.sampleFraction > 0 )
+        ? options.sampleFraction
+        : SampledHistogram::fractionForError( image.numPixels(), options.sampleError );
+    SampledHistogram sampler{ htool, options.sampleMethod };
+    Histogram red, green, blue;
+
+    QTime time;
+    time.start();
+    sampler.compute( image, fraction, red, green, blue );
+    int time_taken = time.elapsed();
+
+    Histogram bounds[6];
+    sampler.interval( RgbAccumulator::Red, bounds[0], bounds[1] );
+    sampler.interval( RgbAccumulator::Green, bounds[2], bounds[3] );
+    sampler.interval( RgbAccumulator::Blue, bounds[4], bounds[5] );
+    uint64_t widest = 0;
+    for( size_t channel = 0; channel < 3; ++channel ) {
+        for( size_t i = 0; i < 256; ++i ) {
+            widest = std::max( widest, bounds[channel * 2 + 1][i] - bounds[channel * 2][i] );
+        }
+    }
+
+    cout << " Time Taken : " << time_taken << "ms" << endl;
+    cout << " Sampled : " << sampler.numSamples() << " of " << image.numPixels() << " pixels ("
+         << sampler.sampledFraction() * 100 << "%)" << endl;
+    cout << " Widest 95% interval : " << widest << " pixels" << endl;
+
+    ofstream outputFile;
+    if( ! openOutput( options, outputFile ) ) {
+        return ERR_COULDNT_WRITE_FILE;
+    }
+    ostream& output = outputFile.is_open() ? static_cast<ostream&>( outputFile ) : cout;
+    HistogramWriter writer{ output, options.outputFormat };
+    writer.write( red );
+    writer.write( green );
+    writer.write( blue );
+    for( const Histogram& bound : bounds ) {
+        writer.write( bound );
+    }
+    if( ! writer.flush() ) {
+        cerr << "Couldn't write histogram to " << options.outputFileName << endl;
+        return ERR_COULDNT_WRITE_FILE;
+    }
+
+    if( options.runSelfTest ) {
+        selfTest( image.numPixels(), red, green, blue );
+    }
+    return ERR_NO_ERROR;
+}
+
+
+/*
+ * Count the joint red, green and blue histogram of an image and write the bins which were hit.
+ */
+int runJoint( const Options& options, HistogramTool& htool, const ImageView& image ) {
+    using namespace std;
+
+    JointHistogram joint{ htool, options.jointBins };
+
+    QTime time;
+    time.start();
+    joint.compute( image );
+    int time_taken = time.elapsed();
+
+    cout << " Time Taken : " << time_taken << "ms" << endl;
+    cout << " Joint bins hit : " << joint.keys().size() << " of "
+         << options.jointBins * options.jointBins * options.jointBins
+         << ( joint.storage() == JointHistogram::Storage::Dense ? " (dense)" : " (sparse)" ) << endl;
+
+    ofstream outputFile;
+    if( ! openOutput( options, outputFile ) ) {
+        return ERR_COULDNT_WRITE_FILE;
+    }
+    ostream& output = outputFile.is_open() ? static_cast<ostream&>( outputFile ) : cout;
+    HistogramWriter writer{ output, options.outputFormat };
+    writer.write( joint );
+    if( ! writer.flush() ) {
+        cerr << "Couldn't write histogram to " << options.outputFileName << endl;
+        return ERR_COULDNT_WRITE_FILE;
+    }
+
+    if( options.runSelfTest ) {
+        cout << " Joint samples : " << joint.total() << endl;
+        cout << "  Image Pixels : " << image.numPixels() << endl;
+        cout << ( joint.total() == image.numPixels() ? "PASSED" : "** FAILED **" ) << endl;
+    }
+    return ERR_NO_ERROR;
+}
+
+
+/*
+ * Number of pixels in the image named on the command line, from its header or the raw dimensions.
+ * UINT64_MAX if it can't be told without decoding it.
+ */
+uint64_t imagePixels( const Options& options ) {
+    if( options.rawWidth > 0 ) {
+        return static_cast<uint64_t>( options.rawWidth ) * options.rawHeight;
+    }
+    QSize size = QImageReader( QString::fromStdString( options.imageFileName ) ).size();
+    return size.isValid() ? static_cast<uint64_t>( size.width() ) * static_cast<uint64_t>( size.height() ) : UINT64_MAX;
+}
+
+
+/*
+ * Choose the threads and kernel for the image from saved tuning, calibrating and saving it first if there is
+ * none for this machine or recalibration was asked for. A thread count or kernel given on the command line is kept.
+ */
+void autoConfigure( const Options& options, const CpuTopology& cpus, uint32_t& numThreads, KernelType& kernel ) {
+    using namespace std;
+
+    AutoTuner tuner{ cpus };
+    bool saved = ! options.calibrate && options.tuningFileName.length() > 0 && tuner.load( options.tuningFileName );
+    if( ! saved ) {
+        cout << "Calibrating..." << endl;
+        tuner.calibrate();
+        if( options.tuningFileName.length() > 0 ) {
+            QDir().mkpath( QFileInfo( QString::fromStdString( options.tuningFileName ) ).absolutePath() );
+            if( ! tuner.save( options.tuningFileName ) ) {
+                cout << "Warning: " << tuner.errorString() << endl;
+            }
+        }
+    }
+
+    const AutoTuner::Choice& choice = tuner.choose( imagePixels( options ) );
+    if( numThreads == 0 ) {
+        numThreads = choice.numThreads;
+    }
+    if( kernel == KernelType::Auto ) {
+        kernel = choice.kernel;
+    }
+    cout << " Tuned : " << choice.numThreads << " threads, " << HistogramKernel::nameOf( choice.kernel ) << " kernel"
+         << ( saved ? "" : " (calibrated)" ) << endl;
+}
+
+
+/*
+ * Print the profile and write the Chrome trace, if asked for.
+ * Returns the error code passed in unless that is success and the trace can't be written.
+ */
+int finishTrace( const Options& options, const Trace& trace, int result ) {
+    using namespace std;
+
+    if( options.hardwareCounters && ! trace.countersAvailable() ) {
+        cout << "Warning: Hardware counters aren't available" << endl;
+    }
+    if( options.profile ) {
+        trace.writeSummary( cout );
+    }
+    if( options.traceFileName.length() > 0 ) {
+        ofstream traceFile{ options.traceFileName };
+        trace.writeChromeTrace( traceFile );
+        if( ! traceFile.good() ) {
+            cerr << "Couldn't write trace to " << options.traceFileName << endl;
+            return ( result == ERR_NO_ERROR ) ? ERR_COULDNT_WRITE_FILE : result;
+        }
+    }
+    return result;
 }
 
 
@@ -122,94 +1096,255 @@ int main(int argc, char *argv[])
     using namespace std;
 
     //
-    // Set up some default values for run
+    // Parse command line to see if any of the defaults are overridden
     //
-    bool runSelfTest = false;
-    uint32_t numThreads = 0;
-    string imageFileName = "";
-    string outputFileName = "";
+    Options options;
+    parseCommandLine( argc, argv, options );
 
+    // A client needs no threads of its own
+    if( options.connectSocket.length() > 0 ) {
+        return runClient( options );
+    }
 
     //
-    // Parse command line to see if any of these are overridden
+    // If numThreads is not been specified, look at what this process may run on and use
+    // the threads and kernel found fastest for images of this size
     //
-    parseCommandLine( argc, argv, imageFileName, outputFileName, runSelfTest, numThreads );
+    uint32_t numThreads = options.numThreads;
+    KernelType kernel = options.kernel;
+    CpuTopology cpus = CpuTopology::detect();
+    if( numThreads == 0 ) {
+        cout << "Detected " << cpus.logicalCpus << " logical CPUs, " << cpus.physicalCores << " cores";
+        if( cpus.cpuQuota > 0 ) {
+            cout << ", quota of " << cpus.cpuQuota << " CPUs";
+        }
+        cout << "." << endl;
+    }
 
-    //
-    // Try to load the image
-    //
-    QImage img;
-    if( ! img.load( QString::fromStdString(imageFileName) ) ) {
-        cerr << "Unable to load image " << imageFileName << endl;
-        exit( ERR_IMAGE_FILE_NOT_FOUND );
+    if( options.batch ) {
+        return runBatch( options, ( numThreads > 0 ) ? numThreads : cpus.recommendedThreads() );
+    }
+    if( numThreads == 0 || options.calibrate ) {
+        autoConfigure( options, cpus, numThreads, kernel );
     }
 
     //
-    // Convert image to ARGB32 format for consistency
+    // Record phases only if asked; an untraced run passes null around
     //
-    img = img.convertToFormat(QImage::Format_ARGB32);
+    Trace trace{ options.hardwareCounters };
+    Trace *tracer = ( options.profile || options.traceFileName.length() > 0 ) ? &trace : nullptr;
+
+    unique_ptr<HistogramTool> tool;
+    {
+        TraceScope scope{ tracer, "spawn" };
+        tool.reset( new HistogramTool{numThreads, kernel} );
+    }
+    HistogramTool& htool = *tool;
+    htool.setChunkRows( options.chunkRows );
+    htool.setTrace( tracer );
+    cout << "Using " << htool.kernel().name() << " kernel." << endl;
+    if( options.numa ) {
+        NumaTopology topology = NumaTopology::detect();
+        bool pinned = htool.setNumaTopology( topology );
+        cout << " NUMA : " << topology.numNodes() << " nodes" << ( pinned ? "" : ", threads not pinned" ) << endl;
+    }
+
+    if( options.serveSocket.length() > 0 ) {
+        return finishTrace( options, trace, runServer( options, htool ) );
+    }
+
+    Histogram red, green, blue;
+    DerivedHistograms derived{ options.derivedChannels };
+    uint64_t numPixels = 0;
 
     //
-    // If numThreads is not been specified, ask how many cores there are
-    // and use that value.
+    // With a memory budget, images which can't be mapped are streamed so they are never decoded whole,
+    // unless regions or samples need the whole image
     //
-    if( numThreads == 0 ) {
-        // Determine the number of cores available on this machine. May return 0 if librarty can't tell
-        unsigned numberOfCores= thread::hardware_concurrency();
-        if( numberOfCores == 0 ) {
-            cout << "Warning: Couldn't detect number of cores. Using 1." << endl;
-            numberOfCores = 1;
+    size_t memoryBudget = static_cast<size_t>( options.memoryBudgetMB ) * 1024 * 1024;
+    bool mappable = options.rawWidth > 0 || ( options.map && MappedRaster::isMappable( options.imageFileName ) );
+    bool wholeImage = options.regionsFileName.length() > 0 || options.sampleFraction > 0 || options.sampleError > 0
+        || options.jointBins > 0;
+    if( memoryBudget > 0 && ! mappable && ! wholeImage ) {
+        options.stream = true;
+    }
+
+    if( options.stream ) {
+        //
+        // Decode and count band by band. Timing includes the decode as the two overlap
+        //
+        QTime time;
+        time.start();
+
+        StreamingHistogram stream{htool, options.bandRows};
+        if( memoryBudget > 0 ) {
+            // A band is decoding, one counting and one queued between them
+            stream.setBandBytes( memoryBudget / 3 );
         }
-        else {
-            cout << "Detected " << numberOfCores << " cores." << endl;
+        TraceScope scope{ tracer, "stream" };
+        if( ! stream.compute( QString::fromStdString( options.imageFileName ), red, green, blue ) ) {
+            cerr << stream.errorString() << endl;
+            exit( ERR_IMAGE_FILE_NOT_FOUND );
         }
-        numThreads = numberOfCores;
+
+        int time_taken = time.elapsed();
+        cout << " Time Taken : " << time_taken << "ms (including decode)" << endl;
+        cout << " Bands : " << stream.numBands() << ", largest " << stream.peakBandBytes() << " bytes" << endl;
+        numPixels = stream.numPixels();
+        scope.setPixels( numPixels );
     }
+    else {
+        //
+        // Map raw data and uncompressed rasters directly; no copy of the pixels is made.
+        // Rasters the mapper doesn't handle (say 16 bit PPM) fall back to QImage
+        //
+        MappedRaster raster;
+        bool mapped = false;
+        QImage img;
+        {
+            TraceScope scope{ tracer, "load" };
+            if( options.rawWidth > 0 ) {
+                if( ! raster.openRaw( options.imageFileName, options.rawWidth, options.rawHeight, options.rawStride, options.rawFormat ) ) {
+                    cerr << raster.errorString() << endl;
+                    exit( ERR_IMAGE_FILE_NOT_FOUND );
+                }
+                mapped = true;
+            }
+            else if( mappable ) {
+                mapped = raster.open( options.imageFileName );
+                if( ! mapped ) {
+                    cout << "Warning: " << raster.errorString() << ". Loading with QImage." << endl;
+                }
+            }
 
-    HistogramTool htool{numThreads};
+            //
+            // Otherwise try to load the image
+            //
+            if( ! mapped && ! img.load( QString::fromStdString(options.imageFileName) ) ) {
+                cerr << "Unable to load image " << options.imageFileName << endl;
+                exit( ERR_IMAGE_FILE_NOT_FOUND );
+            }
+        }
 
-    // Start timer
-    QTime time;
-    time.start();
+        //
+        // Regions are answered from an index of the whole image, and samples and joint histograms are read
+        // straight from it
+        //
+        if( wholeImage ) {
+            ImageView view;
+            if( mapped ) {
+                view = raster.view();
+            } else if( ! HistogramTool::viewOf( img, view ) || view.format == PixelFormat::Indexed8 ) {
+                img = img.convertToFormat( QImage::Format_ARGB32 );
+                HistogramTool::viewOf( img, view );
+            }
+            int result = ( options.regionsFileName.length() > 0 ) ? runRegions( options, htool, view )
+                : ( options.jointBins > 0 ) ? runJoint( options, htool, view )
+                : runSampled( options, htool, view );
+            return finishTrace( options, trace, result );
+        }
 
-    //
-    // Do the actual work
-    //
-    Histogram red, green, blue;
-    htool.computeHistogram( img, red, green, blue );
+        //
+        // No conversion needed; HistogramTool counts common formats in place
+        //
+        numPixels = mapped
+            ? raster.view().numPixels()
+            : static_cast<uint64_t>( img.width() ) * static_cast<uint64_t>( img.height() );
+        if( mapped ) {
+            cout << " Mapped " << raster.mappedBytes() << " bytes" << endl;
+        }
 
-    //
-    // Compute elapsed time
-    //
-    int time_taken = time.elapsed();
-    cout << " Time Taken : " << time_taken << "ms" << endl;
+        // Start timer
+        QTime time;
+        time.start();
+
+        //
+        // Do the actual work
+        //
+        bool tiled = mapped && memoryBudget > 0;
+        TiledHistogram tiles{ htool, tiled ? memoryBudget : TiledHistogram::DEFAULT_MEMORY_BUDGET };
+        {
+            TraceScope scope{ tracer, "count", numPixels };
+            if( tiled ) {
+                // Drop each band from the mapping once counted so resident pixels stay within the budget
+                tiles.compute( raster.view(), red, green, blue, [&raster]( uint32_t firstRow, uint32_t numRows ) {
+                    raster.release( firstRow, numRows );
+                } );
+            } else if( mapped ) {
+                htool.computeHistogram( raster.view(), red, green, blue, derived, options.channels );
+            } else {
+                htool.computeHistogram( img, red, green, blue, derived, options.channels );
+            }
+        }
+
+        //
+        // Compute elapsed time
+        //
+        int time_taken = time.elapsed();
+        cout << " Time Taken : " << time_taken << "ms" << endl;
+        if( tiled ) {
+            cout << " Tiles : " << tiles.numTiles() << " of at most " << options.memoryBudgetMB << "MB" << endl;
+        }
+
+        //
+        // Show how evenly the chunks were spread over the threads
+        //
+        vector<uint32_t> chunks = htool.chunksPerThread();
+        cout << " Chunks per thread : ";
+        for( size_t i = 0; i < chunks.size(); ++i ) {
+            cout << chunks[i] << ( ( i + 1 < chunks.size() ) ? ", " : "" );
+        }
+        cout << " (" << ( mapped ? htool.chunkRowsFor( raster.view() ) : htool.chunkRowsFor( img ) ) << " rows per chunk)" << endl;
+    }
 
 
     //
     // Write output to file if name provided ...
     //
-    if( outputFileName.length() > 0 ) {
-        ofstream output{outputFileName};
-        if( output.good()) {
-            output<< red << green << blue;
-        }
-        else {
-            cerr << "Couldn't write histogram to " << outputFileName << endl;
+    {
+        TraceScope scope{ tracer, "write" };
+        ofstream outputFile;
+        if( ! openOutput( options, outputFile ) ) {
             exit( ERR_COULDNT_WRITE_FILE );
         }
-    }
 
-    // .. or else stdout
-    else {
-        cout << red << green << blue;
+        // .. or else stdout
+        ostream& output = outputFile.is_open() ? static_cast<ostream&>( outputFile ) : cout;
+        HistogramWriter writer{ output, options.outputFormat };
+        vector<const uint64_t*> counts;
+        if( options.channels & HistogramKernel::Red ) {
+            counts.push_back( red.data() );
+        }
+        if( options.channels & HistogramKernel::Green ) {
+            counts.push_back( green.data() );
+        }
+        if( options.channels & HistogramKernel::Blue ) {
+            counts.push_back( blue.data() );
+        }
+        for( size_t channel = 0; channel < DerivedChannels::COUNT; ++channel ) {
+            if( derived.has( static_cast<DerivedChannel>( channel ) ) ) {
+                counts.push_back( derived[ static_cast<DerivedChannel>( channel ) ].data() );
+            }
+        }
+        if( options.stats ) {
+            writeStats( writer, counts );
+        } else {
+            for( const uint64_t *histogram : counts ) {
+                writer.write( histogram, 256 );
+            }
+        }
+        if( ! writer.flush() ) {
+            cerr << "Couldn't write histogram to " << options.outputFileName << endl;
+            exit( ERR_COULDNT_WRITE_FILE );
+        }
     }
 
     //
     // Optionally print self-test diagnostics
     //
-    if( runSelfTest ) {
-        selfTest(img, red, green, blue );
+    if( options.runSelfTest ) {
+        selfTest(numPixels, red, green, blue, options.channels );
     }
 
-    return ERR_NO_ERROR;
+    return finishTrace( options, trace, ERR_NO_ERROR );
 }
@@ -0,0 +1,26 @@
+#[...]
+
+TEMPLATE = app
+
+SOURCES += \
+    main.cpp \
+    synthetic_image.cpp
+
+HEADERS += \
+    synthetic_image.h
+
+INCLUDEPATH += ../src/
+DEPENDPATH += $${INCLUDEPATH} # force rebuild if the headers change
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TARGET = BenchHistogramTool
+
+# link against project lib
+HISTO_LIB = ../src/libHistogramTool.a
+LIBS += $${HISTO_LIB}
+PRE_TARGETDEPS += $${HISTO_LIB}
+
+# qmake CONFIG+=notrace compiles tracing out
+notrace: DEFINES += HISTOGRAM_NO_TRACE
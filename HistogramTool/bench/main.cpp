@@ -0,0 +1,449 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QCommandLineParser>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "fixed_histogram.h"
+#include "histogram_kernel.h"
+#include "histogram_tool.h"
+#include "joint_histogram.h"
+#include "synthetic_image.h"
+
+const int ERR_NO_ERROR = 0;
+const int ERR_COULDNT_WRITE_FILE = 2;
+const int ERR_ILLEGAL_ARGS= 3;
+
+
+/*
+ * Settings for a benchmark run, populated from the command line
+ */
+struct Options {
+    std::vector<uint32_t>                   sizes;
+    std::vector<SyntheticImage::Pattern>    patterns;
+    std::vector<PixelFormat>                formats;
+    std::vector<KernelType>                 kernels;
+    std::vector<uint32_t>                   threads;
+    std::vector<uint32_t>                   channels;
+    std::vector<uint32_t>                   jointBins;
+    uint32_t        warmup = 2;
+    uint32_t        repetitions = 9;
+    bool            pin = false;
+    std::string     outputFileName = "";
+};
+
+
+/*
+ * Timings of one configuration, in milliseconds
+ */
+struct Result {
+    std::string     pattern;
+    uint32_t        size;
+    std::string     format;
+    std::string     kernel;
+    uint32_t        threads;
+    std::string     channels;
+    std::vector<double> samples;
+
+    // Median time counting every channel over the median here, with the same kernel and threads; 0 if rgb isn't timed
+    double          speedupVsRgb;
+};
+
+
+/*
+ * Names of the pixel formats which can be benchmarked, as accepted by --formats
+ */
+const char * FORMAT_NAMES[] = { "argb32", "rgba", "rgb", "bgr", "grey" };
+const PixelFormat FORMATS[] = { PixelFormat::ARGB32, PixelFormat::RGBA8888, PixelFormat::RGB888, PixelFormat::BGR888, PixelFormat::Grayscale8 };
+const size_t NUM_FORMATS = 5;
+
+std::string formatName( PixelFormat format ) {
+    for( size_t i = 0; i < NUM_FORMATS; ++i ) {
+        if( FORMATS[i] == format ) {
+            return FORMAT_NAMES[i];
+        }
+    }
+    return "unknown";
+}
+
+
+/*
+ * Split a comma separated option value
+ */
+std::vector<std::string> splitList( const QString& value ) {
+    std::vector<std::string> items;
+    std::istringstream stream{ value.toStdString() };
+    std::string item;
+    while( std::getline( stream, item, ',' ) ) {
+        if( item.length() > 0 ) {
+            items.push_back( item );
+        }
+    }
+    return items;
+}
+
+
+/*
+ * Parse a comma separated list of positive integers. Shows help and exits if any isn't positive.
+ */
+void parsePositiveList( QCommandLineParser& parser, const QString& name, std::vector<uint32_t>& values ) {
+    if( ! parser.isSet( name ) ) {
+        return;
+    }
+    values.clear();
+    for( const std::string& item : splitList( parser.value( name ) ) ) {
+        uint32_t value = static_cast<uint32_t>( std::strtoul( item.c_str(), nullptr, 10 ) );
+        if( value == 0 ) {
+            std::cerr << "Values of --" << name.toStdString() << " must be positive integers" << std::endl;
+            parser.showHelp( ERR_ILLEGAL_ARGS );
+        }
+        values.push_back( value );
+    }
+}
+
+
+/*
+ * Parse the command line
+ * Options are:
+ * -h, --help                 Displays this help.
+ * --sizes <sizes>            Comma separated image widths; images are square.
+ *                            Defaults to 256,1024,4096,16384
+ * --patterns <patterns>      Comma separated patterns; uniform, noise, gradient or
+ *                            tiles. Defaults to all
+ * --formats <formats>        Comma separated pixel formats; argb32, rgba, rgb, bgr
+ *                            or grey. Defaults to argb32,rgba,rgb,grey
+ * --kernels <kernels>        Comma separated kernels. Defaults to every kernel the
+ *                            CPU supports
+ * --threads <threads>        Comma separated thread counts. Defaults to powers of
+ *                            two up to the number of cores
+ * --channels <channels>      Comma separated sets of channels to count, as letters
+ *                            r, g and b. Defaults to rgb,r,rg
+ * --joint <bins>             Comma separated bins per channel of joint histograms
+ *                            to time too; 16, 32 or 64. Defaults to none
+ * --warmup <runs>            Untimed runs before each configuration. Defaults to 2
+ * --repetitions <runs>       Timed runs of each configuration. Defaults to 9
+ * --pin                      Confine each configuration to as many CPUs as it has
+ *                            threads (Linux only)
+ * -o, --output-file <file>   Write JSON results to file rather than stdout
+ */
+void parseCommandLine( int argc, char * argv[], Options& options ) {
+    using namespace std;
+
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("BenchHistogramTool");
+    parser.addHelpOption();
+    parser.addOptions( {
+        { "sizes", "Comma separated image widths; images are square. Defaults to 256,1024,4096,16384", "sizes" },
+        { "patterns", "Comma separated patterns; uniform, noise, gradient or tiles. Defaults to all", "patterns" },
+        { "formats", "Comma separated pixel formats; argb32, rgba, rgb, bgr or grey. Defaults to argb32,rgba,rgb,grey", "formats" },
+        { "kernels", "Comma separated kernels. Defaults to every kernel the CPU supports", "kernels" },
+        { "threads", "Comma separated thread counts. Defaults to powers of two up to the number of cores", "threads" },
+        { "channels", "Comma separated sets of channels to count, as letters r, g and b. Defaults to rgb,r,rg", "channels" },
+        { "joint", "Comma separated bins per channel of joint histograms to time too; 16, 32 or 64. Defaults to none", "bins" },
+        { "warmup", "Untimed runs before each configuration. Defaults to 2", "runs" },
+        { "repetitions", "Timed runs of each configuration. Defaults to 9", "runs" },
+        { "pin", "Confine each configuration to as many CPUs as it has threads (Linux only)" },
+        { {"o", "output-file"}, "Write JSON results to file rather than stdout", "file" }
+    });
+    parser.process( app );
+
+    // Defaults
+    options.sizes = { 256, 1024, 4096, 16384 };
+    options.patterns = { SyntheticImage::Pattern::Uniform, SyntheticImage::Pattern::Noise,
+                         SyntheticImage::Pattern::Gradient, SyntheticImage::Pattern::FlatTiles };
+    options.formats = { PixelFormat::ARGB32, PixelFormat::RGBA8888, PixelFormat::RGB888, PixelFormat::Grayscale8 };
+    const KernelType kernels[] = { KernelType::Scalar, KernelType::SSE42, KernelType::AVX2, KernelType::AVX512 };
+    for( KernelType kernel : kernels ) {
+        if( HistogramKernel::isSupported( kernel ) ) {
+            options.kernels.push_back( kernel );
+        }
+    }
+    uint32_t cores = std::max<uint32_t>( 1, thread::hardware_concurrency() );
+    for( uint32_t threads = 1; threads < cores; threads *= 2 ) {
+        options.threads.push_back( threads );
+    }
+    options.threads.push_back( cores );
+    options.channels = { HistogramKernel::AllChannels, HistogramKernel::Red, HistogramKernel::Red | HistogramKernel::Green };
+
+    parsePositiveList( parser, "sizes", options.sizes );
+    parsePositiveList( parser, "threads", options.threads );
+
+    try {
+        if( parser.isSet( "patterns" ) ) {
+            options.patterns.clear();
+            for( const string& name : splitList( parser.value( "patterns" ) ) ) {
+                options.patterns.push_back( SyntheticImage::patternFromName( name ) );
+            }
+        }
+        if( parser.isSet( "kernels" ) ) {
+            options.kernels.clear();
+            for( const string& name : splitList( parser.value( "kernels" ) ) ) {
+                KernelType kernel = HistogramKernel::fromName( name );
+                if( ! HistogramKernel::isSupported( kernel ) ) {
+                    throw invalid_argument( "Kernel " + name + " isn't supported by this CPU" );
+                }
+                options.kernels.push_back( kernel );
+            }
+        }
+        if( parser.isSet( "channels" ) ) {
+            options.channels.clear();
+            for( const string& name : splitList( parser.value( "channels" ) ) ) {
+                options.channels.push_back( HistogramKernel::channelsFromName( name ) );
+            }
+        }
+        if( parser.isSet( "joint" ) ) {
+            for( const string& name : splitList( parser.value( "joint" ) ) ) {
+                options.jointBins.push_back( JointHistogram::binsFromName( name ) );
+            }
+        }
+    } catch( const invalid_argument& e ) {
+        cerr << e.what() << endl;
+        parser.showHelp( ERR_ILLEGAL_ARGS );
+    }
+
+    if( parser.isSet( "formats" ) ) {
+        options.formats.clear();
+        for( const string& name : splitList( parser.value( "formats" ) ) ) {
+            size_t i = 0;
+            while( i < NUM_FORMATS && name != FORMAT_NAMES[i] ) {
+                i++;
+            }
+            if( i == NUM_FORMATS ) {
+                cerr << "Unknown format " << name << endl;
+                parser.showHelp( ERR_ILLEGAL_ARGS );
+            }
+            options.formats.push_back( FORMATS[i] );
+        }
+    }
+
+    QString warmup = parser.value( "warmup" );
+    if( warmup.length() > 0 ) {
+        options.warmup = warmup.toUInt();
+    }
+    vector<uint32_t> repetitions;
+    parsePositiveList( parser, "repetitions", repetitions );
+    if( ! repetitions.empty() ) {
+        options.repetitions = repetitions[0];
+    }
+
+    options.pin = parser.isSet( "pin" );
+    options.outputFileName = parser.value( "o" ).toStdString();
+}
+
+
+/*
+ * Confine this thread, and threads it starts afterwards, to the first numCpus CPUs it may run on.
+ * Passing 0 restores the CPUs allowed when the program started. Does nothing other than on Linux.
+ */
+void pinToCpus( uint32_t numCpus ) {
+#ifdef __linux__
+    static cpu_set_t original;
+    static bool saved = false;
+    if( ! saved ) {
+        sched_getaffinity( 0, sizeof( original ), &original );
+        saved = true;
+    }
+
+    cpu_set_t cpus = original;
+    if( numCpus > 0 ) {
+        CPU_ZERO( &cpus );
+        uint32_t chosen = 0;
+        for( int cpu = 0; cpu < CPU_SETSIZE && chosen < numCpus; ++cpu ) {
+            if( CPU_ISSET( cpu, &original ) ) {
+                CPU_SET( cpu, &cpus );
+                chosen++;
+            }
+        }
+    }
+    sched_setaffinity( 0, sizeof( cpus ), &cpus );
+#else
+    (void) numCpus;
+#endif
+}
+
+
+/*
+ * Return the value at a percentile of sorted samples, by nearest rank
+ */
+double percentile( const std::vector<double>& sorted, double percent ) {
+    size_t rank = static_cast<size_t>( percent / 100.0 * ( sorted.size() - 1 ) + 0.5 );
+    return sorted[ std::min( rank, sorted.size() - 1 ) ];
+}
+
+
+/*
+ * Time every kernel, thread count and set of channels on one image, then any joint histograms
+ */
+void benchImage( const Options& options, const SyntheticImage& image, const std::string& pattern, std::vector<Result>& results ) {
+    using namespace std;
+    const ImageView& view = image.view();
+
+    for( KernelType kernel : options.kernels ) {
+        for( uint32_t threads : options.threads ) {
+            if( options.pin ) {
+                pinToCpus( threads );
+            }
+
+            size_t first = results.size();
+            double rgbMedian = 0;
+            {
+                // Workers are started here so they inherit the pinning
+                HistogramTool tool{ threads, kernel };
+                FixedHistogram<256, uint64_t> red, green, blue;
+
+                for( uint32_t channels : options.channels ) {
+                    Result result{ pattern, view.width, formatName( view.format ), HistogramKernel::nameOf( kernel ), threads,
+                                   HistogramKernel::nameOfChannels( channels ), {}, 0 };
+                    for( uint32_t run = 0; run < options.warmup; ++run ) {
+                        tool.computeHistogram( view, red, green, blue, channels );
+                    }
+                    for( uint32_t run = 0; run < options.repetitions; ++run ) {
+                        red.reset();
+                        green.reset();
+                        blue.reset();
+                        auto start = chrono::steady_clock::now();
+                        tool.computeHistogram( view, red, green, blue, channels );
+                        auto end = chrono::steady_clock::now();
+                        result.samples.push_back( chrono::duration<double, milli>( end - start ).count() );
+                    }
+
+                    vector<double> sorted = result.samples;
+                    sort( sorted.begin(), sorted.end() );
+                    if( channels == HistogramKernel::AllChannels ) {
+                        rgbMedian = percentile( sorted, 50 );
+                    }
+                    results.push_back( result );
+                }
+
+                for( uint32_t bins : options.jointBins ) {
+                    JointHistogram joint{ tool, bins };
+                    Result result{ pattern, view.width, formatName( view.format ), HistogramKernel::nameOf( kernel ), threads,
+                                   "joint" + to_string( bins ), {}, 0 };
+                    for( uint32_t run = 0; run < options.warmup; ++run ) {
+                        joint.compute( view );
+                    }
+                    for( uint32_t run = 0; run < options.repetitions; ++run ) {
+                        joint.reset();
+                        auto start = chrono::steady_clock::now();
+                        joint.compute( view );
+                        auto end = chrono::steady_clock::now();
+                        result.samples.push_back( chrono::duration<double, milli>( end - start ).count() );
+                    }
+                    results.push_back( result );
+                }
+            }
+
+            if( options.pin ) {
+                pinToCpus( 0 );
+            }
+
+            for( size_t r = first; r < results.size(); ++r ) {
+                Result& result = results[r];
+                vector<double> sorted = result.samples;
+                sort( sorted.begin(), sorted.end() );
+                double median = percentile( sorted, 50 );
+                result.speedupVsRgb = ( rgbMedian > 0 && median > 0 ) ? rgbMedian / median : 0;
+                cerr << pattern << " " << view.width << "x" << view.height << " " << result.format << " " << result.kernel
+                     << " " << threads << " threads " << result.channels << ": " << median << "ms";
+                if( result.speedupVsRgb > 0 ) {
+                    cerr << " (" << result.speedupVsRgb << "x rgb)";
+                }
+                cerr << endl;
+            }
+        }
+    }
+}
+
+
+/*
+ * Write the results as JSON
+ */
+void writeJson( std::ostream& out, const Options& options, const std::vector<Result>& results ) {
+    using namespace std;
+
+    out << "{" << endl;
+    out << "  \"timestamp\": " << time( nullptr ) << "," << endl;
+    out << "  \"cores\": " << thread::hardware_concurrency() << "," << endl;
+    out << "  \"best_kernel\": \"" << HistogramKernel::nameOf( HistogramKernel::bestAvailable() ) << "\"," << endl;
+#ifdef __VERSION__
+    out << "  \"compiler\": \"" << __VERSION__ << "\"," << endl;
+#endif
+    out << "  \"warmup\": " << options.warmup << "," << endl;
+    out << "  \"repetitions\": " << options.repetitions << "," << endl;
+    out << "  \"pinned\": " << ( options.pin ? "true" : "false" ) << "," << endl;
+    out << "  \"results\": [" << endl;
+
+    for( size_t r = 0; r < results.size(); ++r ) {
+        const Result& result = results[r];
+        vector<double> sorted = result.samples;
+        sort( sorted.begin(), sorted.end() );
+        double median = percentile( sorted, 50 );
+        double megapixels = static_cast<double>( result.size ) * result.size / 1e6;
+
+        out << "    { \"pattern\": \"" << result.pattern << "\", \"width\": " << result.size << ", \"height\": " << result.size
+            << ", \"format\": \"" << result.format << "\", \"kernel\": \"" << result.kernel << "\", \"threads\": " << result.threads
+            << ", \"channels\": \"" << result.channels << "\""
+            << ", \"median_ms\": " << median << ", \"p10_ms\": " << percentile( sorted, 10 ) << ", \"p90_ms\": " << percentile( sorted, 90 )
+            << ", \"min_ms\": " << sorted.front() << ", \"max_ms\": " << sorted.back()
+            << ", \"mpixels_per_s\": " << ( median > 0 ? megapixels / ( median / 1000 ) : 0 )
+            << ", \"speedup_vs_rgb\": " << result.speedupVsRgb
+            << ", \"samples_ms\": [";
+        for( size_t i = 0; i < result.samples.size(); ++i ) {
+            out << result.samples[i] << ( i + 1 < result.samples.size() ? ", " : "" );
+        }
+        out << "] }" << ( r + 1 < results.size() ? "," : "" ) << endl;
+    }
+
+    out << "  ]" << endl;
+    out << "}" << endl;
+}
+
+
+/*
+ * Generate each image in turn and time every configuration on it
+ */
+int main(int argc, char *argv[])
+{
+    using namespace std;
+
+    Options options;
+    parseCommandLine( argc, argv, options );
+
+    vector<Result> results;
+    for( uint32_t size : options.sizes ) {
+        for( SyntheticImage::Pattern pattern : options.patterns ) {
+            for( PixelFormat format : options.formats ) {
+                SyntheticImage image{ pattern, size, size, format };
+                benchImage( options, image, SyntheticImage::nameOf( pattern ), results );
+            }
+        }
+    }
+
+    if( options.outputFileName.length() > 0 ) {
+        ofstream output{ options.outputFileName };
+        writeJson( output, options, results );
+        if( ! output.good() ) {
+            cerr << "Couldn't write results to " << options.outputFileName << endl;
+            return ERR_COULDNT_WRITE_FILE;
+        }
+    } else {
+        writeJson( cout, options, results );
+    }
+
+    return ERR_NO_ERROR;
+}
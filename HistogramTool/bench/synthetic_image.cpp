@@ -0,0 +1,136 @@
+#include "synthetic_image.h"
+
+#include <QImage>
+
+#include <stdexcept>
+
+
+/*
+ * A cheap, well mixed hash of a pixel position, used as its noise
+ */
+static inline uint32_t mix( uint64_t value )
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    value ^= value >> 33;
+    return static_cast<uint32_t>( value );
+}
+
+/*
+ * Generate the pixels of a pattern in the given format
+ */
+SyntheticImage::SyntheticImage( Pattern pattern, uint32_t width, uint32_t height, PixelFormat format )
+{
+    if( format == PixelFormat::Indexed8 ) {
+        throw std::invalid_argument( "Indexed8 images can't be generated" );
+    }
+
+    const uint32_t bytesPerPixel = ImageView::bytesPerPixel( format );
+    const size_t bytesPerLine = static_cast<size_t>( width ) * bytesPerPixel;
+    mPixels.resize( bytesPerLine * height );
+    mView = ImageView{ mPixels.data(), width, height, static_cast<ptrdiff_t>( bytesPerLine ), format };
+
+    for( uint32_t y = 0; y < height; ++y ) {
+        uint8_t *pixel = &mPixels[ y * bytesPerLine ];
+
+        for( uint32_t x = 0; x < width; ++x, pixel += bytesPerPixel ) {
+            uint8_t red, green, blue;
+            switch( pattern ) {
+                case Pattern::Uniform:
+                    red = 200;
+                    green = 120;
+                    blue = 40;
+                    break;
+
+                case Pattern::Noise: {
+                    uint32_t noise = mix( static_cast<uint64_t>( y ) * width + x );
+                    red = static_cast<uint8_t>( noise );
+                    green = static_cast<uint8_t>( noise >> 8 );
+                    blue = static_cast<uint8_t>( noise >> 16 );
+                    break;
+                }
+
+                case Pattern::Gradient:
+                    red = static_cast<uint8_t>( width > 1 ? static_cast<uint64_t>( x ) * 255 / ( width - 1 ) : 0 );
+                    green = static_cast<uint8_t>( height > 1 ? static_cast<uint64_t>( y ) * 255 / ( height - 1 ) : 0 );
+                    blue = static_cast<uint8_t>( ( red + green ) / 2 );
+                    break;
+
+                case Pattern::FlatTiles:
+                default: {
+                    uint32_t colour = mix( ( static_cast<uint64_t>( y / 64 ) << 32 ) | ( x / 64 ) );
+                    red = static_cast<uint8_t>( colour );
+                    green = static_cast<uint8_t>( colour >> 8 );
+                    blue = static_cast<uint8_t>( colour >> 16 );
+                    break;
+                }
+            }
+
+            switch( format ) {
+                case PixelFormat::ARGB32:
+                    *reinterpret_cast<QRgb *>( pixel ) = qRgb( red, green, blue );
+                    break;
+                case PixelFormat::RGBA8888:
+                    pixel[0] = red;
+                    pixel[1] = green;
+                    pixel[2] = blue;
+                    pixel[3] = 255;
+                    break;
+                case PixelFormat::RGB888:
+                    pixel[0] = red;
+                    pixel[1] = green;
+                    pixel[2] = blue;
+                    break;
+                case PixelFormat::BGR888:
+                    pixel[0] = blue;
+                    pixel[1] = green;
+                    pixel[2] = red;
+                    break;
+                default:
+                    pixel[0] = red;
+                    break;
+            }
+        }
+    }
+}
+
+/*
+ * Return a view of the pixels
+ */
+const ImageView& SyntheticImage::view( ) const
+{
+    return mView;
+}
+
+/*
+ * Return the name of a pattern
+ */
+std::string SyntheticImage::nameOf( Pattern pattern )
+{
+    switch( pattern ) {
+        case Pattern::Uniform:
+            return "uniform";
+        case Pattern::Noise:
+            return "noise";
+        case Pattern::Gradient:
+            return "gradient";
+        default:
+            return "tiles";
+    }
+}
+
+/*
+ * Parse a pattern name
+ */
+SyntheticImage::Pattern SyntheticImage::patternFromName( const std::string& name )
+{
+    const Pattern patterns[] = { Pattern::Uniform, Pattern::Noise, Pattern::Gradient, Pattern::FlatTiles };
+    for( Pattern pattern : patterns ) {
+        if( nameOf( pattern ) == name ) {
+            return pattern;
+        }
+    }
+    throw std::invalid_argument( "Unknown pattern " + name );
+}
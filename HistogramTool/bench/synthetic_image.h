@@ -0,0 +1,75 @@
+#ifndef SYNTHETIC_IMAGE_H
+#define SYNTHETIC_IMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "image_view.h"
+
+/**
+ * SyntheticImage.
+ *
+ * A generated image for benchmarking. The same pattern, size and format always gives the same pixels,
+ * so timings from different builds or machines are of the same work.
+ *
+ * Patterns stress the kernels differently:
+ *   - Uniform: every pixel the same colour; all counts land in one bucket per channel.
+ *   - Noise: independent pseudo random values; counts are spread over every bucket.
+ *   - Gradient: red follows x, green follows y and blue the diagonal; long runs of nearby buckets.
+ *   - FlatTiles: 64 x 64 tiles of flat colour, like a map with large uniform areas.
+ */
+class SyntheticImage {
+public:
+    /**
+     * The pixel patterns which can be generated.
+     */
+    enum class Pattern {
+        Uniform,
+        Noise,
+        Gradient,
+        FlatTiles
+    };
+
+private:
+    // The pixels, scanlines unpadded
+    std::vector<uint8_t>    mPixels;
+
+    // A view of mPixels
+    ImageView               mView;
+
+public:
+    /**
+     * Generate an image.
+     * @param pattern The pattern.
+     * @param width Pixels per scanline.
+     * @param height Number of scanlines.
+     * @param format Layout of each pixel. Indexed8 is not supported.
+     * @throws std::invalid_argument if format is Indexed8.
+     * @throws std::bad_alloc if the pixels cannot be allocated.
+     */
+    SyntheticImage( Pattern pattern, uint32_t width, uint32_t height, PixelFormat format );
+
+    SyntheticImage( const SyntheticImage& ) = delete;
+    SyntheticImage& operator=( const SyntheticImage& ) = delete;
+
+    /**
+     * @return A view of the pixels. Valid while this object exists.
+     */
+    const ImageView& view( ) const;
+
+    /**
+     * @param pattern A pattern.
+     * @return The name of the pattern, as accepted by patternFromName().
+     */
+    static std::string nameOf( Pattern pattern );
+
+    /**
+     * Parse a pattern name.
+     * @param name One of uniform, noise, gradient or tiles.
+     * @return The pattern.
+     * @throws std::invalid_argument if the name is not recognised.
+     */
+    static Pattern patternFromName( const std::string& name );
+};
+
+#endif // SYNTHETIC_IMAGE_H
@@ -0,0 +1,272 @@
+#include "auto_tuner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include "fixed_histogram.h"
+#include "histogram_tool.h"
+#include "noise_source.h"
+
+const uint32_t AutoTuner::FILE_VERSION;
+const uint32_t AutoTuner::RUNS_PER_CANDIDATE;
+constexpr double AutoTuner::MARGIN;
+
+// First line of a tuning file, followed by the version
+static const char FILE_TAG[] = "histogramtool-tuning";
+
+
+/*
+ * Check the classes and start from the topology's recommendation
+ */
+AutoTuner::AutoTuner( const CpuTopology& topology, const std::vector<uint32_t>& sides )
+    : mTopology( topology ), mSides{ sides }, mCalibrated{ false } {
+    if( mSides.empty() ) {
+        throw std::invalid_argument( "There must be at least one size class" );
+    }
+    for( size_t i = 0; i < mSides.size(); ++i ) {
+        if( mSides[i] == 0 || ( i > 0 && mSides[i] <= mSides[i - 1] ) ) {
+            throw std::invalid_argument( "Size class sides must be positive and ascending" );
+        }
+    }
+
+    for( size_t i = 0; i < mSides.size(); ++i ) {
+        uint64_t maxPixels = ( i + 1 < mSides.size() ) ? static_cast<uint64_t>( mSides[i] ) * mSides[i] : UINT64_MAX;
+        mChoices.push_back( Choice{ maxPixels, mTopology.recommendedThreads(), HistogramKernel::bestAvailable() } );
+    }
+}
+
+/*
+ * Topology being tuned for
+ */
+const CpuTopology& AutoTuner::topology( ) const {
+    return mTopology;
+}
+
+/*
+ * Whether the choices were measured or loaded
+ */
+bool AutoTuner::calibrated( ) const {
+    return mCalibrated;
+}
+
+/*
+ * Choice for each class
+ */
+const std::vector<AutoTuner::Choice>& AutoTuner::choices( ) const {
+    return mChoices;
+}
+
+/*
+ * First class the image fits in. The last class takes everything
+ */
+const AutoTuner::Choice& AutoTuner::choose( uint64_t numPixels ) const {
+    for( const Choice& choice : mChoices ) {
+        if( numPixels <= choice.maxPixels ) {
+            return choice;
+        }
+    }
+    return mChoices.back();
+}
+
+/*
+ * Powers of two up to the CPUs we may use, plus the physical cores and the recommendation
+ */
+std::vector<uint32_t> AutoTuner::candidateThreads( ) const {
+    uint32_t most = mTopology.maxUsefulThreads();
+    std::vector<uint32_t> threads;
+    for( uint32_t count = 1; count <= most; count *= 2 ) {
+        threads.push_back( count );
+    }
+    threads.push_back( std::min( most, std::max<uint32_t>( 1, mTopology.physicalCores ) ) );
+    threads.push_back( mTopology.recommendedThreads() );
+    threads.push_back( most );
+
+    std::sort( threads.begin(), threads.end() );
+    threads.erase( std::unique( threads.begin(), threads.end() ), threads.end() );
+    return threads;
+}
+
+/*
+ * Count noise of each class's size with every candidate, taking the median of a few timed runs
+ */
+void AutoTuner::calibrate( ) {
+    // One square of noise the size of the largest class; smaller classes count its top left corner
+    const uint32_t side = mSides.back();
+    std::vector<uint32_t> pixels( static_cast<size_t>( side ) * side );
+    NoiseSource noise;
+    for( uint32_t& pixel : pixels ) {
+        pixel = noise.next() | 0xFF000000u;
+    }
+    ptrdiff_t bytesPerLine = static_cast<ptrdiff_t>( side ) * 4;
+
+    std::vector<KernelType> kernels;
+    for( KernelType kernel : { KernelType::Scalar, KernelType::SSE42, KernelType::AVX2, KernelType::AVX512 } ) {
+        if( HistogramKernel::isSupported( kernel ) ) {
+            kernels.push_back( kernel );
+        }
+    }
+
+    std::vector<double> best( mSides.size(), 0 );
+    std::vector<Choice> choices = mChoices;
+    FixedHistogram<256, uint64_t> red, green, blue;
+
+    // Fewest threads first so that more only win by a margin
+    for( uint32_t numThreads : candidateThreads() ) {
+        for( KernelType kernel : kernels ) {
+            HistogramTool tool{ numThreads, kernel };
+
+            for( size_t c = 0; c < mSides.size(); ++c ) {
+                ImageView image{ reinterpret_cast<const uint8_t *>( pixels.data() ), mSides[c], mSides[c], bytesPerLine, PixelFormat::ARGB32 };
+                tool.computeHistogram( image, red, green, blue );
+
+                std::vector<double> seconds;
+                for( uint32_t run = 0; run < RUNS_PER_CANDIDATE; ++run ) {
+                    auto start = std::chrono::steady_clock::now();
+                    tool.computeHistogram( image, red, green, blue );
+                    seconds.push_back( std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() );
+                }
+                std::sort( seconds.begin(), seconds.end() );
+                double median = seconds[seconds.size() / 2];
+
+                if( best[c] == 0 || median < best[c] * ( 1 - MARGIN ) ) {
+                    best[c] = median;
+                    choices[c].numThreads = numThreads;
+                    choices[c].kernel = kernel;
+                }
+            }
+        }
+    }
+
+    mChoices.swap( choices );
+    mCalibrated = true;
+}
+
+/*
+ * Logical CPUs, cores, quota in thousandths of a CPU and the kernels this CPU supports
+ */
+std::string AutoTuner::machineKey( ) const {
+    std::ostringstream key;
+    key << mTopology.logicalCpus << " " << mTopology.physicalCores << " " << std::llround( mTopology.cpuQuota * 1000 );
+    for( KernelType kernel : { KernelType::Scalar, KernelType::SSE42, KernelType::AVX2, KernelType::AVX512 } ) {
+        if( HistogramKernel::isSupported( kernel ) ) {
+            key << " " << HistogramKernel::nameOf( kernel );
+        }
+    }
+    return key.str();
+}
+
+/*
+ * Tag and version, the machine, then one line per class: the side it was calibrated on, threads and kernel
+ */
+bool AutoTuner::save( const std::string& fileName ) {
+    std::ofstream file{ fileName };
+    if( ! file.good() ) {
+        mErrorString = "Couldn't write tuning file " + fileName;
+        return false;
+    }
+
+    file << FILE_TAG << " " << FILE_VERSION << "\n";
+    file << "machine " << machineKey() << "\n";
+    for( size_t c = 0; c < mChoices.size(); ++c ) {
+        file << "class " << mSides[c] << " " << mChoices[c].numThreads << " " << HistogramKernel::nameOf( mChoices[c].kernel ) << "\n";
+    }
+
+    file.flush();
+    if( ! file.good() ) {
+        mErrorString = "Couldn't write tuning file " + fileName;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Everything must match this machine and these classes before anything is replaced
+ */
+bool AutoTuner::load( const std::string& fileName ) {
+    std::ifstream file{ fileName };
+    if( ! file.good() ) {
+        mErrorString = "Couldn't read tuning file " + fileName;
+        return false;
+    }
+
+    std::string line, tag;
+    uint32_t version = 0;
+    if( ! std::getline( file, line ) || ! ( std::istringstream{ line } >> tag >> version ) || tag != FILE_TAG || version != FILE_VERSION ) {
+        mErrorString = "Not a tuning file of this version: " + fileName;
+        return false;
+    }
+    if( ! std::getline( file, line ) || line != "machine " + machineKey() ) {
+        mErrorString = "Tuning file is for another machine: " + fileName;
+        return false;
+    }
+
+    std::vector<Choice> choices = mChoices;
+    size_t numClasses = 0;
+    while( std::getline( file, line ) ) {
+        if( line.empty() ) {
+            continue;
+        }
+
+        std::istringstream fields{ line };
+        std::string keyword, kernelName;
+        uint32_t side = 0, numThreads = 0;
+        KernelType kernel = KernelType::Auto;
+        if( ! ( fields >> keyword >> side >> numThreads >> kernelName ) || keyword != "class" || numThreads == 0 ) {
+            mErrorString = "Malformed tuning file: " + fileName;
+            return false;
+        }
+        try {
+            kernel = HistogramKernel::fromName( kernelName );
+        } catch( const std::invalid_argument& ) {
+            mErrorString = "Malformed tuning file: " + fileName;
+            return false;
+        }
+        if( kernel == KernelType::Auto || ! HistogramKernel::isSupported( kernel ) ) {
+            mErrorString = "Malformed tuning file: " + fileName;
+            return false;
+        }
+
+        if( numClasses == mSides.size() || side != mSides[numClasses] ) {
+            mErrorString = "Tuning file is for other size classes: " + fileName;
+            return false;
+        }
+        choices[numClasses].numThreads = numThreads;
+        choices[numClasses].kernel = kernel;
+        numClasses++;
+    }
+    if( numClasses != mSides.size() ) {
+        mErrorString = "Tuning file is for other size classes: " + fileName;
+        return false;
+    }
+
+    mChoices.swap( choices );
+    mCalibrated = true;
+    return true;
+}
+
+/*
+ * Why the last load or save failed
+ */
+std::string AutoTuner::errorString( ) const {
+    return mErrorString;
+}
+
+/*
+ * XDG cache directory, or ~/.cache
+ */
+std::string AutoTuner::defaultCacheFile( ) {
+    const char *cache = std::getenv( "XDG_CACHE_HOME" );
+    if( cache != nullptr && cache[0] != '\0' ) {
+        return std::string{ cache } + "/histogramtool/tuning";
+    }
+    const char *home = std::getenv( "HOME" );
+    if( home != nullptr && home[0] != '\0' ) {
+        return std::string{ home } + "/.cache/histogramtool/tuning";
+    }
+    return "";
+}
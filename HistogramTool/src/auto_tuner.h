@@ -0,0 +1,146 @@
+#ifndef AUTO_TUNER_H
+#define AUTO_TUNER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "cpu_topology.h"
+#include "histogram_kernel.h"
+
+/**
+ * AutoTuner.
+ *
+ * Chooses the number of threads and the kernel for an image from measurements rather than guesses.
+ * Images are put in size classes, each calibrated on a square of noise: by default images of up to
+ * 512 x 512 pixels, up to 2048 x 2048 and larger. calibrate() times every supported kernel with each
+ * candidate thread count, powers of two up to the CPUs the process may use plus the physical core count,
+ * and keeps the fastest for each class. A candidate only displaces one with fewer threads if it is
+ * clearly faster, so SMT siblings and cores beyond the memory bandwidth aren't used for noise.
+ *
+ * Calibration takes a second or two, so the choices are saved to a small text file and loaded by later
+ * runs. The file records the topology and kernels it was measured with; a file from a different machine
+ * or container, or for different size classes, is not loaded.
+ *
+ * Until calibrated or loaded, every class uses the topology's recommended threads and the best kernel.
+ */
+class AutoTuner {
+public:
+    /**
+     * The configuration chosen for a size class.
+     */
+    struct Choice {
+        // Largest image in the class, in pixels
+        uint64_t    maxPixels;
+
+        // Threads to count with, including the caller
+        uint32_t    numThreads;
+
+        // Kernel to count with. Never Auto
+        KernelType  kernel;
+    };
+
+    /**
+     * Version of the tuning file format.
+     */
+    static const uint32_t FILE_VERSION = 1;
+
+    /**
+     * Times a candidate must be timed, after one warm up, the median being taken.
+     */
+    static const uint32_t RUNS_PER_CANDIDATE = 3;
+
+    /**
+     * Fraction by which a candidate with more threads must beat the best so far to replace it.
+     */
+    static constexpr double MARGIN = 0.03;
+
+private:
+    // What the process may run on
+    CpuTopology             mTopology;
+
+    // Side of the square each class is calibrated on, ascending
+    std::vector<uint32_t>   mSides;
+
+    // The choice for each class. The last class has no upper limit
+    std::vector<Choice>     mChoices;
+
+    // Whether mChoices were measured or loaded
+    bool                    mCalibrated;
+
+    // Why the last load or save failed
+    std::string             mErrorString;
+
+    /**
+     * @return A line identifying the topology and the kernels available, as written to tuning files.
+     */
+    std::string machineKey( ) const;
+
+public:
+    /**
+     * Build a tuner for a topology.
+     * @param topology What the process may run on, normally CpuTopology::detect().
+     * @param sides The side of the square each size class is calibrated on, ascending. A class holds images of
+     * up to its side squared pixels, except the last which holds all larger images too.
+     * @throws std::invalid_argument if sides is empty, not strictly ascending or contains 0.
+     */
+    explicit AutoTuner( const CpuTopology& topology, const std::vector<uint32_t>& sides = { 512, 2048, 4096 } );
+
+    /**
+     * @return The topology being tuned for.
+     */
+    const CpuTopology& topology( ) const;
+
+    /**
+     * @return Whether the choices have been calibrated or loaded.
+     */
+    bool calibrated( ) const;
+
+    /**
+     * @return The choice for each size class, smallest first.
+     */
+    const std::vector<Choice>& choices( ) const;
+
+    /**
+     * @param numPixels The number of pixels in an image.
+     * @return The choice for the image's size class.
+     */
+    const Choice& choose( uint64_t numPixels ) const;
+
+    /**
+     * @return The thread counts calibration tries, ascending.
+     */
+    std::vector<uint32_t> candidateThreads( ) const;
+
+    /**
+     * Time each supported kernel with each candidate thread count on every size class and keep the fastest.
+     */
+    void calibrate( );
+
+    /**
+     * Load choices saved by save().
+     * @param fileName The tuning file.
+     * @return false if the file can't be read, is malformed or was measured on another machine or for other
+     * size classes, when the choices are unchanged. See errorString().
+     */
+    bool load( const std::string& fileName );
+
+    /**
+     * Save the choices. The file's directory must exist.
+     * @param fileName The tuning file.
+     * @return false if the file can't be written. See errorString().
+     */
+    bool save( const std::string& fileName );
+
+    /**
+     * @return Why the last load or save failed.
+     */
+    std::string errorString( ) const;
+
+    /**
+     * @return Where tuning is kept: histogramtool/tuning in $XDG_CACHE_HOME, or in ~/.cache if that isn't set.
+     * Empty if neither is known.
+     */
+    static std::string defaultCacheFile( );
+};
+
+#endif // AUTO_TUNER_H
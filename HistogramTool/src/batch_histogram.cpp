@@ -0,0 +1,187 @@
+#include "batch_histogram.h"
+#include "bounded_queue.h"
+
+#include <QImage>
+#include <QImageReader>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+
+namespace {
+    /*
+     * An image on its way from a decoder to a counter
+     */
+    struct DecodedImage {
+        std::unique_ptr<BatchRecord>    record;
+        QImage                          image;
+    };
+}
+
+
+/*
+ * Construct a pipeline with the given concurrency at each stage
+ */
+BatchHistogram::BatchHistogram( uint32_t numDecoders, uint32_t numCounters, uint32_t threadsPerCounter, KernelType kernel, uint32_t queueCapacity )
+{
+    if( numDecoders == 0 || numCounters == 0 || threadsPerCounter == 0 ) {
+        throw std::invalid_argument( "Number of decoders, counters and threads must be positive" );
+    }
+    if( queueCapacity == 0 ) {
+        throw std::invalid_argument( "Queue capacity must be positive" );
+    }
+
+    mNumDecoders = numDecoders;
+    mNumCounters = numCounters;
+    mQueueCapacity = queueCapacity;
+    mPeakDecodedDepth = 0;
+    mPeakCountedDepth = 0;
+
+    for( uint32_t i = 0; i < numCounters; ++i ) {
+        mTools.emplace_back( new HistogramTool{ threadsPerCounter, kernel } );
+    }
+}
+
+/*
+ * Run the pipeline over a list of files
+ */
+uint32_t BatchHistogram::run( const QStringList& fileNames, const Writer& writer )
+{
+    const uint32_t numFiles = static_cast<uint32_t>( fileNames.size() );
+
+    BoundedQueue<DecodedImage> decoded{ mQueueCapacity };
+    BoundedQueue<std::unique_ptr<BatchRecord>> counted{ mQueueCapacity };
+
+    // Next file to be claimed by a decoder and the number of threads still feeding each queue
+    std::atomic<uint32_t> nextFile{ 0 };
+    std::atomic<uint32_t> decodersLeft{ mNumDecoders };
+    std::atomic<uint32_t> countersLeft{ mNumCounters };
+
+    std::vector<std::thread> threads;
+
+    for( uint32_t d = 0; d < mNumDecoders; ++d ) {
+        threads.emplace_back( [&]{
+            for( uint32_t index = nextFile++; index < numFiles; index = nextFile++ ) {
+                DecodedImage item;
+                item.record.reset( new BatchRecord );
+                item.record->index = index;
+                item.record->fileName = fileNames[index];
+
+                QImageReader reader{ fileNames[index] };
+                item.image = reader.read();
+                if( item.image.isNull() ) {
+                    item.record->error = "Unable to read image " + fileNames[index].toStdString() + ": " + reader.errorString().toStdString();
+                }
+
+                if( ! decoded.push( std::move( item ) ) ) {
+                    break;
+                }
+            }
+            if( --decodersLeft == 0 ) {
+                decoded.close();
+            }
+        } );
+    }
+
+    for( uint32_t c = 0; c < mNumCounters; ++c ) {
+        HistogramTool& tool = *mTools[c];
+        threads.emplace_back( [&]{
+            DecodedImage item;
+            while( decoded.pop( item ) ) {
+                BatchRecord& record = *item.record;
+                if( record.ok() ) {
+                    record.numPixels = static_cast<uint64_t>( item.image.width() ) * static_cast<uint64_t>( item.image.height() );
+                    try {
+                        tool.computeHistogram( item.image, record.red, record.green, record.blue );
+                    } catch( const std::exception& e ) {
+                        record.error = e.what();
+                    }
+                }
+                item.image = QImage();
+
+                if( ! counted.push( std::move( item.record ) ) ) {
+                    break;
+                }
+            }
+            if( --countersLeft == 0 ) {
+                counted.close();
+            }
+        } );
+    }
+
+    // Write records as they arrive. If the writer fails, shut the pipeline down before reporting it
+    uint32_t failures = 0;
+    std::exception_ptr writerError;
+    std::unique_ptr<BatchRecord> record;
+    try {
+        while( counted.pop( record ) ) {
+            if( ! record->ok() ) {
+                failures++;
+            }
+            writer( *record );
+        }
+    } catch( ... ) {
+        writerError = std::current_exception();
+        decoded.close();
+        counted.close();
+    }
+
+    for( std::thread& thread : threads ) {
+        thread.join();
+    }
+
+    mPeakDecodedDepth = decoded.peakSize();
+    mPeakCountedDepth = counted.peakSize();
+
+    if( writerError ) {
+        std::rethrow_exception( writerError );
+    }
+    return failures;
+}
+
+/*
+ * Return the number of decoder threads
+ */
+uint32_t BatchHistogram::numDecoders( ) const
+{
+    return mNumDecoders;
+}
+
+/*
+ * Return the number of counter threads
+ */
+uint32_t BatchHistogram::numCounters( ) const
+{
+    return mNumCounters;
+}
+
+/*
+ * Return the capacity of each queue
+ */
+uint32_t BatchHistogram::queueCapacity( ) const
+{
+    return mQueueCapacity;
+}
+
+/*
+ * Return the largest depth of the decoded queue during the last run
+ */
+size_t BatchHistogram::peakDecodedDepth( ) const
+{
+    return mPeakDecodedDepth;
+}
+
+/*
+ * Return the largest depth of the counted queue during the last run
+ */
+size_t BatchHistogram::peakCountedDepth( ) const
+{
+    return mPeakCountedDepth;
+}
+
+/*
+ * Return the kernel used by the counters
+ */
+const HistogramKernel& BatchHistogram::kernel( ) const
+{
+    return mTools[0]->kernel();
+}
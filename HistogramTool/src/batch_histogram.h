@@ -0,0 +1,148 @@
+#ifndef BATCH_HISTOGRAM_H
+#define BATCH_HISTOGRAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <QString>
+#include <QStringList>
+#include "histogram.h"
+#include "histogram_kernel.h"
+#include "histogram_tool.h"
+
+/**
+ * The result of processing one image in a batch.
+ */
+struct BatchRecord {
+    // Position of the image in the list given to BatchHistogram::run
+    uint32_t        index = 0;
+
+    // The image file
+    QString         fileName;
+
+    // Why the image couldn't be processed. Empty on success
+    std::string     error;
+
+    // Number of pixels counted
+    uint64_t        numPixels = 0;
+
+    // The image's histograms. Only meaningful on success
+    Histogram       red;
+    Histogram       green;
+    Histogram       blue;
+
+    /**
+     * @return true if the image was read and counted.
+     */
+    bool ok( ) const {
+        return error.empty();
+    }
+};
+
+/**
+ * BatchHistogram.
+ *
+ * Computes the histograms of many image files in one process as a three stage pipeline:
+ *
+ *   decoders --> [decoded queue] --> counters --> [counted queue] --> writer
+ *
+ * Decoder threads claim the next file from the list and load it. Counter threads each own a HistogramTool
+ * and count decoded images. The writer, which runs on the thread calling run(), receives one BatchRecord per
+ * image. Both queues are bounded so that fast decoders can't fill memory with images waiting to be counted;
+ * the largest depth each queue reached is recorded so that the slow stage can be identified and its
+ * concurrency raised.
+ *
+ * Records reach the writer in the order images finish, which is not necessarily the order of the list.
+ */
+class BatchHistogram {
+public:
+    /**
+     * Called on the thread calling run() once for each image, successful or not.
+     */
+    typedef std::function<void( BatchRecord& record )> Writer;
+
+private:
+    // Number of decoder threads
+    uint32_t        mNumDecoders;
+
+    // Number of counter threads, each with its own HistogramTool
+    uint32_t        mNumCounters;
+
+    // Most images waiting in each queue
+    uint32_t        mQueueCapacity;
+
+    // One tool per counter thread
+    std::vector<std::unique_ptr<HistogramTool>> mTools;
+
+    // Largest depth of the decoded queue during the last run
+    size_t          mPeakDecodedDepth;
+
+    // Largest depth of the counted queue during the last run
+    size_t          mPeakCountedDepth;
+
+public:
+    /**
+     * Default capacity of each queue.
+     */
+    static const uint32_t DEFAULT_QUEUE_CAPACITY = 4;
+
+    /**
+     * Construct a pipeline.
+     * @param numDecoders The number of threads decoding images.
+     * @param numCounters The number of threads counting decoded images.
+     * @param threadsPerCounter The number of threads each counter's HistogramTool uses.
+     * @param kernel The kernel used to count pixels.
+     * @param queueCapacity The most images that may wait between two stages.
+     * @throws std::invalid_argument if any count is 0 or the CPU does not support the requested kernel.
+     */
+    BatchHistogram( uint32_t numDecoders, uint32_t numCounters, uint32_t threadsPerCounter = 1,
+                    KernelType kernel = KernelType::Auto, uint32_t queueCapacity = DEFAULT_QUEUE_CAPACITY );
+
+    BatchHistogram( const BatchHistogram& ) = delete;
+    BatchHistogram& operator=( const BatchHistogram& ) = delete;
+
+    /**
+     * Compute the histograms of a list of image files.
+     * Images which can't be read produce a record with an error; they don't stop the batch.
+     * @param fileNames The image files.
+     * @param writer Called once per image with its record.
+     * @return The number of images which could not be processed.
+     * Exceptions thrown by the writer stop the pipeline and are rethrown.
+     */
+    uint32_t run( const QStringList& fileNames, const Writer& writer );
+
+    /**
+     * @return The number of decoder threads.
+     */
+    uint32_t numDecoders( ) const;
+
+    /**
+     * @return The number of counter threads.
+     */
+    uint32_t numCounters( ) const;
+
+    /**
+     * @return The capacity of each queue.
+     */
+    uint32_t queueCapacity( ) const;
+
+    /**
+     * @return The largest number of decoded images waiting to be counted during the last run.
+     */
+    size_t peakDecodedDepth( ) const;
+
+    /**
+     * @return The largest number of records waiting for the writer during the last run.
+     */
+    size_t peakCountedDepth( ) const;
+
+    /**
+     * @return The kernel used by the counters.
+     */
+    const HistogramKernel& kernel( ) const;
+};
+
+#endif // BATCH_HISTOGRAM_H
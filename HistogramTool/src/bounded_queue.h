@@ -0,0 +1,137 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+
+/**
+ * BoundedQueue.
+ *
+ * A first in, first out queue shared between producer and consumer threads which holds at most
+ * a fixed number of items. push() blocks while the queue is full, so a fast producer is held back
+ * to the pace of its consumers and the memory held in the queue stays bounded.
+ *
+ * Once close() is called no more items are accepted; consumers drain what remains and then pop()
+ * returns false.
+ *
+ * The queue records the most items it has held at once, to show whether a stage is keeping up.
+ */
+template <typename T>
+class BoundedQueue {
+private:
+    // Items waiting to be consumed
+    std::deque<T>           mItems;
+
+    // Most items held at once
+    size_t                  mCapacity;
+
+    // Largest number of items seen in the queue
+    size_t                  mPeakSize;
+
+    // Set once no more items will be pushed
+    bool                    mClosed;
+
+    // Guards all of the above
+    mutable std::mutex      mMutex;
+
+    // Signalled when an item is pushed or the queue is closed
+    std::condition_variable mNotEmpty;
+
+    // Signalled when an item is popped or the queue is closed
+    std::condition_variable mNotFull;
+
+public:
+    /**
+     * Construct an empty queue.
+     * @param capacity The most items the queue will hold. May not be zero.
+     * @throws std::invalid_argument if capacity is 0.
+     */
+    explicit BoundedQueue( size_t capacity ) : mCapacity{ capacity }, mPeakSize{ 0 }, mClosed{ false } {
+        if( capacity == 0 ) {
+            throw std::invalid_argument( "Queue capacity must be positive" );
+        }
+    }
+
+    BoundedQueue( const BoundedQueue& ) = delete;
+    BoundedQueue& operator=( const BoundedQueue& ) = delete;
+
+    /**
+     * Add an item to the back of the queue, waiting for space if the queue is full.
+     * @param item The item.
+     * @return true if the item was queued, false if the queue has been closed.
+     */
+    bool push( T item ) {
+        std::unique_lock<std::mutex> lock{ mMutex };
+        mNotFull.wait( lock, [this]{ return mClosed || mItems.size() < mCapacity; } );
+        if( mClosed ) {
+            return false;
+        }
+
+        mItems.push_back( std::move( item ) );
+        if( mItems.size() > mPeakSize ) {
+            mPeakSize = mItems.size();
+        }
+        lock.unlock();
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Remove the item at the front of the queue, waiting for one if the queue is empty.
+     * @param item Set to the item removed.
+     * @return true if an item was removed, false if the queue is closed and empty.
+     */
+    bool pop( T& item ) {
+        std::unique_lock<std::mutex> lock{ mMutex };
+        mNotEmpty.wait( lock, [this]{ return mClosed || ! mItems.empty(); } );
+        if( mItems.empty() ) {
+            return false;
+        }
+
+        item = std::move( mItems.front() );
+        mItems.pop_front();
+        lock.unlock();
+        mNotFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Stop accepting items and wake every waiting thread. Items already queued can still be popped.
+     */
+    void close( ) {
+        {
+            std::lock_guard<std::mutex> lock{ mMutex };
+            mClosed = true;
+        }
+        mNotEmpty.notify_all();
+        mNotFull.notify_all();
+    }
+
+    /**
+     * @return The number of items currently queued.
+     */
+    size_t size( ) const {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        return mItems.size();
+    }
+
+    /**
+     * @return The most items the queue will hold.
+     */
+    size_t capacity( ) const {
+        return mCapacity;
+    }
+
+    /**
+     * @return The largest number of items the queue has held at once.
+     */
+    size_t peakSize( ) const {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        return mPeakSize;
+    }
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -0,0 +1,186 @@
+#include "cpu_topology.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+const size_t CpuTopology::DEFAULT_L2_CACHE_BYTES;
+
+
+/*
+ * Read the first line of a file. Returns false if it can't be read
+ */
+static bool readLine( const std::string& fileName, std::string& line ) {
+    std::ifstream file{ fileName };
+    return static_cast<bool>( std::getline( file, line ) );
+}
+
+/*
+ * Quota of this process's cgroup from cgroup v2's cpu.max or v1's cfs quota and period, 0 if none
+ */
+static double detectQuota( ) {
+    std::ifstream cgroups{ "/proc/self/cgroup" };
+    std::string line, v2Path, v1Path;
+    while( std::getline( cgroups, line ) ) {
+        // hierarchy:controllers:path
+        size_t first = line.find( ':' );
+        size_t second = line.find( ':', first + 1 );
+        if( first == std::string::npos || second == std::string::npos ) {
+            continue;
+        }
+        std::string controllers = "," + line.substr( first + 1, second - first - 1 ) + ",";
+        std::string path = line.substr( second + 1 );
+        if( controllers == ",," ) {
+            v2Path = path;
+        } else if( controllers.find( ",cpu," ) != std::string::npos ) {
+            v1Path = path;
+        }
+    }
+
+    std::string text;
+    const std::string v2Files[] = { "/sys/fs/cgroup" + v2Path + "/cpu.max", "/sys/fs/cgroup/cpu.max" };
+    for( const std::string& fileName : v2Files ) {
+        if( readLine( fileName, text ) ) {
+            return CpuTopology::parseCpuMax( text );
+        }
+    }
+
+    const std::string v1Directories[] = { "/sys/fs/cgroup/cpu" + v1Path, "/sys/fs/cgroup/cpu,cpuacct" + v1Path, "/sys/fs/cgroup/cpu" };
+    for( const std::string& directory : v1Directories ) {
+        std::string quotaText, periodText;
+        if( readLine( directory + "/cpu.cfs_quota_us", quotaText ) && readLine( directory + "/cpu.cfs_period_us", periodText ) ) {
+            double quota = std::atof( quotaText.c_str() );
+            double period = std::atof( periodText.c_str() );
+            return ( quota > 0 && period > 0 ) ? quota / period : 0;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Size of the unified or data cache at level 2 of a CPU from sysfs, 0 if not found
+ */
+static size_t detectL2CacheBytes( uint32_t cpu ) {
+    std::string directory = "/sys/devices/system/cpu/cpu" + std::to_string( cpu ) + "/cache/index";
+    for( uint32_t index = 0; index < 8; ++index ) {
+        std::string level, type, size;
+        std::string prefix = directory + std::to_string( index ) + "/";
+        if( readLine( prefix + "level", level ) && readLine( prefix + "type", type ) && readLine( prefix + "size", size )
+            && level == "2" && type != "Instruction" ) {
+            return CpuTopology::parseCacheSize( size );
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Allowed CPUs, their cores and L2 cache from sysfs and the cgroup quota
+ */
+CpuTopology CpuTopology::detect( ) {
+    CpuTopology topology;
+    uint32_t hardwareThreads = std::max<uint32_t>( 1, std::thread::hardware_concurrency() );
+    topology.logicalCpus = hardwareThreads;
+    topology.physicalCores = hardwareThreads;
+
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO( &mask );
+    if( sched_getaffinity( 0, sizeof( mask ), &mask ) == 0 && CPU_COUNT( &mask ) > 0 ) {
+        // Cores are (package, core) pairs. CPUs sysfs says nothing about are taken to be cores of their own
+        std::set<std::pair<std::string, std::string>> cores;
+        uint32_t unknown = 0;
+        size_t l2CacheBytes = 0;
+        for( uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+            if( ! CPU_ISSET( cpu, &mask ) ) {
+                continue;
+            }
+            if( l2CacheBytes == 0 ) {
+                l2CacheBytes = detectL2CacheBytes( cpu );
+            }
+            std::string directory = "/sys/devices/system/cpu/cpu" + std::to_string( cpu ) + "/topology/";
+            std::string package, core;
+            if( readLine( directory + "physical_package_id", package ) && readLine( directory + "core_id", core ) ) {
+                cores.insert( std::make_pair( package, core ) );
+            } else {
+                unknown++;
+            }
+        }
+        topology.logicalCpus = static_cast<uint32_t>( CPU_COUNT( &mask ) );
+        topology.physicalCores = std::max<uint32_t>( 1, static_cast<uint32_t>( cores.size() ) + unknown );
+        if( l2CacheBytes > 0 ) {
+            topology.l2CacheBytes = l2CacheBytes;
+        }
+    }
+    topology.cpuQuota = detectQuota();
+#endif
+
+    return topology;
+}
+
+/*
+ * Physical cores, capped by the quota rounded up
+ */
+uint32_t CpuTopology::recommendedThreads( ) const {
+    uint32_t threads = std::max<uint32_t>( 1, physicalCores );
+    if( cpuQuota > 0 ) {
+        threads = std::min( threads, static_cast<uint32_t>( std::ceil( cpuQuota ) ) );
+    }
+    return std::max<uint32_t>( 1, threads );
+}
+
+/*
+ * Logical CPUs, capped by the quota rounded up
+ */
+uint32_t CpuTopology::maxUsefulThreads( ) const {
+    uint32_t threads = std::max<uint32_t>( 1, logicalCpus );
+    if( cpuQuota > 0 ) {
+        threads = std::min( threads, static_cast<uint32_t>( std::ceil( cpuQuota ) ) );
+    }
+    return std::max<uint32_t>( 1, threads );
+}
+
+/*
+ * "max 100000" is unlimited; "150000 100000" is 1.5 CPUs
+ */
+double CpuTopology::parseCpuMax( const std::string& text ) {
+    std::istringstream fields{ text };
+    std::string quota;
+    double period = 0;
+    if( ! ( fields >> quota >> period ) || quota == "max" || period <= 0 ) {
+        return 0;
+    }
+    double value = std::atof( quota.c_str() );
+    return ( value > 0 ) ? value / period : 0;
+}
+
+/*
+ * "1024K" is 1MB; a bare number is bytes
+ */
+size_t CpuTopology::parseCacheSize( const std::string& text ) {
+    std::istringstream fields{ text };
+    uint64_t value = 0;
+    std::string unit;
+    if( ! ( fields >> value ) || value == 0 ) {
+        return 0;
+    }
+    fields >> unit;
+    if( unit == "K" ) {
+        value *= 1024;
+    } else if( unit == "M" ) {
+        value *= 1024 * 1024;
+    } else if( unit.length() > 0 ) {
+        return 0;
+    }
+    return static_cast<size_t>( value );
+}
@@ -0,0 +1,72 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * CpuTopology.
+ *
+ * How much CPU this process really has. std::thread::hardware_concurrency() counts every hardware thread
+ * on the machine, including SMT siblings which share a core's execution units, and CPUs the process isn't
+ * allowed to use. Counting is limited by execution units and memory bandwidth, so a second thread on a core
+ * gains little, and threads beyond a container's CPU quota just get throttled.
+ *
+ * On Linux detect() counts the CPUs in the process's affinity mask, the distinct cores they belong to from
+ * sysfs, and the CFS quota of the process's cgroup, v1 or v2. Elsewhere logical CPUs and cores are both
+ * hardware_concurrency() and there is no quota.
+ *
+ * The size of the L2 cache of the first allowed CPU is read from sysfs too, for counts which must choose
+ * between dense and sparse storage. Where it can't be read it is taken to be DEFAULT_L2_CACHE_BYTES.
+ */
+struct CpuTopology {
+    /**
+     * L2 cache assumed where its size can't be detected; the smallest in common use.
+     */
+    static const size_t DEFAULT_L2_CACHE_BYTES = 256 * 1024;
+
+    // CPUs the process may run on, counting SMT siblings
+    uint32_t    logicalCpus = 1;
+
+    // Distinct physical cores among those CPUs
+    uint32_t    physicalCores = 1;
+
+    // CPUs worth of time the cgroup may use, 0 if unlimited
+    double      cpuQuota = 0;
+
+    // Bytes of L2 cache of a core
+    size_t      l2CacheBytes = DEFAULT_L2_CACHE_BYTES;
+
+    /**
+     * Detect the topology available to this process.
+     * @return The topology. Counts are at least 1.
+     */
+    static CpuTopology detect( );
+
+    /**
+     * @return The most threads worth using: the physical cores, or fewer if the quota is smaller. At least 1.
+     */
+    uint32_t recommendedThreads( ) const;
+
+    /**
+     * @return The most threads it could be worth trying: the logical CPUs, or fewer if the quota is smaller.
+     */
+    uint32_t maxUsefulThreads( ) const;
+
+    /**
+     * Parse the contents of a cgroup v2 cpu.max file, "<quota> <period>" or "max <period>".
+     * @param text The contents.
+     * @return CPUs worth of quota, or 0 if unlimited or unparseable.
+     */
+    static double parseCpuMax( const std::string& text );
+
+    /**
+     * Parse the contents of a sysfs cache size file, such as "1024K" or "2M".
+     * @param text The contents.
+     * @return The size in bytes, or 0 if unparseable.
+     */
+    static size_t parseCacheSize( const std::string& text );
+};
+
+#endif // CPU_TOPOLOGY_H
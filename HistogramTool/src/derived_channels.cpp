@@ -0,0 +1,362 @@
+#include "derived_channels.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+const size_t DerivedChannels::COUNT;
+const uint32_t DerivedChannels::ALL;
+const size_t DerivedChannels::BLOCK_PIXELS;
+
+namespace {
+
+// Names of the channels in DerivedChannel order
+const char * const NAMES[DerivedChannels::COUNT] = { "alpha", "luma601", "luma709", "cb", "cr", "hue", "saturation" };
+
+// One sixth of the hue circle in fixed point, and the fixed point hue per bucket
+const uint32_t HUE_SECTOR = 1u << 24;
+const uint32_t HUE_PER_BUCKET = 6 * HUE_SECTOR / 256;
+
+/*
+ * Reciprocals for hue and saturation, so neither divides per pixel
+ */
+struct Tables {
+    // HUE_SECTOR / d, rounded up, for a difference d between the largest and smallest components. Rounding up
+    // errs by less than the gap between a hue and the nearest bucket boundary it isn't on, so buckets are exact
+    uint32_t    hueReciprocal[256];
+
+    // 255 * 65536 / m, rounded, for a largest component m
+    uint32_t    saturationReciprocal[256];
+
+    Tables( ) {
+        hueReciprocal[0] = 0;
+        saturationReciprocal[0] = 0;
+        for( uint32_t i = 1; i < 256; ++i ) {
+            hueReciprocal[i] = ( HUE_SECTOR + i - 1 ) / i;
+            saturationReciprocal[i] = ( 255 * 65536 + i / 2 ) / i;
+        }
+    }
+};
+
+/*
+ * Built on first use
+ */
+const Tables& tables( ) {
+    static const Tables t;
+    return t;
+}
+
+/*
+ * A weighted sum of the components in 16 bit fixed point, rounded and clamped to a byte
+ */
+template <int32_t Offset, int32_t R, int32_t G, int32_t B>
+inline uint8_t weighted( uint32_t argb ) {
+    int32_t value = ( Offset * 65536 + 32768 + R * static_cast<int32_t>( ( argb >> 16 ) & 0xFF )
+                      + G * static_cast<int32_t>( ( argb >> 8 ) & 0xFF ) + B * static_cast<int32_t>( argb & 0xFF ) ) >> 16;
+    return static_cast<uint8_t>( std::min( value, 255 ) );
+}
+
+/*
+ * The value of a pixel in a channel. Specialised for each channel so the counting loops hold only its work
+ */
+template <DerivedChannel Channel>
+inline uint8_t channelValue( uint32_t argb, const Tables& t );
+
+template <>
+inline uint8_t channelValue<DerivedChannel::Alpha>( uint32_t argb, const Tables& ) {
+    return static_cast<uint8_t>( argb >> 24 );
+}
+
+template <>
+inline uint8_t channelValue<DerivedChannel::Luma601>( uint32_t argb, const Tables& ) {
+    return weighted<0, 19595, 38470, 7471>( argb );
+}
+
+template <>
+inline uint8_t channelValue<DerivedChannel::Luma709>( uint32_t argb, const Tables& ) {
+    return weighted<0, 13933, 46871, 4732>( argb );
+}
+
+template <>
+inline uint8_t channelValue<DerivedChannel::Cb>( uint32_t argb, const Tables& ) {
+    return weighted<128, -11059, -21709, 32768>( argb );
+}
+
+template <>
+inline uint8_t channelValue<DerivedChannel::Cr>( uint32_t argb, const Tables& ) {
+    return weighted<128, 32768, -27439, -5329>( argb );
+}
+
+template <>
+inline uint8_t channelValue<DerivedChannel::Hue>( uint32_t argb, const Tables& t ) {
+    int32_t r = static_cast<int32_t>( ( argb >> 16 ) & 0xFF );
+    int32_t g = static_cast<int32_t>( ( argb >> 8 ) & 0xFF );
+    int32_t b = static_cast<int32_t>( argb & 0xFF );
+    int32_t max = std::max( r, std::max( g, b ) );
+    int32_t min = std::min( r, std::min( g, b ) );
+    int32_t d = max - min;
+    if( d == 0 ) {
+        return 0;
+    }
+
+    // Which sixth of the circle, then how far round it as a fraction of d. A hue before the start of the
+    // largest component's sector is counted from the start of the sector before, so it is never negative
+    int32_t sector, along;
+    if( max == r ) {
+        sector = 0;
+        along = g - b;
+    } else if( max == g ) {
+        sector = 2;
+        along = b - r;
+    } else {
+        sector = 4;
+        along = r - g;
+    }
+    if( along < 0 ) {
+        sector = ( sector + 5 ) % 6;
+        along += d;
+    }
+    uint32_t hue = static_cast<uint32_t>( sector ) * HUE_SECTOR + static_cast<uint32_t>( along ) * t.hueReciprocal[d];
+    return static_cast<uint8_t>( std::min<uint32_t>( hue / HUE_PER_BUCKET, 255 ) );
+}
+
+template <>
+inline uint8_t channelValue<DerivedChannel::Saturation>( uint32_t argb, const Tables& t ) {
+    uint32_t r = ( argb >> 16 ) & 0xFF;
+    uint32_t g = ( argb >> 8 ) & 0xFF;
+    uint32_t b = argb & 0xFF;
+    uint32_t max = std::max( r, std::max( g, b ) );
+    uint32_t min = std::min( r, std::min( g, b ) );
+    uint32_t saturation = ( ( max - min ) * t.saturationReciprocal[max] + 32768 ) >> 16;
+    return static_cast<uint8_t>( std::min<uint32_t>( saturation, 255 ) );
+}
+
+/*
+ * Count one channel of a block of pixels
+ */
+template <DerivedChannel Channel>
+void countChannel( const uint32_t * pixels, size_t numPixels, uint32_t * counts, const Tables& t ) {
+    counts += static_cast<size_t>( Channel ) * 256;
+    for( size_t i = 0; i < numPixels; ++i ) {
+        counts[ channelValue<Channel>( pixels[i], t ) ]++;
+    }
+}
+
+/*
+ * Count the selected channels of a block of pixels, one loop per channel
+ */
+void countBlock( uint32_t channels, const uint32_t * pixels, size_t numPixels, uint32_t * counts, const Tables& t ) {
+    if( channels & DerivedChannels::bit( DerivedChannel::Alpha ) ) {
+        countChannel<DerivedChannel::Alpha>( pixels, numPixels, counts, t );
+    }
+    if( channels & DerivedChannels::bit( DerivedChannel::Luma601 ) ) {
+        countChannel<DerivedChannel::Luma601>( pixels, numPixels, counts, t );
+    }
+    if( channels & DerivedChannels::bit( DerivedChannel::Luma709 ) ) {
+        countChannel<DerivedChannel::Luma709>( pixels, numPixels, counts, t );
+    }
+    if( channels & DerivedChannels::bit( DerivedChannel::Cb ) ) {
+        countChannel<DerivedChannel::Cb>( pixels, numPixels, counts, t );
+    }
+    if( channels & DerivedChannels::bit( DerivedChannel::Cr ) ) {
+        countChannel<DerivedChannel::Cr>( pixels, numPixels, counts, t );
+    }
+    if( channels & DerivedChannels::bit( DerivedChannel::Hue ) ) {
+        countChannel<DerivedChannel::Hue>( pixels, numPixels, counts, t );
+    }
+    if( channels & DerivedChannels::bit( DerivedChannel::Saturation ) ) {
+        countChannel<DerivedChannel::Saturation>( pixels, numPixels, counts, t );
+    }
+}
+
+/*
+ * Unpack pixels of a scanline in any format into ARGB32 words
+ */
+void unpack( const ImageView& image, const uint8_t * pixels, size_t numPixels, uint32_t * words ) {
+    switch( image.format ) {
+        case PixelFormat::ARGB32:
+            std::memcpy( words, pixels, numPixels * sizeof( uint32_t ) );
+            break;
+
+        case PixelFormat::RGBA8888:
+            for( size_t i = 0; i < numPixels; ++i, pixels += 4 ) {
+                words[i] = ( static_cast<uint32_t>( pixels[3] ) << 24 ) | ( static_cast<uint32_t>( pixels[0] ) << 16 )
+                         | ( static_cast<uint32_t>( pixels[1] ) << 8 ) | pixels[2];
+            }
+            break;
+
+        case PixelFormat::RGB888:
+            for( size_t i = 0; i < numPixels; ++i, pixels += 3 ) {
+                words[i] = 0xFF000000u | ( static_cast<uint32_t>( pixels[0] ) << 16 ) | ( static_cast<uint32_t>( pixels[1] ) << 8 ) | pixels[2];
+            }
+            break;
+
+        case PixelFormat::BGR888:
+            for( size_t i = 0; i < numPixels; ++i, pixels += 3 ) {
+                words[i] = 0xFF000000u | ( static_cast<uint32_t>( pixels[2] ) << 16 ) | ( static_cast<uint32_t>( pixels[1] ) << 8 ) | pixels[0];
+            }
+            break;
+
+        case PixelFormat::Grayscale8:
+            for( size_t i = 0; i < numPixels; ++i ) {
+                words[i] = 0xFF000000u | ( pixels[i] * 0x010101u );
+            }
+            break;
+
+        case PixelFormat::Indexed8:
+            for( size_t i = 0; i < numPixels; ++i ) {
+                words[i] = ( pixels[i] < image.colourCount ) ? image.colourTable[ pixels[i] ] : 0;
+            }
+            break;
+    }
+}
+
+}
+
+
+/*
+ * Look up the name
+ */
+std::string DerivedChannels::nameOf( DerivedChannel channel ) {
+    return NAMES[ static_cast<size_t>( channel ) ];
+}
+
+/*
+ * Find the channel with this name
+ */
+DerivedChannel DerivedChannels::fromName( const std::string& name ) {
+    for( size_t i = 0; i < COUNT; ++i ) {
+        if( name == NAMES[i] ) {
+            return static_cast<DerivedChannel>( i );
+        }
+    }
+    throw std::invalid_argument( "Unknown channel: " + name );
+}
+
+/*
+ * Split on commas and set each channel's bit
+ */
+uint32_t DerivedChannels::maskFromNames( const std::string& names ) {
+    uint32_t mask = 0;
+    size_t start = 0;
+    for( ;; ) {
+        size_t end = names.find( ',', start );
+        mask |= bit( fromName( names.substr( start, ( end == std::string::npos ) ? end : end - start ) ) );
+        if( end == std::string::npos ) {
+            return mask;
+        }
+        start = end + 1;
+    }
+}
+
+/*
+ * The value the counting loops would count
+ */
+uint8_t DerivedChannels::valueOf( uint32_t argb, DerivedChannel channel ) {
+    const Tables& t = tables();
+    switch( channel ) {
+        case DerivedChannel::Alpha:
+            return channelValue<DerivedChannel::Alpha>( argb, t );
+        case DerivedChannel::Luma601:
+            return channelValue<DerivedChannel::Luma601>( argb, t );
+        case DerivedChannel::Luma709:
+            return channelValue<DerivedChannel::Luma709>( argb, t );
+        case DerivedChannel::Cb:
+            return channelValue<DerivedChannel::Cb>( argb, t );
+        case DerivedChannel::Cr:
+            return channelValue<DerivedChannel::Cr>( argb, t );
+        case DerivedChannel::Hue:
+            return channelValue<DerivedChannel::Hue>( argb, t );
+        default:
+            return channelValue<DerivedChannel::Saturation>( argb, t );
+    }
+}
+
+/*
+ * Count a block at a time so each channel's loop reads the pixels from L1
+ */
+void DerivedChannels::count( uint32_t channels, const uint32_t * pixels, size_t numPixels, uint32_t * counts ) {
+    if( channels == 0 ) {
+        return;
+    }
+    const Tables& t = tables();
+    for( size_t start = 0; start < numPixels; start += BLOCK_PIXELS ) {
+        countBlock( channels, pixels + start, std::min( BLOCK_PIXELS, numPixels - start ), counts, t );
+    }
+}
+
+/*
+ * ARGB32 scanlines are counted where they lie; others are unpacked a block at a time
+ */
+void DerivedChannels::countRows( uint32_t channels, const ImageView& image, uint32_t firstRow, uint32_t numRows, uint32_t * counts ) {
+    if( channels == 0 ) {
+        return;
+    }
+    const Tables& t = tables();
+    const size_t bytesPerPixel = ImageView::bytesPerPixel( image.format );
+    uint32_t words[BLOCK_PIXELS];
+
+    for( uint32_t row = firstRow; row < firstRow + numRows; ++row ) {
+        const uint8_t *pixels = image.row( row );
+        for( size_t start = 0; start < image.width; start += BLOCK_PIXELS ) {
+            size_t numPixels = std::min<size_t>( BLOCK_PIXELS, image.width - start );
+            if( image.format == PixelFormat::ARGB32 ) {
+                countBlock( channels, reinterpret_cast<const uint32_t *>( pixels ) + start, numPixels, counts, t );
+            } else {
+                unpack( image, pixels + start * bytesPerPixel, numPixels, words );
+                countBlock( channels, words, numPixels, counts, t );
+            }
+        }
+    }
+}
+
+
+/*
+ * Empty histograms for the chosen channels
+ */
+DerivedHistograms::DerivedHistograms( uint32_t channels ) : mChannels{ channels }, mHistograms( DerivedChannels::COUNT ) {
+    if( ( channels & ~DerivedChannels::ALL ) != 0 ) {
+        throw std::invalid_argument( "Unknown derived channels in mask" );
+    }
+}
+
+/*
+ * Channels counted
+ */
+uint32_t DerivedHistograms::channels( ) const {
+    return mChannels;
+}
+
+/*
+ * Whether the channel is counted
+ */
+bool DerivedHistograms::has( DerivedChannel channel ) const {
+    return ( mChannels & DerivedChannels::bit( channel ) ) != 0;
+}
+
+/*
+ * The channel's histogram
+ */
+const FixedHistogram<256, uint64_t>& DerivedHistograms::operator[]( DerivedChannel channel ) const {
+    return mHistograms[ static_cast<size_t>( channel ) ];
+}
+
+/*
+ * Add each counted channel's 256 counts
+ */
+void DerivedHistograms::addCounts( const uint64_t * counts ) {
+    for( size_t channel = 0; channel < DerivedChannels::COUNT; ++channel ) {
+        if( mChannels & ( 1u << channel ) ) {
+            mHistograms[channel].addCounts( counts + channel * 256 );
+        }
+    }
+}
+
+/*
+ * Zero every histogram
+ */
+void DerivedHistograms::reset( ) {
+    for( FixedHistogram<256, uint64_t>& histogram : mHistograms ) {
+        histogram.reset();
+    }
+}
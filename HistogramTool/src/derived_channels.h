@@ -0,0 +1,174 @@
+#ifndef DERIVED_CHANNELS_H
+#define DERIVED_CHANNELS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "fixed_histogram.h"
+#include "image_view.h"
+
+/**
+ * Channels which can be counted alongside red, green and blue. Each is a value from 0 to 255 per pixel.
+ */
+enum class DerivedChannel {
+    // Alpha of the pixel; 255 for formats without alpha
+    Alpha,
+
+    // Rec. 601 luma: 0.299 R + 0.587 G + 0.114 B
+    Luma601,
+
+    // Rec. 709 luma: 0.2126 R + 0.7152 G + 0.0722 B
+    Luma709,
+
+    // Blue difference chroma as in JPEG's full range YCbCr: 128 - 0.168736 R - 0.331264 G + 0.5 B
+    Cb,
+
+    // Red difference chroma as in JPEG's full range YCbCr: 128 + 0.5 R - 0.418688 G - 0.081312 B
+    Cr,
+
+    // HSV hue, the 360 degrees scaled to 256 buckets with red at 0. Greys, having no hue, count as 0
+    Hue,
+
+    // HSV saturation: 255 (max - min) / max, or 0 for black
+    Saturation
+};
+
+/**
+ * DerivedChannels.
+ *
+ * Counts derived channels of pixels, for HistogramTool to count in the same pass as red, green and blue.
+ * Which channels to count is a mask of bit() values, so any combination may be chosen.
+ *
+ * Luma and chroma are weighted sums in 16 bit fixed point, rounded; hue and saturation divide using a table
+ * of reciprocals rather than dividing per pixel. Every channel is integer arithmetic.
+ *
+ * Each selected channel is counted by a loop of its own, specialised at compile time, over a block of pixels
+ * small enough to stay in L1 cache, so a channel which isn't selected costs nothing and the pixels are read
+ * from memory once however many are. Pixels which aren't ARGB32 words are unpacked into a block of words
+ * first. A mask of 0 counts nothing.
+ */
+class DerivedChannels {
+public:
+    /**
+     * Number of derived channels.
+     */
+    static const size_t COUNT = 7;
+
+    /**
+     * Mask selecting every channel.
+     */
+    static const uint32_t ALL = ( 1u << COUNT ) - 1;
+
+    /**
+     * Pixels unpacked and counted at a time.
+     */
+    static const size_t BLOCK_PIXELS = 512;
+
+    /**
+     * @param channel A channel.
+     * @return The bit selecting the channel in a mask.
+     */
+    static uint32_t bit( DerivedChannel channel ) {
+        return 1u << static_cast<uint32_t>( channel );
+    }
+
+    /**
+     * @param channel A channel.
+     * @return Its name: alpha, luma601, luma709, cb, cr, hue or saturation.
+     */
+    static std::string nameOf( DerivedChannel channel );
+
+    /**
+     * @param name The name of a channel.
+     * @return The channel.
+     * @throws std::invalid_argument if no channel has that name.
+     */
+    static DerivedChannel fromName( const std::string& name );
+
+    /**
+     * @param names Names of channels separated by commas, such as "luma709,hue".
+     * @return The mask selecting them.
+     * @throws std::invalid_argument if a name isn't a channel.
+     */
+    static uint32_t maskFromNames( const std::string& names );
+
+    /**
+     * @param argb A pixel, 0xAARRGGBB.
+     * @param channel A channel.
+     * @return The pixel's value in the channel, as counted.
+     */
+    static uint8_t valueOf( uint32_t argb, DerivedChannel channel );
+
+    /**
+     * Count the selected channels of a run of ARGB32 pixels.
+     * @param channels Mask of the channels to count.
+     * @param pixels The pixels.
+     * @param numPixels The number of pixels.
+     * @param counts COUNT * 256 counts, 256 for each channel in DerivedChannel order. Only the selected
+     * channels' counts are touched.
+     */
+    static void count( uint32_t channels, const uint32_t * pixels, size_t numPixels, uint32_t * counts );
+
+    /**
+     * Count the selected channels of a run of scanlines of a view in any format.
+     * @param channels Mask of the channels to count.
+     * @param image The view.
+     * @param firstRow The first scanline to count.
+     * @param numRows The number of scanlines to count.
+     * @param counts As for count().
+     */
+    static void countRows( uint32_t channels, const ImageView& image, uint32_t firstRow, uint32_t numRows, uint32_t * counts );
+};
+
+/**
+ * DerivedHistograms.
+ *
+ * The histograms of the derived channels chosen for a count. Histograms of channels not chosen stay empty.
+ */
+class DerivedHistograms {
+private:
+    // Mask of the channels counted
+    uint32_t        mChannels;
+
+    // A histogram per channel in DerivedChannel order. Held apart as new doesn't align them before C++17
+    std::vector<FixedHistogram<256, uint64_t>>  mHistograms;
+
+public:
+    /**
+     * Construct empty histograms.
+     * @param channels Mask of DerivedChannels::bit() values choosing the channels to count.
+     * @throws std::invalid_argument if the mask has bits beyond DerivedChannels::ALL.
+     */
+    explicit DerivedHistograms( uint32_t channels = 0 );
+
+    /**
+     * @return Mask of the channels counted.
+     */
+    uint32_t channels( ) const;
+
+    /**
+     * @param channel A channel.
+     * @return Whether the channel is counted.
+     */
+    bool has( DerivedChannel channel ) const;
+
+    /**
+     * @param channel A channel.
+     * @return Its histogram. Empty if the channel isn't counted.
+     */
+    const FixedHistogram<256, uint64_t>& operator[]( DerivedChannel channel ) const;
+
+    /**
+     * Add wide counts into the histograms of the channels counted.
+     * @param counts DerivedChannels::COUNT * 256 counts, 256 for each channel in DerivedChannel order.
+     */
+    void addCounts( const uint64_t * counts );
+
+    /**
+     * Empty every histogram.
+     */
+    void reset( );
+};
+
+#endif // DERIVED_CHANNELS_H
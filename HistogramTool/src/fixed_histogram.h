@@ -0,0 +1,185 @@
+#ifndef FIXED_HISTOGRAM_H
+#define FIXED_HISTOGRAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+/**
+ * FixedHistogram.
+ *
+ * A histogram whose number of buckets and counter type are fixed at compile time. The buckets are held
+ * inline, so constructing, copying or destroying one never touches the heap, and an array or vector of
+ * them is a single contiguous block. Copies and moves are plain copies of the buckets.
+ *
+ * The buckets are aligned to a cache line. Note that before C++17 `new` only guarantees the alignment of
+ * the largest fundamental type, so heap allocated FixedHistograms may not start on a cache line.
+ *
+ * increment() and operator[] do not check the bucket index; they are meant for inner loops whose indices
+ * are known to be in range, such as bytes into a 256 bucket histogram. at() checks.
+ *
+ * @tparam NumBuckets The number of buckets. Must be positive.
+ * @tparam Counter The unsigned integer type of each bucket.
+ */
+template <size_t NumBuckets, typename Counter = uint32_t>
+class FixedHistogram {
+    static_assert( NumBuckets > 0, "FixedHistogram must have at least one bucket" );
+    static_assert( std::is_integral<Counter>::value && std::is_unsigned<Counter>::value, "Counter must be an unsigned integer type" );
+
+private:
+    // The buckets themselves
+    alignas(64) Counter mBuckets[NumBuckets];
+
+public:
+    typedef Counter CounterType;
+
+    /**
+     * The number of buckets.
+     */
+    static const size_t BUCKETS = NumBuckets;
+
+    /**
+     * Construct a FixedHistogram with every bucket 0.
+     */
+    FixedHistogram( ) {
+        reset();
+    }
+
+    /**
+     * Reset every bucket to 0.
+     */
+    void reset( ) {
+        for( size_t i = 0; i < NumBuckets; ++i ) {
+            mBuckets[i] = 0;
+        }
+    }
+
+    /**
+     * @param index The index of a bucket. Not checked.
+     * @return The content of the bucket.
+     */
+    Counter operator[]( size_t index ) const {
+        return mBuckets[index];
+    }
+
+    /**
+     * @param index The index of a bucket.
+     * @return The content of the bucket.
+     * @throws std::invalid_argument if the index is out of range.
+     */
+    Counter at( size_t index ) const {
+        if( index >= NumBuckets ) {
+            throw std::invalid_argument( "Bucket index out of range" );
+        }
+        return mBuckets[index];
+    }
+
+    /**
+     * Increment the count at a bucket.
+     * @param index The index of the bucket. Not checked.
+     */
+    void increment( size_t index ) {
+        mBuckets[index]++;
+    }
+
+    /**
+     * Add counts into the buckets.
+     * @param counts NumBuckets counts, one per bucket.
+     */
+    template <typename T>
+    void addCounts( const T * counts ) {
+        for( size_t i = 0; i < NumBuckets; ++i ) {
+            mBuckets[i] += static_cast<Counter>( counts[i] );
+        }
+    }
+
+    /**
+     * @return The total of all bucket counts.
+     */
+    uint64_t total( ) const {
+        uint64_t total = 0;
+        for( size_t i = 0; i < NumBuckets; ++i ) {
+            total += mBuckets[i];
+        }
+        return total;
+    }
+
+    /**
+     * @return The number of buckets.
+     */
+    static constexpr size_t numBuckets( ) {
+        return NumBuckets;
+    }
+
+    /**
+     * @return The buckets, for passing to kernels which count into plain arrays.
+     */
+    Counter * data( ) {
+        return mBuckets;
+    }
+
+    const Counter * data( ) const {
+        return mBuckets;
+    }
+
+    /**
+     * Add another histogram into this one, bucket by bucket.
+     * @param rhs The other histogram.
+     * @return This histogram.
+     */
+    FixedHistogram& operator+=( const FixedHistogram& rhs ) {
+        for( size_t i = 0; i < NumBuckets; ++i ) {
+            mBuckets[i] += rhs.mBuckets[i];
+        }
+        return *this;
+    }
+
+    /**
+     * Add two histograms. The left hand side is taken by value so a temporary is reused rather than copied.
+     * @param lhs A histogram.
+     * @param rhs Another histogram.
+     * @return The sum.
+     */
+    friend FixedHistogram operator+( FixedHistogram lhs, const FixedHistogram& rhs ) {
+        lhs += rhs;
+        return lhs;
+    }
+
+    /**
+     * @return true if every bucket of the two histograms is equal.
+     */
+    friend bool operator==( const FixedHistogram& lhs, const FixedHistogram& rhs ) {
+        for( size_t i = 0; i < NumBuckets; ++i ) {
+            if( lhs.mBuckets[i] != rhs.mBuckets[i] ) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    friend bool operator!=( const FixedHistogram& lhs, const FixedHistogram& rhs ) {
+        return !( lhs == rhs );
+    }
+};
+
+template <size_t NumBuckets, typename Counter>
+const size_t FixedHistogram<NumBuckets, Counter>::BUCKETS;
+
+/**
+ * Print a FixedHistogram to a stream in the same format as a Histogram: all buckets on one line,
+ * separated by commas and followed by a new line.
+ * @param out An output stream.
+ * @param h A FixedHistogram.
+ * @return The output stream.
+ */
+template <size_t NumBuckets, typename Counter>
+std::ostream& operator<<( std::ostream& out, const FixedHistogram<NumBuckets, Counter>& h ) {
+    for( size_t i = 0; i < NumBuckets; ++i ) {
+        out << static_cast<uint64_t>( h[i] ) << ( ( i == NumBuckets - 1 ) ? "\n" : ", " );
+    }
+    return out;
+}
+
+#endif // FIXED_HISTOGRAM_H
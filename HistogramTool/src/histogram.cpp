@@ -1,5 +1,7 @@
 #include "histogram.h"
 
+#include <algorithm>
+
 
 /*
  * Construct with a given number of buckets
@@ -10,7 +12,7 @@ Histogram::Histogram( uint32_t numBuckets )
         throw std::invalid_argument( "Number of buckets must be positive");
     }
 
-    mBuckets = new uint32_t[ numBuckets];
+    mBuckets = new uint64_t[ numBuckets];
     mNumBuckets = numBuckets;
     reset();
 }
@@ -20,8 +22,20 @@ Histogram::Histogram( uint32_t numBuckets )
  */
 Histogram::Histogram( const Histogram& h )
 {
-    mBuckets = new uint32_t[ h.numBuckets() ];
+    mBuckets = new uint64_t[ h.numBuckets() ];
     mNumBuckets = h.numBuckets();
+    std::copy( h.mBuckets, h.mBuckets + mNumBuckets, mBuckets );
+}
+
+/*
+ * Move constructor, steals the bucket array.
+ */
+Histogram::Histogram( Histogram&& h ) noexcept
+{
+    mBuckets = h.mBuckets;
+    mNumBuckets = h.mNumBuckets;
+    h.mBuckets = nullptr;
+    h.mNumBuckets = 0;
 }
 
 
@@ -47,7 +61,7 @@ void Histogram::reset( )
 /*
  * Return the count at one bucket
  */
-uint32_t Histogram::operator[]( size_t index) const
+uint64_t Histogram::operator[]( size_t index) const
 {
     if( index >= mNumBuckets) {
         throw std::invalid_argument( "Bucket index out of range" );
@@ -69,12 +83,60 @@ void Histogram::increment( size_t index )
     mBuckets[index] ++;
 }
 
+/*
+ * Add an array of counts into the buckets
+ */
+void Histogram::addCounts( const uint32_t * counts, size_t numCounts )
+{
+    if( numCounts != mNumBuckets ) {
+        throw std::invalid_argument( "Number of counts must match number of buckets" );
+    }
+
+    for( size_t i=0; i<mNumBuckets; ++i ) {
+        mBuckets[i] += counts[i];
+    }
+}
+
+/*
+ * Add an array of 64 bit counts into the buckets
+ */
+void Histogram::addCounts( const uint64_t * counts, size_t numCounts )
+{
+    if( numCounts != mNumBuckets ) {
+        throw std::invalid_argument( "Number of counts must match number of buckets" );
+    }
+
+    for( size_t i=0; i<mNumBuckets; ++i ) {
+        mBuckets[i] += counts[i];
+    }
+}
+
+/*
+ * Subtract an array of 64 bit counts from the buckets, leaving them unchanged if any would go negative
+ */
+void Histogram::subtractCounts( const uint64_t * counts, size_t numCounts )
+{
+    if( numCounts != mNumBuckets ) {
+        throw std::invalid_argument( "Number of counts must match number of buckets" );
+    }
+
+    for( size_t i=0; i<mNumBuckets; ++i ) {
+        if( counts[i] > mBuckets[i] ) {
+            throw std::invalid_argument( "Can't subtract more than a bucket holds" );
+        }
+    }
+
+    for( size_t i=0; i<mNumBuckets; ++i ) {
+        mBuckets[i] -= counts[i];
+    }
+}
+
 /*
  * Return the total count across all buckets
  */
-uint32_t Histogram::total( ) const
+uint64_t Histogram::total( ) const
 {
-    uint32_t total = 0;
+    uint64_t total = 0;
     for( size_t i  = 0; i < mNumBuckets; ++i ) {
         total += mBuckets[i];
     }
@@ -89,6 +151,14 @@ uint32_t Histogram::numBuckets( ) const
     return mNumBuckets;
 }
 
+/*
+ * Return the buckets
+ */
+const uint64_t * Histogram::data( ) const
+{
+    return mBuckets;
+}
+
 /*
  * Add another Histogram to this one
  */
@@ -99,7 +169,7 @@ Histogram& Histogram::operator+=( const Histogram& rhs )
     }
 
     for( size_t i=0; i<mNumBuckets; ++i ) {
-        mBuckets[i] += rhs[i];
+        mBuckets[i] += rhs.mBuckets[i];
     }
 
     return *this;
@@ -108,17 +178,35 @@ Histogram& Histogram::operator+=( const Histogram& rhs )
 /*
  * Assigment operator
  */
-void Histogram::operator= ( const Histogram& rhs ) {
-    // Create a copy first
-    uint32_t *tempBuckets = new uint32_t[rhs.numBuckets()];
-    for( size_t i=0; i<rhs.numBuckets(); i++ ) {
-        tempBuckets[i] = rhs[i];
+Histogram& Histogram::operator= ( const Histogram& rhs ) {
+    if( this == &rhs ) {
+        return *this;
+    }
+
+    // Same size; no need to reallocate
+    if( rhs.mNumBuckets == mNumBuckets ) {
+        std::copy( rhs.mBuckets, rhs.mBuckets + mNumBuckets, mBuckets );
+        return *this;
     }
 
+    // Create a copy first
+    uint64_t *tempBuckets = new uint64_t[rhs.numBuckets()];
+    std::copy( rhs.mBuckets, rhs.mBuckets + rhs.mNumBuckets, tempBuckets );
+
     // Delete and switch to make it exception safe
     delete[] mBuckets;
     mBuckets = tempBuckets;
     mNumBuckets = rhs.numBuckets();
+    return *this;
+}
+
+/*
+ * Move assignment, swaps bucket arrays
+ */
+Histogram& Histogram::operator= ( Histogram&& rhs ) noexcept {
+    std::swap( mBuckets, rhs.mBuckets );
+    std::swap( mNumBuckets, rhs.mNumBuckets );
+    return *this;
 }
 
 
@@ -129,19 +217,21 @@ Histogram operator+(const Histogram& h1, const Histogram& h2)
 {
     Histogram h = h1;
     h += h2;
+
+    // Moved, not copied, out
     return h;
 }
 
 /*
  * Print to stream
  */
-std::ostream& operator<<( std::ostream& out, Histogram& h )
+std::ostream& operator<<( std::ostream& out, const Histogram& h )
 {
     for( size_t i=0; i<h.numBuckets(); ++i ) {
         out << h[i];
 
         if( i == h.numBuckets() - 1 ) {
-            out << std::endl;
+            out << '\n';
         }
         else {
             out << ", ";
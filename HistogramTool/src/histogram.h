@@ -3,7 +3,7 @@
 
 #include <iostream>
 #include <cstdint>
-#include <QImage>
+#include "fixed_histogram.h"
 
 /**
  * Histogram.
@@ -24,6 +24,12 @@
  *
  * Histograms can be written to ostream instances where they will write all values to a singel line,
  * separated by commas, and terminated with a new line
+ *
+ * The number of buckets is chosen at run time so the buckets live on the heap. Where the number of buckets
+ * is known at compile time, FixedHistogram holds them inline and avoids the allocation altogether.
+ * Histograms can be built from a FixedHistogram.
+ *
+ * Buckets and totals are 64 bit so that images of more than 4 billion pixels can be counted.
  */
 class Histogram
 {
@@ -32,7 +38,7 @@ private:
     uint32_t    mNumBuckets;
 
     // the buckets themselves
-    uint32_t    *mBuckets;
+    uint64_t    *mBuckets;
 
 public:
     /**
@@ -50,6 +56,25 @@ public:
      */
     Histogram( const Histogram& h );
 
+    /**
+     * Move constructor, takes over the bucket array. h is left with no buckets and may only be
+     * assigned to or destroyed.
+     * @param h Another Histogram.
+     */
+    Histogram( Histogram&& h ) noexcept;
+
+    /**
+     * Construct from a FixedHistogram, copying its buckets.
+     * @param h A FixedHistogram.
+     * @throws std::bad_alloc if memory cannot be allocated for buckets.
+     */
+    template <size_t NumBuckets, typename Counter>
+    explicit Histogram( const FixedHistogram<NumBuckets, Counter>& h ) : Histogram( static_cast<uint32_t>( NumBuckets ) ) {
+        for( size_t i = 0; i < NumBuckets; ++i ) {
+            mBuckets[i] = h[i];
+        }
+    }
+
     /**
      * Frees bucket memory.
      */
@@ -67,7 +92,7 @@ public:
      * @return The content of the given bucket.
      * @throws std::invalid_argument if the bucket index provided is out of range.
      */
-    uint32_t operator[]( size_t index) const;
+    uint64_t operator[]( size_t index) const;
 
     /**
      * Increment the count at a given bucket.
@@ -76,16 +101,46 @@ public:
      */
     void increment( size_t index );
 
+    /**
+     * Add an array of counts into the buckets.
+     * @param counts The counts to add. One per bucket.
+     * @param numCounts The number of counts. Must match the number of buckets.
+     * @throws std::invalid_argument if numCounts is not the same as the number of buckets.
+     */
+    void addCounts( const uint32_t * counts, size_t numCounts );
+
+    /**
+     * Add an array of 64 bit counts into the buckets.
+     * @param counts The counts to add. One per bucket.
+     * @param numCounts The number of counts. Must match the number of buckets.
+     * @throws std::invalid_argument if numCounts is not the same as the number of buckets.
+     */
+    void addCounts( const uint64_t * counts, size_t numCounts );
+
+    /**
+     * Subtract an array of 64 bit counts from the buckets.
+     * @param counts The counts to subtract. One per bucket.
+     * @param numCounts The number of counts. Must match the number of buckets.
+     * @throws std::invalid_argument if numCounts is not the same as the number of buckets or any count
+     * is larger than its bucket. The buckets are unchanged if so.
+     */
+    void subtractCounts( const uint64_t * counts, size_t numCounts );
+
     /**
      * @return The total of all bucket counts.
      */
-    uint32_t total( ) const;
+    uint64_t total( ) const;
 
     /**
      * @return The number of buckets.
      */
     uint32_t numBuckets( ) const;
 
+    /**
+     * @return The buckets, for code which reads every count.
+     */
+    const uint64_t * data( ) const;
+
     /**
      * Add another Histogram into this one.
      * Adds the contents of each bucket of the other histogram into the corresponding
@@ -99,10 +154,19 @@ public:
 
     /**
      * Assign this histogram from another
+     * The bucket array is reused if it is already the right size.
      * @param rhs The other Histogram to be assigned to this one
+     * @return a reference to this Histogram.
      * @throws std::bad_alloc if memory cannot be allocated
      */
-    void operator= ( const Histogram& rhs );
+    Histogram& operator= ( const Histogram& rhs );
+
+    /**
+     * Move assign this histogram from another, taking over its bucket array.
+     * @param rhs The other Histogram. Left with this Histogram's old buckets.
+     * @return a reference to this Histogram.
+     */
+    Histogram& operator= ( Histogram&& rhs ) noexcept;
 
     /**
      * Support addition of Histograms
@@ -117,12 +181,13 @@ public:
 /**
  * Print Histogram to stream.
  * The Histogram bucket contents are all written to one line, separated by commas and with a
- * new line character at the end of the buckets.
+ * new line character at the end of the buckets. The stream is not flushed. HistogramWriter is faster for
+ * writing many histograms.
  * @param out An output stream.
  * @param h A Histogram instance.
  * @returns The output stream.
  */
-std::ostream& operator<<( std::ostream& out, Histogram& h );
+std::ostream& operator<<( std::ostream& out, const Histogram& h );
 
 
 #endif // HISTOGRAM_H
@@ -0,0 +1,236 @@
+#include "histogram_client.h"
+#include "histogram_server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+/*
+ * Check an id is a single token
+ */
+static void checkId( const std::string& id ) {
+    if( id.empty() || id.find_first_of( " \t\r\n" ) != std::string::npos ) {
+        throw std::invalid_argument( "Request ids must be a single word" );
+    }
+}
+
+/*
+ * Name of a writer format in a request
+ */
+static const char * formatName( HistogramWriter::Format format ) {
+    switch( format ) {
+        case HistogramWriter::Format::Binary:
+            return "binary";
+        case HistogramWriter::Format::BinaryDelta:
+            return "delta";
+        default:
+            return "text";
+    }
+}
+
+
+/*
+ * Not connected
+ */
+HistogramClient::HistogramClient( ) : mSocket{ -1 } {
+}
+
+/*
+ * Close the connection
+ */
+HistogramClient::~HistogramClient( ) {
+    close();
+}
+
+/*
+ * Connect to the server's socket
+ */
+bool HistogramClient::connect( const std::string& socketPath ) {
+    close();
+
+    sockaddr_un address;
+    std::memset( &address, 0, sizeof( address ) );
+    address.sun_family = AF_UNIX;
+    if( socketPath.empty() || socketPath.size() >= sizeof( address.sun_path ) ) {
+        mErrorString = "Socket path is empty or too long: " + socketPath;
+        return false;
+    }
+    std::memcpy( address.sun_path, socketPath.c_str(), socketPath.size() );
+
+    mSocket = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( mSocket < 0 || ::connect( mSocket, reinterpret_cast<sockaddr *>( &address ), sizeof( address ) ) != 0 ) {
+        mErrorString = "Unable to connect to " + socketPath + ": " + std::strerror( errno );
+        close();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Drop the connection and anything half received
+ */
+void HistogramClient::close( ) {
+    if( mSocket >= 0 ) {
+        ::close( mSocket );
+        mSocket = -1;
+    }
+    mReceived.clear();
+}
+
+/*
+ * Send the whole line, attaching the descriptor to its first byte
+ */
+bool HistogramClient::sendLine( const std::string& line, int fd ) {
+    std::lock_guard<std::mutex> lock{ mSendMutex };
+    if( mSocket < 0 ) {
+        mErrorString = "Not connected";
+        return false;
+    }
+
+    size_t sent = 0;
+    while( sent < line.size() ) {
+        iovec buffer{ const_cast<char *>( line.data() + sent ), line.size() - sent };
+        msghdr message;
+        std::memset( &message, 0, sizeof( message ) );
+        message.msg_iov = &buffer;
+        message.msg_iovlen = 1;
+
+        char control[CMSG_SPACE( sizeof( int ) )];
+        if( fd >= 0 && sent == 0 ) {
+            std::memset( control, 0, sizeof( control ) );
+            message.msg_control = control;
+            message.msg_controllen = sizeof( control );
+            cmsghdr *header = CMSG_FIRSTHDR( &message );
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN( sizeof( int ) );
+            std::memcpy( CMSG_DATA( header ), &fd, sizeof( int ) );
+        }
+
+        ssize_t count = ::sendmsg( mSocket, &message, SEND_FLAGS );
+        if( count < 0 && errno == EINTR ) {
+            continue;
+        }
+        if( count <= 0 ) {
+            mErrorString = std::string{ "Unable to send request: " } + std::strerror( errno );
+            return false;
+        }
+        sent += static_cast<size_t>( count );
+    }
+    return true;
+}
+
+/*
+ * id file format path
+ */
+bool HistogramClient::requestFile( const std::string& id, const std::string& fileName, HistogramWriter::Format format ) {
+    checkId( id );
+    if( fileName.empty() || fileName.find( '\n' ) != std::string::npos ) {
+        throw std::invalid_argument( "File names must be a single line" );
+    }
+    return sendLine( id + " file " + formatName( format ) + " " + fileName + "\n", -1 );
+}
+
+/*
+ * id shm format width height stride pixel format, with the descriptor
+ */
+bool HistogramClient::requestPixels( const std::string& id, int fd, uint32_t width, uint32_t height, uint32_t bytesPerLine,
+                                     PixelFormat pixelFormat, HistogramWriter::Format format ) {
+    checkId( id );
+    if( fd < 0 ) {
+        throw std::invalid_argument( "Pixels must be passed by descriptor" );
+    }
+    return sendLine( id + " shm " + formatName( format ) + " " + std::to_string( width ) + " " + std::to_string( height )
+                     + " " + std::to_string( bytesPerLine ) + " " + HistogramServer::nameOf( pixelFormat ) + "\n", fd );
+}
+
+/*
+ * Half close so the server sees the end of the requests
+ */
+void HistogramClient::finishRequests( ) {
+    std::lock_guard<std::mutex> lock{ mSendMutex };
+    if( mSocket >= 0 ) {
+        ::shutdown( mSocket, SHUT_WR );
+    }
+}
+
+/*
+ * Append whatever has arrived
+ */
+bool HistogramClient::receiveMore( ) {
+    char data[65536];
+    for( ;; ) {
+        ssize_t count = ::recv( mSocket, data, sizeof( data ), 0 );
+        if( count < 0 && errno == EINTR ) {
+            continue;
+        }
+        if( count <= 0 ) {
+            return false;
+        }
+        mReceived.append( data, static_cast<size_t>( count ) );
+        return true;
+    }
+}
+
+/*
+ * A line "id ok|error length" then length bytes
+ */
+bool HistogramClient::receive( Response& response ) {
+    if( mSocket < 0 ) {
+        mErrorString = "Not connected";
+        return false;
+    }
+
+    size_t end;
+    while( ( end = mReceived.find( '\n' ) ) == std::string::npos ) {
+        if( ! receiveMore() ) {
+            mErrorString = "Server closed the connection";
+            return false;
+        }
+    }
+
+    std::string line = mReceived.substr( 0, end );
+    size_t first = line.find( ' ' );
+    size_t second = ( first == std::string::npos ) ? first : line.find( ' ', first + 1 );
+    if( second == std::string::npos ) {
+        mErrorString = "Malformed response: " + line;
+        return false;
+    }
+    std::string status = line.substr( first + 1, second - first - 1 );
+    std::string lengthText = line.substr( second + 1 );
+    if( ( status != "ok" && status != "error" ) || lengthText.empty() || lengthText.find_first_not_of( "0123456789" ) != std::string::npos ) {
+        mErrorString = "Malformed response: " + line;
+        return false;
+    }
+
+    size_t length = static_cast<size_t>( std::strtoull( lengthText.c_str(), nullptr, 10 ) );
+    while( mReceived.size() - end - 1 < length ) {
+        if( ! receiveMore() ) {
+            mErrorString = "Server closed the connection";
+            return false;
+        }
+    }
+
+    response.id = line.substr( 0, first );
+    response.ok = ( status == "ok" );
+    response.body = mReceived.substr( end + 1, length );
+    mReceived.erase( 0, end + 1 + length );
+    return true;
+}
+
+/*
+ * Why the last call failed
+ */
+std::string HistogramClient::errorString( ) const {
+    return mErrorString;
+}
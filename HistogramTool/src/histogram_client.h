@@ -0,0 +1,126 @@
+#ifndef HISTOGRAM_CLIENT_H
+#define HISTOGRAM_CLIENT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include "histogram_writer.h"
+#include "image_view.h"
+
+/**
+ * HistogramClient.
+ *
+ * Speaks the protocol of a HistogramServer so that scripts needn't. Requests and responses are independent:
+ * a client may send many requests before reading any responses, and one thread may send while another
+ * receives. A client sending more than a handful of requests should do so, as the server stops reading
+ * when it is busy and a client which only sends will then wait forever.
+ *
+ * Only available on POSIX systems.
+ */
+class HistogramClient {
+public:
+    /**
+     * A server's answer to one request.
+     */
+    struct Response {
+        // The id given with the request
+        std::string     id;
+
+        // Whether the image was counted
+        bool            ok = false;
+
+        // The histograms in the requested format, or why they couldn't be computed
+        std::string     body;
+    };
+
+private:
+    // The connection, or -1
+    int             mSocket;
+
+    // Bytes received but not yet returned as a response
+    std::string     mReceived;
+
+    // Serialises senders
+    std::mutex      mSendMutex;
+
+    // Description of the last failure
+    std::string     mErrorString;
+
+    // Send a request line with an optional descriptor attached. Returns false and sets mErrorString on failure
+    bool sendLine( const std::string& line, int fd );
+
+    // Read more bytes into mReceived. Returns false at the end of the stream or on failure
+    bool receiveMore( );
+
+public:
+    /**
+     * Construct a client, not yet connected.
+     */
+    HistogramClient( );
+
+    /**
+     * Close the connection, if any.
+     */
+    ~HistogramClient( );
+
+    HistogramClient( const HistogramClient& ) = delete;
+    HistogramClient& operator=( const HistogramClient& ) = delete;
+
+    /**
+     * Connect to a server, closing any earlier connection.
+     * @param socketPath The path of the server's socket.
+     * @return false if nothing is listening there. See errorString().
+     */
+    bool connect( const std::string& socketPath );
+
+    /**
+     * Close the connection. Responses not yet received are lost.
+     */
+    void close( );
+
+    /**
+     * Ask for the histograms of an image file.
+     * @param id Identifies the response. May not be empty or contain whitespace.
+     * @param fileName The image file. Relative paths are relative to the server's working directory.
+     * @param format The format the histograms are to be returned in.
+     * @return false if the request couldn't be sent. See errorString().
+     * @throws std::invalid_argument if the id or file name can't be sent.
+     */
+    bool requestFile( const std::string& id, const std::string& fileName, HistogramWriter::Format format );
+
+    /**
+     * Ask for the histograms of headerless pixels held in shared memory. The descriptor is passed to the server,
+     * which maps it; it may be closed once this returns.
+     * @param id Identifies the response. May not be empty or contain whitespace.
+     * @param fd A descriptor of the pixels, such as a memfd or shm_open object.
+     * @param width Pixels per scanline.
+     * @param height Number of scanlines.
+     * @param bytesPerLine Distance in bytes between the starts of scanlines, or 0 if scanlines aren't padded.
+     * @param pixelFormat Layout of each pixel. May not be Indexed8.
+     * @param format The format the histograms are to be returned in.
+     * @return false if the request couldn't be sent. See errorString().
+     * @throws std::invalid_argument if the id can't be sent or fd is negative.
+     */
+    bool requestPixels( const std::string& id, int fd, uint32_t width, uint32_t height, uint32_t bytesPerLine,
+                        PixelFormat pixelFormat, HistogramWriter::Format format );
+
+    /**
+     * Tell the server no more requests are coming. Responses can still be received.
+     */
+    void finishRequests( );
+
+    /**
+     * Wait for the next response, which may be to any outstanding request.
+     * @param response Set to the response.
+     * @return false if the server closed the connection or sent something malformed. See errorString().
+     */
+    bool receive( Response& response );
+
+    /**
+     * @return A description of the last failure.
+     */
+    std::string errorString( ) const;
+};
+
+#endif // HISTOGRAM_CLIENT_H
@@ -0,0 +1,149 @@
+#include "histogram_job.h"
+
+// Wide counts of each task; red, green then blue
+static const size_t COUNTS_PER_TASK = 3 * 256;
+
+
+/*
+ * Nothing to count until HistogramTool fills the job in
+ */
+HistogramJob::HistogramJob( )
+    : mView{ nullptr, 0, 0, 0, PixelFormat::ARGB32 }, mNumTasks{ 0 }, mRowsPerChunk{ 1 }, mNumChunks{ 0 },
+      mNextChunk{ 0 }, mTasksLeft{ 0 }, mPixelsDone{ 0 }, mCancelled{ false }, mHistograms( 3 ), mState{ State::Running }, mFinished{ false } {
+}
+
+/*
+ * The last task to finish merges the tasks' counts, unless a chunk was skipped, then calls back
+ */
+void HistogramJob::taskFinished( const std::string& error ) {
+    bool failed;
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        if( ! error.empty() && mErrorString.empty() ) {
+            mErrorString = error;
+        }
+        if( --mTasksLeft != 0 ) {
+            return;
+        }
+        failed = ! mErrorString.empty();
+    }
+
+    State state = State::Failed;
+    if( ! failed && mPixelsDone.load() == mView.numPixels() ) {
+        for( uint32_t task = 0; task < mNumTasks; ++task ) {
+            const uint64_t *wide = &mWideCounts[ static_cast<size_t>( task ) * COUNTS_PER_TASK ];
+            for( size_t channel = 0; channel < 3; ++channel ) {
+                mHistograms[channel].addCounts( wide + channel * 256 );
+            }
+        }
+        state = State::Done;
+    } else if( ! failed ) {
+        state = State::Cancelled;
+    }
+    mAccumulators.reset();
+    std::vector<uint64_t>().swap( mWideCounts );
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        mState = state;
+    }
+
+    // Dropped once called, in case it holds the job
+    Callback callback;
+    callback.swap( mCallback );
+    if( callback ) {
+        callback( *this );
+    }
+    callback = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        mFinished = true;
+        mKeepAlive.reset();
+    }
+    mFinishedSignal.notify_all();
+}
+
+/*
+ * Tasks check the flag before each chunk
+ */
+void HistogramJob::cancel( ) {
+    mCancelled = true;
+}
+
+/*
+ * Whether cancel was called
+ */
+bool HistogramJob::cancelRequested( ) const {
+    return mCancelled.load();
+}
+
+/*
+ * Block until finished and called back
+ */
+HistogramJob::State HistogramJob::wait( ) {
+    std::unique_lock<std::mutex> lock{ mMutex };
+    mFinishedSignal.wait( lock, [this]{ return mFinished; } );
+    return mState;
+}
+
+/*
+ * Block until finished or timed out
+ */
+HistogramJob::State HistogramJob::waitFor( std::chrono::milliseconds timeout ) {
+    std::unique_lock<std::mutex> lock{ mMutex };
+    if( ! mFinishedSignal.wait_for( lock, timeout, [this]{ return mFinished; } ) ) {
+        return State::Running;
+    }
+    return mState;
+}
+
+/*
+ * Final state, or Running
+ */
+HistogramJob::State HistogramJob::state( ) const {
+    std::lock_guard<std::mutex> lock{ mMutex };
+    return mState;
+}
+
+/*
+ * Pixels counted so far
+ */
+uint64_t HistogramJob::pixelsDone( ) const {
+    return mPixelsDone.load();
+}
+
+/*
+ * Pixels in the image
+ */
+uint64_t HistogramJob::numPixels( ) const {
+    return mView.numPixels();
+}
+
+/*
+ * What the failing task threw
+ */
+std::string HistogramJob::errorString( ) const {
+    std::lock_guard<std::mutex> lock{ mMutex };
+    return mErrorString;
+}
+
+/*
+ * Red counts
+ */
+const FixedHistogram<256, uint64_t>& HistogramJob::red( ) const {
+    return mHistograms[0];
+}
+
+/*
+ * Green counts
+ */
+const FixedHistogram<256, uint64_t>& HistogramJob::green( ) const {
+    return mHistograms[1];
+}
+
+/*
+ * Blue counts
+ */
+const FixedHistogram<256, uint64_t>& HistogramJob::blue( ) const {
+    return mHistograms[2];
+}
@@ -0,0 +1,184 @@
+#ifndef HISTOGRAM_JOB_H
+#define HISTOGRAM_JOB_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "fixed_histogram.h"
+#include "image_view.h"
+#include "rgb_accumulator.h"
+
+class HistogramTool;
+
+/**
+ * HistogramJob.
+ *
+ * The histograms of one image being computed in the background by HistogramTool::computeHistogramAsync, and a
+ * handle on them. A job can be waited for, polled for the pixels counted so far or cancelled. It can also call
+ * back when it finishes.
+ *
+ * The image is cut into chunks as for HistogramTool::computeHistogram, and its tasks are queued on the tool's
+ * workers alongside those of every other job, so many images in flight share the same threads. Each task checks
+ * for cancellation before claiming each chunk, so a cancelled job stops within a chunk per thread.
+ *
+ * Jobs are shared: the tool's workers hold a reference until the job finishes, so a caller may drop its
+ * handle early without harm.
+ */
+class HistogramJob {
+public:
+    /**
+     * How a job finished, if it has.
+     */
+    enum class State {
+        // Still counting
+        Running,
+
+        // Counted every pixel; the histograms are complete
+        Done,
+
+        // Stopped early by cancel(); the histograms are empty
+        Cancelled,
+
+        // A task threw; see errorString()
+        Failed
+    };
+
+    /**
+     * Called once when a job finishes, however it finishes, on the thread which finished it.
+     */
+    typedef std::function<void( HistogramJob& job )> Callback;
+
+private:
+    friend class HistogramTool;
+
+    // Pixels to count
+    ImageView       mView;
+
+    // Whatever owns the pixels when the job was given them, such as a QImage, released when the job is done
+    std::shared_ptr<const void>     mKeepAlive;
+
+    // Number of tasks counting chunks
+    uint32_t        mNumTasks;
+
+    // Scanlines per chunk
+    uint32_t        mRowsPerChunk;
+
+    // Number of chunks
+    uint32_t        mNumChunks;
+
+    // Next chunk to be claimed
+    std::atomic<uint32_t>   mNextChunk;
+
+    // Tasks which have not yet finished
+    std::atomic<uint32_t>   mTasksLeft;
+
+    // Pixels counted so far
+    std::atomic<uint64_t>   mPixelsDone;
+
+    // Set by cancel()
+    std::atomic<bool>       mCancelled;
+
+    // Scratch counts for each task
+    std::unique_ptr<RgbAccumulatorArray>    mAccumulators;
+
+    // 64 bit counts for each task, into which the scratch counts are flushed
+    std::vector<uint64_t>   mWideCounts;
+
+    // Called when the job finishes, or empty
+    Callback        mCallback;
+
+    // Results; red, green then blue. Held apart from the job as new doesn't align them before C++17
+    std::vector<FixedHistogram<256, uint64_t>>  mHistograms;
+
+    // Guards mState, mErrorString and mFinished
+    mutable std::mutex              mMutex;
+
+    // Signalled when the job has finished and its callback returned
+    std::condition_variable         mFinishedSignal;
+
+    // How the job finished
+    State           mState;
+
+    // Why a task failed
+    std::string     mErrorString;
+
+    // Whether the callback has returned
+    bool            mFinished;
+
+    // Built by HistogramTool only
+    HistogramJob( );
+
+    // Record how a task ended and, if it was the last, merge the counts, call back and wake waiters
+    void taskFinished( const std::string& error );
+
+public:
+    HistogramJob( const HistogramJob& ) = delete;
+    HistogramJob& operator=( const HistogramJob& ) = delete;
+
+    /**
+     * Ask the job to stop. Chunks being counted are finished but no more are started. Has no effect if the job
+     * has already finished or every chunk had been counted. Doesn't wait; wait() does.
+     */
+    void cancel( );
+
+    /**
+     * @return Whether cancel() has been called.
+     */
+    bool cancelRequested( ) const;
+
+    /**
+     * Wait until the job has finished and its callback has returned. Must not be called from the callback.
+     * @return How the job finished.
+     */
+    State wait( );
+
+    /**
+     * Wait until the job has finished or the time has passed.
+     * @param timeout The longest to wait.
+     * @return How the job finished, or State::Running if it hasn't.
+     */
+    State waitFor( std::chrono::milliseconds timeout );
+
+    /**
+     * @return How the job finished, or State::Running if it hasn't. Already final in the callback.
+     */
+    State state( ) const;
+
+    /**
+     * @return The number of pixels counted so far. Grows a chunk at a time.
+     */
+    uint64_t pixelsDone( ) const;
+
+    /**
+     * @return The number of pixels in the image.
+     */
+    uint64_t numPixels( ) const;
+
+    /**
+     * @return The description of the failure if the state is Failed.
+     */
+    std::string errorString( ) const;
+
+    /**
+     * @return The histogram of red values. Complete once the state is Done; empty if cancelled or failed.
+     */
+    const FixedHistogram<256, uint64_t>& red( ) const;
+
+    /**
+     * @return The histogram of green values. Complete once the state is Done; empty if cancelled or failed.
+     */
+    const FixedHistogram<256, uint64_t>& green( ) const;
+
+    /**
+     * @return The histogram of blue values. Complete once the state is Done; empty if cancelled or failed.
+     */
+    const FixedHistogram<256, uint64_t>& blue( ) const;
+};
+
+#endif // HISTOGRAM_JOB_H
@@ -0,0 +1,465 @@
+#include "histogram_kernel.h"
+
+#include <stdexcept>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HISTOGRAM_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Number of interleaved sub-histograms per channel
+const size_t NUM_BANKS = 4;
+
+// Size of each channel's banks and of the whole bank array
+const size_t CHANNEL_STRIDE = NUM_BANKS * 256;
+const size_t BANK_SIZE = 3 * CHANNEL_STRIDE;
+
+// Offsets of each channel within the bank array
+const uint32_t RED_OFFSET = 0;
+const uint32_t GREEN_OFFSET = CHANNEL_STRIDE;
+const uint32_t BLUE_OFFSET = 2 * CHANNEL_STRIDE;
+
+/*
+ * Zero the banks of the chosen channels. The others are never touched.
+ */
+template <uint32_t Channels>
+void clearBanks( uint32_t * banks ) {
+    for( size_t channel = 0; channel < 3; ++channel ) {
+        if( Channels & ( 1u << channel ) ) {
+            std::memset( banks + channel * CHANNEL_STRIDE, 0, CHANNEL_STRIDE * sizeof( uint32_t ) );
+        }
+    }
+}
+
+/*
+ * Add the banks of each chosen channel into the output counts.
+ */
+template <uint32_t Channels>
+void foldBanks( const uint32_t * banks, uint32_t * red, uint32_t * green, uint32_t * blue ) {
+    uint32_t * const outputs[3] = { red, green, blue };
+
+    for( size_t channel = 0; channel < 3; ++channel ) {
+        if( ! ( Channels & ( 1u << channel ) ) ) {
+            continue;
+        }
+        const uint32_t * channelBanks = banks + channel * CHANNEL_STRIDE;
+        uint32_t * out = outputs[channel];
+
+        for( size_t i = 0; i < 256; ++i ) {
+            out[i] += channelBanks[i] + channelBanks[256 + i] + channelBanks[512 + i] + channelBanks[768 + i];
+        }
+    }
+}
+
+/*
+ * Count the chosen channels of a single pixel into the given bank
+ */
+template <uint32_t Channels>
+inline void countPixel( uint32_t rgb, uint32_t * banks, uint32_t bank ) {
+    if( Channels & HistogramKernel::Red ) {
+        banks[ RED_OFFSET   + bank * 256 + ( ( rgb >> 16 ) & 0xFF ) ]++;
+    }
+    if( Channels & HistogramKernel::Green ) {
+        banks[ GREEN_OFFSET + bank * 256 + ( ( rgb >> 8 ) & 0xFF ) ]++;
+    }
+    if( Channels & HistogramKernel::Blue ) {
+        banks[ BLUE_OFFSET  + bank * 256 + ( rgb & 0xFF ) ]++;
+    }
+}
+
+/*
+ * Portable kernel. Unrolled by four with one bank per pixel.
+ */
+template <uint32_t Channels>
+void scalarKernel( const uint32_t * pixels, size_t numPixels, uint32_t * red, uint32_t * green, uint32_t * blue ) {
+    uint32_t banks[BANK_SIZE];
+    clearBanks<Channels>( banks );
+
+    size_t i = 0;
+    for( ; i + NUM_BANKS <= numPixels; i += NUM_BANKS ) {
+        countPixel<Channels>( pixels[i],     banks, 0 );
+        countPixel<Channels>( pixels[i + 1], banks, 1 );
+        countPixel<Channels>( pixels[i + 2], banks, 2 );
+        countPixel<Channels>( pixels[i + 3], banks, 3 );
+    }
+    for( ; i < numPixels; ++i ) {
+        countPixel<Channels>( pixels[i], banks, 0 );
+    }
+
+    foldBanks<Channels>( banks, red, green, blue );
+}
+
+#ifdef HISTOGRAM_KERNEL_X86
+
+/*
+ * Increment the banks at the four indices held in a vector. The indices are moved out as two 64 bit
+ * words rather than stored and reloaded.
+ */
+__attribute__((target("sse4.2")))
+inline void countLanes( __m128i indices, uint32_t * banks ) {
+    uint64_t low = static_cast<uint64_t>( _mm_cvtsi128_si64( indices ) );
+    uint64_t high = static_cast<uint64_t>( _mm_extract_epi64( indices, 1 ) );
+
+    banks[ static_cast<uint32_t>( low ) ]++;
+    banks[ low >> 32 ]++;
+    banks[ static_cast<uint32_t>( high ) ]++;
+    banks[ high >> 32 ]++;
+}
+
+/*
+ * Increment the banks for four pixels of each chosen channel, red, green then blue. The indices of channels not
+ * chosen are never used, so the compiler drops the unpacking which made them.
+ */
+template <uint32_t Channels>
+__attribute__((target("sse4.2")))
+inline void countChosenLanes( __m128i red, __m128i green, __m128i blue, uint32_t * banks ) {
+    if( Channels & HistogramKernel::Red ) {
+        countLanes( red, banks );
+    }
+    if( Channels & HistogramKernel::Green ) {
+        countLanes( green, banks );
+    }
+    if( Channels & HistogramKernel::Blue ) {
+        countLanes( blue, banks );
+    }
+}
+
+/*
+ * SSE4.2 kernel. Four pixels at a time, shuffling each channel byte out into a 32 bit lane and adding
+ * the lane's bank and channel offset to give an index into the bank array.
+ */
+template <uint32_t Channels>
+__attribute__((target("sse4.2")))
+void sse42Kernel( const uint32_t * pixels, size_t numPixels, uint32_t * red, uint32_t * green, uint32_t * blue ) {
+    alignas(64) uint32_t banks[BANK_SIZE];
+    clearBanks<Channels>( banks );
+
+    const __m128i blueShuffle  = _mm_setr_epi8( 0, -1, -1, -1, 4, -1, -1, -1, 8,  -1, -1, -1, 12, -1, -1, -1 );
+    const __m128i greenShuffle = _mm_setr_epi8( 1, -1, -1, -1, 5, -1, -1, -1, 9,  -1, -1, -1, 13, -1, -1, -1 );
+    const __m128i redShuffle   = _mm_setr_epi8( 2, -1, -1, -1, 6, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1 );
+
+    const __m128i laneOffsets = _mm_setr_epi32( 0, 256, 512, 768 );
+    const __m128i redOffsets   = _mm_add_epi32( laneOffsets, _mm_set1_epi32( RED_OFFSET ) );
+    const __m128i greenOffsets = _mm_add_epi32( laneOffsets, _mm_set1_epi32( GREEN_OFFSET ) );
+    const __m128i blueOffsets  = _mm_add_epi32( laneOffsets, _mm_set1_epi32( BLUE_OFFSET ) );
+
+    size_t i = 0;
+    for( ; i + 4 <= numPixels; i += 4 ) {
+        __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( pixels + i ) );
+
+        countChosenLanes<Channels>( _mm_add_epi32( _mm_shuffle_epi8( v, redShuffle ),   redOffsets ),
+                                    _mm_add_epi32( _mm_shuffle_epi8( v, greenShuffle ), greenOffsets ),
+                                    _mm_add_epi32( _mm_shuffle_epi8( v, blueShuffle ),  blueOffsets ), banks );
+    }
+    for( ; i < numPixels; ++i ) {
+        countPixel<Channels>( pixels[i], banks, 0 );
+    }
+
+    foldBanks<Channels>( banks, red, green, blue );
+}
+
+/*
+ * AVX2 kernel. As for SSE4.2 but eight pixels at a time. Lanes 4-7 reuse banks 0-3; by the time
+ * they are incremented the increments from lanes 0-3 are twelve stores back.
+ */
+template <uint32_t Channels>
+__attribute__((target("avx2")))
+void avx2Kernel( const uint32_t * pixels, size_t numPixels, uint32_t * red, uint32_t * green, uint32_t * blue ) {
+    alignas(64) uint32_t banks[BANK_SIZE];
+    clearBanks<Channels>( banks );
+
+    // vpshufb shuffles within each 128 bit lane so the same pattern is repeated
+    const __m256i blueShuffle  = _mm256_setr_epi8( 0, -1, -1, -1, 4, -1, -1, -1, 8,  -1, -1, -1, 12, -1, -1, -1,
+                                                   0, -1, -1, -1, 4, -1, -1, -1, 8,  -1, -1, -1, 12, -1, -1, -1 );
+    const __m256i greenShuffle = _mm256_setr_epi8( 1, -1, -1, -1, 5, -1, -1, -1, 9,  -1, -1, -1, 13, -1, -1, -1,
+                                                   1, -1, -1, -1, 5, -1, -1, -1, 9,  -1, -1, -1, 13, -1, -1, -1 );
+    const __m256i redShuffle   = _mm256_setr_epi8( 2, -1, -1, -1, 6, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1,
+                                                   2, -1, -1, -1, 6, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1 );
+
+    const __m256i laneOffsets = _mm256_setr_epi32( 0, 256, 512, 768, 0, 256, 512, 768 );
+    const __m256i redOffsets   = _mm256_add_epi32( laneOffsets, _mm256_set1_epi32( RED_OFFSET ) );
+    const __m256i greenOffsets = _mm256_add_epi32( laneOffsets, _mm256_set1_epi32( GREEN_OFFSET ) );
+    const __m256i blueOffsets  = _mm256_add_epi32( laneOffsets, _mm256_set1_epi32( BLUE_OFFSET ) );
+
+    size_t i = 0;
+    for( ; i + 8 <= numPixels; i += 8 ) {
+        __m256i v = _mm256_loadu_si256( reinterpret_cast<const __m256i *>( pixels + i ) );
+
+        __m256i r = _mm256_add_epi32( _mm256_shuffle_epi8( v, redShuffle ),   redOffsets );
+        __m256i g = _mm256_add_epi32( _mm256_shuffle_epi8( v, greenShuffle ), greenOffsets );
+        __m256i b = _mm256_add_epi32( _mm256_shuffle_epi8( v, blueShuffle ),  blueOffsets );
+
+        countChosenLanes<Channels>( _mm256_castsi256_si128( r ), _mm256_castsi256_si128( g ), _mm256_castsi256_si128( b ), banks );
+        countChosenLanes<Channels>( _mm256_extracti128_si256( r, 1 ), _mm256_extracti128_si256( g, 1 ), _mm256_extracti128_si256( b, 1 ), banks );
+    }
+    for( ; i < numPixels; ++i ) {
+        countPixel<Channels>( pixels[i], banks, 0 );
+    }
+
+    foldBanks<Channels>( banks, red, green, blue );
+}
+
+/*
+ * Increment the banks at sixteen indices stored from a vector. Moving 128 bit lanes out of a 512 bit vector
+ * instead makes GCC warn that the intrinsics may use uninitialised values.
+ */
+inline void countStoredLanes( const uint32_t * indices, uint32_t * banks ) {
+    for( size_t lane = 0; lane < 16; ++lane ) {
+        banks[ indices[lane] ]++;
+    }
+}
+
+/*
+ * Increment the banks for sixteen pixels of each chosen channel, red, green then blue, through one aligned
+ * store each. As for countChosenLanes, the vectors of channels not chosen are never used.
+ */
+template <uint32_t Channels>
+__attribute__((target("avx512f")))
+inline void countChosenVectors( __m512i red, __m512i green, __m512i blue, uint32_t * banks ) {
+    alignas(64) uint32_t indices[16];
+    if( Channels & HistogramKernel::Red ) {
+        _mm512_store_si512( indices, red );
+        countStoredLanes( indices, banks );
+    }
+    if( Channels & HistogramKernel::Green ) {
+        _mm512_store_si512( indices, green );
+        countStoredLanes( indices, banks );
+    }
+    if( Channels & HistogramKernel::Blue ) {
+        _mm512_store_si512( indices, blue );
+        countStoredLanes( indices, banks );
+    }
+}
+
+/*
+ * AVX-512 kernel. Sixteen pixels at a time. Uses shifts and masks rather than byte shuffles so that
+ * only AVX-512F is required.
+ */
+template <uint32_t Channels>
+__attribute__((target("avx512f")))
+void avx512Kernel( const uint32_t * pixels, size_t numPixels, uint32_t * red, uint32_t * green, uint32_t * blue ) {
+    alignas(64) uint32_t banks[BANK_SIZE];
+    clearBanks<Channels>( banks );
+
+    const __m512i byteMask = _mm512_set1_epi32( 0xFF );
+    const __m512i laneOffsets = _mm512_setr_epi32( 0, 256, 512, 768, 0, 256, 512, 768,
+                                                   0, 256, 512, 768, 0, 256, 512, 768 );
+    const __m512i redOffsets   = _mm512_add_epi32( laneOffsets, _mm512_set1_epi32( RED_OFFSET ) );
+    const __m512i greenOffsets = _mm512_add_epi32( laneOffsets, _mm512_set1_epi32( GREEN_OFFSET ) );
+    const __m512i blueOffsets  = _mm512_add_epi32( laneOffsets, _mm512_set1_epi32( BLUE_OFFSET ) );
+
+    size_t i = 0;
+    for( ; i + 16 <= numPixels; i += 16 ) {
+        __m512i v = _mm512_loadu_si512( pixels + i );
+
+        // Zero masked shifts; the unmasked ones merge into an undefined vector, which GCC warns of
+        __m512i r = _mm512_add_epi32( _mm512_and_si512( _mm512_maskz_srli_epi32( 0xFFFF, v, 16 ), byteMask ), redOffsets );
+        __m512i g = _mm512_add_epi32( _mm512_and_si512( _mm512_maskz_srli_epi32( 0xFFFF, v, 8 ),  byteMask ), greenOffsets );
+        __m512i b = _mm512_add_epi32( _mm512_and_si512( v, byteMask ),                          blueOffsets );
+
+        countChosenVectors<Channels>( r, g, b, banks );
+    }
+    for( ; i < numPixels; ++i ) {
+        countPixel<Channels>( pixels[i], banks, 0 );
+    }
+
+    foldBanks<Channels>( banks, red, green, blue );
+}
+
+#endif // HISTOGRAM_KERNEL_X86
+
+/*
+ * Kernel for a mask choosing no channels
+ */
+void countNothing( const uint32_t *, size_t, uint32_t *, uint32_t *, uint32_t * ) {
+}
+
+/*
+ * Every instantiation of each kernel, indexed by channel mask
+ */
+const HistogramKernel::Function SCALAR_KERNELS[8] = {
+    countNothing, scalarKernel<1>, scalarKernel<2>, scalarKernel<3>, scalarKernel<4>, scalarKernel<5>, scalarKernel<6>, scalarKernel<7>
+};
+
+#ifdef HISTOGRAM_KERNEL_X86
+const HistogramKernel::Function SSE42_KERNELS[8] = {
+    countNothing, sse42Kernel<1>, sse42Kernel<2>, sse42Kernel<3>, sse42Kernel<4>, sse42Kernel<5>, sse42Kernel<6>, sse42Kernel<7>
+};
+
+const HistogramKernel::Function AVX2_KERNELS[8] = {
+    countNothing, avx2Kernel<1>, avx2Kernel<2>, avx2Kernel<3>, avx2Kernel<4>, avx2Kernel<5>, avx2Kernel<6>, avx2Kernel<7>
+};
+
+const HistogramKernel::Function AVX512_KERNELS[8] = {
+    countNothing, avx512Kernel<1>, avx512Kernel<2>, avx512Kernel<3>, avx512Kernel<4>, avx512Kernel<5>, avx512Kernel<6>, avx512Kernel<7>
+};
+#endif
+
+}
+
+
+/*
+ * Construct a kernel of the given type
+ */
+HistogramKernel::HistogramKernel( KernelType type ) {
+    if( type == KernelType::Auto ) {
+        type = bestAvailable();
+    }
+
+    if( ! isSupported( type ) ) {
+        throw std::invalid_argument( "Kernel " + nameOf( type ) + " is not supported on this CPU" );
+    }
+
+    mType = type;
+    switch( type ) {
+#ifdef HISTOGRAM_KERNEL_X86
+        case KernelType::SSE42:
+            mFunctions = SSE42_KERNELS;
+            break;
+
+        case KernelType::AVX2:
+            mFunctions = AVX2_KERNELS;
+            break;
+
+        case KernelType::AVX512:
+            mFunctions = AVX512_KERNELS;
+            break;
+#endif
+        default:
+            mFunctions = SCALAR_KERNELS;
+            break;
+    }
+}
+
+/*
+ * Return the type of the kernel
+ */
+KernelType HistogramKernel::type( ) const {
+    return mType;
+}
+
+/*
+ * Return the name of the kernel
+ */
+std::string HistogramKernel::name( ) const {
+    return nameOf( mType );
+}
+
+/*
+ * Check whether the CPU supports a kernel
+ */
+bool HistogramKernel::isSupported( KernelType type ) {
+    switch( type ) {
+        case KernelType::Auto:
+        case KernelType::Scalar:
+            return true;
+
+#ifdef HISTOGRAM_KERNEL_X86
+        case KernelType::SSE42:
+            return __builtin_cpu_supports( "sse4.2" );
+
+        case KernelType::AVX2:
+            return __builtin_cpu_supports( "avx2" );
+
+        case KernelType::AVX512:
+            return __builtin_cpu_supports( "avx512f" );
+#endif
+
+        default:
+            return false;
+    }
+}
+
+/*
+ * Return the fastest supported kernel.
+ * AVX-512 is not chosen automatically; the increments are still scalar so the wider unpack doesn't
+ * pay for itself and on many parts it lowers the clock speed. It can still be requested explicitly.
+ */
+KernelType HistogramKernel::bestAvailable( ) {
+    const KernelType preferred[] = { KernelType::AVX2, KernelType::SSE42 };
+    for( KernelType type : preferred ) {
+        if( isSupported( type ) ) {
+            return type;
+        }
+    }
+    return KernelType::Scalar;
+}
+
+/*
+ * Return the name of a kernel type
+ */
+std::string HistogramKernel::nameOf( KernelType type ) {
+    switch( type ) {
+        case KernelType::Auto:   return "auto";
+        case KernelType::Scalar: return "scalar";
+        case KernelType::SSE42:  return "sse4.2";
+        case KernelType::AVX2:   return "avx2";
+        case KernelType::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+/*
+ * Parse a kernel name
+ */
+KernelType HistogramKernel::fromName( const std::string& name ) {
+    const KernelType all[] = { KernelType::Auto, KernelType::Scalar, KernelType::SSE42, KernelType::AVX2, KernelType::AVX512 };
+    for( KernelType type : all ) {
+        if( nameOf( type ) == name ) {
+            return type;
+        }
+    }
+    throw std::invalid_argument( "Unknown kernel " + name );
+}
+
+/*
+ * Parse letters r, g and b into a mask
+ */
+uint32_t HistogramKernel::channelsFromName( const std::string& name ) {
+    uint32_t channels = 0;
+    for( char letter : name ) {
+        uint32_t channel = 0;
+        switch( letter ) {
+            case 'r': channel = Red; break;
+            case 'g': channel = Green; break;
+            case 'b': channel = Blue; break;
+        }
+        if( channel == 0 || ( channels & channel ) ) {
+            throw std::invalid_argument( "Channels must be some of r, g and b, each at most once: " + name );
+        }
+        channels |= channel;
+    }
+    if( channels == 0 ) {
+        throw std::invalid_argument( "No channels chosen" );
+    }
+    return channels;
+}
+
+/*
+ * Spell out a mask as letters in red, green, blue order
+ */
+std::string HistogramKernel::nameOfChannels( uint32_t channels ) {
+    std::string name;
+    if( channels & Red ) {
+        name += 'r';
+    }
+    if( channels & Green ) {
+        name += 'g';
+    }
+    if( channels & Blue ) {
+        name += 'b';
+    }
+    return name;
+}
+
+/*
+ * Check a mask chooses some channels and nothing else
+ */
+void HistogramKernel::checkChannels( uint32_t channels ) {
+    if( channels == 0 || ( channels & ~AllChannels ) != 0 ) {
+        throw std::invalid_argument( "Channel mask must choose some of red, green and blue" );
+    }
+}
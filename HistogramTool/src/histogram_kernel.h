@@ -0,0 +1,144 @@
+#ifndef HISTOGRAM_KERNEL_H
+#define HISTOGRAM_KERNEL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/**
+ * The instruction sets for which a histogram kernel is available.
+ * Auto selects the best kernel supported by the CPU at run time.
+ * AVX512 is only used when requested explicitly.
+ */
+enum class KernelType {
+    Auto,
+    Scalar,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+/**
+ * HistogramKernel.
+ *
+ * The inner loop of the histogram computation. A kernel takes a run of 0xAARRGGBB pixels and adds the
+ * red, green and blue values of each into three 256 bucket count arrays.
+ *
+ * Each kernel counts into several interleaved sub-histograms (banks) per channel so that runs of
+ * identical pixels, common in flat areas of an image, don't serialise on a store-to-load dependency
+ * on the same bucket. The banks are folded into the output arrays once the run is complete.
+ *
+ * The vectorised kernels unpack the channels of 4 (SSE4.2), 8 (AVX2) or 16 (AVX-512) pixels at a time
+ * into bank indices. Which kernels are available is determined at run time using CPUID so a single
+ * binary can run on any x86-64 machine; on other architectures only the scalar kernel is available.
+ *
+ * Every kernel is a template on a mask of the channels to count, instantiated for each of the seven
+ * combinations. A channel not in the mask is never unpacked, its banks are never cleared, incremented or
+ * folded and its output isn't touched, so counting only red costs about a third of counting all three.
+ * The mask passed at run time picks the instantiation from a table.
+ */
+class HistogramKernel {
+public:
+    /**
+     * Signature of a kernel function.
+     * Counts are added to, not overwritten.
+     */
+    typedef void (*Function)( const uint32_t * pixels, size_t numPixels, uint32_t * red, uint32_t * green, uint32_t * blue );
+
+    /**
+     * Bits of a mask choosing which channels are counted.
+     */
+    enum Channels : uint32_t {
+        Red = 1,
+        Green = 2,
+        Blue = 4,
+        AllChannels = 7
+    };
+
+private:
+    // The kernel in use. Never Auto.
+    KernelType      mType;
+
+    // The functions implementing it, one per channel mask
+    const Function *    mFunctions;
+
+public:
+    /**
+     * Construct a kernel of the given type.
+     * @param type The type of kernel. Auto selects the best kernel the CPU supports.
+     * @throws std::invalid_argument if the CPU does not support the requested kernel.
+     */
+    HistogramKernel( KernelType type = KernelType::Auto );
+
+    /**
+     * Count a run of pixels.
+     * @param pixels The first pixel to count.
+     * @param numPixels The number of pixels to count.
+     * @param red 256 counts to which red values will be added.
+     * @param green 256 counts to which green values will be added.
+     * @param blue 256 counts to which blue values will be added.
+     * @param channels Mask of the channels to count. The counts of other channels are untouched and may be null.
+     */
+    void operator()( const uint32_t * pixels, size_t numPixels, uint32_t * red, uint32_t * green, uint32_t * blue,
+                     uint32_t channels = AllChannels ) const {
+        mFunctions[ channels & AllChannels ]( pixels, numPixels, red, green, blue );
+    }
+
+    /**
+     * @return The type of this kernel. This is never KernelType::Auto.
+     */
+    KernelType type( ) const;
+
+    /**
+     * @return The name of this kernel.
+     */
+    std::string name( ) const;
+
+    /**
+     * @param type A kernel type.
+     * @return true if the CPU this is running on supports the given kernel.
+     */
+    static bool isSupported( KernelType type );
+
+    /**
+     * @return The fastest kernel type supported by this CPU. AVX512 is never chosen automatically.
+     */
+    static KernelType bestAvailable( );
+
+    /**
+     * @param type A kernel type.
+     * @return The name of the kernel type, as accepted by fromName().
+     */
+    static std::string nameOf( KernelType type );
+
+    /**
+     * Parse a kernel name.
+     * @param name One of auto, scalar, sse4.2, avx2 or avx512.
+     * @return The corresponding kernel type.
+     * @throws std::invalid_argument if the name is not recognised.
+     */
+    static KernelType fromName( const std::string& name );
+
+    /**
+     * Parse a set of channels.
+     * @param name Some of the letters r, g and b, each at most once, such as "rg".
+     * @return The mask of Channels.
+     * @throws std::invalid_argument if the name has another letter, a repeated one or none.
+     */
+    static uint32_t channelsFromName( const std::string& name );
+
+    /**
+     * @param channels A mask of Channels.
+     * @return Its name, as accepted by channelsFromName(); the letters in the order r, g, b.
+     */
+    static std::string nameOfChannels( uint32_t channels );
+
+    /**
+     * Check a mask of Channels.
+     * @param channels The mask.
+     * @throws std::invalid_argument if it chooses no channel or has bits beyond AllChannels.
+     */
+    static void checkChannels( uint32_t channels );
+};
+
+#endif // HISTOGRAM_KERNEL_H
@@ -0,0 +1,192 @@
+#include "histogram_reader.h"
+#include "histogram_writer.h"
+
+#include <algorithm>
+#include <cstring>
+
+const size_t HistogramReader::READ_PIECE_BYTES;
+
+/*
+ * Little endian integer from bytes
+ */
+static uint64_t littleEndian( const uint8_t * bytes, size_t numBytes ) {
+    uint64_t value = 0;
+    for( size_t i = numBytes; i > 0; --i ) {
+        value = ( value << 8 ) | bytes[i - 1];
+    }
+    return value;
+}
+
+
+/*
+ * Construct a reader
+ */
+HistogramReader::HistogramReader( std::istream& input )
+    : mInput( input ), mStarted{ false }, mFailed{ false }, mDelta{ false } {
+}
+
+/*
+ * Record the error and stop
+ */
+bool HistogramReader::fail( const std::string& error ) {
+    mFailed = true;
+    mErrorString = error;
+    return false;
+}
+
+/*
+ * Check the magic number and version
+ */
+bool HistogramReader::start( ) {
+    if( mStarted ) {
+        return ! mFailed;
+    }
+    mStarted = true;
+
+    uint8_t header[HistogramWriter::HEADER_BYTES];
+    if( ! mInput.read( reinterpret_cast<char *>( header ), sizeof( header ) ) ) {
+        return fail( "Histogram file is too short for its header" );
+    }
+    if( std::memcmp( header, HistogramWriter::MAGIC, 4 ) != 0 ) {
+        return fail( "Not a histogram file" );
+    }
+    uint64_t version = littleEndian( header + 4, 2 );
+    if( version != HistogramWriter::VERSION ) {
+        return fail( "Unsupported histogram file version " + std::to_string( version ) );
+    }
+    mDelta = ( littleEndian( header + 6, 2 ) & HistogramWriter::FLAG_DELTA ) != 0;
+    return true;
+}
+
+/*
+ * Grow the buffer only as far as bytes have arrived, so the claimed length can't force a huge allocation
+ */
+bool HistogramReader::readRecord( uint64_t length ) {
+    mRecord.clear();
+    while( mRecord.size() < length ) {
+        size_t at = mRecord.size();
+        size_t piece = static_cast<size_t>( std::min<uint64_t>( length - at, READ_PIECE_BYTES ) );
+        mRecord.resize( at + piece );
+        if( ! mInput.read( reinterpret_cast<char *>( mRecord.data() + at ), static_cast<std::streamsize>( piece ) ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Number of buckets then fixed width or varint counts, which must fill the record exactly
+ */
+bool HistogramReader::decodeHistogram( ) {
+    if( mRecord.size() < 4 ) {
+        return false;
+    }
+    // Every count takes at least a byte, so a corrupt count can't make a huge allocation
+    uint64_t numCounts = littleEndian( mRecord.data(), 4 );
+    if( numCounts == 0 || numCounts > mRecord.size() - 4 ) {
+        return false;
+    }
+    mCounts.resize( numCounts );
+
+    const uint8_t *next = mRecord.data() + 4;
+    const uint8_t *end = mRecord.data() + mRecord.size();
+    if( ! mDelta ) {
+        if( static_cast<uint64_t>( end - next ) != numCounts * 8 ) {
+            return false;
+        }
+        for( size_t i = 0; i < numCounts; ++i, next += 8 ) {
+            mCounts[i] = littleEndian( next, 8 );
+        }
+        return true;
+    }
+
+    uint64_t previous = 0;
+    for( size_t i = 0; i < numCounts; ++i ) {
+        uint64_t zigzag = 0;
+        unsigned shift = 0;
+        for( ;; ) {
+            if( next == end || shift > 63 ) {
+                return false;
+            }
+            uint8_t byte = *next++;
+            zigzag |= static_cast<uint64_t>( byte & 0x7F ) << shift;
+            shift += 7;
+            if( ( byte & 0x80 ) == 0 ) {
+                break;
+            }
+        }
+        uint64_t delta = ( zigzag >> 1 ) ^ ( ( zigzag & 1 ) ? UINT64_MAX : 0 );
+        previous += delta;
+        mCounts[i] = previous;
+    }
+    return next == end;
+}
+
+/*
+ * Read records until a histogram, keeping labels and skipping unknown types
+ */
+bool HistogramReader::read( Histogram& histogram ) {
+    if( ! start() ) {
+        return false;
+    }
+
+    for( ;; ) {
+        uint8_t recordHeader[HistogramWriter::RECORD_HEADER_BYTES];
+        mInput.read( reinterpret_cast<char *>( recordHeader ), sizeof( recordHeader ) );
+        if( mInput.gcount() == 0 && mInput.eof() ) {
+            return false;
+        }
+        if( ! mInput ) {
+            return fail( "Histogram file ends part way through a record" );
+        }
+
+        uint8_t type = recordHeader[0];
+        uint64_t length = littleEndian( recordHeader + 1, 4 );
+        if( type != HistogramWriter::RECORD_LABEL && type != HistogramWriter::RECORD_HISTOGRAM ) {
+            mInput.ignore( static_cast<std::streamsize>( length ) );
+            if( static_cast<uint64_t>( mInput.gcount() ) != length ) {
+                return fail( "Histogram file ends part way through a record" );
+            }
+            continue;
+        }
+        if( ! readRecord( length ) ) {
+            return fail( "Histogram file ends part way through a record" );
+        }
+
+        if( type == HistogramWriter::RECORD_LABEL ) {
+            mLabel.assign( mRecord.begin(), mRecord.end() );
+        } else {
+            if( ! decodeHistogram() ) {
+                return fail( "Corrupt histogram record" );
+            }
+            if( histogram.numBuckets() != mCounts.size() ) {
+                histogram = Histogram{ static_cast<uint32_t>( mCounts.size() ) };
+            } else {
+                histogram.reset();
+            }
+            histogram.addCounts( mCounts.data(), mCounts.size() );
+            return true;
+        }
+    }
+}
+
+/*
+ * Last label read
+ */
+const std::string& HistogramReader::label( ) const {
+    return mLabel;
+}
+
+/*
+ * Whether counts are delta encoded
+ */
+bool HistogramReader::isDelta( ) const {
+    return mDelta;
+}
+
+/*
+ * Why reading stopped
+ */
+const std::string& HistogramReader::errorString( ) const {
+    return mErrorString;
+}
@@ -0,0 +1,111 @@
+#ifndef HISTOGRAM_READER_H
+#define HISTOGRAM_READER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <vector>
+#include "histogram.h"
+
+/**
+ * HistogramReader.
+ *
+ * Reads back histograms written by a HistogramWriter in either binary format. The header is read and
+ * checked before the first histogram. Each record is read into a reusable buffer and decoded from there.
+ * Record lengths aren't trusted: the buffer grows READ_PIECE_BYTES at a time as bytes arrive, so a corrupt
+ * length fails at the end of the stream rather than allocating up to 4GB first. Labels are kept as they are
+ * met, so label() is the last label written before the current histogram. Records of types this version
+ * doesn't know are skipped without being read into memory.
+ *
+ * Reading stops at the end of the stream or at the first problem; errorString() tells the two apart.
+ */
+class HistogramReader {
+public:
+    /**
+     * Most bytes a record's buffer grows by before they have been read.
+     */
+    static const size_t READ_PIECE_BYTES = 64 * 1024;
+
+private:
+    // Stream read from
+    std::istream&       mInput;
+
+    // Whether the header has been read and whether it was good
+    bool                mStarted;
+    bool                mFailed;
+
+    // Whether counts are delta and varint encoded
+    bool                mDelta;
+
+    // Last label read
+    std::string         mLabel;
+
+    // Body of the current record
+    std::vector<uint8_t>    mRecord;
+
+    // Decoded counts of the current histogram
+    std::vector<uint64_t>   mCounts;
+
+    // Why reading stopped, empty if it hasn't or reached the end
+    std::string         mErrorString;
+
+    /**
+     * Read and check the header if it hasn't been yet.
+     * @return false if the header is missing or not understood.
+     */
+    bool start( );
+
+    /**
+     * Stop reading with an error.
+     * @return false.
+     */
+    bool fail( const std::string& error );
+
+    /**
+     * Read a record's body into mRecord, a piece at a time.
+     * @param length The length the record claims.
+     * @return false if the stream ends first.
+     */
+    bool readRecord( uint64_t length );
+
+    /**
+     * Decode the counts of the histogram record in mRecord into mCounts.
+     * @return false if the record is corrupt.
+     */
+    bool decodeHistogram( );
+
+public:
+    /**
+     * Construct a reader. Nothing is read until the first call to read().
+     * @param input Stream to read from, opened in binary mode. Must outlive the reader.
+     */
+    explicit HistogramReader( std::istream& input );
+
+    HistogramReader( const HistogramReader& ) = delete;
+    HistogramReader& operator=( const HistogramReader& ) = delete;
+
+    /**
+     * Read the next histogram, and any labels before it.
+     * @param histogram Set to the histogram read. Resized if it has a different number of buckets.
+     * @return false at the end of the stream or on an error, when histogram is unchanged.
+     */
+    bool read( Histogram& histogram );
+
+    /**
+     * @return The last label read, empty if none has been.
+     */
+    const std::string& label( ) const;
+
+    /**
+     * @return Whether the stream's counts are delta and varint encoded. Valid once read() has been called.
+     */
+    bool isDelta( ) const;
+
+    /**
+     * @return Why reading stopped, or an empty string if it reached the end of the stream or hasn't stopped.
+     */
+    const std::string& errorString( ) const;
+};
+
+#endif // HISTOGRAM_READER_H
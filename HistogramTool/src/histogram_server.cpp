@@ -0,0 +1,517 @@
+#include "histogram_server.h"
+#include "mapped_raster.h"
+
+#include <QImage>
+#include <QImageReader>
+#include <QString>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+// Most descriptors accepted with one read of a connection
+static const size_t MAX_DESCRIPTORS_PER_READ = 16;
+
+const size_t HistogramServer::MAX_REQUEST_BYTES;
+
+
+/*
+ * A client's socket and the lock which keeps responses from interleaving
+ */
+struct HistogramServer::Connection {
+    int         socket;
+    std::mutex  writeMutex;
+
+    explicit Connection( int socket ) : socket{ socket } {
+    }
+
+    ~Connection( ) {
+        ::close( socket );
+    }
+
+    // Send a response line and body. A client which has gone is ignored
+    void respond( const std::string& id, bool ok, const std::string& body ) {
+        std::string response = id + ( ok ? " ok " : " error " ) + std::to_string( body.size() ) + "\n" + body;
+
+        std::lock_guard<std::mutex> lock{ writeMutex };
+        size_t sent = 0;
+        while( sent < response.size() ) {
+            ssize_t count = ::send( socket, response.data() + sent, response.size() - sent, SEND_FLAGS );
+            if( count < 0 && errno == EINTR ) {
+                continue;
+            }
+            if( count <= 0 ) {
+                return;
+            }
+            sent += static_cast<size_t>( count );
+        }
+    }
+};
+
+/*
+ * What to count and how to answer. Owns the descriptor of a shm request
+ */
+struct HistogramServer::Request {
+    std::shared_ptr<Connection> connection;
+    std::string                 id;
+    HistogramWriter::Format     format = HistogramWriter::Format::Text;
+    std::string                 path;
+    int                         fd = -1;
+    uint32_t                    width = 0;
+    uint32_t                    height = 0;
+    uint32_t                    stride = 0;
+    PixelFormat                 pixelFormat = PixelFormat::RGBA8888;
+
+    Request( ) {
+    }
+
+    Request( Request&& other ) {
+        *this = std::move( other );
+    }
+
+    Request& operator=( Request&& other ) {
+        if( this != &other ) {
+            release();
+            connection = std::move( other.connection );
+            id = std::move( other.id );
+            format = other.format;
+            path = std::move( other.path );
+            fd = other.fd;
+            width = other.width;
+            height = other.height;
+            stride = other.stride;
+            pixelFormat = other.pixelFormat;
+            other.fd = -1;
+        }
+        return *this;
+    }
+
+    ~Request( ) {
+        release();
+    }
+
+    void release( ) {
+        if( fd >= 0 ) {
+            ::close( fd );
+            fd = -1;
+        }
+    }
+};
+
+/*
+ * A connection's thread. Holds the connection weakly so it closes once its requests are answered
+ */
+struct HistogramServer::Reader {
+    std::thread                 thread;
+    std::weak_ptr<Connection>   connection;
+    std::atomic<bool>           done{ false };
+};
+
+
+/*
+ * Check the concurrency; nothing is opened until listen
+ */
+HistogramServer::HistogramServer( HistogramTool& tool, uint32_t numDecoders, uint32_t queueCapacity )
+    : mTool( tool ), mNumDecoders{ numDecoders }, mListenSocket{ -1 }, mStopping{ false }, mRequestsAnswered{ 0 } {
+    if( numDecoders == 0 ) {
+        throw std::invalid_argument( "Number of decoders must be positive" );
+    }
+    mRequests.reset( new BoundedQueue<Request>{ queueCapacity } );
+    mWakePipe[0] = -1;
+    mWakePipe[1] = -1;
+}
+
+/*
+ * Anything still open is closed
+ */
+HistogramServer::~HistogramServer( ) {
+    stop();
+    reapReaders( true );
+    closeSockets();
+}
+
+/*
+ * Bind the socket, replacing a stale socket file nobody is listening on
+ */
+bool HistogramServer::listen( const std::string& socketPath ) {
+    sockaddr_un address;
+    std::memset( &address, 0, sizeof( address ) );
+    address.sun_family = AF_UNIX;
+    if( socketPath.empty() || socketPath.size() >= sizeof( address.sun_path ) ) {
+        mErrorString = "Socket path is empty or too long: " + socketPath;
+        return false;
+    }
+    std::memcpy( address.sun_path, socketPath.c_str(), socketPath.size() );
+
+    closeSockets();
+    if( ::pipe( mWakePipe ) != 0 ) {
+        mErrorString = std::string{ "Unable to create pipe: " } + std::strerror( errno );
+        return false;
+    }
+    mListenSocket = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( mListenSocket < 0 ) {
+        mErrorString = std::string{ "Unable to create socket: " } + std::strerror( errno );
+        closeSockets();
+        return false;
+    }
+    fcntl( mListenSocket, F_SETFD, FD_CLOEXEC );
+
+    sockaddr *name = reinterpret_cast<sockaddr *>( &address );
+    int bound = ::bind( mListenSocket, name, sizeof( address ) );
+    if( bound != 0 && errno == EADDRINUSE ) {
+        // Someone answering means a live server; otherwise the file is left over from one that died
+        int probe = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+        bool live = probe >= 0 && ::connect( probe, name, sizeof( address ) ) == 0;
+        if( probe >= 0 ) {
+            ::close( probe );
+        }
+        if( live ) {
+            mErrorString = "Another server is listening on " + socketPath;
+            closeSockets();
+            return false;
+        }
+        ::unlink( socketPath.c_str() );
+        bound = ::bind( mListenSocket, name, sizeof( address ) );
+    }
+    if( bound != 0 || ::listen( mListenSocket, SOMAXCONN ) != 0 ) {
+        mErrorString = "Unable to listen on " + socketPath + ": " + std::strerror( errno );
+        closeSockets();
+        return false;
+    }
+
+    mSocketPath = socketPath;
+    mStopping = false;
+    return true;
+}
+
+/*
+ * Accept until woken by stop, then wind down: readers first so no more requests arrive, then the decoders
+ * once they have answered what was queued
+ */
+void HistogramServer::run( ) {
+    std::vector<std::thread> decoders;
+    for( uint32_t i = 0; i < mNumDecoders; ++i ) {
+        decoders.emplace_back( [this]{ decode(); } );
+    }
+
+    while( ! mStopping && mListenSocket >= 0 ) {
+        pollfd waits[2] = { { mListenSocket, POLLIN, 0 }, { mWakePipe[0], POLLIN, 0 } };
+        if( ::poll( waits, 2, -1 ) < 0 ) {
+            if( errno == EINTR ) {
+                continue;
+            }
+            break;
+        }
+        if( waits[1].revents != 0 ) {
+            break;
+        }
+        if( ( waits[0].revents & POLLIN ) == 0 ) {
+            continue;
+        }
+
+        int client = ::accept( mListenSocket, nullptr, nullptr );
+        if( client < 0 ) {
+            continue;
+        }
+        fcntl( client, F_SETFD, FD_CLOEXEC );
+
+        reapReaders( false );
+        std::shared_ptr<Connection> connection = std::make_shared<Connection>( client );
+        Reader *reader = new Reader;
+        reader->connection = connection;
+        mReaders.emplace_back( reader );
+        reader->thread = std::thread( [this, reader, connection]{
+            readConnection( connection );
+            reader->done = true;
+        } );
+    }
+
+    for( const std::unique_ptr<Reader>& reader : mReaders ) {
+        if( std::shared_ptr<Connection> connection = reader->connection.lock() ) {
+            ::shutdown( connection->socket, SHUT_RD );
+        }
+    }
+    reapReaders( true );
+
+    mRequests->close();
+    for( std::thread& decoder : decoders ) {
+        decoder.join();
+    }
+    closeSockets();
+}
+
+/*
+ * Only async signal safe calls: a flag and a write
+ */
+void HistogramServer::stop( ) {
+    mStopping = true;
+    if( mWakePipe[1] >= 0 ) {
+        ssize_t ignored = ::write( mWakePipe[1], "x", 1 );
+        (void) ignored;
+    }
+}
+
+/*
+ * Read a connection, taking descriptors passed with the data, and handle each complete line
+ */
+void HistogramServer::readConnection( const std::shared_ptr<Connection>& connection ) {
+    std::string pending;
+    std::vector<int> descriptors;
+    char data[4096];
+    char control[CMSG_SPACE( MAX_DESCRIPTORS_PER_READ * sizeof( int ) )];
+    bool reading = true;
+
+    while( reading ) {
+        iovec buffer{ data, sizeof( data ) };
+        msghdr message;
+        std::memset( &message, 0, sizeof( message ) );
+        message.msg_iov = &buffer;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof( control );
+
+#ifdef MSG_CMSG_CLOEXEC
+        ssize_t count = ::recvmsg( connection->socket, &message, MSG_CMSG_CLOEXEC );
+#else
+        ssize_t count = ::recvmsg( connection->socket, &message, 0 );
+#endif
+        if( count < 0 && errno == EINTR ) {
+            continue;
+        }
+        if( count <= 0 ) {
+            break;
+        }
+
+        for( cmsghdr *header = CMSG_FIRSTHDR( &message ); header != nullptr; header = CMSG_NXTHDR( &message, header ) ) {
+            if( header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS ) {
+                size_t numDescriptors = ( header->cmsg_len - CMSG_LEN( 0 ) ) / sizeof( int );
+                for( size_t i = 0; i < numDescriptors; ++i ) {
+                    int fd;
+                    std::memcpy( &fd, CMSG_DATA( header ) + i * sizeof( int ), sizeof( int ) );
+                    descriptors.push_back( fd );
+                }
+            }
+        }
+
+        pending.append( data, static_cast<size_t>( count ) );
+        size_t start = 0;
+        for( size_t end = pending.find( '\n' ); end != std::string::npos && reading; end = pending.find( '\n', start ) ) {
+            reading = handleLine( connection, pending.substr( start, end - start ), descriptors );
+            start = end + 1;
+        }
+        pending.erase( 0, start );
+
+        if( pending.size() > MAX_REQUEST_BYTES ) {
+            connection->respond( "-", false, "Request is too long" );
+            mRequestsAnswered++;
+            reading = false;
+        }
+    }
+
+    for( int fd : descriptors ) {
+        ::close( fd );
+    }
+}
+
+/*
+ * Parse a request. Malformed requests are answered here; good ones wait for a decoder
+ */
+bool HistogramServer::handleLine( const std::shared_ptr<Connection>& connection, const std::string& line, std::vector<int>& descriptors ) {
+    std::istringstream fields{ line };
+    Request request;
+    std::string kind, formatName;
+    if( ! ( fields >> request.id ) ) {
+        return true;
+    }
+
+    std::string error;
+    if( ! ( fields >> kind >> formatName ) ) {
+        error = "Request needs a kind and a format";
+    } else {
+        try {
+            request.format = HistogramWriter::formatFromName( formatName );
+        } catch( const std::invalid_argument& e ) {
+            error = e.what();
+        }
+    }
+
+    if( error.empty() && kind == "file" ) {
+        std::getline( fields >> std::ws, request.path );
+        if( request.path.empty() ) {
+            error = "File request needs a path";
+        }
+    } else if( error.empty() && kind == "shm" ) {
+        std::string pixelFormatName;
+        if( descriptors.empty() ) {
+            error = "Shm request needs a descriptor";
+        } else {
+            request.fd = descriptors.front();
+            descriptors.erase( descriptors.begin() );
+            if( ! ( fields >> request.width >> request.height >> request.stride >> pixelFormatName )
+                || ! pixelFormatFromName( pixelFormatName, request.pixelFormat ) ) {
+                error = "Shm request needs a width, height, stride and pixel format";
+            }
+        }
+    } else if( error.empty() ) {
+        error = "Unknown request " + kind;
+    }
+
+    if( ! error.empty() ) {
+        connection->respond( request.id, false, error );
+        mRequestsAnswered++;
+        return true;
+    }
+
+    request.connection = connection;
+    return mRequests->push( std::move( request ) );
+}
+
+/*
+ * Answer requests until the queue closes, dropping each connection reference as soon as it is answered
+ */
+void HistogramServer::decode( ) {
+    Request request;
+    while( mRequests->pop( request ) ) {
+        std::string body;
+        bool ok = answer( request, body );
+        request.connection->respond( request.id, ok, body );
+        mRequestsAnswered++;
+        request = Request();
+    }
+}
+
+/*
+ * Map or decode the image, count it and write the histograms in the format asked for
+ */
+bool HistogramServer::answer( Request& request, std::string& body ) {
+    Histogram red, green, blue;
+    std::string label;
+    try {
+        MappedRaster raster;
+        if( request.fd >= 0 ) {
+            if( ! raster.openRaw( request.fd, request.width, request.height, request.stride, request.pixelFormat ) ) {
+                body = raster.errorString();
+                return false;
+            }
+            request.release();
+            mTool.computeHistogram( raster.view(), red, green, blue );
+            label = request.id;
+        } else if( MappedRaster::isMappable( request.path ) && raster.open( request.path ) ) {
+            mTool.computeHistogram( raster.view(), red, green, blue );
+            label = request.path;
+        } else {
+            QImageReader reader{ QString::fromStdString( request.path ) };
+            QImage image = reader.read();
+            if( image.isNull() ) {
+                body = "Unable to read image " + request.path + ": " + reader.errorString().toStdString();
+                return false;
+            }
+            mTool.computeHistogram( image, red, green, blue );
+            label = request.path;
+        }
+    } catch( const std::exception& e ) {
+        body = e.what();
+        return false;
+    }
+
+    std::ostringstream output;
+    HistogramWriter writer{ output, request.format };
+    writer.writeLabel( label );
+    writer.write( red );
+    writer.write( green );
+    writer.write( blue );
+    writer.flush();
+    body = output.str();
+    return true;
+}
+
+/*
+ * Join finished readers, or all of them
+ */
+void HistogramServer::reapReaders( bool all ) {
+    for( auto reader = mReaders.begin(); reader != mReaders.end(); ) {
+        if( all || ( *reader )->done ) {
+            if( ( *reader )->thread.joinable() ) {
+                ( *reader )->thread.join();
+            }
+            reader = mReaders.erase( reader );
+        } else {
+            ++reader;
+        }
+    }
+}
+
+/*
+ * Close the listening socket, removing its file, and the wake pipe
+ */
+void HistogramServer::closeSockets( ) {
+    if( mListenSocket >= 0 ) {
+        ::close( mListenSocket );
+        mListenSocket = -1;
+        ::unlink( mSocketPath.c_str() );
+    }
+    for( int& end : mWakePipe ) {
+        if( end >= 0 ) {
+            ::close( end );
+            end = -1;
+        }
+    }
+}
+
+/*
+ * Requests answered so far
+ */
+uint64_t HistogramServer::requestsAnswered( ) const {
+    return mRequestsAnswered;
+}
+
+/*
+ * Why listen failed
+ */
+std::string HistogramServer::errorString( ) const {
+    return mErrorString;
+}
+
+/*
+ * Name of a raw pixel format
+ */
+std::string HistogramServer::nameOf( PixelFormat format ) {
+    switch( format ) {
+        case PixelFormat::ARGB32:
+            return "argb32";
+        case PixelFormat::RGB888:
+            return "rgb";
+        case PixelFormat::BGR888:
+            return "bgr";
+        case PixelFormat::Grayscale8:
+            return "grey";
+        default:
+            return "rgba";
+    }
+}
+
+/*
+ * Parse a raw pixel format name
+ */
+bool HistogramServer::pixelFormatFromName( const std::string& name, PixelFormat& format ) {
+    const char * const names[] = { "rgba", "argb32", "rgb", "bgr", "grey" };
+    const PixelFormat formats[] = { PixelFormat::RGBA8888, PixelFormat::ARGB32, PixelFormat::RGB888, PixelFormat::BGR888, PixelFormat::Grayscale8 };
+    for( size_t i = 0; i < 5; ++i ) {
+        if( name == names[i] ) {
+            format = formats[i];
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,182 @@
+#ifndef HISTOGRAM_SERVER_H
+#define HISTOGRAM_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bounded_queue.h"
+#include "histogram_tool.h"
+#include "histogram_writer.h"
+#include "image_view.h"
+
+/**
+ * HistogramServer.
+ *
+ * Keeps a HistogramTool and a pool of decoder threads resident and answers histogram requests over a Unix domain
+ * stream socket, so that a script computing many histograms doesn't pay for starting a process, loading image
+ * plugins, spawning threads and warming caches on every image.
+ *
+ * Requests are lines of text, each with an id of the client's choosing which is echoed in the response:
+ *
+ *   <id> file <format> <path>
+ *   <id> shm <format> <width> <height> <stride> <pixel format>
+ *
+ * format is text, binary or delta as for HistogramWriter::formatFromName. A file request names an image file,
+ * which is mapped if it is a PPM, PAM or BMP and decoded by Qt otherwise; a relative path is relative to the
+ * server's working directory. A shm request must be sent with exactly one file descriptor attached (SCM_RIGHTS),
+ * typically a memfd or shm_open object, holding headerless pixels laid out as described; stride may be 0 for
+ * unpadded scanlines and pixel format is one of rgba, argb32, rgb, bgr or grey. Descriptors are matched to shm
+ * requests in the order they arrive. The pixels are mapped, not copied.
+ *
+ * Each response is a line followed by a body:
+ *
+ *   <id> ok <length>        then the label and the red, green and blue histograms written in the requested format
+ *   <id> error <length>     then a message
+ *
+ * Connections are read by a thread each and requests handed through a bounded queue to the decoder threads,
+ * which load the image, count it with the shared tool and write the response. So requests on one or many
+ * connections are pipelined: images are decoded while others are counted, and responses come back as each
+ * finishes, not necessarily in the order asked. When the queue is full, connection threads stop reading and the
+ * socket buffers fill, so clients sending faster than the server can count are held back rather than growing
+ * its memory. A client that sends many requests should read responses as it goes.
+ *
+ * Only available on POSIX systems.
+ */
+class HistogramServer {
+public:
+    /**
+     * Most bytes of a request line. Longer lines are answered with an error and the connection closed.
+     */
+    static const size_t MAX_REQUEST_BYTES = 8192;
+
+private:
+    /**
+     * A client connection. Closed when the reader and every request from it are done.
+     */
+    struct Connection;
+
+    /**
+     * A parsed request waiting for a decoder.
+     */
+    struct Request;
+
+    /**
+     * A thread reading a connection, and whether it has finished.
+     */
+    struct Reader;
+
+    // Counts every image
+    HistogramTool&  mTool;
+
+    // Number of decoder threads
+    uint32_t        mNumDecoders;
+
+    // Requests waiting for a decoder
+    std::unique_ptr<BoundedQueue<Request>> mRequests;
+
+    // Path of the socket, removed when the server stops
+    std::string     mSocketPath;
+
+    // The listening socket, or -1
+    int             mListenSocket;
+
+    // Written to by stop() to wake the accept loop
+    int             mWakePipe[2];
+
+    // Set once stop() has been called
+    std::atomic<bool>       mStopping;
+
+    // Requests answered since the server started, successful or not
+    std::atomic<uint64_t>   mRequestsAnswered;
+
+    // Threads reading connections
+    std::list<std::unique_ptr<Reader>>  mReaders;
+
+    // Description of the last failure
+    std::string     mErrorString;
+
+    // Read requests from a connection until it closes or the server stops
+    void readConnection( const std::shared_ptr<Connection>& connection );
+
+    // Parse a request line and queue it, or answer it with an error. Returns false if the server is stopping
+    bool handleLine( const std::shared_ptr<Connection>& connection, const std::string& line, std::vector<int>& descriptors );
+
+    // Load, count and answer requests until the queue is closed
+    void decode( );
+
+    // Count one request into a response body. Returns false with a message in body on failure
+    bool answer( Request& request, std::string& body );
+
+    // Join and forget readers which have finished
+    void reapReaders( bool all );
+
+    // Close the sockets and pipe
+    void closeSockets( );
+
+public:
+    /**
+     * Build a server, not yet listening.
+     * @param tool The tool which counts every image. Must outlive the server.
+     * @param numDecoders The number of threads loading and counting images.
+     * @param queueCapacity The most requests waiting for a decoder.
+     * @throws std::invalid_argument if numDecoders or queueCapacity is 0.
+     */
+    HistogramServer( HistogramTool& tool, uint32_t numDecoders = 1, uint32_t queueCapacity = 4 );
+
+    /**
+     * Stop, if running, and remove the socket.
+     */
+    ~HistogramServer( );
+
+    HistogramServer( const HistogramServer& ) = delete;
+    HistogramServer& operator=( const HistogramServer& ) = delete;
+
+    /**
+     * Create the socket and start listening. A stale socket file left by a server which has gone is replaced.
+     * @param socketPath The path of the socket.
+     * @return false if the socket can't be created or another server is listening on it. See errorString().
+     */
+    bool listen( const std::string& socketPath );
+
+    /**
+     * Accept connections and answer requests until stop() is called, then finish the requests already queued,
+     * close every connection and remove the socket. listen() must have succeeded.
+     */
+    void run( );
+
+    /**
+     * Ask run() to return. May be called from any thread or from a signal handler.
+     */
+    void stop( );
+
+    /**
+     * @return The number of requests answered, successfully or not.
+     */
+    uint64_t requestsAnswered( ) const;
+
+    /**
+     * @return A description of why listen() failed.
+     */
+    std::string errorString( ) const;
+
+    /**
+     * @param format A pixel format which raw data may have.
+     * @return Its name in shm requests: rgba, argb32, rgb, bgr or grey.
+     */
+    static std::string nameOf( PixelFormat format );
+
+    /**
+     * @param name The name of a pixel format in a shm request.
+     * @param format Set to the format named.
+     * @return false if the name isn't rgba, argb32, rgb, bgr or grey.
+     */
+    static bool pixelFormatFromName( const std::string& name, PixelFormat& format );
+};
+
+#endif // HISTOGRAM_SERVER_H
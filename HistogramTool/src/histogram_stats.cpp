@@ -0,0 +1,304 @@
+#include "histogram_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "histogram_kernel.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define HISTOGRAM_STATS_X86
+#include <immintrin.h>
+#endif
+
+
+const size_t HistogramStats::LANES;
+
+namespace {
+
+const size_t LANES = HistogramStats::LANES;
+
+// Results of the passes over the buckets for each lane
+struct LaneSums {
+    double  samples[LANES];
+    double  sums[LANES];
+    double  means[LANES];
+    double  rank1[LANES];
+    double  rank99[LANES];
+    double  squares[LANES];
+    double  below1[LANES];
+    double  below99[LANES];
+    double  best[LANES];
+    double  thresholds[LANES];
+};
+
+/*
+ * Samples, and the sum of their values, at or below each bucket
+ */
+void runningSums( const double * buckets, size_t numBuckets, double * cumulative, double * weighted, LaneSums& lanes )
+{
+    for( size_t i = 0; i < numBuckets; ++i ) {
+        size_t row = i * LANES;
+        double value = static_cast<double>( i );
+        for( size_t lane = 0; lane < LANES; ++lane ) {
+            lanes.samples[lane] += buckets[row + lane];
+            lanes.sums[lane] += value * buckets[row + lane];
+            cumulative[row + lane] = lanes.samples[lane];
+            weighted[row + lane] = lanes.sums[lane];
+        }
+    }
+}
+
+/*
+ * Squared distances from the mean, buckets below each rank and the variance between classes of each split.
+ * The variance is in proportion to the weight of each class times the square of the difference of their
+ * means. A split with samples on both sides has a product of weights of at least 1, so dividing by at least 1
+ * changes nothing and needs no branch
+ */
+void splitSums( const double * buckets, const double * cumulative, const double * weighted, size_t numBuckets, LaneSums& lanes )
+{
+    for( size_t i = 0; i < numBuckets; ++i ) {
+        size_t row = i * LANES;
+        double value = static_cast<double>( i );
+        for( size_t lane = 0; lane < LANES; ++lane ) {
+            double distance = value - lanes.means[lane];
+            lanes.squares[lane] += distance * distance * buckets[row + lane];
+            lanes.below1[lane] += ( cumulative[row + lane] < lanes.rank1[lane] ) ? 1.0 : 0.0;
+            lanes.below99[lane] += ( cumulative[row + lane] < lanes.rank99[lane] ) ? 1.0 : 0.0;
+
+            double lower = cumulative[row + lane];
+            double product = lower * ( lanes.samples[lane] - lower );
+            double difference = lanes.means[lane] * lower - weighted[row + lane];
+            double between = ( product > 0 ) ? difference * difference / std::max( product, 1.0 ) : 0.0;
+            if( between > lanes.best[lane] ) {
+                lanes.best[lane] = between;
+                lanes.thresholds[lane] = value;
+            }
+        }
+    }
+}
+
+#ifdef HISTOGRAM_STATS_X86
+
+/*
+ * runningSums four lanes to a vector. Operations are in the same order, so results are the same
+ */
+__attribute__((target("avx2")))
+void runningSumsAvx2( const double * buckets, size_t numBuckets, double * cumulative, double * weighted, LaneSums& lanes )
+{
+    __m256d samples[2], sums[2];
+    for( size_t half = 0; half < 2; ++half ) {
+        samples[half] = _mm256_loadu_pd( lanes.samples + half * 4 );
+        sums[half] = _mm256_loadu_pd( lanes.sums + half * 4 );
+    }
+
+    for( size_t i = 0; i < numBuckets; ++i ) {
+        __m256d value = _mm256_set1_pd( static_cast<double>( i ) );
+        for( size_t half = 0; half < 2; ++half ) {
+            size_t at = i * LANES + half * 4;
+            __m256d counts = _mm256_loadu_pd( buckets + at );
+            samples[half] = _mm256_add_pd( samples[half], counts );
+            sums[half] = _mm256_add_pd( sums[half], _mm256_mul_pd( value, counts ) );
+            _mm256_storeu_pd( cumulative + at, samples[half] );
+            _mm256_storeu_pd( weighted + at, sums[half] );
+        }
+    }
+
+    for( size_t half = 0; half < 2; ++half ) {
+        _mm256_storeu_pd( lanes.samples + half * 4, samples[half] );
+        _mm256_storeu_pd( lanes.sums + half * 4, sums[half] );
+    }
+}
+
+/*
+ * splitSums four lanes to a vector, with comparisons as masks and the best split chosen by blending
+ */
+__attribute__((target("avx2")))
+void splitSumsAvx2( const double * buckets, const double * cumulative, const double * weighted, size_t numBuckets, LaneSums& lanes )
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd( 1.0 );
+
+    for( size_t half = 0; half < 2; ++half ) {
+        size_t lane = half * 4;
+        __m256d samples = _mm256_loadu_pd( lanes.samples + lane );
+        __m256d means = _mm256_loadu_pd( lanes.means + lane );
+        __m256d rank1 = _mm256_loadu_pd( lanes.rank1 + lane );
+        __m256d rank99 = _mm256_loadu_pd( lanes.rank99 + lane );
+        __m256d squares = _mm256_loadu_pd( lanes.squares + lane );
+        __m256d below1 = _mm256_loadu_pd( lanes.below1 + lane );
+        __m256d below99 = _mm256_loadu_pd( lanes.below99 + lane );
+        __m256d best = _mm256_loadu_pd( lanes.best + lane );
+        __m256d thresholds = _mm256_loadu_pd( lanes.thresholds + lane );
+
+        for( size_t i = 0; i < numBuckets; ++i ) {
+            size_t at = i * LANES + lane;
+            __m256d value = _mm256_set1_pd( static_cast<double>( i ) );
+            __m256d counts = _mm256_loadu_pd( buckets + at );
+            __m256d lower = _mm256_loadu_pd( cumulative + at );
+
+            __m256d distance = _mm256_sub_pd( value, means );
+            squares = _mm256_add_pd( squares, _mm256_mul_pd( _mm256_mul_pd( distance, distance ), counts ) );
+            below1 = _mm256_add_pd( below1, _mm256_and_pd( _mm256_cmp_pd( lower, rank1, _CMP_LT_OQ ), one ) );
+            below99 = _mm256_add_pd( below99, _mm256_and_pd( _mm256_cmp_pd( lower, rank99, _CMP_LT_OQ ), one ) );
+
+            __m256d product = _mm256_mul_pd( lower, _mm256_sub_pd( samples, lower ) );
+            __m256d difference = _mm256_sub_pd( _mm256_mul_pd( means, lower ), _mm256_loadu_pd( weighted + at ) );
+            __m256d between = _mm256_div_pd( _mm256_mul_pd( difference, difference ), _mm256_max_pd( product, one ) );
+            between = _mm256_and_pd( between, _mm256_cmp_pd( product, zero, _CMP_GT_OQ ) );
+            __m256d better = _mm256_cmp_pd( between, best, _CMP_GT_OQ );
+            best = _mm256_blendv_pd( best, between, better );
+            thresholds = _mm256_blendv_pd( thresholds, value, better );
+        }
+
+        _mm256_storeu_pd( lanes.squares + lane, squares );
+        _mm256_storeu_pd( lanes.below1 + lane, below1 );
+        _mm256_storeu_pd( lanes.below99 + lane, below99 );
+        _mm256_storeu_pd( lanes.best + lane, best );
+        _mm256_storeu_pd( lanes.thresholds + lane, thresholds );
+    }
+}
+
+#endif // HISTOGRAM_STATS_X86
+
+}
+
+
+/*
+ * Copy the histograms side by side, then make each pass over the buckets with an inner loop across them.
+ * Unused lanes are empty histograms, so the inner loops always run LANES times. Other than the totals, sums
+ * are doubles as there is no vector conversion of 64 bit integers before AVX-512
+ */
+void HistogramStats::computeLanes( const uint64_t * const * counts, size_t numHistograms, size_t numBuckets, Summary * summaries )
+{
+    mCounts.resize( numBuckets * LANES );
+    mCumulative.resize( numBuckets * LANES );
+    mWeighted.resize( numBuckets * LANES );
+    double *buckets = mCounts.data();
+    double *cumulative = mCumulative.data();
+    double *weighted = mWeighted.data();
+
+    uint64_t totals[LANES] = {};
+    for( size_t lane = 0; lane < LANES; ++lane ) {
+        for( size_t i = 0; i < numBuckets; ++i ) {
+            uint64_t count = ( lane < numHistograms ) ? counts[lane][i] : 0;
+            totals[lane] += count;
+            buckets[i * LANES + lane] = static_cast<double>( count );
+        }
+    }
+
+    LaneSums lanes = {};
+#ifdef HISTOGRAM_STATS_X86
+    bool avx2 = HistogramKernel::isSupported( KernelType::AVX2 );
+    ( avx2 ? runningSumsAvx2 : runningSums )( buckets, numBuckets, cumulative, weighted, lanes );
+#else
+    runningSums( buckets, numBuckets, cumulative, weighted, lanes );
+#endif
+
+    // Nearest ranks of the 1st and 99th percentiles; 0 for no samples, which no bucket is below
+    for( size_t lane = 0; lane < LANES; ++lane ) {
+        uint64_t total = totals[lane];
+        lanes.means[lane] = ( total > 0 ) ? lanes.sums[lane] / lanes.samples[lane] : 0;
+        lanes.rank1[lane] = static_cast<double>( total / 100 + ( ( total % 100 != 0 ) ? 1 : 0 ) );
+        lanes.rank99[lane] = static_cast<double>( total - total / 100 );
+    }
+
+#ifdef HISTOGRAM_STATS_X86
+    ( avx2 ? splitSumsAvx2 : splitSums )( buckets, cumulative, weighted, numBuckets, lanes );
+#else
+    splitSums( buckets, cumulative, weighted, numBuckets, lanes );
+#endif
+
+    for( size_t lane = 0; lane < numHistograms; ++lane ) {
+        Summary& summary = summaries[lane];
+        summary.total = totals[lane];
+        summary.mean = lanes.means[lane];
+        summary.standardDeviation = ( totals[lane] > 0 ) ? std::sqrt( lanes.squares[lane] / lanes.samples[lane] ) : 0;
+        summary.percentile1 = static_cast<uint32_t>( lanes.below1[lane] );
+        summary.percentile99 = static_cast<uint32_t>( lanes.below99[lane] );
+        summary.otsuThreshold = static_cast<uint32_t>( lanes.thresholds[lane] );
+    }
+}
+
+/*
+ * A batch of one
+ */
+HistogramStats::Summary HistogramStats::compute( const Histogram& histogram )
+{
+    const uint64_t *counts = histogram.data();
+    Summary summary;
+    computeLanes( &counts, 1, histogram.numBuckets(), &summary );
+    return summary;
+}
+
+/*
+ * The buckets of each histogram, then as arrays
+ */
+void HistogramStats::compute( const std::vector<const Histogram*>& histograms, std::vector<Summary>& summaries )
+{
+    std::vector<const uint64_t*> counts;
+    counts.reserve( histograms.size() );
+    for( const Histogram *histogram : histograms ) {
+        if( histogram->numBuckets() != histograms.front()->numBuckets() ) {
+            throw std::invalid_argument( "Histograms must have the same number of buckets" );
+        }
+        counts.push_back( histogram->data() );
+    }
+    compute( counts, histograms.empty() ? 1 : histograms.front()->numBuckets(), summaries );
+}
+
+/*
+ * LANES histograms at a time
+ */
+void HistogramStats::compute( const std::vector<const uint64_t*>& counts, size_t numBuckets, std::vector<Summary>& summaries )
+{
+    if( numBuckets == 0 ) {
+        throw std::invalid_argument( "Histograms must have buckets" );
+    }
+
+    summaries.resize( counts.size() );
+    for( size_t first = 0; first < counts.size(); first += LANES ) {
+        computeLanes( counts.data() + first, std::min( LANES, counts.size() - first ), numBuckets, summaries.data() + first );
+    }
+}
+
+/*
+ * Running sum of the counts over the total
+ */
+void HistogramStats::cdf( const Histogram& histogram, std::vector<double>& cdf )
+{
+    const uint64_t *counts = histogram.data();
+    uint64_t total = histogram.total();
+    cdf.resize( histogram.numBuckets() );
+
+    uint64_t samples = 0;
+    for( size_t i = 0; i < cdf.size(); ++i ) {
+        samples += counts[i];
+        cdf[i] = ( total > 0 ) ? static_cast<double>( samples ) / static_cast<double>( total ) : 0;
+    }
+}
+
+/*
+ * The first bucket whose running sum reaches the nearest rank
+ */
+uint32_t HistogramStats::percentile( const Histogram& histogram, double percent )
+{
+    if( ! ( percent >= 0 && percent <= 100 ) ) {
+        throw std::invalid_argument( "Percentile must be from 0 to 100" );
+    }
+
+    const uint64_t *counts = histogram.data();
+    uint64_t total = histogram.total();
+    if( total == 0 ) {
+        return 0;
+    }
+    double rank = std::max( 1.0, std::ceil( percent * static_cast<double>( total ) / 100 ) );
+
+    uint64_t samples = 0;
+    for( uint32_t i = 0; i < histogram.numBuckets(); ++i ) {
+        samples += counts[i];
+        if( static_cast<double>( samples ) >= rank ) {
+            return i;
+        }
+    }
+    return histogram.numBuckets() - 1;
+}
@@ -0,0 +1,113 @@
+#ifndef HISTOGRAM_STATS_H
+#define HISTOGRAM_STATS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "histogram.h"
+
+/**
+ * HistogramStats.
+ *
+ * Works out the statistics usually wanted of a histogram straight from its buckets: the number of samples,
+ * mean, standard deviation, 1st and 99th percentiles and Otsu threshold. Each comes from running sums over the
+ * buckets, the samples and the sum of their values at or below each bucket, so a histogram is read a few
+ * times whatever the number of samples.
+ *
+ * Histograms are worked on LANES at a time. Their buckets are first copied side by side, a bucket of each
+ * histogram next to the same bucket of the others, and each later pass runs over the buckets with an inner
+ * loop across the histograms. Histograms don't depend on each other, so with AVX2 each step of the running
+ * sums and of the search for the Otsu threshold is done for four histograms in one vector, with the same
+ * results as the scalar loops used otherwise. Percentiles are found without branches by counting the buckets
+ * whose running sum is below the rank.
+ * Totals are exact; other sums are doubles, so are exact up to 2^53 samples.
+ *
+ * Bucket i is taken to hold the value i. The standard deviation is that of the samples, not an estimate for
+ * a population they were drawn from. Percentiles are nearest rank: the first bucket at or below which at least
+ * that percentage of the samples fall. The Otsu threshold is the last bucket of the lower class of the split
+ * with the greatest variance between classes; the first if several are equal, and 0 if no split has samples on
+ * both sides. A histogram with no samples has every statistic 0.
+ *
+ * cdf() and percentile() give the cumulative distribution and other percentiles of a single histogram.
+ */
+class HistogramStats {
+public:
+    /**
+     * Statistics of one histogram.
+     */
+    struct Summary {
+        uint64_t    total = 0;
+        double      mean = 0;
+        double      standardDeviation = 0;
+        uint32_t    percentile1 = 0;
+        uint32_t    percentile99 = 0;
+        uint32_t    otsuThreshold = 0;
+    };
+
+    /**
+     * Histograms worked on together.
+     */
+    static const size_t LANES = 8;
+
+private:
+    // Counts of the histograms being worked on; LANES for each bucket
+    std::vector<double>     mCounts;
+
+    // Samples at or below each bucket; LANES for each bucket
+    std::vector<double>     mCumulative;
+
+    // Sum of the values of the samples at or below each bucket; LANES for each bucket
+    std::vector<double>     mWeighted;
+
+    /**
+     * Work out the statistics of up to LANES histograms.
+     * @param counts The counts of each histogram.
+     * @param numHistograms The number of histograms, from 1 to LANES.
+     * @param numBuckets The number of buckets of every histogram.
+     * @param summaries Set to the statistics of each histogram.
+     */
+    void computeLanes( const uint64_t * const * counts, size_t numHistograms, size_t numBuckets, Summary * summaries );
+
+public:
+    /**
+     * Work out the statistics of a histogram.
+     * @param histogram The histogram.
+     * @return Its statistics.
+     */
+    Summary compute( const Histogram& histogram );
+
+    /**
+     * Work out the statistics of a batch of histograms.
+     * @param histograms The histograms. Every one must have the same number of buckets.
+     * @param summaries Set to the statistics of each histogram, in order.
+     * @throws std::invalid_argument if the histograms have different numbers of buckets.
+     */
+    void compute( const std::vector<const Histogram*>& histograms, std::vector<Summary>& summaries );
+
+    /**
+     * Work out the statistics of a batch of histograms held as arrays of counts, such as FixedHistograms.
+     * @param counts The counts of each histogram.
+     * @param numBuckets The number of buckets of every histogram.
+     * @param summaries Set to the statistics of each histogram, in order.
+     * @throws std::invalid_argument if numBuckets is 0.
+     */
+    void compute( const std::vector<const uint64_t*>& counts, size_t numBuckets, std::vector<Summary>& summaries );
+
+    /**
+     * Work out the cumulative distribution of a histogram.
+     * @param histogram The histogram.
+     * @param cdf Set to the fraction of the samples at or below each bucket; all 0 if there are none.
+     */
+    static void cdf( const Histogram& histogram, std::vector<double>& cdf );
+
+    /**
+     * Find a percentile of a histogram.
+     * @param histogram The histogram.
+     * @param percent The percentage, from 0 to 100.
+     * @return The first bucket at or below which at least percent of the samples fall; 0 if there are none.
+     * @throws std::invalid_argument if percent is out of range.
+     */
+    static uint32_t percentile( const Histogram& histogram, double percent );
+};
+
+#endif // HISTOGRAM_STATS_H
@@ -1,105 +1,962 @@
 #include "histogram_tool.h"
+#include "pixel_format_kernels.h"
 
 #include <thread>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+
+/*
+ * Check a view can be counted
+ */
+static void checkView( const ImageView& image ) {
+    if( ! image.isValid() ) {
+        throw std::invalid_argument( "Image has pixels but no pixel data" );
+    }
+}
+
 
 /**
  * Build a HistogramTool configured to use the given number of threads.
  * @param numThreads The number of threads to use to compute the histogram.
  * The input image data is divided into blocks and each thread handles a block
  * So long as there are multiple cores, each thread will run on its own core.
+ * The threads are started here and live as long as the tool.
+ * @param kernel The kernel used to count pixels.
  */
-HistogramTool::HistogramTool( uint32_t numThreads) {
+HistogramTool::HistogramTool( uint32_t numThreads, KernelType kernel) : mKernel{kernel}, mTrace{nullptr}, mNumaCounts{nullptr}, mNumaThreads{0} {
+    if( numThreads == 0 ) {
+        throw std::invalid_argument( "Number of threads must be positive" );
+    }
+
     mNumThreads = numThreads;
+    mMinPixelsPerThread = DEFAULT_MIN_PIXELS_PER_THREAD;
+    mChunkRows = 0;
+    mPool.reset( new WorkerPool{ numThreads - 1 } );
+    mAccumulators.reset( new RgbAccumulatorArray{ numThreads } );
+}
+
+
+/**
+ * Cancel the jobs still running and wait for them, as the pool discards work still queued when destroyed.
+ * Callbacks may start more jobs meanwhile, so repeat until none are left.
+ */
+HistogramTool::~HistogramTool( ) {
+    for( ;; ) {
+        std::vector<std::shared_ptr<HistogramJob>> running;
+        {
+            std::lock_guard<std::mutex> lock{ mJobsMutex };
+            for( const std::weak_ptr<HistogramJob>& job : mJobs ) {
+                if( std::shared_ptr<HistogramJob> alive = job.lock() ) {
+                    running.push_back( alive );
+                }
+            }
+            mJobs.clear();
+        }
+        if( running.empty() ) {
+            return;
+        }
+        for( const std::shared_ptr<HistogramJob>& job : running ) {
+            job->cancel();
+        }
+        for( const std::shared_ptr<HistogramJob>& job : running ) {
+            job->wait();
+        }
+    }
+}
+
+
+/**
+ * @return The kernel used to count pixels.
+ */
+const HistogramKernel& HistogramTool::kernel( ) const {
+    return mKernel;
+}
+
+
+/**
+ * @return The number of threads used to compute a histogram.
+ */
+uint32_t HistogramTool::numThreads( ) const {
+    return mNumThreads;
+}
+
+
+/**
+ * @return The fewest pixels that will be given to a thread.
+ */
+uint32_t HistogramTool::minPixelsPerThread( ) const {
+    return mMinPixelsPerThread;
+}
+
+
+/**
+ * Set the fewest pixels that will be given to a thread.
+ * @param minPixels The number of pixels.
+ */
+void HistogramTool::setMinPixelsPerThread( uint32_t minPixels ) {
+    mMinPixelsPerThread = minPixels;
 }
 
 
 /**
- * Compute the histogram for a given block of pixels within the image.
- * @param imageData The entire image data.
- * @param firstPixel The offset of the first pixel in the block to consider.
- * @param lastPixel The offset of the last pixel in the block to consider.
- * @param red Histogram into which red values will be stored.
- * @param green Histogram into whihc green values will be stored.
- * @param blue Histogram into whihc blue values will be stored.
+ * @return The Trace phases are recorded in, or null.
  */
-void HistogramTool::computePartialHistogram( const QRgb * const imageData, uint32_t firstPixel, uint32_t lastPixel, Histogram& red, Histogram& green, Histogram& blue ) {
+Trace * HistogramTool::trace( ) const {
+    return mTrace;
+}
 
-    for( uint32_t i=firstPixel; i<=lastPixel; i++ ) {
-        QRgb rgb = imageData[i];
 
-        red.increment(   static_cast<size_t>( qRed(rgb) ) );
-        green.increment( static_cast<size_t>( qGreen(rgb) ) );
-        blue.increment(  static_cast<size_t>( qBlue(rgb) ) );
+/**
+ * Record phases of later computeHistogram calls in a Trace, or stop if null.
+ * @param trace The Trace.
+ */
+void HistogramTool::setTrace( Trace * trace ) {
+    mTrace = trace;
+}
+
+
+/**
+ * Pin the workers across the nodes of a topology and count NUMA aware from now on.
+ * Thread 0 is the caller, which isn't pinned, so workers take CPUs from the second in spread order.
+ * @param topology The nodes of the machine.
+ * @return false if some worker couldn't be pinned.
+ */
+bool HistogramTool::setNumaTopology( const NumaTopology& topology ) {
+    std::lock_guard<std::mutex> lock{ mMutex };
+    mTopology.reset( new NumaTopology{ topology } );
+
+    std::vector<uint32_t> spread = topology.spreadCpus();
+    std::vector<uint32_t> workerCpus;
+    mWorkerNodes.clear();
+    for( uint32_t worker = 0; worker < mPool->numWorkers(); ++worker ) {
+        uint32_t cpu = spread[ ( worker + 1 ) % spread.size() ];
+        workerCpus.push_back( cpu );
+        mWorkerNodes.push_back( topology.nodeOfCpu( cpu ) );
     }
+    return workerCpus.empty() || mPool->pinWorkers( workerCpus );
+}
+
+
+/**
+ * @return Whether counts are NUMA aware.
+ */
+bool HistogramTool::numaAware( ) const {
+    return mTopology != nullptr;
+}
+
+
+/**
+ * Work out how many threads it is worth using for an image.
+ * @param numPixels The number of pixels in the image.
+ * @return Between 1 and the configured number of threads.
+ */
+uint32_t HistogramTool::threadsFor( uint64_t numPixels ) const {
+    uint64_t threads = ( mMinPixelsPerThread > 1 ) ? numPixels / mMinPixelsPerThread : numPixels;
+    return static_cast<uint32_t>( std::max<uint64_t>( 1, std::min<uint64_t>( threads, mNumThreads ) ) );
+}
+
+
+/**
+ * @return The number of scanlines in each chunk, or 0 if chosen automatically.
+ */
+uint32_t HistogramTool::chunkRows( ) const {
+    return mChunkRows;
+}
+
+
+/**
+ * Set the number of scanlines in each chunk.
+ * @param rows The number of scanlines, or 0 to size chunks to DEFAULT_CHUNK_BYTES.
+ */
+void HistogramTool::setChunkRows( uint32_t rows ) {
+    mChunkRows = rows;
+}
+
+
+/**
+ * Work out how many scanlines go in each chunk of an image.
+ * @param image The image.
+ * @return At least 1.
+ */
+uint32_t HistogramTool::chunkRowsFor( const ImageView& image ) const {
+    // A chunk is never so large that it could overflow the narrow per-thread counts
+    uint32_t maxRows = std::max<uint32_t>( 1, UINT32_MAX / std::max<uint32_t>( 1, image.width ) );
+    if( mChunkRows > 0 ) {
+        return std::min( mChunkRows, maxRows );
+    }
+
+    size_t bytesPerRow = std::max<size_t>( 1, static_cast<size_t>( image.width ) * ImageView::bytesPerPixel( image.format ) );
+    return static_cast<uint32_t>( std::min<size_t>( maxRows, std::max<size_t>( 1, DEFAULT_CHUNK_BYTES / bytesPerRow ) ) );
+}
+
+
+/**
+ * @return The number of chunks processed by each thread during the last call to computeHistogram.
+ */
+std::vector<uint32_t> HistogramTool::chunksPerThread( ) const {
+    return mChunksPerThread;
+}
+
+
+/**
+ * Compute the histogram for a run of scanlines within the image.
+ * Single byte formats are counted into the red and green counts alternately and expanded when the
+ * counts are flushed by flushCounts().
+ * @param image The image.
+ * @param firstRow The first scanline to consider.
+ * @param numRows The number of scanlines to consider.
+ * @param counts Accumulator into which red, green and blue values will be counted.
+ * @param channels Mask of the channels to count.
+ */
+void HistogramTool::computePartialHistogram( const ImageView& image, uint32_t firstRow, uint32_t numRows, RgbAccumulator& counts,
+                                             uint32_t channels ) const {
+    const size_t width = image.width;
+    uint32_t *red = counts.counts( RgbAccumulator::Red );
+    uint32_t *green = counts.counts( RgbAccumulator::Green );
+    uint32_t *blue = counts.counts( RgbAccumulator::Blue );
+
+    switch( image.format ) {
+        case PixelFormat::ARGB32: {
+            // Rows without padding can be counted in a single run
+            bool contiguous = image.bytesPerLine == static_cast<ptrdiff_t>( width * sizeof( uint32_t ) );
+            uint32_t rowsPerRun = contiguous ? numRows : 1;
+
+            for( uint32_t row = 0; row < numRows; row += rowsPerRun ) {
+                const uint32_t *pixels = reinterpret_cast<const uint32_t *>( image.row( firstRow + row ) );
+                mKernel( pixels, width * rowsPerRun, red, green, blue, channels );
+            }
+            break;
+        }
+
+        case PixelFormat::RGBA8888:
+            for( uint32_t row = 0; row < numRows; ++row ) {
+                countInterleavedRowChannels<0, 1, 2, 4>( channels, image.row( firstRow + row ), width, red, green, blue );
+            }
+            break;
+
+        case PixelFormat::RGB888:
+            for( uint32_t row = 0; row < numRows; ++row ) {
+                countInterleavedRowChannels<0, 1, 2, 3>( channels, image.row( firstRow + row ), width, red, green, blue );
+            }
+            break;
+
+        case PixelFormat::BGR888:
+            for( uint32_t row = 0; row < numRows; ++row ) {
+                countInterleavedRowChannels<2, 1, 0, 3>( channels, image.row( firstRow + row ), width, red, green, blue );
+            }
+            break;
+
+        // One byte per pixel whichever channels are wanted; they are told apart when flushed
+        case PixelFormat::Grayscale8:
+        case PixelFormat::Indexed8:
+            for( uint32_t row = 0; row < numRows; ++row ) {
+                countSingleByteRow( image.row( firstRow + row ), width, red, green );
+            }
+            break;
+    }
+}
+
+
+/**
+ * Add the narrow counts of one thread into its wide counts and reset them.
+ * Counts of single byte formats are turned into red, green and blue counts on the way: on entry the red and
+ * green counts hold alternate pixels' grey levels or colour indices. Grey levels are added to all three
+ * channels. Colour indices are mapped through the colour table; indices beyond the table count as black.
+ * @param image The image being counted.
+ * @param counts The thread's narrow counts.
+ * @param wide The thread's wide counts; red, green then blue, 256 of each.
+ * @param channels Mask of the channels counted. Only their wide counts are added to.
+ */
+void HistogramTool::flushCounts( const ImageView& image, RgbAccumulator& counts, uint64_t * wide, uint32_t channels ) {
+    const uint32_t *red = counts.counts( RgbAccumulator::Red );
+    const uint32_t *green = counts.counts( RgbAccumulator::Green );
+    const uint32_t *blue = counts.counts( RgbAccumulator::Blue );
+    uint64_t *wideRed = wide;
+    uint64_t *wideGreen = wide + 256;
+    uint64_t *wideBlue = wide + 512;
+    const bool hasRed = ( channels & HistogramKernel::Red ) != 0;
+    const bool hasGreen = ( channels & HistogramKernel::Green ) != 0;
+    const bool hasBlue = ( channels & HistogramKernel::Blue ) != 0;
+
+    switch( image.format ) {
+        case PixelFormat::Grayscale8:
+            for( size_t i = 0; i < 256; ++i ) {
+                uint64_t value = static_cast<uint64_t>( red[i] ) + green[i];
+                wideRed[i] += hasRed ? value : 0;
+                wideGreen[i] += hasGreen ? value : 0;
+                wideBlue[i] += hasBlue ? value : 0;
+            }
+            break;
+
+        case PixelFormat::Indexed8:
+            for( size_t i = 0; i < 256; ++i ) {
+                uint64_t value = static_cast<uint64_t>( red[i] ) + green[i];
+                uint32_t colour = ( i < image.colourCount ) ? image.colourTable[i] : 0;
+                wideRed[ ( colour >> 16 ) & 0xFF ] += hasRed ? value : 0;
+                wideGreen[ ( colour >> 8 ) & 0xFF ] += hasGreen ? value : 0;
+                wideBlue[ colour & 0xFF ] += hasBlue ? value : 0;
+            }
+            break;
+
+        default:
+            for( size_t i = 0; i < 256; ++i ) {
+                wideRed[i] += red[i];
+                wideGreen[i] += green[i];
+                wideBlue[i] += blue[i];
+            }
+            break;
+    }
+
+    counts.reset();
 }
 
 
 /**
  * Compute the histogram for the given image.
- * The image is split into multiple blocks and each block is processed by a different thread.
- * Each thread uses its own Histogram and all Histograms are then merged into a single
- * Histogram once all threads have finished executing.
- * @param image The image. Expected to be RGB data.
+ * @param image The image.
+ * @param red The overall Histogram of red values in the image.
+ * @param green The overall Histogram of green values in the image.
+ * @param blue The overall Histogram of blue values in the image.
+ * @param channels Mask of the channels to count.
+ */
+void HistogramTool::computeHistogram( const ImageView& image, Histogram& red, Histogram& green, Histogram& blue, uint32_t channels ) {
+
+    if( red.numBuckets() != 256 || green.numBuckets() != 256 || blue.numBuckets() != 256 ) {
+        throw std::invalid_argument( "Histograms must have 256 buckets" );
+    }
+
+    countInto( image, red, green, blue, channels );
+}
+
+
+/**
+ * Compute the histogram for the given image into FixedHistograms.
+ * @param image The image.
+ * @param red The overall Histogram of red values in the image.
+ * @param green The overall Histogram of green values in the image.
+ * @param blue The overall Histogram of blue values in the image.
+ * @param channels Mask of the channels to count.
+ */
+void HistogramTool::computeHistogram( const ImageView& image, FixedHistogram<256>& red, FixedHistogram<256>& green, FixedHistogram<256>& blue,
+                                      uint32_t channels ) {
+    countInto( image, red, green, blue, channels );
+}
+
+
+/**
+ * Compute the histogram for the given image into FixedHistograms with 64 bit counters.
+ * @param image The image.
+ * @param red The overall Histogram of red values in the image.
+ * @param green The overall Histogram of green values in the image.
+ * @param blue The overall Histogram of blue values in the image.
+ * @param channels Mask of the channels to count.
+ */
+void HistogramTool::computeHistogram( const ImageView& image, FixedHistogram<256, uint64_t>& red, FixedHistogram<256, uint64_t>& green,
+                                      FixedHistogram<256, uint64_t>& blue, uint32_t channels ) {
+    countInto( image, red, green, blue, channels );
+}
+
+
+/*
+ * Add a thread's narrow derived counts into its wide ones and zero them. Nothing to do if none are counted
+ */
+static void flushDerivedCounts( uint32_t * counts, uint64_t * wide ) {
+    if( counts == nullptr ) {
+        return;
+    }
+    for( size_t i = 0; i < DerivedChannels::COUNT * 256; ++i ) {
+        wide[i] += counts[i];
+        counts[i] = 0;
+    }
+}
+
+
+/**
+ * Add 256 wide counts into a histogram.
+ */
+void HistogramTool::addCounts( Histogram& histogram, const uint64_t * counts ) {
+    histogram.addCounts( counts, 256 );
+}
+
+template <typename Counter>
+void HistogramTool::addCounts( FixedHistogram<256, Counter>& histogram, const uint64_t * counts ) {
+    histogram.addCounts( counts );
+}
+
+
+/**
+ * Add the wide counts of the chosen channels into their histograms.
+ * @param channels Mask of the channels counted.
+ * @param red The Histogram of red values.
+ * @param green The Histogram of green values.
+ * @param blue The Histogram of blue values.
+ * @param total 3 * 256 counts; red, green then blue.
+ */
+template <typename H>
+void HistogramTool::addChosenCounts( uint32_t channels, H& red, H& green, H& blue, const uint64_t * total ) {
+    if( channels & HistogramKernel::Red ) {
+        addCounts( red, total );
+    }
+    if( channels & HistogramKernel::Green ) {
+        addCounts( green, total + 256 );
+    }
+    if( channels & HistogramKernel::Blue ) {
+        addCounts( blue, total + 512 );
+    }
+}
+
+
+/**
+ * Count the pixels of an image in chunks across the pool into 64 bit counts.
+ * The image is cut into chunks of chunkRowsFor() scanlines. Threads from the pool repeatedly claim the
+ * next unprocessed chunk, using an atomic counter, until there are none left. A thread which is slow or
+ * descheduled simply processes fewer chunks rather than holding up the others.
+ * Each thread counts into its own RgbAccumulator, flushed into its own wide counts, and all the wide
+ * counts are merged once all chunks are done. Derived channels, if asked for, are counted and flushed
+ * alongside and merged likewise. The caller must hold mMutex.
+ * @param image The image.
+ * @param channels Mask of the channels to count. The counts of the others are 0.
+ * @param derived Mask of derived channels to count as well.
+ * @return The merged counts; red, green then blue.
+ */
+const uint64_t * HistogramTool::countWide( const ImageView& image, uint32_t channels, uint32_t derived ) {
+    if( mTopology && derived == 0 ) {
+        return countWideNuma( image, channels );
+    }
+
+    // Work out how many chunks to carve this into and how many threads to share them between
+    uint64_t numPixels = image.numPixels();
+    uint32_t numRows = image.height;
+    uint32_t rowsPerChunk = chunkRowsFor( image );
+    uint32_t numChunks = static_cast<uint32_t>( ( static_cast<uint64_t>( numRows ) + rowsPerChunk - 1 ) / rowsPerChunk );
+    uint32_t numTasks = std::max<uint32_t>( 1, std::min( threadsFor( numPixels ), numChunks ) );
+    uint64_t pixelsPerChunk = static_cast<uint64_t>( rowsPerChunk ) * image.width;
+
+    RgbAccumulatorArray& accumulators = *mAccumulators;
+    mChunksPerThread.assign( numTasks, 0 );
+    mWideCounts.assign( static_cast<size_t>( numTasks ) * WIDE_COUNTS_PER_THREAD, 0 );
+    if( derived != 0 ) {
+        mDerivedCounts.assign( static_cast<size_t>( numTasks ) * DERIVED_COUNTS_PER_THREAD, 0 );
+        mDerivedWideCounts.assign( static_cast<size_t>( numTasks ) * DERIVED_COUNTS_PER_THREAD, 0 );
+    }
+
+    // Next chunk to be claimed
+    std::atomic<uint32_t> nextChunk{ 0 };
+
+    mPool->run( numTasks, [&]( uint32_t task ) {
+        TraceScope scope{ mTrace, "scan" };
+        RgbAccumulator& counts = accumulators[task];
+        uint64_t *wide = &mWideCounts[ static_cast<size_t>( task ) * WIDE_COUNTS_PER_THREAD ];
+        uint32_t *derivedCounts = ( derived != 0 ) ? &mDerivedCounts[ static_cast<size_t>( task ) * DERIVED_COUNTS_PER_THREAD ] : nullptr;
+        uint64_t *derivedWide = ( derived != 0 ) ? &mDerivedWideCounts[ static_cast<size_t>( task ) * DERIVED_COUNTS_PER_THREAD ] : nullptr;
+        counts.reset();
+
+        // Flush before a bucket of the narrow counts could overflow
+        uint64_t pixelsSinceFlush = 0;
+        uint32_t chunksDone = 0;
+        uint64_t pixelsDone = 0;
+        for( uint32_t chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++ ) {
+            uint32_t firstRow = chunk * rowsPerChunk;
+            uint32_t rows = std::min( rowsPerChunk, numRows - firstRow );
+
+            if( pixelsSinceFlush + pixelsPerChunk > UINT32_MAX ) {
+                flushCounts( image, counts, wide, channels );
+                flushDerivedCounts( derivedCounts, derivedWide );
+                pixelsSinceFlush = 0;
+            }
+            if( derived != 0 ) {
+                countChunkWithDerived( image, firstRow, rows, counts, channels, derived, derivedCounts );
+            } else {
+                computePartialHistogram( image, firstRow, rows, counts, channels );
+            }
+            pixelsSinceFlush += pixelsPerChunk;
+            pixelsDone += static_cast<uint64_t>( rows ) * image.width;
+            chunksDone++;
+        }
+        flushCounts( image, counts, wide, channels );
+        flushDerivedCounts( derivedCounts, derivedWide );
+        mChunksPerThread[task] = chunksDone;
+        scope.setPixels( pixelsDone );
+    } );
+
+    // Merge all outputs into the first thread's counts
+    TraceScope scope{ mTrace, "merge" };
+    uint64_t *total = &mWideCounts[0];
+    for( uint32_t task = 1; task < numTasks; task++ ) {
+        const uint64_t *wide = &mWideCounts[ static_cast<size_t>( task ) * WIDE_COUNTS_PER_THREAD ];
+        for( size_t i = 0; i < WIDE_COUNTS_PER_THREAD; ++i ) {
+            total[i] += wide[i];
+        }
+        if( derived != 0 ) {
+            const uint64_t *derivedWide = &mDerivedWideCounts[ static_cast<size_t>( task ) * DERIVED_COUNTS_PER_THREAD ];
+            for( size_t i = 0; i < DerivedChannels::COUNT * 256; ++i ) {
+                mDerivedWideCounts[i] += derivedWide[i];
+            }
+        }
+    }
+    return total;
+}
+
+
+/*
+ * Count runs of scanlines small enough to stay in L1, each by the RGB kernel and then the derived channels
+ */
+void HistogramTool::countChunkWithDerived( const ImageView& image, uint32_t firstRow, uint32_t numRows, RgbAccumulator& counts,
+                                           uint32_t channels, uint32_t derived, uint32_t * derivedCounts ) const {
+    size_t bytesPerRow = std::max<size_t>( 1, static_cast<size_t>( image.width ) * ImageView::bytesPerPixel( image.format ) );
+    uint32_t rowsPerRun = static_cast<uint32_t>( std::max<size_t>( 1, DERIVED_RUN_BYTES / bytesPerRow ) );
+
+    for( uint32_t row = 0; row < numRows; row += rowsPerRun ) {
+        uint32_t rows = std::min( rowsPerRun, numRows - row );
+        computePartialHistogram( image, firstRow + row, rows, counts, channels );
+        DerivedChannels::countRows( derived, image, firstRow + row, rows, derivedCounts );
+    }
+}
+
+
+/**
+ * Count the pixels of an image NUMA aware into 64 bit counts.
+ * The page holding the first scanline of each chunk is looked up and the chunk queued on that page's node;
+ * chunks whose node is unknown, or has no threads, are shared out between the nodes in proportion to their
+ * threads, in runs so each node reads contiguous memory. Task i runs on worker i - 1, so each task knows its
+ * node. Tasks claim chunks from their node's queue with an atomic counter and, when it is empty, from the
+ * other nodes' queues in turn.
+ * Each task zeroes and keeps its wide counts on their own pages, so the first call places them on its node.
+ * Tasks are then ranked by node and merged in a combining tree: at each level the second of a pair of tasks
+ * to finish adds the other's counts into the lower ranked one's and carries on up, while the first stops.
+ * The caller must hold mMutex.
+ * @param image The image.
+ * @param channels Mask of the channels to count.
+ * @return The merged counts; red, green then blue.
+ */
+const uint64_t * HistogramTool::countWideNuma( const ImageView& image, uint32_t channels ) {
+    const NumaTopology& topology = *mTopology;
+    uint32_t numNodes = topology.numNodes();
+
+    uint64_t numPixels = image.numPixels();
+    uint32_t numRows = image.height;
+    uint32_t rowsPerChunk = chunkRowsFor( image );
+    uint32_t numChunks = static_cast<uint32_t>( ( static_cast<uint64_t>( numRows ) + rowsPerChunk - 1 ) / rowsPerChunk );
+    uint32_t numTasks = std::max<uint32_t>( 1, std::min( threadsFor( numPixels ), numChunks ) );
+    uint64_t pixelsPerChunk = static_cast<uint64_t>( rowsPerChunk ) * image.width;
+
+    // Node of each task; the caller's is wherever it is running now
+    std::vector<uint32_t> taskNodes( numTasks );
+    std::vector<uint32_t> tasksOnNode( numNodes, 0 );
+    for( uint32_t task = 0; task < numTasks; ++task ) {
+        taskNodes[task] = ( task == 0 ) ? topology.nodeOfCpu( NumaTopology::currentCpu() ) : mWorkerNodes[task - 1];
+        tasksOnNode[ taskNodes[task] ]++;
+    }
+
+    // Home node of each chunk, or numNodes if unknown or a node without tasks
+    std::vector<const void *> firstPages( numChunks );
+    for( uint32_t chunk = 0; chunk < numChunks; ++chunk ) {
+        firstPages[chunk] = image.data + static_cast<ptrdiff_t>( chunk ) * rowsPerChunk * image.bytesPerLine;
+    }
+    std::vector<int> pageNodes;
+    std::vector<uint32_t> homes( numChunks, numNodes );
+    if( numNodes > 1 && NumaTopology::nodesOfPages( firstPages, pageNodes ) ) {
+        for( uint32_t chunk = 0; chunk < numChunks; ++chunk ) {
+            uint32_t node = topology.nodeFromSystem( pageNodes[chunk] );
+            homes[chunk] = ( node < numNodes && tasksOnNode[node] > 0 ) ? node : numNodes;
+        }
+    }
+    uint32_t numHomeless = static_cast<uint32_t>( std::count( homes.begin(), homes.end(), numNodes ) );
+    uint32_t homeless = 0;
+    for( uint32_t chunk = 0; chunk < numChunks; ++chunk ) {
+        if( homes[chunk] == numNodes ) {
+            // Runs of homeless chunks in proportion to each node's tasks
+            uint64_t share = static_cast<uint64_t>( homeless++ ) * numTasks / numHomeless;
+            uint32_t node = 0;
+            for( uint64_t tasksBefore = tasksOnNode[0]; tasksBefore <= share; tasksBefore += tasksOnNode[++node] ) {
+            }
+            homes[chunk] = node;
+        }
+    }
+
+    // Each node's queue of chunks, in order, one after another
+    std::vector<uint32_t> queueStart( numNodes + 1, 0 );
+    for( uint32_t home : homes ) {
+        queueStart[home + 1]++;
+    }
+    for( uint32_t node = 0; node < numNodes; ++node ) {
+        queueStart[node + 1] += queueStart[node];
+    }
+    std::vector<uint32_t> queues( numChunks );
+    std::vector<uint32_t> filled( queueStart.begin(), queueStart.end() - 1 );
+    for( uint32_t chunk = 0; chunk < numChunks; ++chunk ) {
+        queues[ filled[ homes[chunk] ]++ ] = chunk;
+    }
+    std::unique_ptr<std::atomic<uint32_t>[]> nextInQueue{ new std::atomic<uint32_t>[numNodes] };
+    for( uint32_t node = 0; node < numNodes; ++node ) {
+        nextInQueue[node] = queueStart[node];
+    }
+
+    // Wide counts on pages of their own
+    if( mNumaThreads < numTasks ) {
+        const size_t pageCounts = 4096 / sizeof( uint64_t );
+        mNumaStorage.reset( new uint64_t[ static_cast<size_t>( mNumThreads ) * NUMA_COUNTS_PER_THREAD + pageCounts ] );
+        uintptr_t address = reinterpret_cast<uintptr_t>( mNumaStorage.get() );
+        mNumaCounts = reinterpret_cast<uint64_t *>( ( address + 4095 ) & ~static_cast<uintptr_t>( 4095 ) );
+        mNumaThreads = mNumThreads;
+    }
+
+    // Rank of each task, tasks on the same node together, and a flag for each pair in the merge tree
+    std::vector<uint32_t> ranked( numTasks ), rankOf( numTasks );
+    for( uint32_t task = 0; task < numTasks; ++task ) {
+        ranked[task] = task;
+    }
+    std::stable_sort( ranked.begin(), ranked.end(), [&taskNodes]( uint32_t a, uint32_t b ) {
+        return taskNodes[a] < taskNodes[b];
+    } );
+    for( uint32_t rank = 0; rank < numTasks; ++rank ) {
+        rankOf[ ranked[rank] ] = rank;
+    }
+    uint32_t numLevels = 0;
+    while( ( 1u << numLevels ) < numTasks ) {
+        numLevels++;
+    }
+    std::unique_ptr<std::atomic<bool>[]> arrived{ new std::atomic<bool>[ static_cast<size_t>( numTasks ) * std::max<uint32_t>( 1, numLevels ) ] };
+    for( size_t i = 0; i < static_cast<size_t>( numTasks ) * std::max<uint32_t>( 1, numLevels ); ++i ) {
+        arrived[i] = false;
+    }
+
+    RgbAccumulatorArray& accumulators = *mAccumulators;
+    mChunksPerThread.assign( numTasks, 0 );
+
+    mPool->runPlaced( numTasks, [&]( uint32_t task ) {
+        uint64_t *wide = mNumaCounts + static_cast<size_t>( task ) * NUMA_COUNTS_PER_THREAD;
+        {
+            TraceScope scope{ mTrace, "scan" };
+            RgbAccumulator& counts = accumulators[task];
+            std::fill( wide, wide + WIDE_COUNTS_PER_THREAD, 0 );
+            counts.reset();
+
+            // Own node's queue first, then the others in turn
+            uint64_t pixelsSinceFlush = 0;
+            uint32_t chunksDone = 0;
+            uint64_t pixelsDone = 0;
+            for( uint32_t i = 0; i < numNodes; ++i ) {
+                uint32_t node = ( taskNodes[task] + i ) % numNodes;
+                for( uint32_t next = nextInQueue[node]++; next < queueStart[node + 1]; next = nextInQueue[node]++ ) {
+                    uint32_t firstRow = queues[next] * rowsPerChunk;
+                    uint32_t rows = std::min( rowsPerChunk, numRows - firstRow );
+
+                    if( pixelsSinceFlush + pixelsPerChunk > UINT32_MAX ) {
+                        flushCounts( image, counts, wide, channels );
+                        pixelsSinceFlush = 0;
+                    }
+                    computePartialHistogram( image, firstRow, rows, counts, channels );
+                    pixelsSinceFlush += pixelsPerChunk;
+                    pixelsDone += static_cast<uint64_t>( rows ) * image.width;
+                    chunksDone++;
+                }
+            }
+            flushCounts( image, counts, wide, channels );
+            mChunksPerThread[task] = chunksDone;
+            scope.setPixels( pixelsDone );
+        }
+
+        // Combine up the tree until another task is still to finish a pair this one is in
+        TraceScope scope{ mTrace, "merge" };
+        uint32_t rank = rankOf[task];
+        for( uint32_t level = 0; level < numLevels; ++level ) {
+            uint32_t span = 1u << level;
+            uint32_t lower = rank & ~( 2 * span - 1 );
+            uint32_t upper = lower + span;
+            if( upper >= numTasks ) {
+                continue;
+            }
+            if( ! arrived[ static_cast<size_t>( lower ) * numLevels + level ].exchange( true, std::memory_order_acq_rel ) ) {
+                return;
+            }
+
+            uint64_t *into = mNumaCounts + static_cast<size_t>( ranked[lower] ) * NUMA_COUNTS_PER_THREAD;
+            const uint64_t *from = mNumaCounts + static_cast<size_t>( ranked[upper] ) * NUMA_COUNTS_PER_THREAD;
+            for( size_t i = 0; i < WIDE_COUNTS_PER_THREAD; ++i ) {
+                into[i] += from[i];
+            }
+            rank = lower;
+        }
+    } );
+
+    return mNumaCounts + static_cast<size_t>( ranked[0] ) * NUMA_COUNTS_PER_THREAD;
+}
+
+
+/**
+ * Count the pixels of an image across the pool and add them to the given histograms.
+ * @param image The image.
  * @param red The overall Histogram of red values in the image.
  * @param green The overall Histogram of green values in the image.
  * @param blue The overall Histogram of blue values in the image.
+ * @param channels Mask of the channels to count. The histograms of the others are untouched.
  */
-void HistogramTool::computeHistogram( const QImage& image, Histogram& red, Histogram& green, Histogram& blue) {
+template <typename H>
+void HistogramTool::countInto( const ImageView& image, H& red, H& green, H& blue, uint32_t channels ) {
+    checkView( image );
+    HistogramKernel::checkChannels( channels );
+    std::lock_guard<std::mutex> lock{ mMutex };
+    const uint64_t *total = countWide( image, channels );
+    addChosenCounts( channels, red, green, blue, total );
+}
 
-    // Work out how many blocks to carve this into
-    uint32_t numPixels = static_cast<uint32_t>( image.width() * image.height() );
-    uint32_t blockSize = numPixels / mNumThreads;
 
-    // Get reference to data
-    const QRgb* const imageData = reinterpret_cast<const QRgb * const> ( image.constBits() );
+/**
+ * Count the pixels of an image and its derived channels across the pool and add them to the given histograms.
+ * @param image The image.
+ * @param red The overall Histogram of red values in the image.
+ * @param green The overall Histogram of green values in the image.
+ * @param blue The overall Histogram of blue values in the image.
+ * @param derived Histograms of the derived channels.
+ * @param channels Mask of the channels to count.
+ */
+void HistogramTool::computeHistogram( const ImageView& image, Histogram& red, Histogram& green, Histogram& blue, DerivedHistograms& derived,
+                                      uint32_t channels ) {
+    if( red.numBuckets() != 256 || green.numBuckets() != 256 || blue.numBuckets() != 256 ) {
+        throw std::invalid_argument( "Histograms must have 256 buckets" );
+    }
+
+    checkView( image );
+    HistogramKernel::checkChannels( channels );
+    std::lock_guard<std::mutex> lock{ mMutex };
+    const uint64_t *total = countWide( image, channels, derived.channels() );
+    addChosenCounts( channels, red, green, blue, total );
+    if( derived.channels() != 0 ) {
+        derived.addCounts( &mDerivedWideCounts[0] );
+    }
+}
+
+
+/**
+ * Split rectangles into disjoint rectangles covering the same pixels.
+ * Each rectangle in turn has the rectangles already kept cut out of it; what is left of it, at most four
+ * pieces per cut, is kept too.
+ * @param rects The rectangles.
+ * @return The disjoint rectangles.
+ */
+std::vector<Rect> HistogramTool::disjointRects( const std::vector<Rect>& rects ) {
+    std::vector<Rect> kept;
 
-    // Allocate Histogram storage per thread
-    Histogram *redHistograms = new Histogram[ mNumThreads];
-    Histogram *greenHistograms = new Histogram[ mNumThreads];
-    Histogram *blueHistograms = new Histogram[ mNumThreads];
+    for( const Rect& rect : rects ) {
+        std::vector<Rect> pieces;
+        if( rect.width > 0 && rect.height > 0 ) {
+            pieces.push_back( rect );
+        }
 
-    // Launch a thread per block
-    std::thread*  threads = new std::thread[ mNumThreads ];
+        for( size_t k = 0; k < kept.size() && ! pieces.empty(); ++k ) {
+            const Rect& cut = kept[k];
+            uint64_t cutRight = static_cast<uint64_t>( cut.x ) + cut.width;
+            uint64_t cutBottom = static_cast<uint64_t>( cut.y ) + cut.height;
 
-    uint32_t firstPixel = 0;
+            std::vector<Rect> remaining;
+            for( const Rect& piece : pieces ) {
+                uint64_t right = static_cast<uint64_t>( piece.x ) + piece.width;
+                uint64_t bottom = static_cast<uint64_t>( piece.y ) + piece.height;
 
-    for( uint32_t tIndex=0; tIndex<mNumThreads; tIndex++ ) {
-        uint32_t lastPixel = firstPixel + blockSize - 1;
+                if( cut.x >= right || piece.x >= cutRight || cut.y >= bottom || piece.y >= cutBottom ) {
+                    remaining.push_back( piece );
+                    continue;
+                }
 
-        // Fix for final block in case image cannot be neatly divided into equal blocks
-        if( tIndex == mNumThreads - 1 ) {
-            lastPixel = numPixels - 1;
+                // The rows above and below the cut, then the parts of the rows beside it
+                uint32_t top = std::max( piece.y, cut.y );
+                uint32_t lower = static_cast<uint32_t>( std::min( bottom, cutBottom ) );
+                if( piece.y < cut.y ) {
+                    remaining.push_back( Rect{ piece.x, piece.y, piece.width, cut.y - piece.y } );
+                }
+                if( bottom > cutBottom ) {
+                    remaining.push_back( Rect{ piece.x, lower, piece.width, static_cast<uint32_t>( bottom - cutBottom ) } );
+                }
+                if( piece.x < cut.x ) {
+                    remaining.push_back( Rect{ piece.x, top, cut.x - piece.x, lower - top } );
+                }
+                if( right > cutRight ) {
+                    remaining.push_back( Rect{ static_cast<uint32_t>( cutRight ), top, static_cast<uint32_t>( right - cutRight ), lower - top } );
+                }
+            }
+            pieces.swap( remaining );
         }
 
-        Histogram& r = redHistograms[tIndex];
-        Histogram& g = greenHistograms[tIndex];
-        Histogram& b = blueHistograms[tIndex];
+        kept.insert( kept.end(), pieces.begin(), pieces.end() );
+    }
+    return kept;
+}
+
+
+/**
+ * Start counting a view in the background.
+ * @param image The view.
+ * @param callback Called when the job finishes, or empty.
+ * @return The job.
+ */
+std::shared_ptr<HistogramJob> HistogramTool::computeHistogramAsync( const ImageView& image, HistogramJob::Callback callback ) {
+    checkView( image );
+    std::shared_ptr<HistogramJob> job{ new HistogramJob };
+    job->mView = image;
+    startJob( job, std::move( callback ) );
+    return job;
+}
 
-        // Kick off a new thread. Capture pixel indices and 'this' by copying, r, g and b by reference
-        threads[tIndex] = std::thread{ [firstPixel, lastPixel, this, &imageData, &r, &g, &b]{ computePartialHistogram(imageData, firstPixel, lastPixel, r, g, b); } };
 
-        // Next block
-        firstPixel += blockSize;
+/**
+ * Cut a job into chunks as countWide does and post a task for each thread it is worth, each claiming chunks
+ * until none are left. The last task to finish completes the job.
+ * @param job The job, its view set.
+ * @param callback Called when the job finishes, or empty.
+ */
+void HistogramTool::startJob( const std::shared_ptr<HistogramJob>& job, HistogramJob::Callback callback ) {
+    const ImageView& image = job->mView;
+    job->mRowsPerChunk = chunkRowsFor( image );
+    job->mNumChunks = static_cast<uint32_t>( ( static_cast<uint64_t>( image.height ) + job->mRowsPerChunk - 1 ) / job->mRowsPerChunk );
+    job->mCallback = std::move( callback );
+
+    std::lock_guard<std::mutex> lock{ mJobsMutex };
+    WorkerPool *pool = mPool.get();
+    if( pool->numWorkers() == 0 ) {
+        if( ! mJobPool ) {
+            mJobPool.reset( new WorkerPool{ 1 } );
+        }
+        pool = mJobPool.get();
+    }
+
+    uint32_t numTasks = std::max<uint32_t>( 1, std::min( { threadsFor( image.numPixels() ), job->mNumChunks, pool->numWorkers() } ) );
+    job->mNumTasks = numTasks;
+    job->mTasksLeft = numTasks;
+    job->mAccumulators.reset( new RgbAccumulatorArray{ numTasks } );
+    job->mWideCounts.assign( static_cast<size_t>( numTasks ) * WIDE_COUNTS_PER_THREAD, 0 );
+
+    mJobs.erase( std::remove_if( mJobs.begin(), mJobs.end(), []( const std::weak_ptr<HistogramJob>& j ){ return j.expired(); } ), mJobs.end() );
+    mJobs.push_back( job );
+
+    for( uint32_t task = 0; task < numTasks; ++task ) {
+        pool->post( [this, job, task]{
+            std::string error;
+            try {
+                countJobChunks( *job, task );
+            } catch( const std::exception& e ) {
+                error = std::string{ "Counting failed: " } + e.what();
+            } catch( ... ) {
+                error = "Counting failed";
+            }
+            job->taskFinished( error );
+        } );
+    }
+}
+
+
+/**
+ * Claim and count chunks of a job until there are none left or it is cancelled, then flush into the task's
+ * wide counts. Progress is published after each chunk.
+ * @param job The job.
+ * @param task The index of the task within the job.
+ */
+void HistogramTool::countJobChunks( HistogramJob& job, uint32_t task ) const {
+    TraceScope scope{ mTrace, "scan" };
+    const ImageView& image = job.mView;
+    RgbAccumulator& counts = ( *job.mAccumulators )[task];
+    uint64_t *wide = &job.mWideCounts[ static_cast<size_t>( task ) * WIDE_COUNTS_PER_THREAD ];
+    uint64_t pixelsPerChunk = static_cast<uint64_t>( job.mRowsPerChunk ) * image.width;
+    counts.reset();
+
+    uint64_t pixelsSinceFlush = 0;
+    uint64_t pixelsDone = 0;
+    while( ! job.mCancelled.load( std::memory_order_relaxed ) ) {
+        uint32_t chunk = job.mNextChunk++;
+        if( chunk >= job.mNumChunks ) {
+            break;
+        }
+        uint32_t firstRow = chunk * job.mRowsPerChunk;
+        uint32_t rows = std::min( job.mRowsPerChunk, image.height - firstRow );
+
+        if( pixelsSinceFlush + pixelsPerChunk > UINT32_MAX ) {
+            flushCounts( image, counts, wide );
+            pixelsSinceFlush = 0;
+        }
+        computePartialHistogram( image, firstRow, rows, counts );
+        pixelsSinceFlush += pixelsPerChunk;
+        pixelsDone += static_cast<uint64_t>( rows ) * image.width;
+        job.mPixelsDone += static_cast<uint64_t>( rows ) * image.width;
     }
+    flushCounts( image, counts, wide );
+    scope.setPixels( pixelsDone );
+}
+
 
-    // Wait for all threads to finish execution
-    for( uint32_t tIndex=0; tIndex<mNumThreads; ++tIndex ) {
-        threads[tIndex].join();
+/**
+ * Update the histograms of an image after some regions of it have changed.
+ * Both the old and new pixels of the disjoint dirty rectangles are counted across the pool. The previous
+ * histograms are checked to hold the old counts before anything is changed.
+ * @param oldImage The image the histograms were computed from.
+ * @param newImage The changed image.
+ * @param dirtyRects The rectangles which may have changed.
+ * @param red The Histogram of red values, updated.
+ * @param green The Histogram of green values, updated.
+ * @param blue The Histogram of blue values, updated.
+ * @param verify If true, compare the result with a full recount.
+ * @return false if verification failed.
+ */
+bool HistogramTool::updateHistogram( const ImageView& oldImage, const ImageView& newImage, const std::vector<Rect>& dirtyRects,
+                                     Histogram& red, Histogram& green, Histogram& blue, bool verify ) {
+    if( red.numBuckets() != 256 || green.numBuckets() != 256 || blue.numBuckets() != 256 ) {
+        throw std::invalid_argument( "Histograms must have 256 buckets" );
+    }
+    if( oldImage.width != newImage.width || oldImage.height != newImage.height ) {
+        throw std::invalid_argument( "Old and new images must be the same size" );
+    }
+    checkView( oldImage );
+    checkView( newImage );
+    for( const Rect& rect : dirtyRects ) {
+        if( ! newImage.contains( rect ) ) {
+            throw std::invalid_argument( "Dirty rectangles must lie within the image" );
+        }
     }
 
-    // Merge all outputs into provided Histograms
-    for( uint32_t tIndex = 0; tIndex< mNumThreads; tIndex++ ) {
+    std::vector<uint64_t> removed( WIDE_COUNTS_PER_THREAD, 0 );
+    std::vector<uint64_t> added( WIDE_COUNTS_PER_THREAD, 0 );
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        for( const Rect& rect : disjointRects( dirtyRects ) ) {
+            const uint64_t *counts = countWide( oldImage.subView( rect ) );
+            for( size_t i = 0; i < WIDE_COUNTS_PER_THREAD; ++i ) {
+                removed[i] += counts[i];
+            }
+            counts = countWide( newImage.subView( rect ) );
+            for( size_t i = 0; i < WIDE_COUNTS_PER_THREAD; ++i ) {
+                added[i] += counts[i];
+            }
+        }
+    }
 
-        red += redHistograms[tIndex];
-        green += greenHistograms[tIndex];
-        blue += blueHistograms[tIndex];
+    // Histograms which don't hold the old pixels weren't computed from oldImage
+    Histogram *histograms[] = { &red, &green, &blue };
+    for( size_t channel = 0; channel < 3; ++channel ) {
+        for( size_t i = 0; i < 256; ++i ) {
+            if( removed[channel * 256 + i] > ( *histograms[channel] )[i] + added[channel * 256 + i] ) {
+                throw std::invalid_argument( "Histograms don't hold the old pixels" );
+            }
+        }
+    }
+    for( size_t channel = 0; channel < 3; ++channel ) {
+        histograms[channel]->addCounts( &added[channel * 256], 256 );
+        histograms[channel]->subtractCounts( &removed[channel * 256], 256 );
     }
 
+    if( ! verify ) {
+        return true;
+    }
 
-    // And free memory
-    delete[] redHistograms;
-    delete[] greenHistograms;
-    delete[] blueHistograms;
-    delete[] threads;
+    Histogram fullRed, fullGreen, fullBlue;
+    computeHistogram( newImage, fullRed, fullGreen, fullBlue );
+    bool matches = true;
+    for( size_t i = 0; i < 256; ++i ) {
+        matches = matches && red[i] == fullRed[i] && green[i] == fullGreen[i] && blue[i] == fullBlue[i];
+    }
+    if( ! matches ) {
+        red = fullRed;
+        green = fullGreen;
+        blue = fullBlue;
+    }
+    return matches;
 }
@@ -3,16 +3,74 @@
 
 #include <vector>
 #include <thread>
+#include <memory>
+#include <mutex>
+#include "derived_channels.h"
 #include "histogram.h"
+#include "histogram_job.h"
+#include "histogram_kernel.h"
+#include "image_view.h"
+#include "numa_topology.h"
+#include "rgb_accumulator.h"
+#include "trace.h"
+#include "worker_pool.h"
+
+class QImage;
 
 /**
  * HistogramTool.
  *
  * Process an image and extract the RGB histograms from it.
  * On construction, specify the number of threads to use to process images. The image data is
- * divided into blocks and partial histograms computed for each part on separate threads.
+ * divided into chunks of whole scanlines and partial histograms computed on separate threads.
+ * Chunks are handed out dynamically: each thread claims the next unprocessed chunk when it finishes
+ * its last, so a thread which is preempted doesn't stall the whole image. The number of chunks each
+ * thread processed is available from chunksPerThread() to show how evenly the work was spread.
+ *
+ * The threads are started once, when the tool is built, and kept in a WorkerPool which is reused by
+ * every call to computeHistogram. The calling thread processes chunks too. Small images use fewer threads,
+ * down to just the calling thread, so that each thread has at least minPixelsPerThread() pixels and waking
+ * a worker is worth its while.
+ *
+ * Each thread counts into its own RgbAccumulator. The accumulators are allocated once and reused.
+ * Their 32 bit counts are flushed into 64 bit per-thread counts before they could overflow, and at the end,
+ * so images of more than 4 billion pixels are counted correctly. The 64 bit counts are merged together
+ * once all chunks are done and only then added to the resulting histograms.
+ *
+ * A HistogramTool may be shared between threads but computeHistogram calls are serialised.
+ *
+ * The pixels are counted by a HistogramKernel. By default the fastest kernel the CPU supports is used.
+ * Images which aren't 32 bits per pixel but have a simple byte layout are counted in their own format
+ * rather than being converted first. A caller needing only some of red, green and blue passes a mask of
+ * HistogramKernel::Channels; the kernels and byte layout loops are specialised for each mask, so channels
+ * not asked for aren't unpacked, counted, flushed or merged.
  *
- * The resulting histograms are merged together once all threads have exited.
+ * The core counts an ImageView: a pointer, width, height, distance between scanlines and pixel layout, so
+ * pixels held in any buffer are counted in place, padded scanlines and subViews of a larger image included.
+ * It needs nothing from Qt. The QImage overloads are a thin adapter in a translation unit of their own,
+ * histogram_tool_qimage.cpp, which describes a QImage's pixels with viewOf(), so a program counting only
+ * its own buffers needs neither Qt's headers nor its libraries.
+ *
+ * Given a NumaTopology the tool becomes NUMA aware. Workers are pinned to CPUs spread over the nodes. Each
+ * chunk is queued on the node holding its first page, and threads take chunks from their own node's queue
+ * before helping other nodes. Each thread's counts live on pages it touched first, so on its own node. The
+ * counts are then merged in a tree: as each thread finishes it merges with its neighbour, threads being
+ * ordered by node, so counts are combined within each node before across nodes and no thread merges more
+ * than log2 of the number of threads. Counting is otherwise the same.
+ *
+ * computeHistogramAsync counts an image in the background and returns a HistogramJob at once. Its chunks are
+ * claimed by tasks posted to the same workers, so many images can be in flight without starting threads, and
+ * they interleave with computeHistogram calls rather than waiting for them. A tool built with one thread has
+ * no workers, so it starts one the first time it is asked for a job. Jobs are not NUMA aware. Destroying the
+ * tool cancels the jobs still running and waits for them.
+ *
+ * Derived channels such as luma or hue can be counted alongside red, green and blue by passing DerivedHistograms.
+ * They are counted in the same pass: each chunk is counted a few scanlines at a time, the RGB kernel then the
+ * derived channels' loops, so the pixels are read from memory once and the second read comes from L1 cache. Such
+ * counts aren't NUMA aware; a NUMA aware tool counts them as if it weren't.
+ *
+ * If given a Trace, each thread's share of an image is recorded as a "scan" span with the pixels it counted,
+ * the merge of the threads' counts as "merge" and any conversion of a QImage as "convert".
  */
 
 class HistogramTool {
@@ -20,16 +78,150 @@ private:
     // Number of threads to use
     uint32_t        mNumThreads;
 
+    // Kernel used to count pixels
+    HistogramKernel mKernel;
+
+    // Fewest pixels worth handing to a thread
+    uint32_t        mMinPixelsPerThread;
+
+    // Scanlines per chunk. 0 to size chunks automatically
+    uint32_t        mChunkRows;
+
+    // Chunks processed by each thread in the last computeHistogram call
+    std::vector<uint32_t>   mChunksPerThread;
+
+    // Long lived worker threads. One fewer than mNumThreads as the caller does a share of the work
+    std::unique_ptr<WorkerPool>             mPool;
+
+    // Scratch counts for each block, reused between calls
+    std::unique_ptr<RgbAccumulatorArray>    mAccumulators;
+
+    // 64 bit counts for each block, into which the 32 bit scratch counts are flushed
+    std::vector<uint64_t>   mWideCounts;
+
+    // Number of wide counts for each block
+    static const size_t WIDE_COUNTS_PER_THREAD = 3 * 256;
+
+    // Scratch counts of derived channels for each block, when asked for
+    std::vector<uint32_t>   mDerivedCounts;
+
+    // 64 bit counts of derived channels for each block, into which mDerivedCounts are flushed
+    std::vector<uint64_t>   mDerivedWideCounts;
+
+    // Spacing of each block's derived counts, padded so threads' counts don't share cache lines
+    static const size_t DERIVED_COUNTS_PER_THREAD = DerivedChannels::COUNT * 256 + 16;
+
+    // Bytes of scanlines counted by the RGB kernel before the derived channels are counted from them
+    static const size_t DERIVED_RUN_BYTES = 16 * 1024;
+
+    // Serialises use of the pool and the scratch counts
+    std::mutex      mMutex;
+
+    // Trace to record phases in, or null
+    Trace *         mTrace;
+
+    // Nodes of the machine when NUMA aware, otherwise null
+    std::unique_ptr<NumaTopology>   mTopology;
+
+    // Node each worker is pinned to when NUMA aware
+    std::vector<uint32_t>   mWorkerNodes;
+
+    // Storage for each thread's wide counts when NUMA aware, with slack to align them to pages
+    std::unique_ptr<uint64_t[]>     mNumaStorage;
+
+    // Each thread's wide counts when NUMA aware, NUMA_COUNTS_PER_THREAD apart
+    uint64_t *      mNumaCounts;
+
+    // Number of threads mNumaCounts has room for
+    uint32_t        mNumaThreads;
+
+    // Spacing of the wide counts of each thread when NUMA aware; whole pages so each thread touches its own
+    static const size_t NUMA_COUNTS_PER_THREAD = 1024;
+
+    // Worker for background jobs when the tool has no workers of its own, or null
+    std::unique_ptr<WorkerPool>     mJobPool;
+
+    // Jobs started, some perhaps finished, so the destructor can cancel those left
+    std::vector<std::weak_ptr<HistogramJob>>    mJobs;
+
+    // Guards mJobPool and mJobs
+    std::mutex      mJobsMutex;
+
+    /**
+     * Add 256 wide counts into a histogram.
+     */
+    static void addCounts( Histogram& histogram, const uint64_t * counts );
+
+    template <typename Counter>
+    static void addCounts( FixedHistogram<256, Counter>& histogram, const uint64_t * counts );
+
     /**
-     * Compute the histogram for a given block of pixels within the image.
-     * @param imageData The entire image data.
-     * @param firstPixel The offset of the first pixel in the block to consider.
-     * @param lastPixel The offset of the last pixel in the block to consider.
-     * @param red Histogram into which red values will be stored.
-     * @param green Histogram into whihc green values will be stored.
-     * @param blue Histogram into whihc blue values will be stored.
+     * Add the wide counts of the chosen channels into their histograms, leaving the others untouched.
      */
-    void computePartialHistogram( const QRgb * const imageData, uint32_t firstPixel, uint32_t lastPixel, Histogram& red, Histogram& green, Histogram& blue );
+    template <typename H>
+    static void addChosenCounts( uint32_t channels, H& red, H& green, H& blue, const uint64_t * total );
+
+    /**
+     * Count the pixels described by a view across the pool into 64 bit counts. The caller must hold mMutex.
+     * @param image The view.
+     * @param channels Mask of the HistogramKernel::Channels to count. The counts of the others are 0.
+     * @param derived Mask of derived channels to count as well. Their counts are left at the start of
+     * mDerivedWideCounts, DerivedChannels::COUNT * 256 of them. Not NUMA aware if any are asked for.
+     * @return 3 * 256 counts; red, green then blue. Valid until the next call.
+     */
+    const uint64_t * countWide( const ImageView& image, uint32_t channels = HistogramKernel::AllChannels, uint32_t derived = 0 );
+
+    /**
+     * Count a chunk's red, green and blue and its derived channels a run of scanlines at a time, so the
+     * derived channels read pixels the kernel has just brought into L1 cache.
+     * @param image The view.
+     * @param firstRow The first scanline of the chunk.
+     * @param numRows The number of scanlines in the chunk.
+     * @param counts Accumulator into which red, green and blue values will be counted.
+     * @param channels Mask of the HistogramKernel::Channels to count.
+     * @param derived Mask of the derived channels to count.
+     * @param derivedCounts DerivedChannels::COUNT * 256 narrow counts for the derived channels.
+     */
+    void countChunkWithDerived( const ImageView& image, uint32_t firstRow, uint32_t numRows, RgbAccumulator& counts,
+                                uint32_t channels, uint32_t derived, uint32_t * derivedCounts ) const;
+
+    /**
+     * Count the pixels described by a view into 64 bit counts, placing chunks on the node holding them and
+     * merging in a tree. The caller must hold mMutex.
+     * @param image The image.
+     * @param channels Mask of the HistogramKernel::Channels to count.
+     * @return The merged counts; red, green then blue.
+     */
+    const uint64_t * countWideNuma( const ImageView& image, uint32_t channels );
+
+    /**
+     * Split rectangles into rectangles which don't overlap but cover the same pixels. Empty rectangles are dropped.
+     * @param rects The rectangles.
+     * @return The disjoint rectangles.
+     */
+    static std::vector<Rect> disjointRects( const std::vector<Rect>& rects );
+
+    /**
+     * Count the pixels described by a view and add them to the given histograms.
+     * @tparam H Histogram or FixedHistogram<256>.
+     * @throws std::invalid_argument if the view isn't valid or the mask of channels is.
+     */
+    template <typename H>
+    void countInto( const ImageView& image, H& red, H& green, H& blue, uint32_t channels );
+
+    /**
+     * Split a job into chunks and post its tasks.
+     * @param job The job, its view set.
+     * @param callback Called when the job finishes, or empty.
+     */
+    void startJob( const std::shared_ptr<HistogramJob>& job, HistogramJob::Callback callback );
+
+    /**
+     * Count chunks of a job until none are left or it is cancelled.
+     * @param job The job.
+     * @param task The index of the task within the job.
+     */
+    void countJobChunks( HistogramJob& job, uint32_t task ) const;
 
 public:
     /**
@@ -37,20 +229,278 @@ public:
      * @param numThreads The number of threads to use to compute the histogram.
      * The input image data is divided into blocks and each thread handles a block
      * So long as there are multiple cores, each thread will run on its own core. Defaults to 1 thread.
+     * The calling thread counts as one of these; numThreads - 1 workers are started.
+     * @param kernel The kernel used to count pixels. Defaults to the fastest supported by the CPU.
+     * @throws std::invalid_argument if numThreads is 0 or the CPU does not support the requested kernel.
+     */
+    HistogramTool( uint32_t threadsToUse = 1, KernelType kernel = KernelType::Auto );
+
+    /**
+     * Cancels the jobs still running and waits for them.
      */
-    HistogramTool( uint32_t threadsToUse = 1 );
+    ~HistogramTool( );
+
+    HistogramTool( const HistogramTool& ) = delete;
+    HistogramTool& operator=( const HistogramTool& ) = delete;
+
+    /**
+     * @return The number of threads used to compute a histogram, including the caller.
+     */
+    uint32_t numThreads( ) const;
+
+    /**
+     * Describe the pixels of a QImage if they are in a format which can be counted directly.
+     * The colour table of an Indexed8 image is not filled in.
+     * @param image The image.
+     * @param view Set to a view of the image's pixels.
+     * @return true if the image's format has a specialised kernel, false if it must be converted.
+     */
+    static bool viewOf( const QImage& image, ImageView& view );
+
+    /**
+     * Compute the histogram for a run of scanlines within the image on the calling thread.
+     * Safe to call from several threads at once with different accumulators. Single byte formats are
+     * counted into the red and green counts alternately; pass the counts through flushCounts() to get
+     * red, green and blue counts. A run must have fewer than 2^32 pixels or the counts may overflow.
+     * @param image The image.
+     * @param firstRow The first scanline to consider.
+     * @param numRows The number of scanlines to consider.
+     * @param counts Accumulator into which red, green and blue values will be counted.
+     * @param channels Mask of the HistogramKernel::Channels to count. The counts of the others are untouched,
+     * except that single byte formats are counted whatever the mask.
+     */
+    void computePartialHistogram( const ImageView& image, uint32_t firstRow, uint32_t numRows, RgbAccumulator& counts,
+                                  uint32_t channels = HistogramKernel::AllChannels ) const;
+
+    /**
+     * Add a thread's narrow counts into its wide counts and reset them.
+     * Counts of Grayscale8 or Indexed8 images are turned into red, green and blue counts on the way.
+     * @param image The image counted.
+     * @param counts The thread's narrow counts.
+     * @param wide 3 * 256 counts; red, green then blue.
+     * @param channels Mask of the HistogramKernel::Channels counted. Only their wide counts are added to.
+     */
+    static void flushCounts( const ImageView& image, RgbAccumulator& counts, uint64_t * wide,
+                             uint32_t channels = HistogramKernel::AllChannels );
+
+    /**
+     * Default for minPixelsPerThread().
+     */
+    static const uint32_t DEFAULT_MIN_PIXELS_PER_THREAD = 32768;
+
+    /**
+     * @return The fewest pixels that will be given to a thread. Images with fewer than twice this many
+     * pixels are processed entirely on the calling thread.
+     */
+    uint32_t minPixelsPerThread( ) const;
+
+    /**
+     * Set the fewest pixels that will be given to a thread.
+     * @param minPixels The number of pixels. 0 or 1 always use every thread.
+     */
+    void setMinPixelsPerThread( uint32_t minPixels );
+
+    /**
+     * @return The Trace phases are recorded in, or null if not tracing.
+     */
+    Trace * trace( ) const;
+
+    /**
+     * Record phases of later computeHistogram calls in a Trace.
+     * @param trace The Trace, which must outlive its use here, or null to stop tracing.
+     */
+    void setTrace( Trace * trace );
+
+    /**
+     * Make later counts NUMA aware. Workers are pinned to CPUs taken in turn from each node of the topology.
+     * @param topology The nodes of the machine, normally NumaTopology::detect().
+     * @return false if some worker couldn't be pinned, say on other than Linux. Counting is still correct
+     * but chunks may not be counted on the node holding them.
+     */
+    bool setNumaTopology( const NumaTopology& topology );
+
+    /**
+     * @return Whether counts are NUMA aware.
+     */
+    bool numaAware( ) const;
+
+    /**
+     * @param numPixels The number of pixels in an image.
+     * @return The number of threads that would be used to process an image of that size.
+     */
+    uint32_t threadsFor( uint64_t numPixels ) const;
+
+    /**
+     * Target size of a chunk when chunkRows() is 0. Chosen to sit comfortably in a core's L2 cache.
+     */
+    static const uint32_t DEFAULT_CHUNK_BYTES = 256 * 1024;
+
+    /**
+     * @return The number of scanlines in each chunk, or 0 if chunks are sized automatically.
+     */
+    uint32_t chunkRows( ) const;
+
+    /**
+     * Set the number of scanlines in each chunk.
+     * @param rows The number of scanlines, or 0 to size chunks to about DEFAULT_CHUNK_BYTES.
+     */
+    void setChunkRows( uint32_t rows );
+
+    /**
+     * @param image An image.
+     * @return The number of scanlines in each chunk of the image. At least 1.
+     */
+    uint32_t chunkRowsFor( const QImage& image ) const;
+
+    /**
+     * @param image A view of an image.
+     * @return The number of scanlines in each chunk of the image. At least 1.
+     */
+    uint32_t chunkRowsFor( const ImageView& image ) const;
+
+    /**
+     * @return The number of chunks processed by each thread during the last call to computeHistogram.
+     * One entry per thread used; the first is the calling thread.
+     */
+    std::vector<uint32_t> chunksPerThread( ) const;
+
+    /**
+     * @return The kernel used to count pixels.
+     */
+    const HistogramKernel& kernel( ) const;
 
 
     /**
      * Compute the histogram for the given image.
-     * The image is split into multiple blocks and each block is processed by a different thread.
-     * Each thread uses its own Histogram and all Histograms are then merged into a single
-     * Histogram once all threads have finished executing.
-     * @param image The image. Expected to be RGB data.
+     * The image is cut into chunks of chunkRowsFor() scanlines which threads from the pool claim one at a
+     * time until none are left. Each thread counts into its own RgbAccumulator and all accumulators are
+     * then merged and added to the Histograms once all chunks are done.
+     * ARGB32, RGB32, RGBA8888, RGBX8888, RGB888, Grayscale8 and Indexed8 images are counted in place by a
+     * kernel specialised for the format. Images in any other format are first converted to ARGB32.
+     * @param image The image.
      * @param red The overall Histogram of red values in the image.
      * @param green The overall Histogram of green values in the image.
      * @param blue The overall Histogram of blue values in the image.
+     * @param channels Mask of the HistogramKernel::Channels to count, such as HistogramKernel::Red alone. The
+     * kernels are specialised for each mask, so a channel not asked for costs nothing and its Histogram is
+     * left untouched.
+     * @throws std::invalid_argument if any of the Histograms does not have 256 buckets or the mask chooses no
+     * channel.
+     */
+    void computeHistogram(const QImage& image, Histogram& red, Histogram& green, Histogram& blue,
+                          uint32_t channels = HistogramKernel::AllChannels );
+
+    /**
+     * Compute the histogram for pixels described by a view, such as a MappedRaster, without copying them.
+     * The view must remain valid until the call returns.
+     * @param image The view.
+     * @param red The overall Histogram of red values in the image.
+     * @param green The overall Histogram of green values in the image.
+     * @param blue The overall Histogram of blue values in the image.
+     * @param channels Mask of the HistogramKernel::Channels to count. Histograms of the others are untouched.
+     * @throws std::invalid_argument if any of the Histograms does not have 256 buckets, the view isn't
+     * valid (see ImageView::isValid()) or the mask chooses no channel.
+     */
+    void computeHistogram( const ImageView& image, Histogram& red, Histogram& green, Histogram& blue,
+                           uint32_t channels = HistogramKernel::AllChannels );
+
+    /**
+     * Compute the histogram for pixels described by a view into FixedHistograms, which need no allocation.
+     * The 32 bit counters wrap if a bucket passes 4294967295; use the 64 bit overload for larger images.
+     * @param image The view.
+     * @param red The overall Histogram of red values in the image.
+     * @param green The overall Histogram of green values in the image.
+     * @param blue The overall Histogram of blue values in the image.
+     * @param channels Mask of the HistogramKernel::Channels to count. Histograms of the others are untouched.
+     * @throws std::invalid_argument if the view isn't valid (see ImageView::isValid()) or the mask chooses no channel.
+     */
+    void computeHistogram( const ImageView& image, FixedHistogram<256>& red, FixedHistogram<256>& green, FixedHistogram<256>& blue,
+                           uint32_t channels = HistogramKernel::AllChannels );
+
+    /**
+     * Compute the histogram for pixels described by a view into FixedHistograms with 64 bit counters,
+     * which can count images of any size.
+     * @param image The view.
+     * @param red The overall Histogram of red values in the image.
+     * @param green The overall Histogram of green values in the image.
+     * @param blue The overall Histogram of blue values in the image.
+     * @param channels Mask of the HistogramKernel::Channels to count. Histograms of the others are untouched.
+     * @throws std::invalid_argument if the view isn't valid (see ImageView::isValid()) or the mask chooses no channel.
+     */
+    void computeHistogram( const ImageView& image, FixedHistogram<256, uint64_t>& red, FixedHistogram<256, uint64_t>& green, FixedHistogram<256, uint64_t>& blue,
+                           uint32_t channels = HistogramKernel::AllChannels );
+
+    /**
+     * Compute the histograms of red, green and blue and of derived channels, such as luma or hue, in one pass.
+     * As computeHistogram with a QImage otherwise.
+     * @param image The image.
+     * @param red The overall Histogram of red values in the image.
+     * @param green The overall Histogram of green values in the image.
+     * @param blue The overall Histogram of blue values in the image.
+     * @param derived Histograms of the derived channels, to which the counts of the channels it was built for
+     * are added.
+     * @param channels Mask of the HistogramKernel::Channels of red, green and blue to count.
+     * @throws std::invalid_argument if any of the Histograms does not have 256 buckets or the mask chooses no
+     * channel.
+     */
+    void computeHistogram( const QImage& image, Histogram& red, Histogram& green, Histogram& blue, DerivedHistograms& derived,
+                           uint32_t channels = HistogramKernel::AllChannels );
+
+    /**
+     * Compute the histograms of red, green and blue and of derived channels, such as luma or hue, in one pass
+     * over pixels described by a view.
+     * @param image The view.
+     * @param red The overall Histogram of red values in the image.
+     * @param green The overall Histogram of green values in the image.
+     * @param blue The overall Histogram of blue values in the image.
+     * @param derived Histograms of the derived channels, to which the counts of the channels it was built for
+     * are added.
+     * @param channels Mask of the HistogramKernel::Channels of red, green and blue to count.
+     * @throws std::invalid_argument if any of the Histograms does not have 256 buckets, the view isn't
+     * valid (see ImageView::isValid()) or the mask chooses no channel.
+     */
+    void computeHistogram( const ImageView& image, Histogram& red, Histogram& green, Histogram& blue, DerivedHistograms& derived,
+                           uint32_t channels = HistogramKernel::AllChannels );
+
+    /**
+     * Start computing the histogram for pixels described by a view in the background.
+     * The view, and its colour table, must remain valid until the job has finished.
+     * @param image The view.
+     * @param callback Called on a worker when the job finishes, if not empty. It may start jobs but must not
+     * call computeHistogram or updateHistogram on this tool, or wait for a job.
+     * @return The job, already running.
+     * @throws std::invalid_argument if the view isn't valid; see ImageView::isValid().
+     */
+    std::shared_ptr<HistogramJob> computeHistogramAsync( const ImageView& image, HistogramJob::Callback callback = HistogramJob::Callback() );
+
+    /**
+     * Start computing the histogram for the given image in the background. The job keeps a copy of the image, which
+     * shares its pixels, so the caller needn't keep it. Images in a format without a specialised kernel are
+     * converted to ARGB32 before this returns.
+     * @param image The image.
+     * @param callback Called on a worker when the job finishes, if not empty. As for the ImageView overload.
+     * @return The job, already running.
+     */
+    std::shared_ptr<HistogramJob> computeHistogramAsync( const QImage& image, HistogramJob::Callback callback = HistogramJob::Callback() );
+
+    /**
+     * Update the histograms of an image after some regions of it have changed, counting only the changed pixels.
+     * The old pixels of each dirty rectangle are subtracted and the new pixels added, so the work is proportional
+     * to the dirty area rather than the image. Pixels in more than one dirty rectangle are counted once.
+     * @param oldImage The image the histograms were computed from. Only the dirty rectangles are read.
+     * @param newImage The changed image. Must be the same size as oldImage; the format may differ.
+     * @param dirtyRects The rectangles which may have changed.
+     * @param red The Histogram of red values in oldImage, updated to those in newImage.
+     * @param green The Histogram of green values in oldImage, updated to those in newImage.
+     * @param blue The Histogram of blue values in oldImage, updated to those in newImage.
+     * @param verify If true, the updated histograms are compared with a full recount of newImage.
+     * @return false if verify is set and the update didn't match the recount, in which case the Histograms are
+     * replaced by the recount. true otherwise.
+     * @throws std::invalid_argument if the images differ in size or either isn't valid, a rectangle isn't within
+     * them, any of the Histograms does not have 256 buckets or they hold fewer pixels of some value than the old
+     * rectangles. The Histograms are unchanged if so.
      */
-    void computeHistogram(const QImage& image, Histogram& red, Histogram& green, Histogram& blue );
+    bool updateHistogram( const ImageView& oldImage, const ImageView& newImage, const std::vector<Rect>& dirtyRects,
+                          Histogram& red, Histogram& green, Histogram& blue, bool verify = false );
 };
 #endif // HISTOGRAM_TOOL_H
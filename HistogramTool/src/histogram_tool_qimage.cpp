@@ -0,0 +1,148 @@
+#include "histogram_tool.h"
+
+#include <QImage>
+
+/*
+ * The QImage adapter onto the ImageView core. Kept out of histogram_tool.cpp so that programs which only count
+ * their own buffers link no Qt code.
+ */
+
+namespace {
+
+/*
+ * A QImage, or its ARGB32 conversion, and the colour table of an Indexed8 one, which a view points into
+ */
+struct CountableImage {
+    QImage          image;
+    QVector<QRgb>   colourTable;
+};
+
+/*
+ * Fill in a view of an image, converting it first if its format has no kernel
+ */
+void prepare( const QImage& image, CountableImage& countable, ImageView& view, Trace * trace ) {
+    countable.image = image;
+    if( ! HistogramTool::viewOf( countable.image, view ) ) {
+        TraceScope scope{ trace, "convert", static_cast<uint64_t>( image.width() ) * static_cast<uint64_t>( image.height() ) };
+        countable.image = image.convertToFormat( QImage::Format_ARGB32 );
+        HistogramTool::viewOf( countable.image, view );
+    } else if( view.format == PixelFormat::Indexed8 ) {
+        countable.colourTable = image.colorTable();
+        view.colourTable = countable.colourTable.constData();
+        view.colourCount = static_cast<uint32_t>( countable.colourTable.size() );
+    }
+}
+
+}
+
+
+/**
+ * Describe the pixels of a QImage if they are in a format which can be counted directly.
+ * @param image The image.
+ * @param view Set to a view of the image's pixels.
+ * @return true if the image's format has a specialised kernel, false if it must be converted.
+ */
+bool HistogramTool::viewOf( const QImage& image, ImageView& view ) {
+    PixelFormat format;
+    switch( image.format() ) {
+        case QImage::Format_ARGB32:
+        case QImage::Format_RGB32:
+            format = PixelFormat::ARGB32;
+            break;
+
+        case QImage::Format_RGBA8888:
+        case QImage::Format_RGBX8888:
+            format = PixelFormat::RGBA8888;
+            break;
+
+        case QImage::Format_RGB888:
+            format = PixelFormat::RGB888;
+            break;
+
+        case QImage::Format_Grayscale8:
+            format = PixelFormat::Grayscale8;
+            break;
+
+        case QImage::Format_Indexed8:
+            format = PixelFormat::Indexed8;
+            break;
+
+        default:
+            return false;
+    }
+
+    view = ImageView{ image.constBits(),
+                      static_cast<uint32_t>( image.width() ),
+                      static_cast<uint32_t>( image.height() ),
+                      static_cast<ptrdiff_t>( image.bytesPerLine() ),
+                      format };
+    return true;
+}
+
+
+/**
+ * Work out how many scanlines go in each chunk of an image.
+ * @param image The image.
+ * @return At least 1.
+ */
+uint32_t HistogramTool::chunkRowsFor( const QImage& image ) const {
+    ImageView view;
+    if( ! viewOf( image, view ) ) {
+        view = ImageView{ nullptr, static_cast<uint32_t>( image.width() ), static_cast<uint32_t>( image.height() ), 0, PixelFormat::ARGB32 };
+    }
+    return chunkRowsFor( view );
+}
+
+
+/**
+ * Compute the histogram for the given image.
+ * Images in a format with a specialised kernel are counted in place. Others are first converted to ARGB32.
+ * @param image The image.
+ * @param red The overall Histogram of red values in the image.
+ * @param green The overall Histogram of green values in the image.
+ * @param blue The overall Histogram of blue values in the image.
+ * @param channels Mask of the channels to count.
+ */
+void HistogramTool::computeHistogram( const QImage& image, Histogram& red, Histogram& green, Histogram& blue, uint32_t channels ) {
+    CountableImage countable;
+    ImageView view;
+    prepare( image, countable, view, mTrace );
+    computeHistogram( view, red, green, blue, channels );
+}
+
+
+/**
+ * Compute the histogram and derived channels for the given image, converting it first if need be.
+ * @param image The image.
+ * @param red The overall Histogram of red values in the image.
+ * @param green The overall Histogram of green values in the image.
+ * @param blue The overall Histogram of blue values in the image.
+ * @param derived Histograms of the derived channels.
+ * @param channels Mask of the channels of red, green and blue to count.
+ */
+void HistogramTool::computeHistogram( const QImage& image, Histogram& red, Histogram& green, Histogram& blue, DerivedHistograms& derived,
+                                      uint32_t channels ) {
+    CountableImage countable;
+    ImageView view;
+    prepare( image, countable, view, mTrace );
+    computeHistogram( view, red, green, blue, derived, channels );
+}
+
+
+/**
+ * Start counting a QImage in the background, the job keeping a shallow copy, or a conversion, alive.
+ * @param image The image.
+ * @param callback Called when the job finishes, or empty.
+ * @return The job.
+ */
+std::shared_ptr<HistogramJob> HistogramTool::computeHistogramAsync( const QImage& image, HistogramJob::Callback callback ) {
+    std::shared_ptr<CountableImage> countable = std::make_shared<CountableImage>();
+    ImageView view;
+    prepare( image, *countable, view, mTrace );
+
+    std::shared_ptr<HistogramJob> job{ new HistogramJob };
+    job->mView = view;
+    job->mKeepAlive = countable;
+    startJob( job, std::move( callback ) );
+    return job;
+}
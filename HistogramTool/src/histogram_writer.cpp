@@ -0,0 +1,334 @@
+#include "histogram_writer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include "joint_histogram.h"
+
+
+const char HistogramWriter::MAGIC[4] = { 'H', 'S', 'T', 'G' };
+const uint16_t HistogramWriter::VERSION;
+const uint16_t HistogramWriter::FLAG_DELTA;
+const uint8_t HistogramWriter::RECORD_LABEL;
+const uint8_t HistogramWriter::RECORD_HISTOGRAM;
+const uint8_t HistogramWriter::RECORD_JOINT;
+const uint8_t HistogramWriter::RECORD_STATS;
+const size_t HistogramWriter::HEADER_BYTES;
+const size_t HistogramWriter::RECORD_HEADER_BYTES;
+const size_t HistogramWriter::DEFAULT_BUFFER_BYTES;
+
+// Text of every number from 00 to 99, two characters each
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+
+/*
+ * Construct a writer with an empty buffer
+ */
+HistogramWriter::HistogramWriter( std::ostream& output, Format format, size_t bufferBytes )
+    : mOutput( output ), mFormat{ format }, mBufferBytes{ bufferBytes }, mStarted{ false } {
+    if( bufferBytes == 0 ) {
+        throw std::invalid_argument( "Buffer size must be positive" );
+    }
+    mBuffer.reserve( bufferBytes );
+}
+
+/*
+ * Flush whatever is left
+ */
+HistogramWriter::~HistogramWriter( ) {
+    flush();
+}
+
+/*
+ * How histograms are written
+ */
+HistogramWriter::Format HistogramWriter::format( ) const {
+    return mFormat;
+}
+
+/*
+ * Binary header, once
+ */
+void HistogramWriter::start( ) {
+    if( mStarted || mFormat == Format::Text ) {
+        return;
+    }
+    mStarted = true;
+    mBuffer.insert( mBuffer.end(), MAGIC, MAGIC + 4 );
+    appendLittleEndian( VERSION, 2 );
+    appendLittleEndian( ( mFormat == Format::BinaryDelta ) ? FLAG_DELTA : 0, 2 );
+}
+
+/*
+ * Record type and length
+ */
+void HistogramWriter::appendRecordHeader( uint8_t type, uint32_t length ) {
+    mBuffer.push_back( static_cast<char>( type ) );
+    appendLittleEndian( length, 4 );
+}
+
+/*
+ * Least significant byte first
+ */
+void HistogramWriter::appendLittleEndian( uint64_t value, size_t numBytes ) {
+    for( size_t i = 0; i < numBytes; ++i ) {
+        mBuffer.push_back( static_cast<char>( value & 0xFF ) );
+        value >>= 8;
+    }
+}
+
+/*
+ * Convert two digits at a time from the end, then append the digits in one go
+ */
+void HistogramWriter::appendDecimal( uint64_t value ) {
+    char text[20];
+    char *end = text + sizeof( text );
+    char *first = end;
+
+    while( value >= 100 ) {
+        size_t pair = static_cast<size_t>( value % 100 ) * 2;
+        value /= 100;
+        first -= 2;
+        std::memcpy( first, DIGIT_PAIRS + pair, 2 );
+    }
+    if( value >= 10 ) {
+        first -= 2;
+        std::memcpy( first, DIGIT_PAIRS + value * 2, 2 );
+    } else {
+        *--first = static_cast<char>( '0' + value );
+    }
+    mBuffer.insert( mBuffer.end(), first, end );
+}
+
+/*
+ * Seven bits at a time, least significant first, with the top bit set on all but the last byte
+ */
+void HistogramWriter::appendVarint( uint64_t value ) {
+    while( value >= 0x80 ) {
+        mBuffer.push_back( static_cast<char>( ( value & 0x7F ) | 0x80 ) );
+        value >>= 7;
+    }
+    mBuffer.push_back( static_cast<char>( value ) );
+}
+
+/*
+ * Hand a full buffer to the stream. Only called between records
+ */
+void HistogramWriter::flushIfFull( ) {
+    if( mBuffer.size() >= mBufferBytes ) {
+        mOutput.write( mBuffer.data(), static_cast<std::streamsize>( mBuffer.size() ) );
+        mBuffer.clear();
+    }
+}
+
+/*
+ * A line of text or a label record
+ */
+void HistogramWriter::writeLabel( const std::string& label ) {
+    if( label.size() > UINT32_MAX ) {
+        throw std::invalid_argument( "Label is too long" );
+    }
+
+    if( mFormat == Format::Text ) {
+        mBuffer.insert( mBuffer.end(), label.begin(), label.end() );
+        mBuffer.push_back( '\n' );
+    } else {
+        start();
+        appendRecordHeader( RECORD_LABEL, static_cast<uint32_t>( label.size() ) );
+        mBuffer.insert( mBuffer.end(), label.begin(), label.end() );
+    }
+    flushIfFull();
+}
+
+/*
+ * A line of counts or a histogram record. The length of a delta encoded record is filled in once known
+ */
+void HistogramWriter::write( const uint64_t * counts, size_t numCounts ) {
+    if( numCounts == 0 ) {
+        throw std::invalid_argument( "Histograms must have buckets" );
+    }
+    if( numCounts > ( UINT32_MAX - 4 ) / 10 ) {
+        throw std::invalid_argument( "Histogram is too large" );
+    }
+
+    switch( mFormat ) {
+        case Format::Text:
+            for( size_t i = 0; i < numCounts; ++i ) {
+                appendDecimal( counts[i] );
+                if( i + 1 < numCounts ) {
+                    mBuffer.push_back( ',' );
+                    mBuffer.push_back( ' ' );
+                }
+            }
+            mBuffer.push_back( '\n' );
+            break;
+
+        case Format::Binary:
+            start();
+            appendRecordHeader( RECORD_HISTOGRAM, static_cast<uint32_t>( 4 + numCounts * 8 ) );
+            appendLittleEndian( numCounts, 4 );
+            for( size_t i = 0; i < numCounts; ++i ) {
+                appendLittleEndian( counts[i], 8 );
+            }
+            break;
+
+        case Format::BinaryDelta: {
+            start();
+            size_t lengthAt = mBuffer.size() + 1;
+            appendRecordHeader( RECORD_HISTOGRAM, 0 );
+            size_t bodyAt = mBuffer.size();
+            appendLittleEndian( numCounts, 4 );
+
+            uint64_t previous = 0;
+            for( size_t i = 0; i < numCounts; ++i ) {
+                // Differences wrap; zigzag maps small negative and positive differences to small numbers
+                uint64_t delta = counts[i] - previous;
+                appendVarint( ( delta << 1 ) ^ ( ( delta >> 63 ) ? UINT64_MAX : 0 ) );
+                previous = counts[i];
+            }
+
+            uint64_t length = mBuffer.size() - bodyAt;
+            for( size_t i = 0; i < 4; ++i ) {
+                mBuffer[lengthAt + i] = static_cast<char>( ( length >> ( 8 * i ) ) & 0xFF );
+            }
+            break;
+        }
+    }
+    flushIfFull();
+}
+
+/*
+ * A line of bins and counts or a joint record. Keys are ascending, so their gaps are never negative
+ */
+void HistogramWriter::write( const JointHistogram& histogram ) {
+    const std::vector<uint32_t>& keys = histogram.keys();
+    const std::vector<uint64_t>& counts = histogram.counts();
+    if( keys.size() > ( UINT32_MAX - 8 ) / 12 ) {
+        throw std::invalid_argument( "Histogram is too large" );
+    }
+
+    switch( mFormat ) {
+        case Format::Text: {
+            static const char prefix[] = "joint ";
+            mBuffer.insert( mBuffer.end(), prefix, prefix + sizeof( prefix ) - 1 );
+            appendDecimal( histogram.binsPerChannel() );
+            mBuffer.push_back( ':' );
+            for( size_t i = 0; i < keys.size(); ++i ) {
+                uint32_t red = 0, green = 0, blue = 0;
+                histogram.binsOf( keys[i], red, green, blue );
+                mBuffer.push_back( ' ' );
+                appendDecimal( red );
+                mBuffer.push_back( ' ' );
+                appendDecimal( green );
+                mBuffer.push_back( ' ' );
+                appendDecimal( blue );
+                mBuffer.push_back( ' ' );
+                appendDecimal( counts[i] );
+                if( i + 1 < keys.size() ) {
+                    mBuffer.push_back( ',' );
+                }
+            }
+            mBuffer.push_back( '\n' );
+            break;
+        }
+
+        case Format::Binary:
+            start();
+            appendRecordHeader( RECORD_JOINT, static_cast<uint32_t>( 8 + keys.size() * 12 ) );
+            appendLittleEndian( histogram.binsPerChannel(), 4 );
+            appendLittleEndian( keys.size(), 4 );
+            for( size_t i = 0; i < keys.size(); ++i ) {
+                appendLittleEndian( keys[i], 4 );
+                appendLittleEndian( counts[i], 8 );
+            }
+            break;
+
+        case Format::BinaryDelta: {
+            start();
+            size_t lengthAt = mBuffer.size() + 1;
+            appendRecordHeader( RECORD_JOINT, 0 );
+            size_t bodyAt = mBuffer.size();
+            appendLittleEndian( histogram.binsPerChannel(), 4 );
+            appendLittleEndian( keys.size(), 4 );
+
+            uint32_t next = 0;
+            for( size_t i = 0; i < keys.size(); ++i ) {
+                appendVarint( keys[i] - next );
+                appendVarint( counts[i] );
+                next = keys[i] + 1;
+            }
+
+            uint64_t length = mBuffer.size() - bodyAt;
+            for( size_t i = 0; i < 4; ++i ) {
+                mBuffer[lengthAt + i] = static_cast<char>( ( length >> ( 8 * i ) ) & 0xFF );
+            }
+            break;
+        }
+    }
+    flushIfFull();
+}
+
+/*
+ * A line of named statistics or a stats record, the same whether or not counts are delta encoded
+ */
+void HistogramWriter::write( const HistogramStats::Summary& summary ) {
+    if( mFormat == Format::Text ) {
+        char text[160];
+        int length = std::snprintf( text, sizeof( text ), "total %llu, mean %.6g, sd %.6g, p1 %u, p99 %u, otsu %u\n",
+                                    static_cast<unsigned long long>( summary.total ), summary.mean, summary.standardDeviation,
+                                    summary.percentile1, summary.percentile99, summary.otsuThreshold );
+        mBuffer.insert( mBuffer.end(), text, text + length );
+    } else {
+        start();
+        appendRecordHeader( RECORD_STATS, 36 );
+        appendLittleEndian( summary.total, 8 );
+        uint64_t bits = 0;
+        std::memcpy( &bits, &summary.mean, sizeof( bits ) );
+        appendLittleEndian( bits, 8 );
+        std::memcpy( &bits, &summary.standardDeviation, sizeof( bits ) );
+        appendLittleEndian( bits, 8 );
+        appendLittleEndian( summary.percentile1, 4 );
+        appendLittleEndian( summary.percentile99, 4 );
+        appendLittleEndian( summary.otsuThreshold, 4 );
+    }
+    flushIfFull();
+}
+
+/*
+ * Write a Histogram's buckets
+ */
+void HistogramWriter::write( const Histogram& histogram ) {
+    mCounts.resize( histogram.numBuckets() );
+    for( size_t i = 0; i < mCounts.size(); ++i ) {
+        mCounts[i] = histogram[i];
+    }
+    write( mCounts.data(), mCounts.size() );
+}
+
+/*
+ * Hand everything to the stream. A binary stream with no records still gets its header
+ */
+bool HistogramWriter::flush( ) {
+    start();
+    if( ! mBuffer.empty() ) {
+        mOutput.write( mBuffer.data(), static_cast<std::streamsize>( mBuffer.size() ) );
+        mBuffer.clear();
+    }
+    mOutput.flush();
+    return mOutput.good();
+}
+
+/*
+ * Parse a format name
+ */
+HistogramWriter::Format HistogramWriter::formatFromName( const std::string& name ) {
+    if( name == "text" ) {
+        return Format::Text;
+    } else if( name == "binary" ) {
+        return Format::Binary;
+    } else if( name == "delta" ) {
+        return Format::BinaryDelta;
+    }
+    throw std::invalid_argument( "Unknown output format " + name );
+}
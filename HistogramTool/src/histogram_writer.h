@@ -0,0 +1,228 @@
+#ifndef HISTOGRAM_WRITER_H
+#define HISTOGRAM_WRITER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "histogram.h"
+#include "fixed_histogram.h"
+#include "histogram_stats.h"
+
+class JointHistogram;
+
+/**
+ * HistogramWriter.
+ *
+ * Writes many histograms to a stream quickly. Output is formatted into a reusable buffer which is passed to
+ * the stream only when it fills, or on flush(), rather than formatting each count through the stream and
+ * flushing at each line as operator<< does.
+ *
+ * Text output is the same as operator<<: each histogram is one line of counts separated by ", ". Counts
+ * are converted two digits at a time from a table, in the manner of std::to_chars. Labels are written as
+ * lines of their own. A joint histogram is a line "joint <bins>:" followed by the red, green and blue bin and
+ * count of each bin hit, separated by ", ". Statistics are a line "total <n>, mean <m>, sd <s>, p1 <b>, p99 <b>,
+ * otsu <b>".
+ *
+ * Binary output starts with a fixed header followed by a record for each label and histogram:
+ *
+ *      Header  : "HSTG", version (uint16), flags (uint16)
+ *      Record  : type (uint8), body length in bytes (uint32), body
+ *      Label   : type 1; the label's bytes
+ *      Histogram: type 2; number of buckets (uint32) then the counts
+ *      Joint   : type 3; bins per channel (uint32), number of bins hit (uint32), then the key (uint32) and
+ *                count of each bin hit, ascending by key
+ *      Stats   : type 4; total (uint64), mean and standard deviation (IEEE doubles as uint64), 1st and 99th
+ *                percentile and Otsu threshold (uint32)
+ *
+ * Numbers are little endian whatever the host. Counts are uint64 unless the header has the Delta flag, in
+ * which case each count is stored as its difference from the one before, zigzag encoded as a LEB128 varint.
+ * Neighbouring buckets of an image histogram are usually close, so most counts take one to three bytes.
+ * In joint records with the Delta flag, each key is instead stored as its gap from the one before, and
+ * each count as is, both as varints.
+ * HistogramReader reads binary output back.
+ */
+class HistogramWriter {
+public:
+    /**
+     * How histograms are written.
+     */
+    enum class Format {
+        // Lines of comma separated counts, as operator<<
+        Text,
+        // Binary records with uint64 counts
+        Binary,
+        // Binary records with delta and varint encoded counts
+        BinaryDelta
+    };
+
+    /**
+     * First bytes of binary output.
+     */
+    static const char MAGIC[4];
+
+    /**
+     * Version of the binary format written.
+     */
+    static const uint16_t VERSION = 1;
+
+    /**
+     * Header flag set when counts are delta and varint encoded.
+     */
+    static const uint16_t FLAG_DELTA = 1;
+
+    /**
+     * Record types.
+     */
+    static const uint8_t RECORD_LABEL = 1;
+    static const uint8_t RECORD_HISTOGRAM = 2;
+    static const uint8_t RECORD_JOINT = 3;
+    static const uint8_t RECORD_STATS = 4;
+
+    /**
+     * Size of the binary header and of a record's type and length.
+     */
+    static const size_t HEADER_BYTES = 8;
+    static const size_t RECORD_HEADER_BYTES = 5;
+
+    /**
+     * Default number of bytes buffered before they are passed to the stream.
+     */
+    static const size_t DEFAULT_BUFFER_BYTES = 64 * 1024;
+
+private:
+    // Stream written to
+    std::ostream&       mOutput;
+
+    // How histograms are written
+    Format              mFormat;
+
+    // Bytes buffered before they are passed to the stream
+    size_t              mBufferBytes;
+
+    // Output not yet passed to the stream
+    std::vector<char>   mBuffer;
+
+    // Whether the binary header has been written
+    bool                mStarted;
+
+    // Counts of a FixedHistogram or Histogram being written
+    std::vector<uint64_t>   mCounts;
+
+    /**
+     * Write the binary header if it hasn't been yet.
+     */
+    void start( );
+
+    /**
+     * Append a record's type and length to the buffer.
+     */
+    void appendRecordHeader( uint8_t type, uint32_t length );
+
+    /**
+     * Append an integer in little endian order.
+     */
+    void appendLittleEndian( uint64_t value, size_t numBytes );
+
+    /**
+     * Append an integer as text.
+     */
+    void appendDecimal( uint64_t value );
+
+    /**
+     * Append an integer as a LEB128 varint.
+     */
+    void appendVarint( uint64_t value );
+
+    /**
+     * Pass the buffer to the stream if it is full.
+     */
+    void flushIfFull( );
+
+public:
+    /**
+     * Construct a writer. Nothing is written until the first label or histogram.
+     * @param output Stream to write to. Open in binary mode for binary formats. Must outlive the writer.
+     * @param format How histograms are written.
+     * @param bufferBytes Bytes buffered before they are passed to the stream.
+     * @throws std::invalid_argument if bufferBytes is 0.
+     */
+    HistogramWriter( std::ostream& output, Format format = Format::Text, size_t bufferBytes = DEFAULT_BUFFER_BYTES );
+
+    /**
+     * Flushes any buffered output to the stream.
+     */
+    ~HistogramWriter( );
+
+    HistogramWriter( const HistogramWriter& ) = delete;
+    HistogramWriter& operator=( const HistogramWriter& ) = delete;
+
+    /**
+     * @return How histograms are written.
+     */
+    Format format( ) const;
+
+    /**
+     * Write a label, such as the name of the image the following histograms are of.
+     * @param label The label. Should not contain new lines if writing text.
+     * @throws std::invalid_argument if the label has 2^32 or more bytes.
+     */
+    void writeLabel( const std::string& label );
+
+    /**
+     * Write a histogram from an array of counts.
+     * @param counts The counts.
+     * @param numCounts The number of counts.
+     * @throws std::invalid_argument if numCounts is 0 or the record would have 2^32 or more bytes.
+     */
+    void write( const uint64_t * counts, size_t numCounts );
+
+    /**
+     * Write a histogram.
+     * @param histogram The histogram.
+     */
+    void write( const Histogram& histogram );
+
+    /**
+     * Write a FixedHistogram.
+     * @param histogram The histogram.
+     */
+    template <size_t NumBuckets, typename Counter>
+    void write( const FixedHistogram<NumBuckets, Counter>& histogram ) {
+        mCounts.resize( NumBuckets );
+        for( size_t i = 0; i < NumBuckets; ++i ) {
+            mCounts[i] = histogram[i];
+        }
+        write( mCounts.data(), NumBuckets );
+    }
+
+    /**
+     * Write the bins hit of a joint histogram.
+     * @param histogram The histogram.
+     * @throws std::invalid_argument if the record would have 2^32 or more bytes.
+     */
+    void write( const JointHistogram& histogram );
+
+    /**
+     * Write the statistics of a histogram in place of its counts.
+     * @param summary The statistics.
+     */
+    void write( const HistogramStats::Summary& summary );
+
+    /**
+     * Pass everything buffered to the stream and flush it.
+     * @return true if the stream is still good.
+     */
+    bool flush( );
+
+    /**
+     * Parse the name of a format.
+     * @param name One of text, binary or delta.
+     * @return The format.
+     * @throws std::invalid_argument if the name is not recognised.
+     */
+    static Format formatFromName( const std::string& name );
+};
+
+#endif // HISTOGRAM_WRITER_H
@@ -0,0 +1,160 @@
+#ifndef IMAGE_VIEW_H
+#define IMAGE_VIEW_H
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Layouts of pixel data which can be counted without conversion.
+ */
+enum class PixelFormat {
+    // 32 bit words 0xAARRGGBB in native byte order, as QImage::Format_ARGB32 and Format_RGB32
+    ARGB32,
+
+    // Bytes R, G, B, A, as QImage::Format_RGBA8888 and Format_RGBX8888
+    RGBA8888,
+
+    // Bytes R, G, B, as QImage::Format_RGB888
+    RGB888,
+
+    // Bytes B, G, R, as in BMP files
+    BGR888,
+
+    // One byte of grey per pixel
+    Grayscale8,
+
+    // One byte per pixel indexing a colour table of 0xAARRGGBB entries
+    Indexed8
+};
+
+/**
+ * Rect.
+ *
+ * A rectangle of pixels within an image: its top left pixel and its size.
+ */
+struct Rect {
+    uint32_t    x;
+    uint32_t    y;
+    uint32_t    width;
+    uint32_t    height;
+
+    /**
+     * @return The number of pixels in the rectangle.
+     */
+    uint64_t numPixels( ) const {
+        return static_cast<uint64_t>( width ) * height;
+    }
+};
+
+/**
+ * ImageView.
+ *
+ * A description of pixel data held elsewhere: where it starts, its size, the distance between the starts
+ * of consecutive scanlines and the layout of each pixel. The view doesn't own or copy the pixels; whoever
+ * built it must keep them alive while it is in use.
+ *
+ * bytesPerLine may be larger than width * bytesPerPixel when scanlines are padded, and may be negative for
+ * images stored bottom up.
+ */
+struct ImageView {
+    // First byte of the top scanline
+    const uint8_t   *data;
+
+    // Pixels per scanline
+    uint32_t        width;
+
+    // Number of scanlines
+    uint32_t        height;
+
+    // Distance in bytes from the start of one scanline to the next
+    ptrdiff_t       bytesPerLine;
+
+    // Layout of each pixel
+    PixelFormat     format;
+
+    // Colour table for Indexed8 data; ignored otherwise
+    const uint32_t  *colourTable;
+
+    // Number of entries in colourTable. Indices beyond the table count as black
+    uint32_t        colourCount;
+
+    /**
+     * Construct an empty view.
+     */
+    ImageView( )
+        : data{ nullptr }, width{ 0 }, height{ 0 }, bytesPerLine{ 0 }, format{ PixelFormat::ARGB32 },
+          colourTable{ nullptr }, colourCount{ 0 } {
+    }
+
+    /**
+     * Construct a view of existing pixel data.
+     */
+    ImageView( const uint8_t *data, uint32_t width, uint32_t height, ptrdiff_t bytesPerLine, PixelFormat format,
+               const uint32_t *colourTable = nullptr, uint32_t colourCount = 0 )
+        : data{ data }, width{ width }, height{ height }, bytesPerLine{ bytesPerLine }, format{ format },
+          colourTable{ colourTable }, colourCount{ colourCount } {
+    }
+
+    /**
+     * @param y A scanline. Not range checked.
+     * @return The first byte of the scanline.
+     */
+    const uint8_t * row( uint32_t y ) const {
+        return data + static_cast<ptrdiff_t>( y ) * bytesPerLine;
+    }
+
+    /**
+     * @return The number of pixels in the view.
+     */
+    uint64_t numPixels( ) const {
+        return static_cast<uint64_t>( width ) * height;
+    }
+
+    /**
+     * @return true if the pixels can be counted: a view with any pixels has data. Scanlines may overlap, say
+     * with a bytesPerLine of 0 to repeat one scanline.
+     */
+    bool isValid( ) const {
+        return data != nullptr || width == 0 || height == 0;
+    }
+
+    /**
+     * @param rect A rectangle within the view.
+     * @return true if rect lies entirely within the view.
+     */
+    bool contains( const Rect& rect ) const {
+        return static_cast<uint64_t>( rect.x ) + rect.width <= width
+            && static_cast<uint64_t>( rect.y ) + rect.height <= height;
+    }
+
+    /**
+     * @param rect A rectangle within the view. Not range checked; see contains().
+     * @return A view of just the pixels in the rectangle, sharing this view's pixels.
+     */
+    ImageView subView( const Rect& rect ) const {
+        ImageView view = *this;
+        view.data = row( rect.y ) + static_cast<ptrdiff_t>( rect.x ) * bytesPerPixel( format );
+        view.width = rect.width;
+        view.height = rect.height;
+        return view;
+    }
+
+    /**
+     * @param format A pixel format.
+     * @return The number of bytes each pixel occupies.
+     */
+    static uint32_t bytesPerPixel( PixelFormat format ) {
+        switch( format ) {
+            case PixelFormat::ARGB32:
+            case PixelFormat::RGBA8888:
+                return 4;
+            case PixelFormat::RGB888:
+            case PixelFormat::BGR888:
+                return 3;
+            default:
+                return 1;
+        }
+    }
+};
+
+#endif // IMAGE_VIEW_H
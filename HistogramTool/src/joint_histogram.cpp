@@ -0,0 +1,521 @@
+#include "joint_histogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include "cpu_topology.h"
+
+const size_t JointHistogram::BLOCK_PIXELS;
+const uint32_t JointHistogram::INITIAL_SLOTS;
+
+// Key of an empty slot in a sparse table; no bin has it
+static const uint32_t EMPTY_KEY = UINT32_MAX;
+
+// Multiplier of the Fibonacci hash of keys; the top bits of the product pick a key's first slot
+static const uint32_t HASH_MULTIPLIER = 0x9E3779B1u;
+
+
+/*
+ * The counts of one thread: a count per bin, or a hash table of the bins seen and then a sorted run of them
+ */
+struct JointHistogram::ThreadCounts {
+    // Whether the counts are dense; a sparse table which outgrows a dense array becomes one
+    bool                    isDense = false;
+
+    // A slot of a sparse table; key and count together so a probe touches one cache line
+    struct Slot {
+        uint32_t    key;
+        uint32_t    count;
+    };
+
+    // Dense: a count per bin
+    std::vector<uint32_t>   dense;
+
+    // Sparse: the slots, linear probed, and how many are used
+    std::vector<Slot>       slots;
+    uint32_t                numUsed = 0;
+    uint32_t                slotShift = 0;
+
+    // Sparse, once counted: key << 32 | count of each bin seen, ascending
+    std::vector<uint64_t>   sorted;
+
+    // Pixels counted since the counts were last emptied
+    uint64_t                numCounted = 0;
+
+    /*
+     * Empty the counts, allocating them on the thread which will count into them
+     */
+    void reset( Storage storage, uint32_t numBins ) {
+        isDense = storage == Storage::Dense;
+        if( isDense ) {
+            dense.assign( numBins, 0 );
+        } else {
+            dense.clear();
+            slots.assign( INITIAL_SLOTS, Slot{ EMPTY_KEY, 0 } );
+            numUsed = 0;
+            slotShift = 32;
+            for( uint32_t numSlots = INITIAL_SLOTS; numSlots > 1; numSlots >>= 1 ) {
+                slotShift--;
+            }
+            sorted.clear();
+        }
+        numCounted = 0;
+    }
+
+    /*
+     * Put a new key, counted once, in an empty slot, doubling the table when a quarter full. Probes of a
+     * fuller table are longer, and mispredicted
+     */
+    void insert( uint32_t slot, uint32_t key ) {
+        slots[slot] = Slot{ key, 1 };
+        if( ++numUsed * 4 > slots.size() ) {
+            grow();
+        }
+    }
+
+    /*
+     * Move the counts of a sparse table into a dense array
+     */
+    void makeDense( uint32_t numBins ) {
+        dense.assign( numBins, 0 );
+        for( const Slot& entry : slots ) {
+            if( entry.key != EMPTY_KEY ) {
+                dense[entry.key] = entry.count;
+            }
+        }
+        std::vector<Slot>().swap( slots );
+        numUsed = 0;
+        isDense = true;
+    }
+
+    /*
+     * Rehash into twice as many slots
+     */
+    void grow( ) {
+        std::vector<Slot> old( slots.size() * 2, Slot{ EMPTY_KEY, 0 } );
+        old.swap( slots );
+        slotShift--;
+
+        const uint32_t mask = static_cast<uint32_t>( slots.size() ) - 1;
+        for( const Slot& entry : old ) {
+            if( entry.key != EMPTY_KEY ) {
+                uint32_t slot = ( entry.key * HASH_MULTIPLIER ) >> slotShift;
+                while( slots[slot].key != EMPTY_KEY ) {
+                    slot = ( slot + 1 ) & mask;
+                }
+                slots[slot] = entry;
+            }
+        }
+    }
+
+    /*
+     * Sort the bins seen by key for the merge
+     */
+    void sort( ) {
+        sorted.clear();
+        sorted.reserve( numUsed );
+        for( const Slot& entry : slots ) {
+            if( entry.key != EMPTY_KEY ) {
+                sorted.push_back( static_cast<uint64_t>( entry.key ) << 32 | entry.count );
+            }
+        }
+        std::sort( sorted.begin(), sorted.end() );
+    }
+};
+
+
+namespace {
+
+/*
+ * Key of an ARGB32 pixel: each channel's top bits shifted into place
+ */
+template <uint32_t Bits>
+inline uint32_t keyOfArgb( uint32_t argb ) {
+    const uint32_t mask = ( 1u << Bits ) - 1;
+    return ( ( argb >> ( 24 - 3 * Bits ) ) & ( mask << ( 2 * Bits ) ) )
+         | ( ( argb >> ( 16 - 2 * Bits ) ) & ( mask << Bits ) )
+         | ( ( argb >> ( 8 - Bits ) ) & mask );
+}
+
+/*
+ * Key of a pixel's bytes
+ */
+template <uint32_t Bits>
+inline uint32_t keyOfBytes( uint32_t red, uint32_t green, uint32_t blue ) {
+    return ( ( red >> ( 8 - Bits ) ) << ( 2 * Bits ) ) | ( ( green >> ( 8 - Bits ) ) << Bits ) | ( blue >> ( 8 - Bits ) );
+}
+
+/*
+ * Counts keys into a thread's dense counts
+ */
+template <typename Counts>
+class DenseCounter {
+private:
+    uint32_t    *mCounts;
+
+public:
+    explicit DenseCounter( Counts& counts ) : mCounts( counts.dense.data() ) {
+    }
+
+    void add( uint32_t key ) {
+        mCounts[key]++;
+    }
+};
+
+/*
+ * Counts keys into a thread's sparse table. The table is held in locals, which the stores to counts can't
+ * alias, so it isn't reloaded for every pixel; only inserting a key, which may grow it, reloads it
+ */
+template <typename Counts>
+class SparseCounter {
+private:
+    Counts&                     mCounts;
+    typename Counts::Slot       *mSlots;
+    uint32_t                    mMask;
+    uint32_t                    mShift;
+
+    void load( ) {
+        mSlots = mCounts.slots.data();
+        mMask = static_cast<uint32_t>( mCounts.slots.size() ) - 1;
+        mShift = mCounts.slotShift;
+    }
+
+public:
+    explicit SparseCounter( Counts& counts ) : mCounts( counts ) {
+        load();
+    }
+
+    void add( uint32_t key ) {
+        for( uint32_t slot = ( key * HASH_MULTIPLIER ) >> mShift; ; slot = ( slot + 1 ) & mMask ) {
+            if( mSlots[slot].key == key ) {
+                mSlots[slot].count++;
+                return;
+            }
+            if( mSlots[slot].key == EMPTY_KEY ) {
+                mCounts.insert( slot, key );
+                load();
+                return;
+            }
+        }
+    }
+};
+
+/*
+ * Count pixels whose channels are bytes at the given offsets
+ */
+template <uint32_t Bits, size_t R, size_t G, size_t B, size_t BytesPerPixel, typename Counter>
+void countBytes( const uint8_t * pixels, size_t numPixels, Counter& counter ) {
+    for( size_t i = 0; i < numPixels; ++i ) {
+        const uint8_t * pixel = pixels + i * BytesPerPixel;
+        counter.add( keyOfBytes<Bits>( pixel[R], pixel[G], pixel[B] ) );
+    }
+}
+
+/*
+ * Count a run of pixels of a scanline in any format. The key is worked out and counted in one loop, so the
+ * counting overlaps the loads and runs as fast as the pixels can be read
+ */
+template <uint32_t Bits, typename Counter, typename Counts>
+void countPixels( const ImageView& image, const uint8_t * row, uint32_t x, size_t numPixels, Counts& counts ) {
+    Counter counter{ counts };
+    switch( image.format ) {
+        case PixelFormat::ARGB32: {
+            const uint32_t * pixels = reinterpret_cast<const uint32_t *>( row ) + x;
+            for( size_t i = 0; i < numPixels; ++i ) {
+                counter.add( keyOfArgb<Bits>( pixels[i] ) );
+            }
+            break;
+        }
+
+        case PixelFormat::RGBA8888:
+            countBytes<Bits, 0, 1, 2, 4>( row + static_cast<size_t>( x ) * 4, numPixels, counter );
+            break;
+
+        case PixelFormat::RGB888:
+            countBytes<Bits, 0, 1, 2, 3>( row + static_cast<size_t>( x ) * 3, numPixels, counter );
+            break;
+
+        case PixelFormat::BGR888:
+            countBytes<Bits, 2, 1, 0, 3>( row + static_cast<size_t>( x ) * 3, numPixels, counter );
+            break;
+
+        case PixelFormat::Grayscale8: {
+            // A grey's bin is the same in every channel
+            const uint32_t spread = 1u | ( 1u << Bits ) | ( 1u << ( 2 * Bits ) );
+            for( size_t i = 0; i < numPixels; ++i ) {
+                counter.add( ( row[x + i] >> ( 8 - Bits ) ) * spread );
+            }
+            break;
+        }
+
+        case PixelFormat::Indexed8:
+            for( size_t i = 0; i < numPixels; ++i ) {
+                uint8_t index = row[x + i];
+                counter.add( keyOfArgb<Bits>( ( index < image.colourCount ) ? image.colourTable[index] : 0 ) );
+            }
+            break;
+    }
+}
+
+}
+
+
+/*
+ * Choose dense or sparse counts from the number of bins and the cache, and start the threads
+ */
+JointHistogram::JointHistogram( HistogramTool& tool, uint32_t binsPerChannel, size_t denseLimitBytes ) : mTool( tool )
+{
+    switch( binsPerChannel ) {
+        case 16:
+            mBits = 4;
+            break;
+        case 32:
+            mBits = 5;
+            break;
+        case 64:
+            mBits = 6;
+            break;
+        default:
+            throw std::invalid_argument( "Bins per channel must be 16, 32 or 64" );
+    }
+
+    if( denseLimitBytes == 0 ) {
+        denseLimitBytes = CpuTopology::detect().l2CacheBytes / 2;
+    }
+    size_t denseBytes = ( static_cast<size_t>( 1 ) << ( 3 * mBits ) ) * sizeof( uint32_t );
+    mStorage = ( denseBytes <= denseLimitBytes ) ? Storage::Dense : Storage::Sparse;
+
+    mPool.reset( new WorkerPool{ tool.numThreads() - 1 } );
+    for( uint32_t i = 0; i < tool.numThreads(); ++i ) {
+        mThreadCounts.emplace_back( new ThreadCounts );
+    }
+}
+
+JointHistogram::~JointHistogram( )
+{
+}
+
+/*
+ * Count each scanline a block at a time, spilling before the counts could overflow
+ */
+void JointHistogram::countRows( const ImageView& image, uint32_t firstRow, uint32_t numRows, ThreadCounts& counts )
+{
+    typedef void (*CountFunction)( const ImageView& image, const uint8_t * row, uint32_t x, size_t numPixels, ThreadCounts& counts );
+    typedef DenseCounter<ThreadCounts> Dense;
+    typedef SparseCounter<ThreadCounts> Sparse;
+    const CountFunction dense[] = { countPixels<4, Dense, ThreadCounts>, countPixels<5, Dense, ThreadCounts>, countPixels<6, Dense, ThreadCounts> };
+    const CountFunction sparse[] = { countPixels<4, Sparse, ThreadCounts>, countPixels<5, Sparse, ThreadCounts>, countPixels<6, Sparse, ThreadCounts> };
+    const uint32_t numBins = 1u << ( 3 * mBits );
+
+    for( uint32_t y = firstRow; y < firstRow + numRows; ++y ) {
+        const uint8_t * row = image.row( y );
+        for( uint32_t x = 0; x < image.width; x += static_cast<uint32_t>( BLOCK_PIXELS ) ) {
+            size_t numPixels = std::min<size_t>( BLOCK_PIXELS, image.width - x );
+            if( counts.numCounted + numPixels > UINT32_MAX ) {
+                spill( counts );
+            }
+            if( ! counts.isDense && counts.slots.size() * sizeof( ThreadCounts::Slot ) > numBins * sizeof( uint32_t ) ) {
+                counts.makeDense( numBins );
+            }
+            ( counts.isDense ? dense : sparse )[mBits - 4]( image, row, x, numPixels, counts );
+            counts.numCounted += numPixels;
+        }
+    }
+}
+
+/*
+ * Add a thread's counts to the wide spilled counts, which are allocated the first time
+ */
+void JointHistogram::spill( ThreadCounts& counts )
+{
+    const uint32_t numBins = 1u << ( 3 * mBits );
+    {
+        std::lock_guard<std::mutex> lock{ mSpillMutex };
+        if( mSpilled.empty() ) {
+            mSpilled.assign( numBins, 0 );
+        }
+        if( counts.isDense ) {
+            for( uint32_t key = 0; key < numBins; ++key ) {
+                mSpilled[key] += counts.dense[key];
+            }
+        } else {
+            for( const ThreadCounts::Slot& entry : counts.slots ) {
+                if( entry.key != EMPTY_KEY ) {
+                    mSpilled[ entry.key ] += entry.count;
+                }
+            }
+        }
+    }
+    counts.reset( mStorage, numBins );
+}
+
+/*
+ * Each task claims slices of the keys and adds up every source's counts in them, then the slices are joined
+ */
+void JointHistogram::merge( uint32_t numThreads )
+{
+    const uint32_t numBins = 1u << ( 3 * mBits );
+    const uint32_t numSlices = std::min<uint32_t>( numThreads * 4, numBins / 256 );
+    const uint32_t sliceBins = ( numBins + numSlices - 1 ) / numSlices;
+
+    std::vector<std::vector<uint32_t>> sliceKeys( numSlices );
+    std::vector<std::vector<uint64_t>> sliceCounts( numSlices );
+    std::atomic<uint32_t> nextSlice{ 0 };
+
+    mPool->run( numThreads, [&]( uint32_t ) {
+        std::vector<uint64_t> sums( sliceBins );
+        for( uint32_t slice = nextSlice++; slice < numSlices; slice = nextSlice++ ) {
+            const uint32_t first = slice * sliceBins;
+            const uint32_t last = std::min( first + sliceBins, numBins );
+            std::fill( sums.begin(), sums.end(), 0 );
+
+            for( uint32_t thread = 0; thread < numThreads; ++thread ) {
+                const ThreadCounts& counts = *mThreadCounts[thread];
+                if( counts.isDense ) {
+                    for( uint32_t i = 0; i < last - first; ++i ) {
+                        sums[i] += counts.dense[first + i];
+                    }
+                } else {
+                    auto entry = std::lower_bound( counts.sorted.begin(), counts.sorted.end(), static_cast<uint64_t>( first ) << 32 );
+                    for( ; entry != counts.sorted.end() && ( *entry >> 32 ) < last; ++entry ) {
+                        sums[ ( *entry >> 32 ) - first ] += *entry & UINT32_MAX;
+                    }
+                }
+            }
+            if( ! mSpilled.empty() ) {
+                for( uint32_t i = 0; i < last - first; ++i ) {
+                    sums[i] += mSpilled[first + i];
+                }
+            }
+            size_t previous = std::lower_bound( mKeys.begin(), mKeys.end(), first ) - mKeys.begin();
+            for( ; previous < mKeys.size() && mKeys[previous] < last; ++previous ) {
+                sums[ mKeys[previous] - first ] += mCounts[previous];
+            }
+
+            for( uint32_t i = 0; i < last - first; ++i ) {
+                if( sums[i] > 0 ) {
+                    sliceKeys[slice].push_back( first + i );
+                    sliceCounts[slice].push_back( sums[i] );
+                }
+            }
+        }
+    } );
+
+    std::vector<uint32_t> keys;
+    std::vector<uint64_t> counts;
+    for( uint32_t slice = 0; slice < numSlices; ++slice ) {
+        keys.insert( keys.end(), sliceKeys[slice].begin(), sliceKeys[slice].end() );
+        counts.insert( counts.end(), sliceCounts[slice].begin(), sliceCounts[slice].end() );
+    }
+    mKeys.swap( keys );
+    mCounts.swap( counts );
+    mSpilled.clear();
+}
+
+/*
+ * Threads claim chunks of scanlines and count them into their own counts, which are then merged
+ */
+void JointHistogram::compute( const ImageView& image )
+{
+    if( ! image.isValid() ) {
+        throw std::invalid_argument( "Image has pixels but no pixel data" );
+    }
+
+    std::lock_guard<std::mutex> lock{ mMutex };
+    if( image.numPixels() == 0 ) {
+        return;
+    }
+
+    const uint32_t numBins = 1u << ( 3 * mBits );
+    const uint32_t chunkRows = mTool.chunkRowsFor( image );
+    const uint32_t numChunks = static_cast<uint32_t>( ( static_cast<uint64_t>( image.height ) + chunkRows - 1 ) / chunkRows );
+    const uint32_t numThreads = std::max<uint32_t>( 1, std::min( mTool.numThreads(), numChunks ) );
+    std::atomic<uint32_t> nextChunk{ 0 };
+
+    mPool->run( numThreads, [&]( uint32_t thread ) {
+        ThreadCounts& counts = *mThreadCounts[thread];
+        counts.reset( mStorage, numBins );
+        for( uint32_t chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++ ) {
+            uint32_t firstRow = chunk * chunkRows;
+            countRows( image, firstRow, std::min( chunkRows, image.height - firstRow ), counts );
+        }
+        if( ! counts.isDense ) {
+            counts.sort();
+        }
+    } );
+
+    merge( numThreads );
+}
+
+/*
+ * Empty the results
+ */
+void JointHistogram::reset( )
+{
+    std::lock_guard<std::mutex> lock{ mMutex };
+    mKeys.clear();
+    mCounts.clear();
+}
+
+uint32_t JointHistogram::binsPerChannel( ) const
+{
+    return 1u << mBits;
+}
+
+JointHistogram::Storage JointHistogram::storage( ) const
+{
+    return mStorage;
+}
+
+uint32_t JointHistogram::keyOf( uint8_t red, uint8_t green, uint8_t blue ) const
+{
+    const uint32_t shift = 8 - mBits;
+    return ( static_cast<uint32_t>( red >> shift ) << ( 2 * mBits ) ) | ( static_cast<uint32_t>( green >> shift ) << mBits ) | ( blue >> shift );
+}
+
+void JointHistogram::binsOf( uint32_t key, uint32_t& red, uint32_t& green, uint32_t& blue ) const
+{
+    const uint32_t mask = ( 1u << mBits ) - 1;
+    red = ( key >> ( 2 * mBits ) ) & mask;
+    green = ( key >> mBits ) & mask;
+    blue = key & mask;
+}
+
+/*
+ * Binary search of the keys hit
+ */
+uint64_t JointHistogram::count( uint32_t key ) const
+{
+    auto found = std::lower_bound( mKeys.begin(), mKeys.end(), key );
+    return ( found != mKeys.end() && *found == key ) ? mCounts[ found - mKeys.begin() ] : 0;
+}
+
+const std::vector<uint32_t>& JointHistogram::keys( ) const
+{
+    return mKeys;
+}
+
+const std::vector<uint64_t>& JointHistogram::counts( ) const
+{
+    return mCounts;
+}
+
+uint64_t JointHistogram::total( ) const
+{
+    uint64_t total = 0;
+    for( uint64_t count : mCounts ) {
+        total += count;
+    }
+    return total;
+}
+
+/*
+ * 16, 32 or 64
+ */
+uint32_t JointHistogram::binsFromName( const std::string& text )
+{
+    if( text == "16" || text == "32" || text == "64" ) {
+        return static_cast<uint32_t>( std::stoul( text ) );
+    }
+    throw std::invalid_argument( "Bins per channel must be 16, 32 or 64, not " + text );
+}
@@ -0,0 +1,190 @@
+#ifndef JOINT_HISTOGRAM_H
+#define JOINT_HISTOGRAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "histogram_tool.h"
+#include "image_view.h"
+#include "worker_pool.h"
+
+/**
+ * JointHistogram.
+ *
+ * Counts the joint distribution of red, green and blue, which separate channel histograms lose. Each channel
+ * is quantized to its top bits, 16, 32 or 64 bins, and a pixel counts in the bin of the three together; a
+ * bin's key is red << 2 * bits | green << bits | blue.
+ *
+ * Threads claim chunks of scanlines as HistogramTool's do. A pixel's key is a few shifts and masks, worked out
+ * and counted in the same loop, specialised at compile time for each format and number of bins, so counting
+ * keeps up with reading the pixels. Each thread counts into storage of its own:
+ *   - Dense: a count for every bin, when that fits in half the L2 cache.
+ *   - Sparse: an open addressed hash table of the bins seen, which grows as needed. Images hold far fewer
+ *     colours than the 262144 bins of 64 per channel, so the table stays in cache where a dense array wouldn't.
+ *     A table which would outgrow a dense array, as for noise, is turned into one.
+ * Counts are 32 bit, and a thread nearing 2^32 pixels adds its counts to a shared wide array and starts again.
+ * Once counted, each thread sorts its sparse bins by key. The merge is parallel: the key range is cut into
+ * slices, and each task adds up one slice from every thread, and from previous results, into the output.
+ *
+ * The result is sparse: the keys of the bins which were hit, ascending, and their counts. Like
+ * HistogramTool, counts are added to the previous results until reset. Calls are serialised.
+ */
+class JointHistogram {
+public:
+    /**
+     * How each thread starts holding its counts.
+     */
+    enum class Storage {
+        Dense,
+        Sparse
+    };
+
+    /**
+     * Pixels counted between checks that a thread's 32 bit counts can't overflow.
+     */
+    static const size_t BLOCK_PIXELS = 512;
+
+    /**
+     * Slots a thread's sparse table starts with. Tables double when a quarter full.
+     */
+    static const uint32_t INITIAL_SLOTS = 4096;
+
+private:
+    // Counts of one thread, defined in the .cpp
+    struct ThreadCounts;
+
+    // Tool whose chunk size and number of threads are used
+    HistogramTool&  mTool;
+
+    // Bits of each channel kept
+    uint32_t        mBits;
+
+    // How threads start holding their counts
+    Storage         mStorage;
+
+    // Keys of the bins hit, ascending, and their counts
+    std::vector<uint32_t>   mKeys;
+    std::vector<uint64_t>   mCounts;
+
+    // Counts of threads which neared 2^32 pixels, a count per bin. Empty until needed
+    std::vector<uint64_t>   mSpilled;
+
+    // Threads which count and merge
+    std::unique_ptr<WorkerPool>     mPool;
+
+    // Counts of each thread
+    std::vector<std::unique_ptr<ThreadCounts>>  mThreadCounts;
+
+    // Serialises calls, and threads spilling their counts
+    std::mutex      mMutex;
+    std::mutex      mSpillMutex;
+
+    /**
+     * Count the pixels of a run of scanlines into a thread's counts.
+     * @param image The image.
+     * @param firstRow The first scanline.
+     * @param numRows The number of scanlines.
+     * @param counts The thread's counts.
+     */
+    void countRows( const ImageView& image, uint32_t firstRow, uint32_t numRows, ThreadCounts& counts );
+
+    /**
+     * Add a thread's counts to the spilled counts and empty them.
+     * @param counts The thread's counts.
+     */
+    void spill( ThreadCounts& counts );
+
+    /**
+     * Add up every thread's counts, the spilled counts and the previous results into new results.
+     * @param numThreads The number of threads which counted.
+     */
+    void merge( uint32_t numThreads );
+
+public:
+    /**
+     * Construct a joint histogram, empty.
+     * @param tool Tool whose chunk size and number of threads are used. Must outlive this object.
+     * @param binsPerChannel Bins each channel is quantized to; 16, 32 or 64.
+     * @param denseLimitBytes Most bytes of dense counts a thread may have; sparse tables are used if more would
+     * be needed. 0 is half of the L2 cache.
+     * @throws std::invalid_argument if binsPerChannel isn't 16, 32 or 64.
+     */
+    JointHistogram( HistogramTool& tool, uint32_t binsPerChannel = 32, size_t denseLimitBytes = 0 );
+
+    ~JointHistogram( );
+
+    JointHistogram( const JointHistogram& ) = delete;
+    JointHistogram& operator=( const JointHistogram& ) = delete;
+
+    /**
+     * Count the pixels of an image, adding them to the results.
+     * @param image The image, in any format.
+     * @throws std::invalid_argument if the view has pixels but no data.
+     */
+    void compute( const ImageView& image );
+
+    /**
+     * Empty the results.
+     */
+    void reset( );
+
+    /**
+     * @return Bins each channel is quantized to.
+     */
+    uint32_t binsPerChannel( ) const;
+
+    /**
+     * @return How each thread starts holding its counts.
+     */
+    Storage storage( ) const;
+
+    /**
+     * @param red Red value of a colour.
+     * @param green Green value.
+     * @param blue Blue value.
+     * @return The key of the bin the colour counts in.
+     */
+    uint32_t keyOf( uint8_t red, uint8_t green, uint8_t blue ) const;
+
+    /**
+     * @param key Key of a bin.
+     * @param red Set to the bin's red bin, from 0 to binsPerChannel() - 1.
+     * @param green Set to its green bin.
+     * @param blue Set to its blue bin.
+     */
+    void binsOf( uint32_t key, uint32_t& red, uint32_t& green, uint32_t& blue ) const;
+
+    /**
+     * @param key Key of a bin.
+     * @return The count of the bin; 0 if it wasn't hit.
+     */
+    uint64_t count( uint32_t key ) const;
+
+    /**
+     * @return Keys of the bins hit, ascending.
+     */
+    const std::vector<uint32_t>& keys( ) const;
+
+    /**
+     * @return Counts of the bins hit, in the order of keys().
+     */
+    const std::vector<uint64_t>& counts( ) const;
+
+    /**
+     * @return The number of pixels counted.
+     */
+    uint64_t total( ) const;
+
+    /**
+     * Parse a number of bins per channel.
+     * @param text 16, 32 or 64.
+     * @return The number.
+     * @throws std::invalid_argument if it is none of those.
+     */
+    static uint32_t binsFromName( const std::string& text );
+};
+
+#endif // JOINT_HISTOGRAM_H
@@ -0,0 +1,512 @@
+#include "mapped_raster.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    /*
+     * Reads the whitespace separated text tokens of a PNM or PAM header
+     */
+    class HeaderReader {
+    private:
+        const uint8_t   *mData;
+        size_t          mSize;
+        size_t          mPos;
+
+    public:
+        HeaderReader( const uint8_t *data, size_t size ) : mData{ data }, mSize{ size }, mPos{ 0 } {
+        }
+
+        // Skip whitespace and, if allowed, comments running to the end of the line
+        void skipSpace( bool comments ) {
+            while( mPos < mSize ) {
+                if( comments && mData[mPos] == '#' ) {
+                    while( mPos < mSize && mData[mPos] != '\n' ) {
+                        mPos++;
+                    }
+                } else if( mData[mPos] == ' ' || mData[mPos] == '\t' || mData[mPos] == '\r' || mData[mPos] == '\n' ) {
+                    mPos++;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        // Read the next token, skipping leading whitespace and comments
+        std::string token( ) {
+            skipSpace( true );
+            size_t start = mPos;
+            while( mPos < mSize && ! std::isspace( mData[mPos] ) ) {
+                mPos++;
+            }
+            return std::string( reinterpret_cast<const char *>( mData + start ), mPos - start );
+        }
+
+        // Read the next token as a non-negative integer. Returns false if it isn't one
+        bool number( uint32_t& value ) {
+            std::string text = token();
+            if( text.empty() || text.size() > 9 || text.find_first_not_of( "0123456789" ) != std::string::npos ) {
+                return false;
+            }
+            value = static_cast<uint32_t>( std::stoul( text ) );
+            return true;
+        }
+
+        // Consume the single whitespace character which ends a header. Returns false if there isn't one
+        bool endOfHeader( ) {
+            if( mPos < mSize && std::isspace( mData[mPos] ) ) {
+                mPos++;
+                return true;
+            }
+            return false;
+        }
+
+        // Skip the rest of the current line
+        void skipLine( ) {
+            while( mPos < mSize && mData[mPos] != '\n' ) {
+                mPos++;
+            }
+            if( mPos < mSize ) {
+                mPos++;
+            }
+        }
+
+        size_t position( ) const {
+            return mPos;
+        }
+    };
+
+    /*
+     * Read little endian values from a BMP header
+     */
+    uint32_t readU32( const uint8_t *p ) {
+        return static_cast<uint32_t>( p[0] ) | ( static_cast<uint32_t>( p[1] ) << 8 )
+            | ( static_cast<uint32_t>( p[2] ) << 16 ) | ( static_cast<uint32_t>( p[3] ) << 24 );
+    }
+
+    uint16_t readU16( const uint8_t *p ) {
+        return static_cast<uint16_t>( p[0] | ( p[1] << 8 ) );
+    }
+}
+
+
+/*
+ * Construct with nothing mapped
+ */
+MappedRaster::MappedRaster( )
+{
+    mMapping = nullptr;
+    mMappedBytes = 0;
+}
+
+/*
+ * Unmap the file
+ */
+MappedRaster::~MappedRaster( )
+{
+    close();
+}
+
+/*
+ * Check the signature at the start of a file
+ */
+bool MappedRaster::isMappable( const std::string& fileName )
+{
+    std::ifstream file{ fileName, std::ios::binary };
+    char signature[2] = { 0, 0 };
+    file.read( signature, 2 );
+    if( ! file.good() ) {
+        return false;
+    }
+
+    return ( signature[0] == 'P' && ( signature[1] == '6' || signature[1] == '7' ) )
+        || ( signature[0] == 'B' && signature[1] == 'M' );
+}
+
+/*
+ * Open a file and map the whole of it
+ */
+bool MappedRaster::map( const std::string& fileName )
+{
+    close();
+    mErrorString.clear();
+
+    int fd = ::open( fileName.c_str(), O_RDONLY );
+    if( fd < 0 ) {
+        mErrorString = "Unable to open " + fileName + ": " + std::strerror( errno );
+        return false;
+    }
+
+    bool mapped = mapDescriptor( fd, fileName );
+    ::close( fd );
+    return mapped;
+}
+
+/*
+ * Map the whole of an open file read only and hint that it will be read sequentially
+ */
+bool MappedRaster::mapDescriptor( int fd, const std::string& name )
+{
+    struct stat status;
+    if( fstat( fd, &status ) != 0 || status.st_size == 0 ) {
+        mErrorString = "Unable to map " + name + ": empty or unreadable file";
+        return false;
+    }
+
+    size_t size = static_cast<size_t>( status.st_size );
+    void *mapping = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if( mapping == MAP_FAILED ) {
+        mErrorString = "Unable to map " + name + ": " + std::strerror( errno );
+        return false;
+    }
+
+    // Only a hint; failure doesn't matter
+    madvise( mapping, size, MADV_SEQUENTIAL );
+
+    mMapping = mapping;
+    mMappedBytes = size;
+    return true;
+}
+
+/*
+ * Map a PPM, PAM or BMP file
+ */
+bool MappedRaster::open( const std::string& fileName )
+{
+    if( ! map( fileName ) ) {
+        return false;
+    }
+
+    const uint8_t *data = static_cast<const uint8_t *>( mMapping );
+    bool parsed = false;
+    if( mMappedBytes >= 2 && data[0] == 'P' && data[1] == '6' ) {
+        parsed = parsePnm();
+    } else if( mMappedBytes >= 2 && data[0] == 'P' && data[1] == '7' ) {
+        parsed = parsePam();
+    } else if( mMappedBytes >= 2 && data[0] == 'B' && data[1] == 'M' ) {
+        parsed = parseBmp();
+    } else {
+        mErrorString = "Not a PPM, PAM or BMP file";
+    }
+
+    if( parsed ) {
+        parsed = checkBounds();
+    }
+    if( ! parsed ) {
+        mErrorString = "Unable to map " + fileName + ": " + mErrorString;
+        close();
+    }
+    return parsed;
+}
+
+/*
+ * Map a headerless file of pixels
+ */
+bool MappedRaster::openRaw( const std::string& fileName, uint32_t width, uint32_t height, uint32_t bytesPerLine, PixelFormat format )
+{
+    if( format == PixelFormat::Indexed8 ) {
+        mErrorString = "Raw data can't be indexed";
+        return false;
+    }
+    if( ! map( fileName ) ) {
+        return false;
+    }
+    return layoutRaw( fileName, width, height, bytesPerLine, format );
+}
+
+/*
+ * Map headerless pixels from a descriptor someone else owns
+ */
+bool MappedRaster::openRaw( int fd, uint32_t width, uint32_t height, uint32_t bytesPerLine, PixelFormat format )
+{
+    close();
+    mErrorString.clear();
+    if( format == PixelFormat::Indexed8 ) {
+        mErrorString = "Raw data can't be indexed";
+        return false;
+    }
+
+    std::string name = "descriptor " + std::to_string( fd );
+    if( ! mapDescriptor( fd, name ) ) {
+        return false;
+    }
+    return layoutRaw( name, width, height, bytesPerLine, format );
+}
+
+/*
+ * Headerless pixels start at the beginning of the mapping
+ */
+bool MappedRaster::layoutRaw( const std::string& name, uint32_t width, uint32_t height, uint32_t bytesPerLine, PixelFormat format )
+{
+    size_t minBytesPerLine = static_cast<size_t>( width ) * ImageView::bytesPerPixel( format );
+    if( bytesPerLine == 0 ) {
+        bytesPerLine = static_cast<uint32_t>( minBytesPerLine );
+    }
+    if( bytesPerLine < minBytesPerLine ) {
+        mErrorString = "Unable to map " + name + ": stride is smaller than a scanline";
+        close();
+        return false;
+    }
+
+    mView = ImageView{ static_cast<const uint8_t *>( mMapping ), width, height, static_cast<ptrdiff_t>( bytesPerLine ), format };
+    if( ! checkBounds() ) {
+        mErrorString = "Unable to map " + name + ": " + mErrorString;
+        close();
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Parse a binary PPM header: P6 width height maxval, then one whitespace character
+ */
+bool MappedRaster::parsePnm( )
+{
+    const uint8_t *data = static_cast<const uint8_t *>( mMapping );
+    HeaderReader header{ data, mMappedBytes };
+    header.token();
+
+    uint32_t width, height, maxValue;
+    if( ! header.number( width ) || ! header.number( height ) || ! header.number( maxValue ) || ! header.endOfHeader() ) {
+        mErrorString = "Malformed PPM header";
+        return false;
+    }
+    if( maxValue != 255 ) {
+        mErrorString = "Only 8 bit PPM files are supported";
+        return false;
+    }
+
+    mView = ImageView{ data + header.position(), width, height, static_cast<ptrdiff_t>( width ) * 3, PixelFormat::RGB888 };
+    return true;
+}
+
+/*
+ * Parse a PAM header: P7 then lines of KEYWORD value up to ENDHDR
+ */
+bool MappedRaster::parsePam( )
+{
+    const uint8_t *data = static_cast<const uint8_t *>( mMapping );
+    HeaderReader header{ data, mMappedBytes };
+    header.token();
+
+    uint32_t width = 0, height = 0, depth = 0, maxValue = 0;
+    for( ;; ) {
+        std::string keyword = header.token();
+        bool ok = true;
+        if( keyword == "ENDHDR" ) {
+            header.skipLine();
+            break;
+        } else if( keyword == "WIDTH" ) {
+            ok = header.number( width );
+        } else if( keyword == "HEIGHT" ) {
+            ok = header.number( height );
+        } else if( keyword == "DEPTH" ) {
+            ok = header.number( depth );
+        } else if( keyword == "MAXVAL" ) {
+            ok = header.number( maxValue );
+        } else if( keyword.empty() ) {
+            ok = false;
+        } else {
+            // TUPLTYPE and anything else is informational; DEPTH says all we need
+            header.skipLine();
+        }
+
+        if( ! ok ) {
+            mErrorString = "Malformed PAM header";
+            return false;
+        }
+    }
+
+    if( maxValue != 255 ) {
+        mErrorString = "Only 8 bit PAM files are supported";
+        return false;
+    }
+
+    PixelFormat format;
+    switch( depth ) {
+        case 1:  format = PixelFormat::Grayscale8; break;
+        case 3:  format = PixelFormat::RGB888; break;
+        case 4:  format = PixelFormat::RGBA8888; break;
+        default:
+            mErrorString = "Only PAM files of depth 1, 3 or 4 are supported";
+            return false;
+    }
+
+    mView = ImageView{ data + header.position(), width, height, static_cast<ptrdiff_t>( width ) * depth, format };
+    return true;
+}
+
+/*
+ * Parse a BMP header. Scanlines are padded to 4 bytes and stored bottom up unless the height is negative.
+ */
+bool MappedRaster::parseBmp( )
+{
+    const uint8_t *data = static_cast<const uint8_t *>( mMapping );
+    const size_t FILE_HEADER_SIZE = 14;
+    if( mMappedBytes < FILE_HEADER_SIZE + 40 ) {
+        mErrorString = "Truncated BMP header";
+        return false;
+    }
+
+    uint32_t pixelOffset = readU32( data + 10 );
+    uint32_t infoSize = readU32( data + 14 );
+    int32_t width = static_cast<int32_t>( readU32( data + 18 ) );
+    int32_t height = static_cast<int32_t>( readU32( data + 22 ) );
+    uint16_t bitsPerPixel = readU16( data + 28 );
+    uint32_t compression = readU32( data + 30 );
+    uint32_t coloursUsed = readU32( data + 46 );
+
+    // BI_RGB, or BI_BITFIELDS with the default 32 bit masks
+    const uint32_t BI_RGB = 0, BI_BITFIELDS = 3;
+    bool defaultMasks = compression == BI_RGB;
+    if( compression == BI_BITFIELDS && bitsPerPixel == 32 && mMappedBytes >= FILE_HEADER_SIZE + 52 ) {
+        defaultMasks = readU32( data + 54 ) == 0x00FF0000 && readU32( data + 58 ) == 0x0000FF00 && readU32( data + 62 ) == 0x000000FF;
+    }
+    if( ! defaultMasks || infoSize < 40 || width <= 0 || height == 0 || height == INT32_MIN ) {
+        mErrorString = "Only uncompressed BMP files are supported";
+        return false;
+    }
+
+    PixelFormat format;
+    switch( bitsPerPixel ) {
+        case 8:  format = PixelFormat::Indexed8; break;
+        case 24: format = PixelFormat::BGR888; break;
+        case 32: format = PixelFormat::ARGB32; break;
+        default:
+            mErrorString = "Only 8, 24 and 32 bit BMP files are supported";
+            return false;
+    }
+
+    // Palette entries are B, G, R, reserved; read as little endian words that is 0x00RRGGBB
+    if( format == PixelFormat::Indexed8 ) {
+        uint32_t numColours = ( coloursUsed == 0 || coloursUsed > 256 ) ? 256 : coloursUsed;
+        size_t paletteStart = FILE_HEADER_SIZE + infoSize;
+        if( paletteStart + static_cast<size_t>( numColours ) * 4 > mMappedBytes ) {
+            mErrorString = "Truncated BMP palette";
+            return false;
+        }
+        mColourTable.resize( numColours );
+        for( uint32_t i = 0; i < numColours; ++i ) {
+            mColourTable[i] = 0xFF000000 | readU32( data + paletteStart + i * 4 );
+        }
+    }
+
+    uint32_t rows = static_cast<uint32_t>( height < 0 ? -height : height );
+    ptrdiff_t bytesPerLine = ( ( static_cast<ptrdiff_t>( width ) * bitsPerPixel + 31 ) / 32 ) * 4;
+    if( pixelOffset >= mMappedBytes || static_cast<uint64_t>( bytesPerLine ) * rows > mMappedBytes - pixelOffset ) {
+        mErrorString = "Truncated BMP file";
+        return false;
+    }
+
+    // Bottom up files are walked from their last scanline with a negative stride
+    const uint8_t *pixels = data + pixelOffset;
+    if( height > 0 ) {
+        pixels += bytesPerLine * ( rows - 1 );
+        bytesPerLine = -bytesPerLine;
+    }
+
+    mView = ImageView{ pixels, static_cast<uint32_t>( width ), rows, bytesPerLine, format,
+                       mColourTable.empty() ? nullptr : mColourTable.data(),
+                       static_cast<uint32_t>( mColourTable.size() ) };
+    return true;
+}
+
+/*
+ * Check that every scanline of the view lies within the mapping
+ */
+bool MappedRaster::checkBounds( )
+{
+    if( mView.width == 0 || mView.height == 0 ) {
+        mErrorString = "Image is empty";
+        return false;
+    }
+
+    // Offsets of the first byte of the first scanline and of the last, whichever way the scanlines run.
+    // Work in 64 bits so that a header claiming an absurd size can't wrap around
+    int64_t first = static_cast<int64_t>( mView.data - static_cast<const uint8_t *>( mMapping ) );
+    uint64_t stride = static_cast<uint64_t>( mView.bytesPerLine < 0 ? -mView.bytesPerLine : mView.bytesPerLine );
+    uint64_t rowBytes = static_cast<uint64_t>( mView.width ) * ImageView::bytesPerPixel( mView.format );
+    uint64_t span = stride * ( mView.height - 1 );
+    bool fits = stride == 0 || ( mView.height - 1 ) <= mMappedBytes / stride;
+    int64_t last = ( mView.bytesPerLine < 0 ) ? first - static_cast<int64_t>( span ) : first + static_cast<int64_t>( span );
+    int64_t low = std::min( first, last );
+    int64_t high = std::max( first, last ) + static_cast<int64_t>( rowBytes );
+
+    if( ! fits || rowBytes > mMappedBytes || low < 0 || high > static_cast<int64_t>( mMappedBytes ) ) {
+        mErrorString = "File is too small for an image of " + std::to_string( mView.width ) + "x" + std::to_string( mView.height );
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Unmap the file
+ */
+void MappedRaster::close( )
+{
+    if( mMapping ) {
+        munmap( mMapping, mMappedBytes );
+    }
+    mMapping = nullptr;
+    mMappedBytes = 0;
+    mView = ImageView();
+    mColourTable.clear();
+}
+
+/*
+ * Drop the whole pages spanned by a band of scanlines
+ */
+void MappedRaster::release( uint32_t firstRow, uint32_t numRows )
+{
+    if( ! mMapping || numRows == 0 || firstRow >= mView.height ) {
+        return;
+    }
+    numRows = std::min( numRows, mView.height - firstRow );
+
+    // Byte range of the band, whichever way the scanlines run
+    uintptr_t first = reinterpret_cast<uintptr_t>( mView.row( firstRow ) );
+    uintptr_t last = reinterpret_cast<uintptr_t>( mView.row( firstRow + numRows - 1 ) );
+    uintptr_t rowBytes = static_cast<uintptr_t>( mView.width ) * ImageView::bytesPerPixel( mView.format );
+    uintptr_t begin = std::min( first, last );
+    uintptr_t end = std::max( first, last ) + rowBytes;
+
+    // Only whole pages inside the band
+    uintptr_t pageSize = static_cast<uintptr_t>( sysconf( _SC_PAGESIZE ) );
+    begin = ( begin + pageSize - 1 ) & ~( pageSize - 1 );
+    end = end & ~( pageSize - 1 );
+    if( begin < end ) {
+        madvise( reinterpret_cast<void *>( begin ), end - begin, MADV_DONTNEED );
+    }
+}
+
+/*
+ * Return a view of the mapped pixels
+ */
+const ImageView& MappedRaster::view( ) const
+{
+    return mView;
+}
+
+/*
+ * Return the number of bytes mapped
+ */
+size_t MappedRaster::mappedBytes( ) const
+{
+    return mMappedBytes;
+}
+
+/*
+ * Return a description of the last failure
+ */
+std::string MappedRaster::errorString( ) const
+{
+    return mErrorString;
+}
@@ -0,0 +1,142 @@
+#ifndef MAPPED_RASTER_H
+#define MAPPED_RASTER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "image_view.h"
+
+/**
+ * MappedRaster.
+ *
+ * Gives direct access to the pixels of an uncompressed raster file by mapping the file into memory.
+ * No pixel is copied: view() describes the pixels where they lie in the mapping and can be passed
+ * straight to HistogramTool::computeHistogram. The kernel is told the file will be read sequentially
+ * so it can read ahead and drop pages once they have been counted, so files much larger than memory
+ * can be processed.
+ *
+ * Supported files are:
+ *   - binary PPM (P6) with a maximum value of 255,
+ *   - PAM (P7) with a depth of 1, 3 or 4 and a maximum value of 255,
+ *   - uncompressed BMP with 8 (paletted), 24 or 32 bits per pixel, top down or bottom up,
+ *   - headerless raw data, whose size and layout must be given by the caller.
+ *
+ * Only available on POSIX systems.
+ */
+class MappedRaster {
+private:
+    // Start and length of the mapping. nullptr if nothing is mapped
+    void            *mMapping;
+    size_t          mMappedBytes;
+
+    // The pixels within the mapping
+    ImageView       mView;
+
+    // Palette of an 8 bit BMP, as 0xAARRGGBB
+    std::vector<uint32_t>   mColourTable;
+
+    // Description of the last failure
+    std::string     mErrorString;
+
+    // Map a whole file read only. Returns false and sets mErrorString on failure
+    bool map( const std::string& fileName );
+
+    // Map the whole of an open file read only, leaving the descriptor open. name is used in errors
+    bool mapDescriptor( int fd, const std::string& name );
+
+    // Describe the mapping as headerless pixels. Returns false, sets mErrorString and unmaps if it doesn't fit
+    bool layoutRaw( const std::string& name, uint32_t width, uint32_t height, uint32_t bytesPerLine, PixelFormat format );
+
+    // Fill in mView from the header of a mapped file. Return false and set mErrorString if it is not supported
+    bool parsePnm( );
+    bool parsePam( );
+    bool parseBmp( );
+
+    // Check that the view lies within the mapping
+    bool checkBounds( );
+
+public:
+    /**
+     * Construct with nothing mapped.
+     */
+    MappedRaster( );
+
+    /**
+     * Unmap the file, if any.
+     */
+    ~MappedRaster( );
+
+    MappedRaster( const MappedRaster& ) = delete;
+    MappedRaster& operator=( const MappedRaster& ) = delete;
+
+    /**
+     * @param fileName A file.
+     * @return true if the file starts with the signature of a PPM, PAM or BMP file. The rest of the
+     * header is not checked so open() may still fail.
+     */
+    static bool isMappable( const std::string& fileName );
+
+    /**
+     * Map a PPM, PAM or BMP file, replacing any file already mapped.
+     * @param fileName The file.
+     * @return true on success, false if the file can't be mapped or isn't a supported raster. See errorString().
+     */
+    bool open( const std::string& fileName );
+
+    /**
+     * Map a headerless file of pixels, replacing any file already mapped.
+     * @param fileName The file.
+     * @param width Pixels per scanline.
+     * @param height Number of scanlines.
+     * @param bytesPerLine Distance in bytes between the starts of scanlines, or 0 if scanlines aren't padded.
+     * @param format Layout of each pixel.
+     * @return true on success, false if the file can't be mapped or is too small. See errorString().
+     */
+    bool openRaw( const std::string& fileName, uint32_t width, uint32_t height, uint32_t bytesPerLine = 0,
+                  PixelFormat format = PixelFormat::RGBA8888 );
+
+    /**
+     * Map headerless pixels from an open file descriptor, such as a memfd or shm_open object shared by another
+     * process, replacing anything already mapped. The descriptor is not closed and may be closed once this returns.
+     * @param fd The descriptor, open for reading.
+     * @param width Pixels per scanline.
+     * @param height Number of scanlines.
+     * @param bytesPerLine Distance in bytes between the starts of scanlines, or 0 if scanlines aren't padded.
+     * @param format Layout of each pixel.
+     * @return true on success, false if the descriptor can't be mapped or is too small. See errorString().
+     */
+    bool openRaw( int fd, uint32_t width, uint32_t height, uint32_t bytesPerLine = 0,
+                  PixelFormat format = PixelFormat::RGBA8888 );
+
+    /**
+     * Unmap the file, if any.
+     */
+    void close( );
+
+    /**
+     * Tell the kernel that a band of scanlines won't be read again so that it can drop their pages.
+     * Pages shared with scanlines outside the band are kept. The pixels can still be read afterwards;
+     * they are just read from the file again.
+     * @param firstRow The first scanline of the band.
+     * @param numRows The number of scanlines in the band.
+     */
+    void release( uint32_t firstRow, uint32_t numRows );
+
+    /**
+     * @return A view of the mapped pixels. Valid until the raster is closed or destroyed.
+     */
+    const ImageView& view( ) const;
+
+    /**
+     * @return The number of bytes mapped, or 0 if nothing is mapped.
+     */
+    size_t mappedBytes( ) const;
+
+    /**
+     * @return A description of why the last call to open or openRaw failed.
+     */
+    std::string errorString( ) const;
+};
+
+#endif // MAPPED_RASTER_H
@@ -0,0 +1,44 @@
+#ifndef NOISE_SOURCE_H
+#define NOISE_SOURCE_H
+
+#include <cstdint>
+
+/**
+ * NoiseSource.
+ *
+ * A fast, repeatable source of 32 bit noise (Marsaglia's xorshift32) for filling images which are only
+ * needed to exercise the counting code, such as when calibrating or testing. It is not for anything which
+ * needs good randomness.
+ *
+ * The same seed always gives the same sequence. The seed must not be 0, which gives only 0s.
+ */
+class NoiseSource {
+public:
+    /**
+     * The seed used unless another is given.
+     */
+    static const uint32_t DEFAULT_SEED = 2463534242u;
+
+private:
+    // The last value produced
+    uint32_t    mState;
+
+public:
+    /**
+     * Construct a source.
+     * @param seed The seed; not 0.
+     */
+    explicit NoiseSource( uint32_t seed = DEFAULT_SEED ) : mState{ seed } {}
+
+    /**
+     * @return The next value.
+     */
+    uint32_t next( ) {
+        mState ^= mState << 13;
+        mState ^= mState >> 17;
+        mState ^= mState << 5;
+        return mState;
+    }
+};
+
+#endif // NOISE_SOURCE_H
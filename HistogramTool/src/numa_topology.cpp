@@ -0,0 +1,253 @@
+#include "numa_topology.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+/*
+ * Check and keep the nodes
+ */
+NumaTopology::NumaTopology( const std::vector<std::vector<uint32_t>>& nodeCpus, const std::vector<uint32_t>& nodeIds )
+    : mNodeCpus{ nodeCpus }, mNodeIds{ nodeIds } {
+    if( mNodeCpus.empty() ) {
+        throw std::invalid_argument( "A topology must have at least one node" );
+    }
+    if( mNodeIds.empty() ) {
+        for( uint32_t node = 0; node < mNodeCpus.size(); ++node ) {
+            mNodeIds.push_back( node );
+        }
+    } else if( mNodeIds.size() != mNodeCpus.size() ) {
+        throw std::invalid_argument( "Every node needs a system number" );
+    }
+
+    std::set<uint32_t> seen;
+    for( std::vector<uint32_t>& cpus : mNodeCpus ) {
+        if( cpus.empty() ) {
+            throw std::invalid_argument( "Every node must have a CPU" );
+        }
+        std::sort( cpus.begin(), cpus.end() );
+        for( uint32_t cpu : cpus ) {
+            if( ! seen.insert( cpu ).second ) {
+                throw std::invalid_argument( "A CPU can only be in one node" );
+            }
+        }
+    }
+}
+
+/*
+ * Nodes from sysfs, limited to our affinity mask. One node of every usable CPU if that fails
+ */
+NumaTopology NumaTopology::detect( ) {
+    std::vector<uint32_t> allowed;
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO( &mask );
+    if( sched_getaffinity( 0, sizeof( mask ), &mask ) == 0 ) {
+        for( uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+            if( CPU_ISSET( cpu, &mask ) ) {
+                allowed.push_back( cpu );
+            }
+        }
+    }
+#endif
+    if( allowed.empty() ) {
+        uint32_t numCpus = std::max<uint32_t>( 1, std::thread::hardware_concurrency() );
+        for( uint32_t cpu = 0; cpu < numCpus; ++cpu ) {
+            allowed.push_back( cpu );
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> nodeCpus;
+    std::vector<uint32_t> nodeIds;
+#ifdef __linux__
+    std::vector<uint32_t> systemNodes;
+    if( DIR *directory = opendir( "/sys/devices/system/node" ) ) {
+        while( dirent *entry = readdir( directory ) ) {
+            std::string name{ entry->d_name };
+            if( name.compare( 0, 4, "node" ) == 0 && name.size() > 4
+                && name.find_first_not_of( "0123456789", 4 ) == std::string::npos ) {
+                systemNodes.push_back( static_cast<uint32_t>( std::strtoul( name.c_str() + 4, nullptr, 10 ) ) );
+            }
+        }
+        closedir( directory );
+    }
+    std::sort( systemNodes.begin(), systemNodes.end() );
+
+    for( uint32_t systemNode : systemNodes ) {
+        std::ifstream file{ "/sys/devices/system/node/node" + std::to_string( systemNode ) + "/cpulist" };
+        std::string text;
+        std::vector<uint32_t> cpus, usable;
+        if( ! std::getline( file, text ) || ! parseCpuList( text, cpus ) ) {
+            continue;
+        }
+        std::set_intersection( cpus.begin(), cpus.end(), allowed.begin(), allowed.end(), std::back_inserter( usable ) );
+        if( ! usable.empty() ) {
+            nodeCpus.push_back( usable );
+            nodeIds.push_back( systemNode );
+        }
+    }
+#endif
+
+    if( nodeCpus.empty() ) {
+        return NumaTopology{ { allowed } };
+    }
+    return NumaTopology{ nodeCpus, nodeIds };
+}
+
+/*
+ * Number of nodes
+ */
+uint32_t NumaTopology::numNodes( ) const {
+    return static_cast<uint32_t>( mNodeCpus.size() );
+}
+
+/*
+ * CPUs of a node
+ */
+const std::vector<uint32_t>& NumaTopology::cpusOf( uint32_t node ) const {
+    if( node >= mNodeCpus.size() ) {
+        throw std::invalid_argument( "Node out of range" );
+    }
+    return mNodeCpus[node];
+}
+
+/*
+ * Node of a CPU, searched for as there are few nodes
+ */
+uint32_t NumaTopology::nodeOfCpu( uint32_t cpu ) const {
+    for( uint32_t node = 0; node < mNodeCpus.size(); ++node ) {
+        if( std::binary_search( mNodeCpus[node].begin(), mNodeCpus[node].end(), cpu ) ) {
+            return node;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Index of a node from its system number
+ */
+uint32_t NumaTopology::nodeFromSystem( int systemNode ) const {
+    for( uint32_t node = 0; node < mNodeIds.size(); ++node ) {
+        if( systemNode >= 0 && mNodeIds[node] == static_cast<uint32_t>( systemNode ) ) {
+            return node;
+        }
+    }
+    return numNodes();
+}
+
+/*
+ * One CPU from each node in turn
+ */
+std::vector<uint32_t> NumaTopology::spreadCpus( ) const {
+    std::vector<uint32_t> cpus;
+    for( size_t rank = 0; ; ++rank ) {
+        bool any = false;
+        for( const std::vector<uint32_t>& node : mNodeCpus ) {
+            if( rank < node.size() ) {
+                cpus.push_back( node[rank] );
+                any = true;
+            }
+        }
+        if( ! any ) {
+            return cpus;
+        }
+    }
+}
+
+/*
+ * CPU of the calling thread
+ */
+uint32_t NumaTopology::currentCpu( ) {
+#ifdef __linux__
+    int cpu = sched_getcpu();
+    if( cpu >= 0 ) {
+        return static_cast<uint32_t>( cpu );
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Ask move_pages where the pages are, without moving them
+ */
+bool NumaTopology::nodesOfPages( const std::vector<const void *>& addresses, std::vector<int>& nodes ) {
+#if defined( __linux__ ) && defined( __NR_move_pages )
+    if( addresses.empty() ) {
+        nodes.clear();
+        return true;
+    }
+
+    uintptr_t pageMask = ~static_cast<uintptr_t>( sysconf( _SC_PAGESIZE ) - 1 );
+    std::vector<void *> pages;
+    pages.reserve( addresses.size() );
+    for( const void *address : addresses ) {
+        pages.push_back( reinterpret_cast<void *>( reinterpret_cast<uintptr_t>( address ) & pageMask ) );
+    }
+
+    std::vector<int> status( addresses.size(), -1 );
+    if( syscall( __NR_move_pages, 0, static_cast<unsigned long>( pages.size() ), pages.data(), nullptr, status.data(), 0 ) != 0 ) {
+        return false;
+    }
+    for( int& node : status ) {
+        node = std::max( node, -1 );
+    }
+    nodes.swap( status );
+    return true;
+#else
+    (void) addresses;
+    (void) nodes;
+    return false;
+#endif
+}
+
+/*
+ * Comma separated CPUs or ranges of CPUs
+ */
+bool NumaTopology::parseCpuList( const std::string& text, std::vector<uint32_t>& cpus ) {
+    std::vector<uint32_t> result;
+    std::istringstream list{ text };
+    std::string item;
+
+    while( std::getline( list, item, ',' ) ) {
+        item.erase( std::remove_if( item.begin(), item.end(), ::isspace ), item.end() );
+        if( item.empty() ) {
+            continue;
+        }
+
+        size_t dash = item.find( '-' );
+        std::string first = item.substr( 0, dash );
+        std::string last = ( dash == std::string::npos ) ? first : item.substr( dash + 1 );
+        if( first.empty() || last.empty()
+            || first.find_first_not_of( "0123456789" ) != std::string::npos
+            || last.find_first_not_of( "0123456789" ) != std::string::npos ) {
+            return false;
+        }
+
+        unsigned long from = std::strtoul( first.c_str(), nullptr, 10 );
+        unsigned long to = std::strtoul( last.c_str(), nullptr, 10 );
+        if( to < from || to >= 65536 ) {
+            return false;
+        }
+        for( unsigned long cpu = from; cpu <= to; ++cpu ) {
+            result.push_back( static_cast<uint32_t>( cpu ) );
+        }
+    }
+
+    std::sort( result.begin(), result.end() );
+    result.erase( std::unique( result.begin(), result.end() ), result.end() );
+    cpus.swap( result );
+    return true;
+}
@@ -0,0 +1,97 @@
+#ifndef NUMA_TOPOLOGY_H
+#define NUMA_TOPOLOGY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * NumaTopology.
+ *
+ * Which CPUs belong to which NUMA node. On Linux detect() reads the nodes from sysfs, keeping only the CPUs
+ * this process may run on, so taskset and cgroup cpusets are respected. Elsewhere, or if sysfs can't be read,
+ * every CPU is put in one node. A topology can also be built by hand, to test placement on machines with a
+ * single node.
+ *
+ * Also finds which node holds given pages of memory, through the move_pages system call, and which CPU the
+ * calling thread is on.
+ */
+class NumaTopology {
+private:
+    // The CPUs of each node, ascending. Nodes are numbered from 0 here whatever the system calls them
+    std::vector<std::vector<uint32_t>>  mNodeCpus;
+
+    // The system's number of each node
+    std::vector<uint32_t>               mNodeIds;
+
+public:
+    /**
+     * Build a topology.
+     * @param nodeCpus The CPUs of each node.
+     * @param nodeIds The system's number of each node. Defaults to 0, 1, 2...
+     * @throws std::invalid_argument if there are no nodes, a node has no CPUs, a CPU is in more than one node
+     * or nodeIds is given and is not the same size as nodeCpus.
+     */
+    explicit NumaTopology( const std::vector<std::vector<uint32_t>>& nodeCpus, const std::vector<uint32_t>& nodeIds = {} );
+
+    /**
+     * Detect the topology of this machine, limited to the CPUs this process may use.
+     * @return The topology. Always has at least one node with at least one CPU.
+     */
+    static NumaTopology detect( );
+
+    /**
+     * @return The number of nodes.
+     */
+    uint32_t numNodes( ) const;
+
+    /**
+     * @param node A node, from 0 to numNodes() - 1.
+     * @return The CPUs of the node.
+     * @throws std::invalid_argument if node is out of range.
+     */
+    const std::vector<uint32_t>& cpusOf( uint32_t node ) const;
+
+    /**
+     * @param cpu A CPU.
+     * @return The node the CPU belongs to, or 0 if it isn't in any.
+     */
+    uint32_t nodeOfCpu( uint32_t cpu ) const;
+
+    /**
+     * @param systemNode The system's number for a node, as returned by nodesOfPages().
+     * @return The index of the node here, or numNodes() if it isn't one of them.
+     */
+    uint32_t nodeFromSystem( int systemNode ) const;
+
+    /**
+     * List the CPUs so that taking any number from the front spreads them as evenly as possible over the
+     * nodes: the first CPU of each node, then the second of each and so on.
+     * @return Every CPU once.
+     */
+    std::vector<uint32_t> spreadCpus( ) const;
+
+    /**
+     * @return The CPU the calling thread is running on, or 0 if that can't be found.
+     */
+    static uint32_t currentCpu( );
+
+    /**
+     * Find the system node holding each of a set of pages.
+     * @param addresses An address within each page.
+     * @param nodes Set to the system node of each page, or -1 for pages not yet touched or not found.
+     * @return false if this system can't say, when nodes is unchanged.
+     */
+    static bool nodesOfPages( const std::vector<const void *>& addresses, std::vector<int>& nodes );
+
+    /**
+     * Parse a Linux CPU list such as "0-3,8,10-11".
+     * @param text The list.
+     * @param cpus Set to the CPUs in the list, ascending.
+     * @return false if the list is malformed.
+     */
+    static bool parseCpuList( const std::string& text, std::vector<uint32_t>& cpus );
+};
+
+#endif // NUMA_TOPOLOGY_H
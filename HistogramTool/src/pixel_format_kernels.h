@@ -0,0 +1,79 @@
+#ifndef PIXEL_FORMAT_KERNELS_H
+#define PIXEL_FORMAT_KERNELS_H
+
+#include <cstdint>
+#include <cstddef>
+#include "image_view.h"
+
+/**
+ * Kernels which count a scanline in its native byte layout, for formats that the 32 bit HistogramKernels
+ * can't read directly. Each is specialised at compile time on the layout so the byte offsets are constants.
+ */
+
+/**
+ * Count a scanline of pixels held as interleaved bytes.
+ * @tparam R Offset of the red byte within a pixel.
+ * @tparam G Offset of the green byte within a pixel.
+ * @tparam B Offset of the blue byte within a pixel.
+ * @tparam BytesPerPixel Distance between consecutive pixels.
+ * @tparam Channels Mask of the HistogramKernel::Channels to count. Bytes of other channels aren't read.
+ * @param row The first byte of the scanline.
+ * @param width The number of pixels in the scanline.
+ * @param red 256 counts to which red values will be added.
+ * @param green 256 counts to which green values will be added.
+ * @param blue 256 counts to which blue values will be added.
+ */
+template <size_t R, size_t G, size_t B, size_t BytesPerPixel, uint32_t Channels = 7>
+inline void countInterleavedRow( const uint8_t *row, size_t width, uint32_t *red, uint32_t *green, uint32_t *blue ) {
+    for( size_t x = 0; x < width; ++x, row += BytesPerPixel ) {
+        if( Channels & 1 ) {
+            red[   row[R] ]++;
+        }
+        if( Channels & 2 ) {
+            green[ row[G] ]++;
+        }
+        if( Channels & 4 ) {
+            blue[  row[B] ]++;
+        }
+    }
+}
+
+/**
+ * Count a scanline of pixels held as interleaved bytes, choosing the instantiation of countInterleavedRow for a
+ * mask known only at run time.
+ * @param channels Mask of the HistogramKernel::Channels to count.
+ */
+template <size_t R, size_t G, size_t B, size_t BytesPerPixel>
+inline void countInterleavedRowChannels( uint32_t channels, const uint8_t *row, size_t width, uint32_t *red, uint32_t *green, uint32_t *blue ) {
+    switch( channels ) {
+        case 1: countInterleavedRow<R, G, B, BytesPerPixel, 1>( row, width, red, green, blue ); break;
+        case 2: countInterleavedRow<R, G, B, BytesPerPixel, 2>( row, width, red, green, blue ); break;
+        case 3: countInterleavedRow<R, G, B, BytesPerPixel, 3>( row, width, red, green, blue ); break;
+        case 4: countInterleavedRow<R, G, B, BytesPerPixel, 4>( row, width, red, green, blue ); break;
+        case 5: countInterleavedRow<R, G, B, BytesPerPixel, 5>( row, width, red, green, blue ); break;
+        case 6: countInterleavedRow<R, G, B, BytesPerPixel, 6>( row, width, red, green, blue ); break;
+        default: countInterleavedRow<R, G, B, BytesPerPixel, 7>( row, width, red, green, blue ); break;
+    }
+}
+
+/**
+ * Count a scanline of single byte pixels, grey levels or colour table indices.
+ * Two sets of counts are used alternately to avoid back to back increments of the same bucket; the
+ * caller adds them together once all scanlines are done.
+ * @param row The first byte of the scanline.
+ * @param width The number of pixels in the scanline.
+ * @param even 256 counts to which even numbered pixels will be added.
+ * @param odd 256 counts to which odd numbered pixels will be added.
+ */
+inline void countSingleByteRow( const uint8_t *row, size_t width, uint32_t *even, uint32_t *odd ) {
+    size_t x = 0;
+    for( ; x + 2 <= width; x += 2 ) {
+        even[ row[x] ]++;
+        odd[ row[x + 1] ]++;
+    }
+    if( x < width ) {
+        even[ row[x] ]++;
+    }
+}
+
+#endif // PIXEL_FORMAT_KERNELS_H
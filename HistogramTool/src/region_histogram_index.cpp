@@ -0,0 +1,241 @@
+#include "region_histogram_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+
+/*
+ * Construct an empty index
+ */
+RegionHistogramIndex::RegionHistogramIndex( const HistogramTool& tool, uint32_t blockSize ) : mTool( tool )
+{
+    if( blockSize == 0 || blockSize > MAX_BLOCK_SIZE ) {
+        throw std::invalid_argument( "Block size must be between 1 and 4096" );
+    }
+
+    mBlockSize = blockSize;
+    mBlocksX = 0;
+    mBlocksY = 0;
+    mPool.reset( new WorkerPool{ tool.numThreads() - 1 } );
+    mAccumulators.reset( new RgbAccumulatorArray{ tool.numThreads() } );
+}
+
+/*
+ * Find the smallest block size whose index fits the budget
+ */
+uint32_t RegionHistogramIndex::blockSizeFor( uint32_t width, uint32_t height, size_t memoryBudget )
+{
+    for( uint32_t blockSize = 16; blockSize < MAX_BLOCK_SIZE; blockSize *= 2 ) {
+        uint64_t cornersX = ( static_cast<uint64_t>( width ) + blockSize - 1 ) / blockSize + 1;
+        uint64_t cornersY = ( static_cast<uint64_t>( height ) + blockSize - 1 ) / blockSize + 1;
+        if( cornersX * cornersY * COUNTS_PER_CORNER * sizeof( uint32_t ) <= memoryBudget ) {
+            return blockSize;
+        }
+    }
+    return MAX_BLOCK_SIZE;
+}
+
+/*
+ * Count a rectangle pixel by pixel, in runs short enough not to overflow the narrow counts
+ */
+void RegionHistogramIndex::countPixels( const Rect& rect, RgbAccumulator& counts, uint64_t * wide ) const
+{
+    if( rect.width == 0 || rect.height == 0 ) {
+        return;
+    }
+
+    ImageView pixels = mImage.subView( rect );
+    uint32_t maxRows = std::max<uint32_t>( 1, UINT32_MAX / rect.width );
+    for( uint32_t firstRow = 0; firstRow < rect.height; firstRow += maxRows ) {
+        uint32_t rows = std::min( maxRows, rect.height - firstRow );
+        mTool.computePartialHistogram( pixels, firstRow, rows, counts );
+        HistogramTool::flushCounts( pixels, counts, wide );
+    }
+}
+
+/*
+ * Count a rectangle: corners for the block aligned middle, pixels for the strips around it
+ */
+void RegionHistogramIndex::countRegion( const Rect& rect, RgbAccumulator& counts, uint64_t * wide )
+{
+    const uint64_t blockSize = mBlockSize;
+    const uint64_t right = static_cast<uint64_t>( rect.x ) + rect.width;
+    const uint64_t bottom = static_cast<uint64_t>( rect.y ) + rect.height;
+
+    // Corners on or inside the rectangle. The image's right and bottom edges are corners too
+    uint64_t firstX = ( rect.x + blockSize - 1 ) / blockSize;
+    uint64_t lastX = ( right == mImage.width ) ? mBlocksX : right / blockSize;
+    uint64_t firstY = ( rect.y + blockSize - 1 ) / blockSize;
+    uint64_t lastY = ( bottom == mImage.height ) ? mBlocksY : bottom / blockSize;
+
+    if( firstX >= lastX || firstY >= lastY ) {
+        countPixels( rect, counts, wide );
+        return;
+    }
+
+    // Sum over groups of blocks small enough that the wrapped differences are exact
+    uint64_t blockPixels = blockSize * blockSize;
+    uint64_t groupColumns = std::max<uint64_t>( 1, std::min<uint64_t>( lastX - firstX, UINT32_MAX / blockPixels ) );
+    uint64_t groupRows = std::max<uint64_t>( 1, UINT32_MAX / ( groupColumns * blockPixels ) );
+
+    for( uint64_t y0 = firstY; y0 < lastY; y0 += groupRows ) {
+        uint32_t y1 = static_cast<uint32_t>( std::min( y0 + groupRows, lastY ) );
+        for( uint64_t x0 = firstX; x0 < lastX; x0 += groupColumns ) {
+            uint32_t x1 = static_cast<uint32_t>( std::min( x0 + groupColumns, lastX ) );
+
+            const uint32_t *topLeft = corner( static_cast<uint32_t>( x0 ), static_cast<uint32_t>( y0 ) );
+            const uint32_t *topRight = corner( x1, static_cast<uint32_t>( y0 ) );
+            const uint32_t *bottomLeft = corner( static_cast<uint32_t>( x0 ), y1 );
+            const uint32_t *bottomRight = corner( x1, y1 );
+            for( size_t i = 0; i < COUNTS_PER_CORNER; ++i ) {
+                wide[i] += static_cast<uint32_t>( bottomRight[i] - topRight[i] - bottomLeft[i] + topLeft[i] );
+            }
+        }
+    }
+
+    // Pixel bounds of the indexed part
+    uint32_t left = static_cast<uint32_t>( std::min<uint64_t>( firstX * blockSize, mImage.width ) );
+    uint32_t top = static_cast<uint32_t>( std::min<uint64_t>( firstY * blockSize, mImage.height ) );
+    uint32_t indexedRight = static_cast<uint32_t>( std::min<uint64_t>( lastX * blockSize, mImage.width ) );
+    uint32_t indexedBottom = static_cast<uint32_t>( std::min<uint64_t>( lastY * blockSize, mImage.height ) );
+
+    countPixels( Rect{ rect.x, rect.y, rect.width, top - rect.y }, counts, wide );
+    countPixels( Rect{ rect.x, indexedBottom, rect.width, static_cast<uint32_t>( bottom - indexedBottom ) }, counts, wide );
+    countPixels( Rect{ rect.x, top, left - rect.x, indexedBottom - top }, counts, wide );
+    countPixels( Rect{ indexedRight, top, static_cast<uint32_t>( right - indexedRight ), indexedBottom - top }, counts, wide );
+}
+
+/*
+ * Count each block, sum across each row of blocks and then down each column of corners
+ */
+void RegionHistogramIndex::build( const ImageView& image )
+{
+    std::lock_guard<std::mutex> lock{ mMutex };
+
+    mImage = image;
+    mBlocksX = static_cast<uint32_t>( ( static_cast<uint64_t>( image.width ) + mBlockSize - 1 ) / mBlockSize );
+    mBlocksY = static_cast<uint32_t>( ( static_cast<uint64_t>( image.height ) + mBlockSize - 1 ) / mBlockSize );
+    mCorners.assign( static_cast<size_t>( mBlocksX + 1 ) * ( mBlocksY + 1 ) * COUNTS_PER_CORNER, 0 );
+
+    if( mBlocksX == 0 || mBlocksY == 0 ) {
+        return;
+    }
+
+    // Rows of blocks are claimed one at a time. Each corner holds the counts of its row of blocks to its left
+    RgbAccumulatorArray& accumulators = *mAccumulators;
+    uint32_t numTasks = std::min( mTool.numThreads(), mBlocksY );
+    std::atomic<uint32_t> nextRow{ 0 };
+
+    mPool->run( numTasks, [&]( uint32_t task ) {
+        RgbAccumulator& counts = accumulators[task];
+        std::vector<uint64_t> wide( COUNTS_PER_CORNER );
+        counts.reset();
+
+        for( uint32_t blockY = nextRow++; blockY < mBlocksY; blockY = nextRow++ ) {
+            uint32_t y = blockY * mBlockSize;
+            uint32_t rows = std::min( mBlockSize, image.height - y );
+
+            for( uint32_t blockX = 0; blockX < mBlocksX; ++blockX ) {
+                uint32_t x = blockX * mBlockSize;
+                std::fill( wide.begin(), wide.end(), 0 );
+                countPixels( Rect{ x, y, std::min( mBlockSize, image.width - x ), rows }, counts, wide.data() );
+
+                const uint32_t *leftCorner = corner( blockX, blockY + 1 );
+                uint32_t *thisCorner = corner( blockX + 1, blockY + 1 );
+                for( size_t i = 0; i < COUNTS_PER_CORNER; ++i ) {
+                    thisCorner[i] = leftCorner[i] + static_cast<uint32_t>( wide[i] );
+                }
+            }
+        }
+    } );
+
+    // Then each column of corners is summed from the top. Columns are shared out between the threads
+    numTasks = std::min( mTool.numThreads(), mBlocksX );
+    mPool->run( numTasks, [&]( uint32_t task ) {
+        for( uint32_t blockX = 1 + task; blockX <= mBlocksX; blockX += numTasks ) {
+            for( uint32_t blockY = 2; blockY <= mBlocksY; ++blockY ) {
+                const uint32_t *above = corner( blockX, blockY - 1 );
+                uint32_t *thisCorner = corner( blockX, blockY );
+                for( size_t i = 0; i < COUNTS_PER_CORNER; ++i ) {
+                    thisCorner[i] += above[i];
+                }
+            }
+        }
+    } );
+}
+
+/*
+ * Compute the histogram of one rectangle
+ */
+void RegionHistogramIndex::query( const Rect& rect, Histogram& red, Histogram& green, Histogram& blue )
+{
+    if( ! mImage.contains( rect ) ) {
+        throw std::invalid_argument( "Region must lie within the image" );
+    }
+    if( red.numBuckets() != 256 || green.numBuckets() != 256 || blue.numBuckets() != 256 ) {
+        throw std::invalid_argument( "Histograms must have 256 buckets" );
+    }
+
+    std::lock_guard<std::mutex> lock{ mMutex };
+    std::vector<uint64_t> wide( COUNTS_PER_CORNER, 0 );
+    countRegion( rect, ( *mAccumulators )[0], wide.data() );
+
+    red.addCounts( &wide[0], 256 );
+    green.addCounts( &wide[256], 256 );
+    blue.addCounts( &wide[512], 256 );
+}
+
+/*
+ * Compute the histograms of many rectangles. Threads claim rectangles one at a time
+ */
+std::vector<RegionHistogram> RegionHistogramIndex::query( const std::vector<Rect>& rects )
+{
+    for( const Rect& rect : rects ) {
+        if( ! mImage.contains( rect ) ) {
+            throw std::invalid_argument( "Region must lie within the image" );
+        }
+    }
+
+    std::vector<RegionHistogram> results( rects.size() );
+    if( rects.empty() ) {
+        return results;
+    }
+
+    std::lock_guard<std::mutex> lock{ mMutex };
+    RgbAccumulatorArray& accumulators = *mAccumulators;
+    uint32_t numTasks = static_cast<uint32_t>( std::min<size_t>( mTool.numThreads(), rects.size() ) );
+    std::atomic<size_t> nextRect{ 0 };
+
+    mPool->run( numTasks, [&]( uint32_t task ) {
+        RgbAccumulator& counts = accumulators[task];
+        std::vector<uint64_t> wide( COUNTS_PER_CORNER );
+        counts.reset();
+
+        for( size_t i = nextRect++; i < rects.size(); i = nextRect++ ) {
+            std::fill( wide.begin(), wide.end(), 0 );
+            countRegion( rects[i], counts, wide.data() );
+            results[i].red.addCounts( &wide[0] );
+            results[i].green.addCounts( &wide[256] );
+            results[i].blue.addCounts( &wide[512] );
+        }
+    } );
+
+    return results;
+}
+
+/*
+ * Return pixels per side of a block
+ */
+uint32_t RegionHistogramIndex::blockSize( ) const
+{
+    return mBlockSize;
+}
+
+/*
+ * Return the size of the corner counts
+ */
+size_t RegionHistogramIndex::memoryBytes( ) const
+{
+    return mCorners.size() * sizeof( uint32_t );
+}
@@ -0,0 +1,169 @@
+#ifndef REGION_HISTOGRAM_INDEX_H
+#define REGION_HISTOGRAM_INDEX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "fixed_histogram.h"
+#include "histogram.h"
+#include "histogram_tool.h"
+#include "image_view.h"
+#include "rgb_accumulator.h"
+#include "worker_pool.h"
+
+/**
+ * RegionHistogram.
+ *
+ * The red, green and blue histograms of one region, as returned by RegionHistogramIndex::query.
+ */
+struct RegionHistogram {
+    FixedHistogram<256, uint64_t>   red;
+    FixedHistogram<256, uint64_t>   green;
+    FixedHistogram<256, uint64_t>   blue;
+};
+
+/**
+ * RegionHistogramIndex.
+ *
+ * Answers "what is the histogram of this rectangle" for many rectangles of the same image without
+ * rescanning their pixels. The image is cut into square blocks and, for each block corner, the index holds
+ * the red, green and blue counts of every pixel above and to the left of it: a blocked integral histogram.
+ *
+ * The counts of the block aligned part of a rectangle are then four lookups, added and subtracted bucket by
+ * bucket, whatever the rectangle's area. The strips between the rectangle's edges and the nearest block
+ * boundaries are counted pixel by pixel, so a query costs O(buckets + blockSize * (width + height)).
+ *
+ * Smaller blocks make queries cheaper and the index larger: it holds 3 KB for each block. blockSizeFor()
+ * picks the smallest block that keeps the index within a memory budget.
+ *
+ * The index refers to the image's pixels to count the edges; they must stay valid and unchanged while the
+ * index is in use. build() and batches of queries are spread over a pool of threads. Calls are serialised.
+ */
+class RegionHistogramIndex {
+private:
+    // Tool whose kernel counts the pixels
+    const HistogramTool&    mTool;
+
+    // Pixels per side of a block
+    uint32_t        mBlockSize;
+
+    // The image indexed
+    ImageView       mImage;
+
+    // Number of blocks across and down. The last block in each direction may be partial
+    uint32_t        mBlocksX;
+    uint32_t        mBlocksY;
+
+    // Counts above and left of each block corner; (mBlocksY + 1) rows of (mBlocksX + 1) corners, each
+    // COUNTS_PER_CORNER counts. Counts wrap; differences are exact so long as the region has fewer than 2^32 pixels
+    std::vector<uint32_t>   mCorners;
+
+    // Red, green and blue counts for each corner
+    static const size_t COUNTS_PER_CORNER = 3 * 256;
+
+    // Threads for building and for batches of queries
+    std::unique_ptr<WorkerPool>             mPool;
+
+    // Scratch counts for each thread
+    std::unique_ptr<RgbAccumulatorArray>    mAccumulators;
+
+    // Serialises use of the pool and the scratch counts
+    std::mutex      mMutex;
+
+    /**
+     * @param blockX Corner column, 0 to mBlocksX.
+     * @param blockY Corner row, 0 to mBlocksY.
+     * @return The counts of the corner.
+     */
+    uint32_t * corner( uint32_t blockX, uint32_t blockY ) {
+        return &mCorners[ ( static_cast<size_t>( blockY ) * ( mBlocksX + 1 ) + blockX ) * COUNTS_PER_CORNER ];
+    }
+
+    /**
+     * Count the pixels of a rectangle directly and add them to wide counts.
+     * @param rect The rectangle, within the image.
+     * @param counts Scratch counts. Left reset.
+     * @param wide 3 * 256 counts; red, green then blue.
+     */
+    void countPixels( const Rect& rect, RgbAccumulator& counts, uint64_t * wide ) const;
+
+    /**
+     * Add the counts of a rectangle to wide counts using the index for its block aligned part.
+     * @param rect The rectangle, within the image.
+     * @param counts Scratch counts. Left reset.
+     * @param wide 3 * 256 counts; red, green then blue.
+     */
+    void countRegion( const Rect& rect, RgbAccumulator& counts, uint64_t * wide );
+
+public:
+    /**
+     * Default for blockSizeFor().
+     */
+    static const size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+    /**
+     * Largest block size.
+     */
+    static const uint32_t MAX_BLOCK_SIZE = 4096;
+
+    /**
+     * Construct an empty index.
+     * @param tool Tool whose kernel and number of threads are used. Must outlive this object.
+     * @param blockSize Pixels per side of a block.
+     * @throws std::invalid_argument if blockSize is 0 or more than MAX_BLOCK_SIZE.
+     */
+    RegionHistogramIndex( const HistogramTool& tool, uint32_t blockSize );
+
+    RegionHistogramIndex( const RegionHistogramIndex& ) = delete;
+    RegionHistogramIndex& operator=( const RegionHistogramIndex& ) = delete;
+
+    /**
+     * Work out the smallest block size, in steps of a power of two from 16, for which the index of an image
+     * fits within a memory budget.
+     * @param width Width of the image.
+     * @param height Height of the image.
+     * @param memoryBudget Most bytes the index may use.
+     * @return The block size. MAX_BLOCK_SIZE if even that doesn't fit.
+     */
+    static uint32_t blockSizeFor( uint32_t width, uint32_t height, size_t memoryBudget = DEFAULT_MEMORY_BUDGET );
+
+    /**
+     * Index an image, replacing any image already indexed.
+     * Each thread counts whole rows of blocks, then the counts are summed down the columns of corners.
+     * @param image The image. Its pixels must stay valid and unchanged while the index is used.
+     * @throws std::bad_alloc if the index cannot be allocated.
+     */
+    void build( const ImageView& image );
+
+    /**
+     * Compute the histogram of a rectangle of the indexed image, adding its counts to the given Histograms.
+     * @param rect The rectangle.
+     * @param red Histogram to which red values will be added.
+     * @param green Histogram to which green values will be added.
+     * @param blue Histogram to which blue values will be added.
+     * @throws std::invalid_argument if the rectangle isn't within the image or any of the Histograms does not have 256 buckets.
+     */
+    void query( const Rect& rect, Histogram& red, Histogram& green, Histogram& blue );
+
+    /**
+     * Compute the histograms of many rectangles of the indexed image, spread over the pool.
+     * @param rects The rectangles.
+     * @return The histogram of each rectangle, in the same order.
+     * @throws std::invalid_argument if any rectangle isn't within the image.
+     */
+    std::vector<RegionHistogram> query( const std::vector<Rect>& rects );
+
+    /**
+     * @return Pixels per side of a block.
+     */
+    uint32_t blockSize( ) const;
+
+    /**
+     * @return The number of bytes used by the index itself, not counting the image.
+     */
+    size_t memoryBytes( ) const;
+};
+
+#endif // REGION_HISTOGRAM_INDEX_H
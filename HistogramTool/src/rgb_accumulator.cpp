@@ -0,0 +1,84 @@
+#include "rgb_accumulator.h"
+
+#include <cstring>
+#include <new>
+
+static_assert( sizeof( RgbAccumulator ) % RgbAccumulator::CACHE_LINE_SIZE == 0, "RgbAccumulator must fill whole cache lines" );
+
+
+/*
+ * Construct with all counts 0
+ */
+RgbAccumulator::RgbAccumulator( )
+{
+    reset();
+}
+
+/*
+ * Reset all counts to 0
+ */
+void RgbAccumulator::reset( )
+{
+    std::memset( mCounts, 0, sizeof( mCounts ) );
+}
+
+/*
+ * Add another accumulator into this one
+ */
+RgbAccumulator& RgbAccumulator::operator+=( const RgbAccumulator& rhs )
+{
+    uint32_t *dst = &mCounts[0][0];
+    const uint32_t *src = &rhs.mCounts[0][0];
+
+    for( size_t i=0; i<NumChannels * 256; ++i ) {
+        dst[i] += src[i];
+    }
+    return *this;
+}
+
+/*
+ * Add the red, green and blue counts to Histograms
+ */
+void RgbAccumulator::addTo( Histogram& red, Histogram& green, Histogram& blue ) const
+{
+    red.addCounts( mCounts[Red], 256 );
+    green.addCounts( mCounts[Green], 256 );
+    blue.addCounts( mCounts[Blue], 256 );
+}
+
+
+/*
+ * Allocate an aligned array of accumulators
+ */
+RgbAccumulatorArray::RgbAccumulatorArray( size_t size )
+{
+    const size_t alignment = RgbAccumulator::CACHE_LINE_SIZE;
+
+    mStorage = new unsigned char[ size * sizeof( RgbAccumulator ) + alignment ];
+    mSize = size;
+
+    // Round the start up to the next cache line
+    uintptr_t address = reinterpret_cast<uintptr_t>( mStorage );
+    address = ( address + alignment - 1 ) & ~static_cast<uintptr_t>( alignment - 1 );
+    mAccumulators = reinterpret_cast<RgbAccumulator *>( address );
+
+    for( size_t i=0; i<size; ++i ) {
+        new ( &mAccumulators[i] ) RgbAccumulator;
+    }
+}
+
+/*
+ * Free the accumulators. They are trivially destructible so only the storage needs releasing.
+ */
+RgbAccumulatorArray::~RgbAccumulatorArray( )
+{
+    delete[] mStorage;
+}
+
+/*
+ * Return the number of accumulators
+ */
+size_t RgbAccumulatorArray::size( ) const
+{
+    return mSize;
+}
@@ -0,0 +1,155 @@
+#ifndef RGB_ACCUMULATOR_H
+#define RGB_ACCUMULATOR_H
+
+#include <cstdint>
+#include <cstddef>
+#include "histogram.h"
+
+/**
+ * RgbAccumulator.
+ *
+ * The counts for every channel of a block of pixels, held together in a single cache line aligned block.
+ * There are 256 counts each for red, green, blue and alpha. Alpha is reserved for kernels which count it.
+ *
+ * Each worker thread counts into its own RgbAccumulator. As the size is a whole number of cache lines and
+ * the start is aligned, neighbouring accumulators in an RgbAccumulatorArray never share a cache line, so
+ * threads don't contend for lines they aren't writing.
+ *
+ * Accumulators are added together and then added into the public Histogram objects once all counting is done.
+ */
+class alignas(64) RgbAccumulator {
+public:
+    /**
+     * Channels held by the accumulator.
+     */
+    enum Channel {
+        Red = 0,
+        Green,
+        Blue,
+        Alpha,
+        NumChannels
+    };
+
+    /**
+     * Cache line size assumed for alignment and padding.
+     */
+    static const size_t CACHE_LINE_SIZE = 64;
+
+private:
+    // The counts for each channel
+    uint32_t    mCounts[NumChannels][256];
+
+public:
+    /**
+     * Construct an accumulator with all counts 0.
+     */
+    RgbAccumulator( );
+
+    /**
+     * Reset all counts to 0.
+     */
+    void reset( );
+
+    /**
+     * @param channel A channel.
+     * @return The 256 counts for the channel.
+     */
+    uint32_t * counts( Channel channel ) {
+        return mCounts[channel];
+    }
+
+    /**
+     * @param channel A channel.
+     * @return The 256 counts for the channel.
+     */
+    const uint32_t * counts( Channel channel ) const {
+        return mCounts[channel];
+    }
+
+    /**
+     * Add the counts of another accumulator into this one.
+     * @param rhs The other accumulator.
+     * @return A reference to this accumulator.
+     */
+    RgbAccumulator& operator+=( const RgbAccumulator& rhs );
+
+    /**
+     * Add the red, green and blue counts into Histograms.
+     * @param red Histogram to which red counts will be added.
+     * @param green Histogram to which green counts will be added.
+     * @param blue Histogram to which blue counts will be added.
+     * @throws std::invalid_argument if any of the Histograms does not have 256 buckets.
+     */
+    void addTo( Histogram& red, Histogram& green, Histogram& blue ) const;
+
+    /**
+     * Add the red, green and blue counts into FixedHistograms.
+     * @param red Histogram to which red counts will be added.
+     * @param green Histogram to which green counts will be added.
+     * @param blue Histogram to which blue counts will be added.
+     */
+    template <typename Counter>
+    void addTo( FixedHistogram<256, Counter>& red, FixedHistogram<256, Counter>& green, FixedHistogram<256, Counter>& blue ) const {
+        red.addCounts( mCounts[Red] );
+        green.addCounts( mCounts[Green] );
+        blue.addCounts( mCounts[Blue] );
+    }
+};
+
+
+/**
+ * RgbAccumulatorArray.
+ *
+ * A fixed number of RgbAccumulators in one allocation, aligned to a cache line.
+ * Plain new[] does not honour over-aligned types before C++17 so the storage is aligned by hand.
+ */
+class RgbAccumulatorArray {
+private:
+    // Raw storage, including slack for alignment
+    unsigned char   *mStorage;
+
+    // The aligned accumulators within mStorage
+    RgbAccumulator  *mAccumulators;
+
+    // Number of accumulators
+    size_t          mSize;
+
+public:
+    /**
+     * Allocate an array of zeroed accumulators.
+     * @param size The number of accumulators.
+     * @throws std::bad_alloc if memory cannot be allocated.
+     */
+    explicit RgbAccumulatorArray( size_t size );
+
+    /**
+     * Frees the accumulators.
+     */
+    ~RgbAccumulatorArray( );
+
+    RgbAccumulatorArray( const RgbAccumulatorArray& ) = delete;
+    RgbAccumulatorArray& operator=( const RgbAccumulatorArray& ) = delete;
+
+    /**
+     * @param index Index of an accumulator. Not range checked.
+     * @return The accumulator.
+     */
+    RgbAccumulator& operator[]( size_t index ) {
+        return mAccumulators[index];
+    }
+
+    /**
+     * @param index Index of an accumulator. Not range checked.
+     * @return The accumulator.
+     */
+    const RgbAccumulator& operator[]( size_t index ) const {
+        return mAccumulators[index];
+    }
+
+    /**
+     * @return The number of accumulators.
+     */
+    size_t size( ) const;
+};
+
+#endif // RGB_ACCUMULATOR_H
@@ -0,0 +1,309 @@
+#include "sampled_histogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+const uint32_t SampledHistogram::TILE_SIZE;
+
+
+/*
+ * Read the red, green and blue values of one pixel in any format
+ */
+static inline void pixelAt( const ImageView& image, uint32_t x, uint32_t y, uint8_t& red, uint8_t& green, uint8_t& blue )
+{
+    const uint8_t *pixel = image.row( y ) + static_cast<size_t>( x ) * ImageView::bytesPerPixel( image.format );
+
+    switch( image.format ) {
+        case PixelFormat::ARGB32: {
+            uint32_t colour = *reinterpret_cast<const uint32_t *>( pixel );
+            red = static_cast<uint8_t>( colour >> 16 );
+            green = static_cast<uint8_t>( colour >> 8 );
+            blue = static_cast<uint8_t>( colour );
+            break;
+        }
+
+        case PixelFormat::RGBA8888:
+        case PixelFormat::RGB888:
+            red = pixel[0];
+            green = pixel[1];
+            blue = pixel[2];
+            break;
+
+        case PixelFormat::BGR888:
+            red = pixel[2];
+            green = pixel[1];
+            blue = pixel[0];
+            break;
+
+        case PixelFormat::Grayscale8:
+            red = green = blue = pixel[0];
+            break;
+
+        case PixelFormat::Indexed8: {
+            uint32_t colour = ( *pixel < image.colourCount ) ? image.colourTable[*pixel] : 0;
+            red = static_cast<uint8_t>( colour >> 16 );
+            green = static_cast<uint8_t>( colour >> 8 );
+            blue = static_cast<uint8_t>( colour );
+            break;
+        }
+    }
+}
+
+
+/*
+ * Construct a sampler
+ */
+SampledHistogram::SampledHistogram( HistogramTool& tool, Method method, uint64_t seed ) : mTool( tool )
+{
+    mMethod = method;
+    mSeed = seed;
+    mNumPixels = 0;
+    mNumSamples = 0;
+    mSampleCounts.assign( 3 * 256, 0 );
+    mPool.reset( new WorkerPool{ tool.numThreads() - 1 } );
+    mAccumulators.reset( new RgbAccumulatorArray{ tool.numThreads() } );
+}
+
+/*
+ * Samples needed for the worst case bucket's interval, z * sqrt( 0.25 / n ), to be within the target
+ */
+double SampledHistogram::fractionForError( uint64_t numPixels, double targetError )
+{
+    if( ! ( targetError > 0 ) ) {
+        throw std::invalid_argument( "Target error must be positive" );
+    }
+    if( numPixels == 0 ) {
+        return 1;
+    }
+
+    double samples = 0.25 * CONFIDENCE_Z * CONFIDENCE_Z / ( targetError * targetError );
+    return std::min( 1.0, samples / static_cast<double>( numPixels ) );
+}
+
+/*
+ * Read one pixel from each cell; its centre when strided, a random position when jittered
+ */
+void SampledHistogram::sampleCells( const ImageView& image, uint32_t cellSize )
+{
+    const uint32_t cellsDown = static_cast<uint32_t>( ( static_cast<uint64_t>( image.height ) + cellSize - 1 ) / cellSize );
+    const uint32_t cellsAcross = static_cast<uint32_t>( ( static_cast<uint64_t>( image.width ) + cellSize - 1 ) / cellSize );
+    const uint32_t numTasks = std::max<uint32_t>( 1, std::min( mTool.numThreads(), cellsDown ) );
+    const bool jittered = mMethod == Method::Jittered;
+
+    RgbAccumulatorArray& accumulators = *mAccumulators;
+    std::vector<uint64_t> wide( static_cast<size_t>( numTasks ) * 3 * 256, 0 );
+    std::atomic<uint32_t> nextRow{ 0 };
+
+    mPool->run( numTasks, [&]( uint32_t task ) {
+        RgbAccumulator& counts = accumulators[task];
+        uint32_t *red = counts.counts( RgbAccumulator::Red );
+        uint32_t *green = counts.counts( RgbAccumulator::Green );
+        uint32_t *blue = counts.counts( RgbAccumulator::Blue );
+        uint64_t *taskCounts = &wide[ static_cast<size_t>( task ) * 3 * 256 ];
+        counts.reset();
+
+        for( uint32_t cellY = nextRow++; cellY < cellsDown; cellY = nextRow++ ) {
+            // Seeded by row so the positions don't depend on which thread claims the row
+            std::mt19937_64 random{ mSeed * 0x9E3779B97F4A7C15ULL + cellY };
+            uint32_t y0 = cellY * cellSize;
+            uint32_t rows = std::min( cellSize, image.height - y0 );
+
+            for( uint32_t cellX = 0; cellX < cellsAcross; ++cellX ) {
+                uint32_t x0 = cellX * cellSize;
+                uint32_t columns = std::min( cellSize, image.width - x0 );
+                uint32_t x = x0 + ( jittered ? static_cast<uint32_t>( random() % columns ) : columns / 2 );
+                uint32_t y = y0 + ( jittered ? static_cast<uint32_t>( random() % rows ) : rows / 2 );
+
+                uint8_t r = 0, g = 0, b = 0;
+                pixelAt( image, x, y, r, g, b );
+                red[r]++;
+                green[g]++;
+                blue[b]++;
+            }
+
+            // A row has fewer than 2^32 cells, so flushing once per row can't overflow
+            for( size_t i = 0; i < 256; ++i ) {
+                taskCounts[i] += red[i];
+                taskCounts[256 + i] += green[i];
+                taskCounts[512 + i] += blue[i];
+            }
+            counts.reset();
+        }
+    } );
+
+    for( uint32_t task = 0; task < numTasks; ++task ) {
+        for( size_t i = 0; i < 3 * 256; ++i ) {
+            mSampleCounts[i] += wide[ static_cast<size_t>( task ) * 3 * 256 + i ];
+        }
+    }
+    mNumSamples = static_cast<uint64_t>( cellsAcross ) * cellsDown;
+}
+
+/*
+ * Count every pixel of tiles chosen with probability fraction
+ */
+void SampledHistogram::sampleTiles( const ImageView& image, double fraction )
+{
+    const uint32_t tilesDown = ( image.height + TILE_SIZE - 1 ) / TILE_SIZE;
+    const uint32_t tilesAcross = ( image.width + TILE_SIZE - 1 ) / TILE_SIZE;
+    const uint32_t numTasks = std::max<uint32_t>( 1, std::min( mTool.numThreads(), tilesDown ) );
+
+    RgbAccumulatorArray& accumulators = *mAccumulators;
+    std::vector<uint64_t> wide( static_cast<size_t>( numTasks ) * 3 * 256, 0 );
+    std::vector<uint64_t> samples( numTasks, 0 );
+    std::atomic<uint32_t> nextRow{ 0 };
+
+    mPool->run( numTasks, [&]( uint32_t task ) {
+        RgbAccumulator& counts = accumulators[task];
+        uint64_t *taskCounts = &wide[ static_cast<size_t>( task ) * 3 * 256 ];
+        std::uniform_real_distribution<double> chance{ 0.0, 1.0 };
+        counts.reset();
+
+        for( uint32_t tileY = nextRow++; tileY < tilesDown; tileY = nextRow++ ) {
+            std::mt19937_64 random{ mSeed * 0x9E3779B97F4A7C15ULL + tileY };
+            uint32_t y = tileY * TILE_SIZE;
+
+            for( uint32_t tileX = 0; tileX < tilesAcross; ++tileX ) {
+                if( chance( random ) >= fraction ) {
+                    continue;
+                }
+                uint32_t x = tileX * TILE_SIZE;
+                Rect tile{ x, y, std::min( TILE_SIZE, image.width - x ), std::min( TILE_SIZE, image.height - y ) };
+                ImageView pixels = image.subView( tile );
+
+                mTool.computePartialHistogram( pixels, 0, tile.height, counts );
+                HistogramTool::flushCounts( pixels, counts, taskCounts );
+                samples[task] += tile.numPixels();
+            }
+        }
+    } );
+
+    mNumSamples = 0;
+    for( uint32_t task = 0; task < numTasks; ++task ) {
+        for( size_t i = 0; i < 3 * 256; ++i ) {
+            mSampleCounts[i] += wide[ static_cast<size_t>( task ) * 3 * 256 + i ];
+        }
+        mNumSamples += samples[task];
+    }
+}
+
+/*
+ * Sample the image and add the scaled up counts to the histograms
+ */
+void SampledHistogram::compute( const ImageView& image, double fraction, Histogram& red, Histogram& green, Histogram& blue )
+{
+    if( ! ( fraction > 0 ) ) {
+        throw std::invalid_argument( "Sample fraction must be positive" );
+    }
+    if( red.numBuckets() != 256 || green.numBuckets() != 256 || blue.numBuckets() != 256 ) {
+        throw std::invalid_argument( "Histograms must have 256 buckets" );
+    }
+
+    std::lock_guard<std::mutex> lock{ mMutex };
+    mNumPixels = image.numPixels();
+    mNumSamples = 0;
+    std::fill( mSampleCounts.begin(), mSampleCounts.end(), 0 );
+
+    if( mNumPixels == 0 ) {
+        return;
+    }
+
+    // One pixel per cell of cellSize x cellSize samples about the fraction asked for
+    uint32_t cellSize = static_cast<uint32_t>( std::min( 65536.0, std::max( 1.0, std::floor( 1.0 / std::sqrt( fraction ) ) ) ) );
+    if( fraction >= 1 || ( cellSize == 1 && mMethod != Method::RandomTiles ) ) {
+        // Every pixel; exact
+        Histogram allRed, allGreen, allBlue;
+        mTool.computeHistogram( image, allRed, allGreen, allBlue );
+        for( size_t i = 0; i < 256; ++i ) {
+            mSampleCounts[i] = allRed[i];
+            mSampleCounts[256 + i] = allGreen[i];
+            mSampleCounts[512 + i] = allBlue[i];
+        }
+        mNumSamples = mNumPixels;
+    } else if( mMethod == Method::RandomTiles ) {
+        sampleTiles( image, fraction );
+    } else {
+        sampleCells( image, cellSize );
+    }
+
+    if( mNumSamples == 0 ) {
+        return;
+    }
+
+    // Scale up to the whole image
+    double scale = static_cast<double>( mNumPixels ) / static_cast<double>( mNumSamples );
+    std::vector<uint64_t> estimates( 3 * 256 );
+    for( size_t i = 0; i < estimates.size(); ++i ) {
+        estimates[i] = static_cast<uint64_t>( std::llround( static_cast<double>( mSampleCounts[i] ) * scale ) );
+    }
+    red.addCounts( &estimates[0], 256 );
+    green.addCounts( &estimates[256], 256 );
+    blue.addCounts( &estimates[512], 256 );
+}
+
+/*
+ * Wilson score interval of each bucket's proportion, narrowed by the finite population correction and scaled to pixels
+ */
+void SampledHistogram::interval( RgbAccumulator::Channel channel, Histogram& lower, Histogram& upper ) const
+{
+    if( channel == RgbAccumulator::Alpha || channel == RgbAccumulator::NumChannels ) {
+        throw std::invalid_argument( "Intervals are only kept for red, green and blue" );
+    }
+    if( lower.numBuckets() != 256 || upper.numBuckets() != 256 ) {
+        throw std::invalid_argument( "Histograms must have 256 buckets" );
+    }
+    if( mNumSamples == 0 ) {
+        return;
+    }
+
+    const double n = static_cast<double>( mNumSamples );
+    const double total = static_cast<double>( mNumPixels );
+    const double z2 = CONFIDENCE_Z * CONFIDENCE_Z;
+    const double correction = ( mNumPixels > 1 ) ? std::sqrt( ( total - n ) / ( total - 1 ) ) : 0;
+
+    std::vector<uint64_t> low( 256 ), high( 256 );
+    for( size_t i = 0; i < 256; ++i ) {
+        double p = static_cast<double>( mSampleCounts[ static_cast<size_t>( channel ) * 256 + i ] ) / n;
+        double centre = ( p + z2 / ( 2 * n ) ) / ( 1 + z2 / n );
+        double halfWidth = CONFIDENCE_Z / ( 1 + z2 / n ) * std::sqrt( p * ( 1 - p ) / n + z2 / ( 4 * n * n ) );
+
+        // With every pixel sampled the correction is 0 and the interval closes on the exact count
+        if( correction == 0 ) {
+            low[i] = high[i] = static_cast<uint64_t>( std::llround( p * total ) );
+            continue;
+        }
+        double from = p + ( centre - halfWidth - p ) * correction;
+        double to = p + ( centre + halfWidth - p ) * correction;
+        low[i] = static_cast<uint64_t>( std::max( 0.0, std::floor( from * total ) ) );
+        high[i] = static_cast<uint64_t>( std::min( total, std::ceil( to * total ) ) );
+    }
+    lower.addCounts( low.data(), 256 );
+    upper.addCounts( high.data(), 256 );
+}
+
+/*
+ * Return the number of pixels sampled
+ */
+uint64_t SampledHistogram::numSamples( ) const
+{
+    return mNumSamples;
+}
+
+/*
+ * Return the fraction of the image sampled
+ */
+double SampledHistogram::sampledFraction( ) const
+{
+    return ( mNumPixels > 0 ) ? static_cast<double>( mNumSamples ) / static_cast<double>( mNumPixels ) : 0;
+}
+
+/*
+ * Return how pixels are picked
+ */
+SampledHistogram::Method SampledHistogram::method( ) const
+{
+    return mMethod;
+}
@@ -0,0 +1,154 @@
+#ifndef SAMPLED_HISTOGRAM_H
+#define SAMPLED_HISTOGRAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "histogram.h"
+#include "histogram_tool.h"
+#include "image_view.h"
+#include "rgb_accumulator.h"
+#include "worker_pool.h"
+
+/**
+ * SampledHistogram.
+ *
+ * Estimates the histogram of an image from a fraction of its pixels, for previews where exact counts
+ * aren't needed. The counts of the pixels sampled are scaled up by the inverse of the fraction actually
+ * sampled, and a confidence interval is kept for every bucket.
+ *
+ * Pixels are picked in one of three ways:
+ *   - Strided: the image is cut into square cells and the centre pixel of each is read.
+ *   - Jittered: one pixel at a random position within each cell is read. Samples are spread evenly like a
+ *     stride but without its aliasing against regular patterns, approximating blue noise.
+ *   - RandomTiles: whole 64 x 64 tiles are chosen at random and every pixel in them counted with the
+ *     tool's kernel. Reads are sequential, so more pixels can be sampled in the same time, but neighbouring
+ *     pixels are alike so the intervals, which assume independent samples, understate the error.
+ *
+ * Sampling is spread over a pool of threads and is deterministic for a given seed, whatever the number of
+ * threads. A fraction of 1 or more counts every pixel exactly. Calls are serialised.
+ */
+class SampledHistogram {
+public:
+    /**
+     * How pixels are picked.
+     */
+    enum class Method {
+        Strided,
+        Jittered,
+        RandomTiles
+    };
+
+    /**
+     * Normal quantile of the confidence intervals; 95%.
+     */
+    static constexpr double CONFIDENCE_Z = 1.96;
+
+    /**
+     * Pixels per side of the tiles picked by Method::RandomTiles.
+     */
+    static const uint32_t TILE_SIZE = 64;
+
+private:
+    // Tool whose kernel counts tiles
+    HistogramTool&  mTool;
+
+    // How pixels are picked
+    Method          mMethod;
+
+    // Seed for random positions and tiles
+    uint64_t        mSeed;
+
+    // Number of pixels in the last image and of them sampled
+    uint64_t        mNumPixels;
+    uint64_t        mNumSamples;
+
+    // Counts of the samples in the last image; red, green then blue
+    std::vector<uint64_t>   mSampleCounts;
+
+    // Threads which sample
+    std::unique_ptr<WorkerPool>             mPool;
+
+    // Scratch counts for each thread
+    std::unique_ptr<RgbAccumulatorArray>    mAccumulators;
+
+    // Serialises use of the pool and the scratch counts
+    std::mutex      mMutex;
+
+    /**
+     * Sample one pixel from each cell of a grid. Each thread claims rows of cells.
+     * @param image The image.
+     * @param cellSize Pixels per side of a cell.
+     */
+    void sampleCells( const ImageView& image, uint32_t cellSize );
+
+    /**
+     * Count every pixel in randomly chosen tiles. Each thread claims rows of tiles.
+     * @param image The image.
+     * @param fraction Probability of each tile being chosen.
+     */
+    void sampleTiles( const ImageView& image, double fraction );
+
+public:
+    /**
+     * Construct a sampler.
+     * @param tool Tool whose kernel and number of threads are used. Must outlive this object.
+     * @param method How pixels are picked.
+     * @param seed Seed for random positions and tiles.
+     */
+    SampledHistogram( HistogramTool& tool, Method method = Method::Jittered, uint64_t seed = 1 );
+
+    SampledHistogram( const SampledHistogram& ) = delete;
+    SampledHistogram& operator=( const SampledHistogram& ) = delete;
+
+    /**
+     * Work out the fraction of an image to sample so that every bucket's estimate is within a given error.
+     * The worst case, a bucket holding half the pixels, is assumed.
+     * @param numPixels The number of pixels in the image.
+     * @param targetError Half width of the confidence interval of a bucket as a fraction of the pixels; 0.01 is 1%.
+     * @return The fraction to sample, at most 1.
+     * @throws std::invalid_argument if targetError isn't positive.
+     */
+    static double fractionForError( uint64_t numPixels, double targetError );
+
+    /**
+     * Estimate the histogram of an image, adding the estimated counts to the given Histograms.
+     * @param image The image.
+     * @param fraction The fraction of pixels to sample. The fraction actually sampled is near this.
+     * @param red Histogram to which estimated red counts will be added.
+     * @param green Histogram to which estimated green counts will be added.
+     * @param blue Histogram to which estimated blue counts will be added.
+     * @throws std::invalid_argument if fraction isn't positive or any of the Histograms does not have 256 buckets.
+     */
+    void compute( const ImageView& image, double fraction, Histogram& red, Histogram& green, Histogram& blue );
+
+    /**
+     * Get the confidence interval of every bucket of one channel from the last call to compute.
+     * Wilson score intervals with a finite population correction are used, so buckets which no sample fell
+     * in still have a non zero upper bound.
+     * @param channel Red, Green or Blue.
+     * @param lower Histogram to which the lower bound of each bucket will be added.
+     * @param upper Histogram to which the upper bound of each bucket will be added.
+     * @throws std::invalid_argument if channel is Alpha or either Histogram does not have 256 buckets.
+     */
+    void interval( RgbAccumulator::Channel channel, Histogram& lower, Histogram& upper ) const;
+
+    /**
+     * @return The number of pixels sampled by the last call to compute.
+     */
+    uint64_t numSamples( ) const;
+
+    /**
+     * @return The fraction of the image sampled by the last call to compute.
+     */
+    double sampledFraction( ) const;
+
+    /**
+     * @return How pixels are picked.
+     */
+    Method method( ) const;
+};
+
+#endif // SAMPLED_HISTOGRAM_H
@@ -5,8 +5,59 @@ CONFIG += staticlib
 
 SOURCES += \
     histogram.cpp \
-    histogram_tool.cpp
+    histogram_tool.cpp \
+    histogram_tool_qimage.cpp \
+    histogram_job.cpp \
+    histogram_kernel.cpp \
+    rgb_accumulator.cpp \
+    worker_pool.cpp \
+    streaming_histogram.cpp \
+    batch_histogram.cpp \
+    mapped_raster.cpp \
+    tiled_histogram.cpp \
+    region_histogram_index.cpp \
+    sampled_histogram.cpp \
+    trace.cpp \
+    histogram_writer.cpp \
+    histogram_reader.cpp \
+    numa_topology.cpp \
+    cpu_topology.cpp \
+    auto_tuner.cpp \
+    histogram_server.cpp \
+    histogram_client.cpp \
+    derived_channels.cpp \
+    joint_histogram.cpp \
+    histogram_stats.cpp
 
 HEADERS += \
     histogram.h \
-    histogram_tool.h
+    histogram_tool.h \
+    histogram_job.h \
+    histogram_kernel.h \
+    rgb_accumulator.h \
+    worker_pool.h \
+    bounded_queue.h \
+    streaming_histogram.h \
+    image_view.h \
+    pixel_format_kernels.h \
+    fixed_histogram.h \
+    batch_histogram.h \
+    mapped_raster.h \
+    tiled_histogram.h \
+    region_histogram_index.h \
+    sampled_histogram.h \
+    trace.h \
+    histogram_writer.h \
+    histogram_reader.h \
+    numa_topology.h \
+    cpu_topology.h \
+    auto_tuner.h \
+    noise_source.h \
+    histogram_server.h \
+    histogram_client.h \
+    derived_channels.h \
+    joint_histogram.h \
+    histogram_stats.h
+
+# qmake CONFIG+=notrace compiles tracing out
+notrace: DEFINES += HISTOGRAM_NO_TRACE
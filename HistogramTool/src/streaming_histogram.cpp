@@ -0,0 +1,144 @@
+#include "streaming_histogram.h"
+#include "bounded_queue.h"
+
+#include <QImageReader>
+#include <algorithm>
+#include <thread>
+
+
+/*
+ * Construct a streaming reader
+ */
+StreamingHistogram::StreamingHistogram( HistogramTool& tool, uint32_t bandRows ) : mTool( tool )
+{
+    mBandRows = bandRows;
+    mBandBytes = DEFAULT_BAND_BYTES;
+    mNumBands = 0;
+    mPeakBandBytes = 0;
+    mNumPixels = 0;
+}
+
+/*
+ * Set the target size of a band
+ */
+void StreamingHistogram::setBandBytes( size_t bandBytes )
+{
+    mBandBytes = ( bandBytes > 0 ) ? bandBytes : DEFAULT_BAND_BYTES;
+}
+
+/*
+ * Check whether a file can be read in bands
+ */
+bool StreamingHistogram::canStream( const QString& fileName )
+{
+    QImageReader reader{ fileName };
+    return reader.canRead()
+        && reader.size().isValid()
+        && reader.supportsOption( QImageIOHandler::ClipRect );
+}
+
+/*
+ * Compute the histogram of a file band by band
+ */
+bool StreamingHistogram::compute( const QString& fileName, Histogram& red, Histogram& green, Histogram& blue )
+{
+    mNumBands = 0;
+    mPeakBandBytes = 0;
+    mNumPixels = 0;
+    mErrorString.clear();
+
+    QImageReader probe{ fileName };
+    if( ! probe.canRead() ) {
+        mErrorString = "Unable to read image " + fileName.toStdString() + ": " + probe.errorString().toStdString();
+        return false;
+    }
+
+    // Formats which can't be clipped are read in one band
+    QSize size = probe.size();
+    bool streamable = size.isValid() && probe.supportsOption( QImageIOHandler::ClipRect );
+    uint32_t height = streamable ? static_cast<uint32_t>( size.height() ) : 1;
+    uint32_t rowsPerBand = 1;
+    if( streamable ) {
+        size_t bytesPerRow = std::max<size_t>( 1, static_cast<size_t>( size.width() ) * sizeof( QRgb ) );
+        rowsPerBand = ( mBandRows > 0 ) ? mBandRows : static_cast<uint32_t>( std::max<size_t>( 1, mBandBytes / bytesPerRow ) );
+    }
+
+    // One band queued while the next is decoded and the previous counted
+    BoundedQueue<QImage> bands{ 1 };
+    std::string decodeError;
+
+    std::thread decoder{ [&]{
+        for( uint32_t firstRow = 0; firstRow < height; firstRow += rowsPerBand ) {
+            QImageReader reader{ fileName };
+            if( streamable ) {
+                int rows = static_cast<int>( std::min( rowsPerBand, height - firstRow ) );
+                reader.setClipRect( QRect( 0, static_cast<int>( firstRow ), size.width(), rows ) );
+            }
+
+            QImage band = reader.read();
+            if( band.isNull() ) {
+                decodeError = reader.errorString().toStdString();
+                break;
+            }
+
+            if( ! bands.push( std::move( band ) ) ) {
+                break;
+            }
+        }
+        bands.close();
+    } };
+
+    // Count bands as they arrive
+    QImage band;
+    try {
+        while( bands.pop( band ) ) {
+            mPeakBandBytes = std::max( mPeakBandBytes, static_cast<size_t>( band.bytesPerLine() ) * static_cast<size_t>( band.height() ) );
+            mNumBands++;
+            mNumPixels += static_cast<uint64_t>( band.width() ) * static_cast<uint64_t>( band.height() );
+            mTool.computeHistogram( band, red, green, blue );
+        }
+    } catch( ... ) {
+        bands.close();
+        decoder.join();
+        throw;
+    }
+    decoder.join();
+
+    if( ! decodeError.empty() ) {
+        mErrorString = decodeError;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Return the number of bands read
+ */
+uint32_t StreamingHistogram::numBands( ) const
+{
+    return mNumBands;
+}
+
+/*
+ * Return the number of pixels counted
+ */
+uint64_t StreamingHistogram::numPixels( ) const
+{
+    return mNumPixels;
+}
+
+/*
+ * Return the size of the largest band
+ */
+size_t StreamingHistogram::peakBandBytes( ) const
+{
+    return mPeakBandBytes;
+}
+
+/*
+ * Return the last error
+ */
+std::string StreamingHistogram::errorString( ) const
+{
+    return mErrorString;
+}
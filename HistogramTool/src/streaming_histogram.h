@@ -0,0 +1,105 @@
+#ifndef STREAMING_HISTOGRAM_H
+#define STREAMING_HISTOGRAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <QString>
+#include "histogram.h"
+#include "histogram_tool.h"
+
+/**
+ * StreamingHistogram.
+ *
+ * Computes the histogram of an image file without holding the whole decoded image in memory.
+ * The image is read as a series of horizontal bands using QImageReader clip rectangles. A decoder
+ * thread reads the next band while the HistogramTool counts the current one, so decoding overlaps
+ * with counting. At most three bands are alive at once: one being decoded, one waiting and one being
+ * counted.
+ *
+ * Only image handlers which support clip rectangles (for example JPEG) can be streamed. Other formats
+ * are read in a single band, as a normal load would. Handlers which cannot seek decode and discard the
+ * scanlines above each band, so smaller bands trade decode time for memory.
+ */
+class StreamingHistogram {
+private:
+    // Tool used to count each band
+    HistogramTool&  mTool;
+
+    // Scanlines per band. 0 to size bands to mBandBytes
+    uint32_t        mBandRows;
+
+    // Target size of a decoded band when mBandRows is 0
+    size_t          mBandBytes;
+
+    // Number of bands read by the last call to compute
+    uint32_t        mNumBands;
+
+    // Size of the largest band read by the last call to compute
+    size_t          mPeakBandBytes;
+
+    // Pixels counted by the last call to compute
+    uint64_t        mNumPixels;
+
+    // Description of the last failure
+    std::string     mErrorString;
+
+public:
+    /**
+     * Target size of a decoded band when the number of rows is not given.
+     */
+    static const size_t DEFAULT_BAND_BYTES = 64 * 1024 * 1024;
+
+    /**
+     * Construct a streaming reader which counts with the given tool.
+     * @param tool The tool used to count each band. Must outlive this object.
+     * @param bandRows The number of scanlines in each band, or 0 to size bands automatically.
+     */
+    StreamingHistogram( HistogramTool& tool, uint32_t bandRows = 0 );
+
+    /**
+     * Set the target size of a decoded band, used when the number of rows per band is not given.
+     * At most three bands are alive at once so this bounds memory use to about three times the size.
+     * @param bandBytes The size in bytes. 0 restores DEFAULT_BAND_BYTES.
+     */
+    void setBandBytes( size_t bandBytes );
+
+    /**
+     * @param fileName An image file.
+     * @return true if the file's image handler can read it band by band.
+     */
+    static bool canStream( const QString& fileName );
+
+    /**
+     * Compute the histogram of an image file, adding its counts to the given Histograms.
+     * @param fileName The image file.
+     * @param red Histogram to which red values will be added.
+     * @param green Histogram to which green values will be added.
+     * @param blue Histogram to which blue values will be added.
+     * @return true on success, false if the file could not be read. See errorString().
+     * @throws std::invalid_argument if any of the Histograms does not have 256 buckets.
+     */
+    bool compute( const QString& fileName, Histogram& red, Histogram& green, Histogram& blue );
+
+    /**
+     * @return The number of bands read by the last call to compute.
+     */
+    uint32_t numBands( ) const;
+
+    /**
+     * @return The number of pixels counted by the last call to compute.
+     */
+    uint64_t numPixels( ) const;
+
+    /**
+     * @return The number of bytes in the largest decoded band during the last call to compute.
+     */
+    size_t peakBandBytes( ) const;
+
+    /**
+     * @return A description of why the last call to compute failed.
+     */
+    std::string errorString( ) const;
+};
+
+#endif // STREAMING_HISTOGRAM_H
@@ -0,0 +1,86 @@
+#include "tiled_histogram.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+/*
+ * Construct a tiled counter
+ */
+TiledHistogram::TiledHistogram( HistogramTool& tool, size_t memoryBudget ) : mTool( tool )
+{
+    if( memoryBudget == 0 ) {
+        throw std::invalid_argument( "Memory budget must be positive" );
+    }
+
+    mMemoryBudget = memoryBudget;
+    mNumTiles = 0;
+}
+
+/*
+ * Size tiles to the memory budget: whole scanlines if one fits, otherwise part of one
+ */
+void TiledHistogram::tileSize( const ImageView& image, uint32_t& tileWidth, uint32_t& tileRows ) const
+{
+    uint64_t bytesPerPixel = ImageView::bytesPerPixel( image.format );
+    uint64_t bytesPerRow = std::max<uint64_t>( 1, image.width * bytesPerPixel );
+
+    if( bytesPerRow <= mMemoryBudget ) {
+        tileWidth = image.width;
+        tileRows = static_cast<uint32_t>( std::min<uint64_t>( std::max<uint32_t>( 1, image.height ), mMemoryBudget / bytesPerRow ) );
+    } else {
+        tileWidth = static_cast<uint32_t>( std::max<uint64_t>( 1, mMemoryBudget / bytesPerPixel ) );
+        tileRows = 1;
+    }
+}
+
+/*
+ * Count an image a tile at a time
+ */
+void TiledHistogram::compute( const ImageView& image, Histogram& red, Histogram& green, Histogram& blue, const BandDone& bandDone )
+{
+    if( red.numBuckets() != 256 || green.numBuckets() != 256 || blue.numBuckets() != 256 ) {
+        throw std::invalid_argument( "Histograms must have 256 buckets" );
+    }
+
+    uint32_t tileWidth, tileRows;
+    tileSize( image, tileWidth, tileRows );
+    const size_t bytesPerPixel = ImageView::bytesPerPixel( image.format );
+
+    mNumTiles = 0;
+    for( uint64_t firstRow = 0; firstRow < image.height; firstRow += tileRows ) {
+        uint32_t rows = static_cast<uint32_t>( std::min<uint64_t>( tileRows, image.height - firstRow ) );
+
+        for( uint64_t firstColumn = 0; firstColumn < image.width; firstColumn += tileWidth ) {
+            uint32_t columns = static_cast<uint32_t>( std::min<uint64_t>( tileWidth, image.width - firstColumn ) );
+
+            ImageView tile = image;
+            tile.data = image.row( static_cast<uint32_t>( firstRow ) ) + firstColumn * bytesPerPixel;
+            tile.width = columns;
+            tile.height = rows;
+
+            mTool.computeHistogram( tile, red, green, blue );
+            mNumTiles++;
+        }
+
+        if( bandDone ) {
+            bandDone( static_cast<uint32_t>( firstRow ), rows );
+        }
+    }
+}
+
+/*
+ * Return the most bytes of pixels in a tile
+ */
+size_t TiledHistogram::memoryBudget( ) const
+{
+    return mMemoryBudget;
+}
+
+/*
+ * Return the number of tiles counted by the last call to compute
+ */
+uint64_t TiledHistogram::numTiles( ) const
+{
+    return mNumTiles;
+}
@@ -0,0 +1,85 @@
+#ifndef TILED_HISTOGRAM_H
+#define TILED_HISTOGRAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include "histogram.h"
+#include "histogram_tool.h"
+#include "image_view.h"
+
+/**
+ * TiledHistogram.
+ *
+ * Computes the histogram of a very large image, such as a mapped gigapixel mosaic, a tile at a time so that
+ * only a bounded number of pixel bytes need be resident at once. Tiles are sized to the memory budget:
+ * whole scanlines when a scanline fits in the budget, otherwise the widest run of a single scanline that does.
+ * Tiles are counted left to right within a band of scanlines and bands top to bottom. Once a band is done the
+ * caller is told so it can release the band's memory, for example with MappedRaster::release().
+ *
+ * Counting uses 64 bit pixel indices and totals throughout, so images of any size are counted correctly.
+ */
+class TiledHistogram {
+public:
+    /**
+     * Called when every tile in a band of scanlines has been counted.
+     * @param firstRow The first scanline of the band.
+     * @param numRows The number of scanlines in the band.
+     */
+    typedef std::function<void( uint32_t firstRow, uint32_t numRows )> BandDone;
+
+private:
+    // Tool used to count each tile
+    HistogramTool&  mTool;
+
+    // Most bytes of pixels in one tile
+    size_t          mMemoryBudget;
+
+    // Number of tiles counted by the last call to compute
+    uint64_t        mNumTiles;
+
+public:
+    /**
+     * Default memory budget.
+     */
+    static const size_t DEFAULT_MEMORY_BUDGET = 256 * 1024 * 1024;
+
+    /**
+     * Construct a tiled counter.
+     * @param tool The tool used to count each tile. Must outlive this object.
+     * @param memoryBudget The most bytes of pixels in a tile.
+     * @throws std::invalid_argument if memoryBudget is 0.
+     */
+    TiledHistogram( HistogramTool& tool, size_t memoryBudget = DEFAULT_MEMORY_BUDGET );
+
+    /**
+     * Work out the size of the tiles an image will be cut into.
+     * @param image The image.
+     * @param tileWidth Set to the number of pixels across each tile. Tiles at the right edge may be narrower.
+     * @param tileRows Set to the number of scanlines in each tile. Tiles at the bottom may be shorter.
+     */
+    void tileSize( const ImageView& image, uint32_t& tileWidth, uint32_t& tileRows ) const;
+
+    /**
+     * Compute the histogram of an image tile by tile, adding its counts to the given Histograms.
+     * @param image The image.
+     * @param red Histogram to which red values will be added.
+     * @param green Histogram to which green values will be added.
+     * @param blue Histogram to which blue values will be added.
+     * @param bandDone Called after each band of tiles. May be empty.
+     * @throws std::invalid_argument if any of the Histograms does not have 256 buckets.
+     */
+    void compute( const ImageView& image, Histogram& red, Histogram& green, Histogram& blue, const BandDone& bandDone = BandDone() );
+
+    /**
+     * @return The most bytes of pixels in a tile.
+     */
+    size_t memoryBudget( ) const;
+
+    /**
+     * @return The number of tiles counted by the last call to compute.
+     */
+    uint64_t numTiles( ) const;
+};
+
+#endif // TILED_HISTOGRAM_H
@@ -0,0 +1,338 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+/*
+ * The calling thread's hardware counters, opened on first use and closed when the thread exits
+ */
+namespace {
+struct ThreadCounters {
+    // Whether opening has been tried and whether it worked
+    bool    tried = false;
+    bool    open = false;
+
+    // Group leader first
+    int     fds[TraceEvent::NUM_COUNTERS] = { -1, -1, -1 };
+
+    ~ThreadCounters( ) {
+#ifdef __linux__
+        for( int fd : fds ) {
+            if( fd >= 0 ) {
+                close( fd );
+            }
+        }
+#endif
+    }
+
+    bool openCounters( ) {
+#ifdef __linux__
+        const uint64_t configs[TraceEvent::NUM_COUNTERS] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES
+        };
+        for( size_t i = 0; i < TraceEvent::NUM_COUNTERS; ++i ) {
+            perf_event_attr attr{};
+            attr.size = sizeof( attr );
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            // This thread on any CPU; the leader counts for the whole group
+            fds[i] = static_cast<int>( syscall( __NR_perf_event_open, &attr, 0, -1, ( i == 0 ) ? -1 : fds[0], 0 ) );
+            if( fds[i] < 0 ) {
+                return false;
+            }
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool read( uint64_t * values ) {
+#ifdef __linux__
+        // Number of counters then each value
+        uint64_t group[1 + TraceEvent::NUM_COUNTERS];
+        if( ::read( fds[0], group, sizeof( group ) ) != static_cast<ssize_t>( sizeof( group ) ) ) {
+            return false;
+        }
+        std::copy( group + 1, group + 1 + TraceEvent::NUM_COUNTERS, values );
+        return true;
+#else
+        (void) values;
+        return false;
+#endif
+    }
+};
+
+thread_local ThreadCounters threadCounters;
+
+
+/*
+ * Quote a string for JSON
+ */
+std::string quoted( const char * text ) {
+    std::string result{ "\"" };
+    for( const char *c = text; *c != '\0'; ++c ) {
+        if( *c == '"' || *c == '\\' ) {
+            result += '\\';
+        }
+        result += *c;
+    }
+    return result + "\"";
+}
+}
+
+
+/*
+ * Start a trace
+ */
+Trace::Trace( bool readCounters ) : mEpoch{ now() }, mReadCounters{ readCounters }, mCountersAvailable{ readCounters } {
+}
+
+/*
+ * Nanoseconds on the steady clock
+ */
+uint64_t Trace::now( ) {
+    return static_cast<uint64_t>( std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count() );
+}
+
+/*
+ * Whether counters are read
+ */
+bool Trace::readsCounters( ) const {
+    return mReadCounters;
+}
+
+/*
+ * Whether counters could be opened everywhere they were tried
+ */
+bool Trace::countersAvailable( ) const {
+    std::lock_guard<std::mutex> lock{ mMutex };
+    return mCountersAvailable;
+}
+
+/*
+ * Read the calling thread's counters, opening them the first time
+ */
+bool Trace::readCounters( uint64_t * values ) {
+    if( ! mReadCounters ) {
+        return false;
+    }
+
+    if( ! threadCounters.tried ) {
+        threadCounters.tried = true;
+        threadCounters.open = threadCounters.openCounters();
+    }
+    if( ! threadCounters.open || ! threadCounters.read( values ) ) {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        mCountersAvailable = false;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Record an ended span, giving its thread a small id if it's new
+ */
+void Trace::record( const char * name, uint64_t start, uint64_t end, uint64_t pixels, const uint64_t * counters ) {
+    TraceEvent event;
+    event.name = name;
+    event.start = ( start > mEpoch ) ? start - mEpoch : 0;
+    event.duration = ( end > start ) ? end - start : 0;
+    event.pixels = pixels;
+    event.hasCounters = ( counters != nullptr );
+    for( size_t i = 0; i < TraceEvent::NUM_COUNTERS; ++i ) {
+        event.counters[i] = event.hasCounters ? counters[i] : 0;
+    }
+
+    std::lock_guard<std::mutex> lock{ mMutex };
+    auto inserted = mThreadIds.insert( std::make_pair( std::this_thread::get_id(), static_cast<uint32_t>( mThreadIds.size() ) ) );
+    event.thread = inserted.first->second;
+    mEvents.push_back( event );
+}
+
+/*
+ * Copy of the events
+ */
+std::vector<TraceEvent> Trace::events( ) const {
+    std::lock_guard<std::mutex> lock{ mMutex };
+    return mEvents;
+}
+
+/*
+ * Drop the events. Thread ids are kept so a thread's id doesn't change
+ */
+void Trace::clear( ) {
+    std::lock_guard<std::mutex> lock{ mMutex };
+    mEvents.clear();
+}
+
+/*
+ * Totals per phase, in the order phases first ended, then rates per thread
+ */
+void Trace::writeSummary( std::ostream& output ) const {
+    std::vector<TraceEvent> events = this->events();
+
+    struct Totals {
+        std::string name;
+        uint64_t    spans = 0;
+        uint64_t    duration = 0;
+        uint64_t    pixels = 0;
+        uint64_t    counters[TraceEvent::NUM_COUNTERS] = { 0, 0, 0 };
+        bool        hasCounters = false;
+    };
+    std::vector<Totals> phases;
+    std::map<uint32_t, Totals> threads;
+
+    for( const TraceEvent& event : events ) {
+        auto phase = std::find_if( phases.begin(), phases.end(), [&event]( const Totals& totals ) {
+            return totals.name == event.name;
+        } );
+        if( phase == phases.end() ) {
+            phases.push_back( Totals{} );
+            phases.back().name = event.name;
+            phase = phases.end() - 1;
+        }
+        phase->spans++;
+        phase->duration += event.duration;
+        phase->pixels += event.pixels;
+        if( event.hasCounters ) {
+            phase->hasCounters = true;
+            for( size_t i = 0; i < TraceEvent::NUM_COUNTERS; ++i ) {
+                phase->counters[i] += event.counters[i];
+            }
+        }
+
+        if( event.pixels > 0 ) {
+            Totals& thread = threads[event.thread];
+            thread.spans++;
+            thread.duration += event.duration;
+            thread.pixels += event.pixels;
+        }
+    }
+
+    std::ios::fmtflags flags = output.flags();
+    std::streamsize precision = output.precision();
+    output << std::fixed << std::setprecision( 3 );
+
+    output << " Trace :" << std::endl;
+    for( const Totals& phase : phases ) {
+        output << "   " << std::left << std::setw( 10 ) << phase.name << std::right
+               << std::setw( 6 ) << phase.spans << " x " << std::setw( 12 ) << phase.duration / 1e6 << "ms";
+        if( phase.hasCounters ) {
+            output << "  " << phase.counters[TraceEvent::Cycles] << " cycles, "
+                   << phase.counters[TraceEvent::Instructions] << " instructions (IPC "
+                   << ( phase.counters[TraceEvent::Cycles] > 0
+                        ? static_cast<double>( phase.counters[TraceEvent::Instructions] ) / phase.counters[TraceEvent::Cycles]
+                        : 0.0 )
+                   << "), " << phase.counters[TraceEvent::CacheMisses] << " cache misses";
+        }
+        output << std::endl;
+    }
+
+    for( const auto& entry : threads ) {
+        const Totals& thread = entry.second;
+        output << "   thread " << entry.first << " : " << thread.spans << " spans, " << thread.pixels << " pixels, "
+               << ( thread.duration > 0 ? thread.pixels * 1e3 / thread.duration : 0.0 ) << " Mpixels/s" << std::endl;
+    }
+
+    output.flags( flags );
+    output.precision( precision );
+}
+
+/*
+ * Chrome trace event format; one complete event per span and a name for each thread
+ */
+void Trace::writeChromeTrace( std::ostream& output ) const {
+    std::vector<TraceEvent> events = this->events();
+    uint32_t numThreads = 0;
+    for( const TraceEvent& event : events ) {
+        numThreads = std::max( numThreads, event.thread + 1 );
+    }
+
+    std::ios::fmtflags flags = output.flags();
+    std::streamsize precision = output.precision();
+    output << std::fixed << std::setprecision( 3 );
+
+    output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for( uint32_t thread = 0; thread < numThreads; ++thread ) {
+        output << ( first ? "\n" : ",\n" ) << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+               << ",\"args\":{\"name\":\"" << ( thread == 0 ? "main" : "thread " + std::to_string( thread ) ) << "\"}}";
+        first = false;
+    }
+    for( const TraceEvent& event : events ) {
+        output << ( first ? "\n" : ",\n" ) << "{\"name\":" << quoted( event.name ) << ",\"cat\":\"histogram\",\"ph\":\"X\""
+               << ",\"pid\":1,\"tid\":" << event.thread
+               << ",\"ts\":" << event.start / 1e3 << ",\"dur\":" << event.duration / 1e3 << ",\"args\":{";
+        first = false;
+
+        bool firstArg = true;
+        if( event.pixels > 0 ) {
+            output << "\"pixels\":" << event.pixels << ",\"mpixels_per_s\":"
+                   << ( event.duration > 0 ? event.pixels * 1e3 / event.duration : 0.0 );
+            firstArg = false;
+        }
+        if( event.hasCounters ) {
+            output << ( firstArg ? "" : "," ) << "\"cycles\":" << event.counters[TraceEvent::Cycles]
+                   << ",\"instructions\":" << event.counters[TraceEvent::Instructions]
+                   << ",\"cache_misses\":" << event.counters[TraceEvent::CacheMisses];
+        }
+        output << "}}";
+    }
+    output << "\n]}" << std::endl;
+
+    output.flags( flags );
+    output.precision( precision );
+}
+
+
+#ifndef HISTOGRAM_NO_TRACE
+
+/*
+ * Note the start time and counters unless there's no trace
+ */
+TraceScope::TraceScope( Trace * trace, const char * name, uint64_t pixels )
+    : mTrace{ trace }, mName{ name }, mPixels{ pixels }, mStart{ 0 }, mHasCounters{ false } {
+    if( mTrace != nullptr ) {
+        mHasCounters = mTrace->readCounters( mCounters );
+        mStart = Trace::now();
+    }
+}
+
+/*
+ * Record the span, with the change in counters if they were read at both ends
+ */
+TraceScope::~TraceScope( ) {
+    if( mTrace == nullptr ) {
+        return;
+    }
+
+    uint64_t end = Trace::now();
+    uint64_t counters[TraceEvent::NUM_COUNTERS];
+    bool hasCounters = mHasCounters && mTrace->readCounters( counters );
+    if( hasCounters ) {
+        for( size_t i = 0; i < TraceEvent::NUM_COUNTERS; ++i ) {
+            counters[i] -= mCounters[i];
+        }
+    }
+    mTrace->record( mName, mStart, end, mPixels, hasCounters ? counters : nullptr );
+}
+
+#endif // HISTOGRAM_NO_TRACE
@@ -0,0 +1,226 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+/**
+ * A timed span of work on one thread, recorded by a Trace.
+ */
+struct TraceEvent {
+    /**
+     * Hardware counters read around a span, when available.
+     */
+    enum Counter {
+        Cycles = 0,
+        Instructions,
+        CacheMisses,
+        NUM_COUNTERS
+    };
+
+    // Name of the phase. Points to a string literal
+    const char *    name;
+
+    // Small id of the thread; 0 is the first thread to record an event
+    uint32_t        thread;
+
+    // Nanoseconds from the creation of the Trace to the start of the span
+    uint64_t        start;
+
+    // Length of the span in nanoseconds
+    uint64_t        duration;
+
+    // Pixels processed in the span, 0 if it doesn't process pixels
+    uint64_t        pixels;
+
+    // Whether counters were read
+    bool            hasCounters;
+
+    // Change in each hardware counter over the span
+    uint64_t        counters[NUM_COUNTERS];
+};
+
+
+/**
+ * Trace.
+ *
+ * Records how long each phase of a computation takes on each thread, for profiling. Spans are timed with
+ * TraceScope, which reads a nanosecond steady clock when it starts and ends and records a TraceEvent here.
+ * Spans which process pixels also give the rate at which each thread counted.
+ *
+ * Optionally the CPU's cycle, instruction and cache miss counters are read around each span through
+ * perf_event_open on Linux. Each thread opens its counters the first time it needs them. If they can't
+ * be opened, say because perf events are restricted, spans are still timed and countersAvailable() says so.
+ *
+ * Events can be printed as a summary per phase and per thread, or exported as a Chrome trace to be viewed
+ * in chrome://tracing or Perfetto.
+ *
+ * Spans are meant to be coarse, such as a thread's share of an image, so events are recorded under a lock.
+ * Classes which can be traced take a Trace pointer which is null unless tracing was asked for, so an
+ * untraced run pays one test of a pointer per span. Building with HISTOGRAM_NO_TRACE defined (qmake
+ * CONFIG+=notrace) compiles TraceScope away altogether.
+ */
+class Trace {
+private:
+    // Time the trace was created, from which event times are measured
+    uint64_t                mEpoch;
+
+    // Whether to read hardware counters
+    bool                    mReadCounters;
+
+    // Whether every thread which tried could open its counters
+    bool                    mCountersAvailable;
+
+    // Events in the order they ended
+    std::vector<TraceEvent> mEvents;
+
+    // Small id of each thread seen
+    std::map<std::thread::id, uint32_t> mThreadIds;
+
+    // Guards all of the above
+    mutable std::mutex      mMutex;
+
+public:
+    /**
+     * Start a trace.
+     * @param readCounters Whether to read hardware counters around each span.
+     */
+    explicit Trace( bool readCounters = false );
+
+    Trace( const Trace& ) = delete;
+    Trace& operator=( const Trace& ) = delete;
+
+    /**
+     * @return Nanoseconds on a steady clock, from an arbitrary point.
+     */
+    static uint64_t now( );
+
+    /**
+     * @return Whether hardware counters are read around each span.
+     */
+    bool readsCounters( ) const;
+
+    /**
+     * @return Whether hardware counters could be read on every thread which tried. Always false on other
+     * than Linux.
+     */
+    bool countersAvailable( ) const;
+
+    /**
+     * Read the calling thread's hardware counters, opening them on first use.
+     * @param values Set to the count of each TraceEvent::Counter.
+     * @return false if counters aren't read or couldn't be opened on this thread.
+     */
+    bool readCounters( uint64_t * values );
+
+    /**
+     * Record a span which has ended on the calling thread.
+     * @param name Name of the phase. Must outlive the trace; normally a string literal.
+     * @param start now() at the start of the span.
+     * @param end now() at the end of the span.
+     * @param pixels Pixels processed in the span, or 0.
+     * @param counters Change in each TraceEvent::Counter over the span, or null if not read.
+     */
+    void record( const char * name, uint64_t start, uint64_t end, uint64_t pixels, const uint64_t * counters );
+
+    /**
+     * @return Every event recorded so far, in the order they ended.
+     */
+    std::vector<TraceEvent> events( ) const;
+
+    /**
+     * Forget every event recorded so far.
+     */
+    void clear( );
+
+    /**
+     * Print the total time and number of spans of each phase, the rate each thread processed pixels at
+     * and, if read, the counters of each phase.
+     * @param output Stream to print to.
+     */
+    void writeSummary( std::ostream& output ) const;
+
+    /**
+     * Write every event as a complete event ("ph":"X") of the Chrome trace event format, times in
+     * microseconds.
+     * @param output Stream to write to.
+     */
+    void writeChromeTrace( std::ostream& output ) const;
+};
+
+
+#ifndef HISTOGRAM_NO_TRACE
+
+/**
+ * TraceScope.
+ *
+ * Times the span from its construction to its destruction and records it in a Trace.
+ * Does nothing if the Trace is null.
+ */
+class TraceScope {
+private:
+    // Trace to record in, or null
+    Trace *         mTrace;
+
+    // Name of the phase
+    const char *    mName;
+
+    // Pixels processed in the span
+    uint64_t        mPixels;
+
+    // Time the span started
+    uint64_t        mStart;
+
+    // Whether counters were read at the start
+    bool            mHasCounters;
+
+    // Counters at the start
+    uint64_t        mCounters[TraceEvent::NUM_COUNTERS];
+
+public:
+    /**
+     * Start a span.
+     * @param trace Trace to record in, or null to do nothing.
+     * @param name Name of the phase. Must outlive the trace; normally a string literal.
+     * @param pixels Pixels processed in the span, if known now.
+     */
+    TraceScope( Trace * trace, const char * name, uint64_t pixels = 0 );
+
+    /**
+     * End the span and record it.
+     */
+    ~TraceScope( );
+
+    TraceScope( const TraceScope& ) = delete;
+    TraceScope& operator=( const TraceScope& ) = delete;
+
+    /**
+     * Set the number of pixels processed in the span, when only known at the end.
+     * @param pixels The number of pixels.
+     */
+    void setPixels( uint64_t pixels ) {
+        mPixels = pixels;
+    }
+};
+
+#else
+
+/*
+ * Tracing compiled out; scopes are empty and optimise away
+ */
+class TraceScope {
+public:
+    TraceScope( Trace *, const char *, uint64_t = 0 ) { }
+    TraceScope( const TraceScope& ) = delete;
+    TraceScope& operator=( const TraceScope& ) = delete;
+    void setPixels( uint64_t ) { }
+};
+
+#endif // HISTOGRAM_NO_TRACE
+
+#endif // TRACE_H
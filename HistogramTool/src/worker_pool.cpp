@@ -0,0 +1,211 @@
+#include "worker_pool.h"
+
+#include <exception>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+/*
+ * Start the worker threads
+ */
+WorkerPool::WorkerPool( uint32_t numWorkers ) : mWorkerQueues( numWorkers ), mStopping{ false }
+{
+    mThreads.reserve( numWorkers );
+    for( uint32_t i=0; i<numWorkers; ++i ) {
+        mThreads.emplace_back( [this, i]{ workerLoop( i ); } );
+    }
+}
+
+/*
+ * Stop and join the workers
+ */
+WorkerPool::~WorkerPool( )
+{
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        mStopping = true;
+    }
+    mWake.notify_all();
+
+    for( std::thread& t : mThreads ) {
+        t.join();
+    }
+}
+
+/*
+ * Return the number of workers
+ */
+uint32_t WorkerPool::numWorkers( ) const
+{
+    return static_cast<uint32_t>( mThreads.size() );
+}
+
+/*
+ * Run queued work until stopped, this worker's own before shared
+ */
+void WorkerPool::workerLoop( uint32_t worker )
+{
+    std::deque<std::function<void()>>& own = mWorkerQueues[worker];
+    for( ;; ) {
+        std::function<void()> work;
+        {
+            std::unique_lock<std::mutex> lock{ mMutex };
+            mWake.wait( lock, [this, &own]{ return mStopping || ! own.empty() || ! mQueue.empty(); } );
+            if( mStopping ) {
+                return;
+            }
+            std::deque<std::function<void()>>& queue = own.empty() ? mQueue : own;
+            work = std::move( queue.front() );
+            queue.pop_front();
+        }
+        work();
+    }
+}
+
+/*
+ * Run a job of numTasks tasks, task 0 on the caller, and wait for all of them
+ */
+void WorkerPool::run( uint32_t numTasks, const Task& task )
+{
+    dispatch( numTasks, task, false );
+}
+
+/*
+ * Run a job with task i on worker i - 1
+ */
+void WorkerPool::runPlaced( uint32_t numTasks, const Task& task )
+{
+    if( numTasks > mThreads.size() + 1 ) {
+        throw std::invalid_argument( "More placed tasks than threads" );
+    }
+    dispatch( numTasks, task, true );
+}
+
+/*
+ * Queue work for whichever worker is free first
+ */
+void WorkerPool::post( std::function<void()> work )
+{
+    if( mThreads.empty() ) {
+        throw std::logic_error( "No workers to post work to" );
+    }
+    {
+        std::lock_guard<std::mutex> lock{ mMutex };
+        mQueue.push_back( std::move( work ) );
+    }
+    mWake.notify_one();
+}
+
+/*
+ * Pin each worker with pthread_setaffinity_np
+ */
+bool WorkerPool::pinWorkers( const std::vector<uint32_t>& cpus )
+{
+    if( cpus.empty() ) {
+        throw std::invalid_argument( "Need a CPU to pin workers to" );
+    }
+
+#ifdef __linux__
+    bool pinned = true;
+    for( size_t i=0; i<mThreads.size(); ++i ) {
+        uint32_t cpu = cpus[i % cpus.size()];
+        if( cpu >= CPU_SETSIZE ) {
+            pinned = false;
+            continue;
+        }
+        cpu_set_t mask;
+        CPU_ZERO( &mask );
+        CPU_SET( cpu, &mask );
+        if( pthread_setaffinity_np( mThreads[i].native_handle(), sizeof( mask ), &mask ) != 0 ) {
+            pinned = false;
+        }
+    }
+    return pinned;
+#else
+    return false;
+#endif
+}
+
+/*
+ * Queue the workers' tasks, shared or each to its own worker, then do task 0 and wait
+ */
+void WorkerPool::dispatch( uint32_t numTasks, const Task& task, bool placed )
+{
+    if( numTasks == 0 ) {
+        return;
+    }
+
+    // Without workers everything runs here
+    if( mThreads.empty() ) {
+        for( uint32_t i=0; i<numTasks; ++i ) {
+            task( i );
+        }
+        return;
+    }
+
+    // Completion state shared with the queued tasks. Lives on this stack frame, which
+    // outlasts every task as we don't return until they have all finished.
+    std::mutex doneMutex;
+    std::condition_variable doneSignal;
+    uint32_t remaining = numTasks - 1;
+    std::exception_ptr error;
+
+    auto finish = [&]( std::exception_ptr e ) {
+        std::lock_guard<std::mutex> lock{ doneMutex };
+        if( e && ! error ) {
+            error = e;
+        }
+        if( --remaining == 0 ) {
+            doneSignal.notify_one();
+        }
+    };
+
+    if( numTasks > 1 ) {
+        {
+            std::lock_guard<std::mutex> lock{ mMutex };
+            for( uint32_t i=1; i<numTasks; ++i ) {
+                std::deque<std::function<void()>>& queue = placed ? mWorkerQueues[i - 1] : mQueue;
+                queue.emplace_back( [i, &task, &finish]{
+                    try {
+                        task( i );
+                        finish( nullptr );
+                    } catch( ... ) {
+                        finish( std::current_exception() );
+                    }
+                } );
+            }
+        }
+        // A placed task needs its own worker woken, which notify_one can't pick
+        if( placed || numTasks - 1 >= mThreads.size() ) {
+            mWake.notify_all();
+        } else {
+            for( uint32_t i=1; i<numTasks; ++i ) {
+                mWake.notify_one();
+            }
+        }
+    }
+
+    // Do our share while the workers do theirs
+    std::exception_ptr callerError;
+    try {
+        task( 0 );
+    } catch( ... ) {
+        callerError = std::current_exception();
+    }
+
+    {
+        std::unique_lock<std::mutex> lock{ doneMutex };
+        doneSignal.wait( lock, [&]{ return remaining == 0; } );
+    }
+
+    if( callerError ) {
+        std::rethrow_exception( callerError );
+    }
+    if( error ) {
+        std::rethrow_exception( error );
+    }
+}
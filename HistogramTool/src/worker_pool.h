@@ -0,0 +1,124 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+/**
+ * WorkerPool.
+ *
+ * A fixed set of long lived worker threads which wait on a shared queue of tasks.
+ * Posting work wakes an idle worker rather than creating a new thread, so the cost of starting
+ * threads is paid once, when the pool is constructed.
+ *
+ * run() splits a job into a number of indexed tasks. The calling thread runs task 0 itself and the
+ * remaining tasks are queued for the workers; run() returns once every task has finished.
+ *
+ * runPlaced() instead gives task i to worker i - 1, so a task knows which thread it runs on. With workers
+ * pinned to CPUs by pinWorkers() that places each task on a known CPU, and so a known NUMA node.
+ *
+ * post() queues a piece of work and returns at once, for callers which want to carry on while it runs. Posted
+ * work and the tasks of jobs share the workers, in the order they were queued.
+ *
+ * Workers are stopped and joined when the pool is destroyed. Tasks still queued at that point are discarded.
+ */
+class WorkerPool {
+public:
+    /**
+     * A task in a job run by run(). Passed the index of the task within the job.
+     */
+    typedef std::function<void( uint32_t taskIndex )> Task;
+
+private:
+    // The worker threads
+    std::vector<std::thread>            mThreads;
+
+    // Work waiting to be picked up
+    std::deque<std::function<void()>>   mQueue;
+
+    // Work waiting for a particular worker
+    std::vector<std::deque<std::function<void()>>> mWorkerQueues;
+
+    // Guards mQueue and mStopping
+    std::mutex                          mMutex;
+
+    // Signalled when work is queued or the pool is stopping
+    std::condition_variable             mWake;
+
+    // Set when the pool is being destroyed
+    bool                                mStopping;
+
+    /**
+     * Body of each worker thread. Runs queued work, its own first, until the pool is stopped.
+     * @param worker The index of the worker.
+     */
+    void workerLoop( uint32_t worker );
+
+    /**
+     * Queue tasks 1 to numTasks - 1, run task 0 and wait for them all.
+     * @param placed Whether task i must run on worker i - 1.
+     */
+    void dispatch( uint32_t numTasks, const Task& task, bool placed );
+
+public:
+    /**
+     * Start a pool of worker threads.
+     * @param numWorkers The number of threads to start. May be 0, in which case all work runs on the caller.
+     * @throws std::system_error if a thread cannot be started.
+     */
+    explicit WorkerPool( uint32_t numWorkers );
+
+    /**
+     * Stops and joins the worker threads.
+     */
+    ~WorkerPool( );
+
+    WorkerPool( const WorkerPool& ) = delete;
+    WorkerPool& operator=( const WorkerPool& ) = delete;
+
+    /**
+     * @return The number of worker threads, not counting the caller.
+     */
+    uint32_t numWorkers( ) const;
+
+    /**
+     * Run a job made up of numTasks tasks and wait for them all to finish.
+     * Task 0 runs on the calling thread, the others on workers. Must not be called from within a task.
+     * @param numTasks The number of tasks. At most numWorkers() + 1 run concurrently.
+     * @param task The task to run, once for each index in [0, numTasks).
+     * @throws Any exception thrown by a task is rethrown once all tasks have finished.
+     */
+    void run( uint32_t numTasks, const Task& task );
+
+    /**
+     * Run a job made up of numTasks tasks, task 0 on the calling thread and task i on worker i - 1, and wait
+     * for them all to finish. Must not be called from within a task.
+     * @param numTasks The number of tasks. At most numWorkers() + 1.
+     * @param task The task to run, once for each index in [0, numTasks).
+     * @throws std::invalid_argument if there are more tasks than threads.
+     * @throws Any exception thrown by a task is rethrown once all tasks have finished.
+     */
+    void runPlaced( uint32_t numTasks, const Task& task );
+
+    /**
+     * Queue work to run on a worker and return without waiting for it. The work must not throw.
+     * @param work The work.
+     * @throws std::logic_error if the pool has no workers to run it.
+     */
+    void post( std::function<void()> work );
+
+    /**
+     * Pin each worker to a CPU. Worker i is pinned to cpus[i % cpus.size()]. Linux only.
+     * @param cpus The CPUs.
+     * @return false if any worker couldn't be pinned, or pinning isn't supported.
+     * @throws std::invalid_argument if cpus is empty.
+     */
+    bool pinWorkers( const std::vector<uint32_t>& cpus );
+};
+
+#endif // WORKER_POOL_H
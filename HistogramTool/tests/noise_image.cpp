@@ -0,0 +1,23 @@
+#include "noise_image.h"
+#include "../src/noise_source.h"
+
+/*
+ * Set each pixel, or its index into the colour table, to the next noise value
+ */
+QImage NoiseImage::make( int width, int height, QImage::Format format ) {
+    QImage image{ width, height, format };
+    if( format == QImage::Format_Indexed8 ) {
+        for( int i = 0; i < 256; ++i ) {
+            image.setColor( i, 0xFF000000u | ( static_cast<uint32_t>( i ) * 2654435761u >> 8 ) );
+        }
+    }
+
+    NoiseSource noise;
+    for( int y = 0; y < height; ++y ) {
+        for( int x = 0; x < width; ++x ) {
+            uint32_t value = noise.next();
+            image.setPixel( x, y, ( format == QImage::Format_Indexed8 ) ? ( value & 0xFF ) : value );
+        }
+    }
+    return image;
+}
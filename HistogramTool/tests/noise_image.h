@@ -0,0 +1,23 @@
+#ifndef NOISE_IMAGE_H
+#define NOISE_IMAGE_H
+
+#include <QImage>
+
+/**
+ * NoiseImage.
+ *
+ * Makes images of repeatable noise, of varied colours and alphas, for the tests to count.
+ */
+class NoiseImage {
+public:
+    /**
+     * Make an image of noise.
+     * @param width The width of the image.
+     * @param height The height of the image.
+     * @param format The format of the image. Indexed8 images get a table of 256 opaque colours.
+     * @return The image.
+     */
+    static QImage make( int width, int height, QImage::Format format );
+};
+
+#endif // NOISE_IMAGE_H
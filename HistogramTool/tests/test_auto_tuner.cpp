@@ -0,0 +1,158 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <fstream>
+
+#include "test_auto_tuner.h"
+
+CpuTopology TestAutoTuner::makeTopology( uint32_t logicalCpus, uint32_t physicalCores, double cpuQuota ) {
+    CpuTopology topology;
+    topology.logicalCpus = logicalCpus;
+    topology.physicalCores = physicalCores;
+    topology.cpuQuota = cpuQuota;
+    return topology;
+}
+
+// When detected, there is at least one CPU and no more cores than CPUs
+void TestAutoTuner::detectsThisMachine( ) {
+    CpuTopology topology = CpuTopology::detect();
+    QVERIFY( topology.logicalCpus >= 1 );
+    QVERIFY( topology.physicalCores >= 1 );
+    QVERIFY( topology.physicalCores <= topology.logicalCpus );
+    QVERIFY( topology.cpuQuota >= 0 );
+    QVERIFY( topology.recommendedThreads() >= 1 );
+    QVERIFY( topology.recommendedThreads() <= topology.maxUsefulThreads() );
+    QVERIFY( topology.l2CacheBytes > 0 );
+}
+
+// When a cgroup v2 cpu.max is parsed, a quota is CPUs worth of time and max or nonsense is unlimited
+void TestAutoTuner::parsesCpuMax( ) {
+    QCOMPARE( CpuTopology::parseCpuMax( "200000 100000" ), 2.0 );
+    QCOMPARE( CpuTopology::parseCpuMax( "150000 100000\n" ), 1.5 );
+    QCOMPARE( CpuTopology::parseCpuMax( "max 100000" ), 0.0 );
+    QCOMPARE( CpuTopology::parseCpuMax( "" ), 0.0 );
+    QCOMPARE( CpuTopology::parseCpuMax( "100000" ), 0.0 );
+    QCOMPARE( CpuTopology::parseCpuMax( "100000 0" ), 0.0 );
+}
+
+// When a sysfs cache size is parsed, K and M are binary multiples and nonsense is 0
+void TestAutoTuner::parsesCacheSize( ) {
+    QCOMPARE( CpuTopology::parseCacheSize( "1024K" ), static_cast<size_t>( 1024 * 1024 ) );
+    QCOMPARE( CpuTopology::parseCacheSize( "2M\n" ), static_cast<size_t>( 2 * 1024 * 1024 ) );
+    QCOMPARE( CpuTopology::parseCacheSize( "65536" ), static_cast<size_t>( 65536 ) );
+    QCOMPARE( CpuTopology::parseCacheSize( "" ), static_cast<size_t>( 0 ) );
+    QCOMPARE( CpuTopology::parseCacheSize( "12Q" ), static_cast<size_t>( 0 ) );
+}
+
+// When there are SMT siblings or a quota, recommended threads are the cores or the quota rounded up
+void TestAutoTuner::recommendsThreads( ) {
+    QCOMPARE( makeTopology( 8, 4, 0 ).recommendedThreads(), static_cast<uint32_t>( 4 ) );
+    QCOMPARE( makeTopology( 8, 4, 0 ).maxUsefulThreads(), static_cast<uint32_t>( 8 ) );
+    QCOMPARE( makeTopology( 8, 4, 1.5 ).recommendedThreads(), static_cast<uint32_t>( 2 ) );
+    QCOMPARE( makeTopology( 8, 4, 1.5 ).maxUsefulThreads(), static_cast<uint32_t>( 2 ) );
+    QCOMPARE( makeTopology( 8, 4, 0.25 ).recommendedThreads(), static_cast<uint32_t>( 1 ) );
+    QCOMPARE( makeTopology( 2, 2, 16 ).recommendedThreads(), static_cast<uint32_t>( 2 ) );
+}
+
+// When candidates are listed, they are ascending powers of two with the cores, up to the CPUs or quota
+void TestAutoTuner::listsCandidateThreads( ) {
+    std::vector<uint32_t> expected{ 1, 2, 4, 6, 8, 12 };
+    QVERIFY( AutoTuner{ makeTopology( 12, 6, 0 ) }.candidateThreads() == expected );
+
+    expected = { 1, 2, 3 };
+    QVERIFY( AutoTuner{ makeTopology( 8, 4, 2.5 ) }.candidateThreads() == expected );
+
+    expected = { 1 };
+    QVERIFY( AutoTuner{ makeTopology( 1, 1, 0 ) }.candidateThreads() == expected );
+}
+
+// When sides are empty, zero or not ascending, throws a std::invalid_argument
+void TestAutoTuner::constructWithBadSides( ) {
+    CpuTopology topology = makeTopology( 4, 2, 0 );
+    QVERIFY_EXCEPTION_THROWN( AutoTuner( topology, std::vector<uint32_t>{} ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( AutoTuner( topology, std::vector<uint32_t>{ 0, 16 } ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( AutoTuner( topology, std::vector<uint32_t>{ 32, 16 } ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( AutoTuner( topology, std::vector<uint32_t>{ 16, 16 } ), std::invalid_argument );
+}
+
+// When an image size is given, the choice is for the smallest class it fits in, or the last
+void TestAutoTuner::choosesBySize( ) {
+    AutoTuner tuner{ makeTopology( 8, 4, 0 ), { 16, 64, 128 } };
+    QVERIFY( ! tuner.calibrated() );
+    QCOMPARE( tuner.choices().size(), static_cast<size_t>( 3 ) );
+
+    QCOMPARE( tuner.choose( 1 ).maxPixels, static_cast<uint64_t>( 256 ) );
+    QCOMPARE( tuner.choose( 256 ).maxPixels, static_cast<uint64_t>( 256 ) );
+    QCOMPARE( tuner.choose( 257 ).maxPixels, static_cast<uint64_t>( 4096 ) );
+    QCOMPARE( tuner.choose( 4097 ).maxPixels, UINT64_MAX );
+    QCOMPARE( tuner.choose( UINT64_MAX ).maxPixels, UINT64_MAX );
+
+    // Uncalibrated choices are the recommendation
+    QCOMPARE( tuner.choose( 1 ).numThreads, static_cast<uint32_t>( 4 ) );
+    QVERIFY( tuner.choose( 1 ).kernel == HistogramKernel::bestAvailable() );
+}
+
+// When calibrated, every class has a supported kernel and a candidate thread count
+void TestAutoTuner::calibrates( ) {
+    AutoTuner tuner{ CpuTopology::detect(), { 64, 256 } };
+    tuner.calibrate();
+    QVERIFY( tuner.calibrated() );
+
+    std::vector<uint32_t> candidates = tuner.candidateThreads();
+    for( const AutoTuner::Choice& choice : tuner.choices() ) {
+        QVERIFY( choice.kernel != KernelType::Auto );
+        QVERIFY( HistogramKernel::isSupported( choice.kernel ) );
+        QVERIFY( std::find( candidates.begin(), candidates.end(), choice.numThreads ) != candidates.end() );
+    }
+}
+
+// When saved and loaded, the choices are the same
+void TestAutoTuner::savesAndLoads( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "tuning" ).toStdString();
+
+    AutoTuner tuner{ CpuTopology::detect(), { 64, 256 } };
+    tuner.calibrate();
+    QVERIFY( tuner.save( fileName ) );
+
+    AutoTuner loaded{ CpuTopology::detect(), { 64, 256 } };
+    QVERIFY( loaded.load( fileName ) );
+    QVERIFY( loaded.calibrated() );
+    QCOMPARE( loaded.choices().size(), tuner.choices().size() );
+    for( size_t i = 0; i < tuner.choices().size(); ++i ) {
+        QCOMPARE( loaded.choices()[i].maxPixels, tuner.choices()[i].maxPixels );
+        QCOMPARE( loaded.choices()[i].numThreads, tuner.choices()[i].numThreads );
+        QVERIFY( loaded.choices()[i].kernel == tuner.choices()[i].kernel );
+    }
+}
+
+// When a tuning file is from another machine, for other classes, missing or malformed, it isn't loaded
+void TestAutoTuner::rejectsMismatchedFiles( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "tuning" ).toStdString();
+
+    AutoTuner tuner{ makeTopology( 8, 4, 0 ), { 64, 256 } };
+    QVERIFY( tuner.save( fileName ) );
+
+    AutoTuner otherMachine{ makeTopology( 8, 8, 0 ), { 64, 256 } };
+    QVERIFY( ! otherMachine.load( fileName ) );
+    QVERIFY( ! otherMachine.calibrated() );
+    QVERIFY( ! otherMachine.errorString().empty() );
+
+    AutoTuner otherQuota{ makeTopology( 8, 4, 2 ), { 64, 256 } };
+    QVERIFY( ! otherQuota.load( fileName ) );
+
+    AutoTuner otherClasses{ makeTopology( 8, 4, 0 ), { 64, 512 } };
+    QVERIFY( ! otherClasses.load( fileName ) );
+
+    AutoTuner missing{ makeTopology( 8, 4, 0 ), { 64, 256 } };
+    QVERIFY( ! missing.load( dir.filePath( "absent" ).toStdString() ) );
+
+    std::ofstream{ fileName } << "histogramtool-tuning 1\nnonsense\n";
+    AutoTuner malformed{ makeTopology( 8, 4, 0 ), { 64, 256 } };
+    QVERIFY( ! malformed.load( fileName ) );
+
+    AutoTuner same{ makeTopology( 8, 4, 0 ), { 64, 256 } };
+    QVERIFY( tuner.save( fileName ) );
+    QVERIFY( same.load( fileName ) );
+}
@@ -0,0 +1,47 @@
+#ifndef TEST_AUTO_TUNER_H
+#define TEST_AUTO_TUNER_H
+
+#include <QtTest>
+#include "../src/auto_tuner.h"
+#include "../src/cpu_topology.h"
+
+class TestAutoTuner : public QObject {
+    Q_OBJECT
+
+private:
+    // A topology with the given counts and quota
+    static CpuTopology makeTopology( uint32_t logicalCpus, uint32_t physicalCores, double cpuQuota );
+
+private slots:
+    // When detected, there is at least one CPU and no more cores than CPUs
+    void detectsThisMachine( );
+
+    // When a cgroup v2 cpu.max is parsed, a quota is CPUs worth of time and max or nonsense is unlimited
+    void parsesCpuMax( );
+
+    // When a sysfs cache size is parsed, K and M are binary multiples and nonsense is 0
+    void parsesCacheSize( );
+
+    // When there are SMT siblings or a quota, recommended threads are the cores or the quota rounded up
+    void recommendsThreads( );
+
+    // When candidates are listed, they are ascending powers of two with the cores, up to the CPUs or quota
+    void listsCandidateThreads( );
+
+    // When sides are empty, zero or not ascending, throws a std::invalid_argument
+    void constructWithBadSides( );
+
+    // When an image size is given, the choice is for the smallest class it fits in, or the last
+    void choosesBySize( );
+
+    // When calibrated, every class has a supported kernel and a candidate thread count
+    void calibrates( );
+
+    // When saved and loaded, the choices are the same
+    void savesAndLoads( );
+
+    // When a tuning file is from another machine, for other classes, missing or malformed, it isn't loaded
+    void rejectsMismatchedFiles( );
+};
+
+#endif // TEST_AUTO_TUNER_H
@@ -0,0 +1,96 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <stdexcept>
+#include <vector>
+
+#include "test_batch_histogram.h"
+
+QStringList TestBatchHistogram::makeImages( const QString& dir, int numImages ) const {
+    QStringList fileNames;
+    for( int i = 0; i < numImages; i++ ) {
+        QImage image{ 20, 10, QImage::Format_RGB32 };
+        image.fill( QColor( i * 10, 0, 255 ) );
+
+        QString fileName = dir + "/image" + QString::number( i ) + ".bmp";
+        image.save( fileName, "BMP" );
+        fileNames.push_back( fileName );
+    }
+    return fileNames;
+}
+
+// When a batch is run, the writer gets exactly one correct record per image
+void TestBatchHistogram::oneRecordPerImage( ) {
+    QTemporaryDir dir;
+    QStringList fileNames = makeImages( dir.path(), 12 );
+
+    BatchHistogram batch{ 2, 3, 1, KernelType::Auto, 2 };
+    std::vector<int> seen( 12, 0 );
+    uint32_t failures = batch.run( fileNames, [&]( BatchRecord& record ) {
+        seen[record.index]++;
+        QVERIFY( record.ok() );
+        QVERIFY( record.fileName == fileNames[record.index] );
+        QCOMPARE( record.numPixels, static_cast<uint64_t>( 200 ) );
+        QCOMPARE( record.red[record.index * 10], static_cast<uint64_t>( 200 ) );
+        QCOMPARE( record.blue[255], static_cast<uint64_t>( 200 ) );
+    } );
+
+    QCOMPARE( failures, static_cast<uint32_t>( 0 ) );
+    for( int count : seen ) {
+        QCOMPARE( count, 1 );
+    }
+}
+
+// When an image can't be read, its record has an error and the rest of the batch completes
+void TestBatchHistogram::unreadableImageReported( ) {
+    QTemporaryDir dir;
+    QStringList fileNames = makeImages( dir.path(), 3 );
+    fileNames.insert( 1, dir.path() + "/missing.bmp" );
+
+    BatchHistogram batch{ 1, 1 };
+    uint32_t records = 0;
+    uint32_t failures = batch.run( fileNames, [&]( BatchRecord& record ) {
+        records++;
+        QCOMPARE( record.ok(), record.index != 1 );
+        if( ! record.ok() ) {
+            QVERIFY( record.error.find( "missing.bmp" ) != std::string::npos );
+        }
+    } );
+
+    QCOMPARE( records, static_cast<uint32_t>( 4 ) );
+    QCOMPARE( failures, static_cast<uint32_t>( 1 ) );
+}
+
+// When images pass through the pipeline, neither queue grows beyond its capacity
+void TestBatchHistogram::queueDepthWithinCapacity( ) {
+    QTemporaryDir dir;
+    QStringList fileNames = makeImages( dir.path(), 8 );
+
+    BatchHistogram batch{ 3, 1, 1, KernelType::Auto, 2 };
+    batch.run( fileNames, []( BatchRecord& ) {} );
+
+    QVERIFY( batch.peakDecodedDepth() >= 1 );
+    QVERIFY( batch.peakDecodedDepth() <= 2 );
+    QVERIFY( batch.peakCountedDepth() >= 1 );
+    QVERIFY( batch.peakCountedDepth() <= 2 );
+}
+
+// When constructed with zero decoders or counters, throws a std::invalid_argument
+void TestBatchHistogram::constructWithZeroStages( ) {
+    QVERIFY_EXCEPTION_THROWN( BatchHistogram( 0, 1 ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( BatchHistogram( 1, 0 ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( BatchHistogram( 1, 1, 1, KernelType::Auto, 0 ), std::invalid_argument );
+}
+
+// When the writer throws, the pipeline stops and the exception is rethrown
+void TestBatchHistogram::writerExceptionStopsBatch( ) {
+    QTemporaryDir dir;
+    QStringList fileNames = makeImages( dir.path(), 10 );
+
+    BatchHistogram batch{ 2, 2, 1, KernelType::Auto, 1 };
+    uint32_t records = 0;
+    QVERIFY_EXCEPTION_THROWN( batch.run( fileNames, [&]( BatchRecord& ) {
+        records++;
+        throw std::runtime_error( "disk full" );
+    } ), std::runtime_error );
+    QCOMPARE( records, static_cast<uint32_t>( 1 ) );
+}
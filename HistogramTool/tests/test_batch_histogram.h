@@ -0,0 +1,31 @@
+#ifndef TEST_BATCH_HISTOGRAM_H
+#define TEST_BATCH_HISTOGRAM_H
+
+#include <QtTest>
+#include "../src/batch_histogram.h"
+
+class TestBatchHistogram : public QObject {
+    Q_OBJECT
+
+private:
+    // Write numImages images to dir, image i filled with red level i * 10, and return their names
+    QStringList makeImages( const QString& dir, int numImages ) const;
+
+private slots:
+    // When a batch is run, the writer gets exactly one correct record per image
+    void oneRecordPerImage( );
+
+    // When an image can't be read, its record has an error and the rest of the batch completes
+    void unreadableImageReported( );
+
+    // When images pass through the pipeline, neither queue grows beyond its capacity
+    void queueDepthWithinCapacity( );
+
+    // When constructed with zero decoders or counters, throws a std::invalid_argument
+    void constructWithZeroStages( );
+
+    // When the writer throws, the pipeline stops and the exception is rethrown
+    void writerExceptionStopsBatch( );
+};
+
+#endif // TEST_BATCH_HISTOGRAM_H
@@ -0,0 +1,154 @@
+#include <QtTest>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "test_derived_channels.h"
+#include "noise_image.h"
+
+// When a pixel's channels are computed, they are within 1 of the floating point definitions
+void TestDerivedChannels::valuesMatchFormulas( ) {
+    for( uint32_t r = 0; r < 256; r += 15 ) {
+        for( uint32_t g = 0; g < 256; g += 17 ) {
+            for( uint32_t b = 0; b < 256; b += 5 ) {
+                uint32_t alpha = ( r + g + b ) & 0xFF;
+                uint32_t argb = ( alpha << 24 ) | ( r << 16 ) | ( g << 8 ) | b;
+                double max = std::max<double>( r, std::max<double>( g, b ) );
+                double min = std::min<double>( r, std::min<double>( g, b ) );
+
+                double hue = 0;
+                if( max > min ) {
+                    double d = max - min;
+                    double sixths = ( max == r ) ? ( static_cast<double>( g ) - b ) / d
+                                  : ( max == g ) ? 2 + ( static_cast<double>( b ) - r ) / d
+                                  : 4 + ( static_cast<double>( r ) - g ) / d;
+                    hue = std::floor( ( sixths < 0 ? sixths + 6 : sixths ) * 256 / 6 );
+                }
+                double expected[DerivedChannels::COUNT] = {
+                    static_cast<double>( alpha ),
+                    0.299 * r + 0.587 * g + 0.114 * b,
+                    0.2126 * r + 0.7152 * g + 0.0722 * b,
+                    std::min( 255.0, 128 - 0.168736 * r - 0.331264 * g + 0.5 * b ),
+                    std::min( 255.0, 128 + 0.5 * r - 0.418688 * g - 0.081312 * b ),
+                    hue,
+                    ( max > 0 ) ? 255 * ( max - min ) / max : 0
+                };
+
+                for( size_t channel = 0; channel < DerivedChannels::COUNT; ++channel ) {
+                    double value = DerivedChannels::valueOf( argb, static_cast<DerivedChannel>( channel ) );
+                    double error = std::fabs( value - expected[channel] );
+                    if( channel == static_cast<size_t>( DerivedChannel::Hue ) ) {
+                        error = std::min( error, 256 - error );
+                    }
+                    QVERIFY( error <= 1.0 );
+                }
+            }
+        }
+    }
+}
+
+
+// When pixels are primaries, secondaries or greys, their hue and saturation are as expected
+void TestDerivedChannels::hueAndSaturationOfKnownColours( ) {
+    const uint32_t colours[] = { 0xFFFF0000u, 0xFFFFFF00u, 0xFF00FF00u, 0xFF00FFFFu, 0xFF0000FFu, 0xFFFF00FFu };
+    const uint8_t hues[] = { 0, 42, 85, 128, 170, 213 };
+    for( size_t i = 0; i < 6; ++i ) {
+        QCOMPARE( DerivedChannels::valueOf( colours[i], DerivedChannel::Hue ), hues[i] );
+        QCOMPARE( DerivedChannels::valueOf( colours[i], DerivedChannel::Saturation ), static_cast<uint8_t>( 255 ) );
+    }
+
+    // Greys and black have no hue or saturation; white is full luma and neutral chroma
+    QCOMPARE( DerivedChannels::valueOf( 0xFF808080u, DerivedChannel::Hue ), static_cast<uint8_t>( 0 ) );
+    QCOMPARE( DerivedChannels::valueOf( 0xFF808080u, DerivedChannel::Saturation ), static_cast<uint8_t>( 0 ) );
+    QCOMPARE( DerivedChannels::valueOf( 0xFF000000u, DerivedChannel::Saturation ), static_cast<uint8_t>( 0 ) );
+    QCOMPARE( DerivedChannels::valueOf( 0xFFFFFFFFu, DerivedChannel::Luma601 ), static_cast<uint8_t>( 255 ) );
+    QCOMPARE( DerivedChannels::valueOf( 0xFFFFFFFFu, DerivedChannel::Luma709 ), static_cast<uint8_t>( 255 ) );
+    QCOMPARE( DerivedChannels::valueOf( 0xFFFFFFFFu, DerivedChannel::Cb ), static_cast<uint8_t>( 128 ) );
+    QCOMPARE( DerivedChannels::valueOf( 0xFFFFFFFFu, DerivedChannel::Cr ), static_cast<uint8_t>( 128 ) );
+    QCOMPARE( DerivedChannels::valueOf( 0x7F123456u, DerivedChannel::Alpha ), static_cast<uint8_t>( 0x7F ) );
+}
+
+
+// When counted by the tool in any format, each channel's histogram matches counting valueOf per pixel
+void TestDerivedChannels::toolMatchesPerPixelValues( ) {
+    HistogramTool tool{ 3 };
+    tool.setMinPixelsPerThread( 1 );
+    tool.setChunkRows( 5 );
+
+    // Wider than a block, and with padded scanlines for the byte formats
+    const QImage::Format formats[] = { QImage::Format_ARGB32, QImage::Format_RGBA8888, QImage::Format_RGB888,
+                                       QImage::Format_Grayscale8, QImage::Format_Indexed8 };
+    for( QImage::Format format : formats ) {
+        QImage image = NoiseImage::make( 1101, 23, format );
+
+        std::vector<uint64_t> expected( DerivedChannels::COUNT * 256, 0 );
+        for( int y = 0; y < image.height(); ++y ) {
+            for( int x = 0; x < image.width(); ++x ) {
+                for( size_t channel = 0; channel < DerivedChannels::COUNT; ++channel ) {
+                    expected[ channel * 256 + DerivedChannels::valueOf( image.pixel( x, y ), static_cast<DerivedChannel>( channel ) ) ]++;
+                }
+            }
+        }
+
+        Histogram red, green, blue;
+        DerivedHistograms derived{ DerivedChannels::ALL };
+        tool.computeHistogram( image, red, green, blue, derived );
+        for( size_t channel = 0; channel < DerivedChannels::COUNT; ++channel ) {
+            for( uint32_t i = 0; i < 256; ++i ) {
+                QCOMPARE( derived[ static_cast<DerivedChannel>( channel ) ][i], expected[ channel * 256 + i ] );
+            }
+        }
+    }
+}
+
+
+// When only some channels are chosen, only they are counted and red, green and blue are unchanged
+void TestDerivedChannels::countsOnlyChosenChannels( ) {
+    HistogramTool tool{ 2 };
+    tool.setMinPixelsPerThread( 1 );
+    QImage image = NoiseImage::make( 300, 200, QImage::Format_ARGB32 );
+
+    Histogram red, green, blue;
+    tool.computeHistogram( image, red, green, blue );
+
+    Histogram derivedRed, derivedGreen, derivedBlue;
+    DerivedHistograms derived{ DerivedChannels::bit( DerivedChannel::Luma709 ) | DerivedChannels::bit( DerivedChannel::Hue ) };
+    tool.computeHistogram( image, derivedRed, derivedGreen, derivedBlue, derived );
+
+    for( uint32_t i = 0; i < 256; ++i ) {
+        QCOMPARE( derivedRed[i], red[i] );
+        QCOMPARE( derivedGreen[i], green[i] );
+        QCOMPARE( derivedBlue[i], blue[i] );
+    }
+    for( size_t channel = 0; channel < DerivedChannels::COUNT; ++channel ) {
+        DerivedChannel c = static_cast<DerivedChannel>( channel );
+        uint64_t expected = ( c == DerivedChannel::Luma709 || c == DerivedChannel::Hue ) ? 300 * 200 : 0;
+        QCOMPARE( derived.has( c ), expected > 0 );
+        QCOMPARE( derived[c].total(), expected );
+    }
+
+    // Counting again adds to the same histograms
+    tool.computeHistogram( image, derivedRed, derivedGreen, derivedBlue, derived );
+    QCOMPARE( derived[ DerivedChannel::Hue ].total(), static_cast<uint64_t>( 2 * 300 * 200 ) );
+    derived.reset();
+    QCOMPARE( derived[ DerivedChannel::Hue ].total(), static_cast<uint64_t>( 0 ) );
+}
+
+
+// When a name or mask isn't a channel, an exception is thrown; names round trip
+void TestDerivedChannels::parsesNames( ) {
+    for( size_t channel = 0; channel < DerivedChannels::COUNT; ++channel ) {
+        DerivedChannel c = static_cast<DerivedChannel>( channel );
+        QVERIFY( DerivedChannels::fromName( DerivedChannels::nameOf( c ) ) == c );
+    }
+    QCOMPARE( DerivedChannels::maskFromNames( "luma709,hue" ),
+              DerivedChannels::bit( DerivedChannel::Luma709 ) | DerivedChannels::bit( DerivedChannel::Hue ) );
+    QCOMPARE( DerivedChannels::maskFromNames( "alpha" ), DerivedChannels::bit( DerivedChannel::Alpha ) );
+
+    QVERIFY_EXCEPTION_THROWN( DerivedChannels::maskFromNames( "luma,hue" ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( DerivedChannels::maskFromNames( "hue," ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( DerivedChannels::maskFromNames( "" ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( DerivedHistograms( DerivedChannels::ALL + 1 ), std::invalid_argument );
+}
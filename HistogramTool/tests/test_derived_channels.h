@@ -0,0 +1,28 @@
+#ifndef TEST_DERIVED_CHANNELS_H
+#define TEST_DERIVED_CHANNELS_H
+
+#include <QtTest>
+#include "../src/derived_channels.h"
+#include "../src/histogram_tool.h"
+
+class TestDerivedChannels : public QObject {
+    Q_OBJECT
+
+private slots:
+    // When a pixel's channels are computed, they are within 1 of the floating point definitions
+    void valuesMatchFormulas( );
+
+    // When pixels are primaries, secondaries or greys, their hue and saturation are as expected
+    void hueAndSaturationOfKnownColours( );
+
+    // When counted by the tool in any format, each channel's histogram matches counting valueOf per pixel
+    void toolMatchesPerPixelValues( );
+
+    // When only some channels are chosen, only they are counted and red, green and blue are unchanged
+    void countsOnlyChosenChannels( );
+
+    // When a name or mask isn't a channel, an exception is thrown; names round trip
+    void parsesNames( );
+};
+
+#endif // TEST_DERIVED_CHANNELS_H
@@ -0,0 +1,106 @@
+#include <QtTest>
+#include <sstream>
+#include <utility>
+
+#include "test_fixed_histogram.h"
+#include "../src/histogram.h"
+
+// When constructed, every bucket is 0
+void TestFixedHistogram::constructEmpty( ) {
+    FixedHistogram<256> h;
+    QCOMPARE( h.numBuckets(), static_cast<size_t>( 256 ) );
+    for( size_t i = 0; i < 256; i++ ) {
+        QCOMPARE( h[i], static_cast<uint32_t>( 0 ) );
+    }
+}
+
+// When buckets are incremented, counts and total are accurate
+void TestFixedHistogram::incrementAndTotal( ) {
+    FixedHistogram<8> h;
+    h.increment( 0 );
+    h.increment( 7 );
+    h.increment( 7 );
+
+    QCOMPARE( h[0], static_cast<uint32_t>( 1 ) );
+    QCOMPARE( h[7], static_cast<uint32_t>( 2 ) );
+    QCOMPARE( h.total(), static_cast<uint64_t>( 3 ) );
+
+    h.reset();
+    QCOMPARE( h.total(), static_cast<uint64_t>( 0 ) );
+}
+
+// When a bucket out of range is requested with at(), throws a std::invalid_argument
+void TestFixedHistogram::atChecksRange( ) {
+    FixedHistogram<8> h;
+    QCOMPARE( h.at( 7 ), static_cast<uint32_t>( 0 ) );
+    QVERIFY_EXCEPTION_THROWN( h.at( 8 ), std::invalid_argument );
+}
+
+// When copied or moved, the counts come too and the histograms are independent
+void TestFixedHistogram::copyAndMove( ) {
+    FixedHistogram<8> h;
+    h.increment( 3 );
+
+    FixedHistogram<8> copy{ h };
+    copy.increment( 3 );
+    QCOMPARE( h[3], static_cast<uint32_t>( 1 ) );
+    QCOMPARE( copy[3], static_cast<uint32_t>( 2 ) );
+
+    FixedHistogram<8> moved{ std::move( copy ) };
+    QCOMPARE( moved[3], static_cast<uint32_t>( 2 ) );
+
+    h = moved;
+    QVERIFY( h == moved );
+}
+
+// When histograms are added, each bucket is the sum
+void TestFixedHistogram::addHistograms( ) {
+    FixedHistogram<4> a, b;
+    a.increment( 1 );
+    b.increment( 1 );
+    b.increment( 2 );
+
+    FixedHistogram<4> sum = a + b;
+    QCOMPARE( sum[1], static_cast<uint32_t>( 2 ) );
+    QCOMPARE( sum[2], static_cast<uint32_t>( 1 ) );
+
+    a += b;
+    QVERIFY( a == sum );
+    QVERIFY( a != b );
+}
+
+// When the counter is 64 bits, counts beyond 32 bits are held
+void TestFixedHistogram::wideCounter( ) {
+    FixedHistogram<2, uint64_t> h;
+    uint64_t counts[2] = { 0x100000000ull, 1 };
+    h.addCounts( counts );
+    h.addCounts( counts );
+
+    QCOMPARE( h[0], static_cast<uint64_t>( 0x200000000ull ) );
+    QCOMPARE( h.total(), static_cast<uint64_t>( 0x200000002ull ) );
+}
+
+// When declared, the buckets are held inline and aligned to a cache line
+void TestFixedHistogram::inlineAlignedStorage( ) {
+    QCOMPARE( sizeof( FixedHistogram<256> ), static_cast<size_t>( 1024 ) );
+    QCOMPARE( alignof( FixedHistogram<256> ), static_cast<size_t>( 64 ) );
+
+    FixedHistogram<256> tiles[3];
+    for( FixedHistogram<256>& tile : tiles ) {
+        QCOMPARE( reinterpret_cast<uintptr_t>( tile.data() ) % 64, static_cast<uintptr_t>( 0 ) );
+        QVERIFY( static_cast<const void *>( tile.data() ) == static_cast<const void *>( &tile ) );
+    }
+}
+
+// When written to a stream, the format matches Histogram
+void TestFixedHistogram::writeToStream( ) {
+    FixedHistogram<4> fixed;
+    fixed.increment( 2 );
+    Histogram h{ fixed };
+
+    std::ostringstream fixedOut, out;
+    fixedOut << fixed;
+    out << h;
+    QCOMPARE( fixedOut.str(), out.str() );
+    QCOMPARE( fixedOut.str(), std::string( "0, 0, 1, 0\n" ) );
+}
@@ -0,0 +1,36 @@
+#ifndef TEST_FIXED_HISTOGRAM_H
+#define TEST_FIXED_HISTOGRAM_H
+
+#include <QtTest>
+#include "../src/fixed_histogram.h"
+
+class TestFixedHistogram : public QObject {
+    Q_OBJECT
+
+private slots:
+    // When constructed, every bucket is 0
+    void constructEmpty( );
+
+    // When buckets are incremented, counts and total are accurate
+    void incrementAndTotal( );
+
+    // When a bucket out of range is requested with at(), throws a std::invalid_argument
+    void atChecksRange( );
+
+    // When copied or moved, the counts come too and the histograms are independent
+    void copyAndMove( );
+
+    // When histograms are added, each bucket is the sum
+    void addHistograms( );
+
+    // When the counter is 64 bits, counts beyond 32 bits are held
+    void wideCounter( );
+
+    // When declared, the buckets are held inline and aligned to a cache line
+    void inlineAlignedStorage( );
+
+    // When written to a stream, the format matches Histogram
+    void writeToStream( );
+};
+
+#endif // TEST_FIXED_HISTOGRAM_H
@@ -47,9 +47,9 @@ void TestHistogram::incrementBucketChangesValues() {
 
     // Increment all buckets
     for( uint32_t i=0; i<h.numBuckets(); i++ ) {
-        uint32_t oldValue = h[i];
+        uint64_t oldValue = h[i];
         h.increment( i );
-        uint32_t newValue = h[i];
+        uint64_t newValue = h[i];
 
         QCOMPARE( newValue, oldValue + 1 );
     }
@@ -60,8 +60,8 @@ void TestHistogram::computeBucketTotals() {
     Histogram h{ 10 };
 
     incrementBuckets(h);
-    uint32_t expectedValue = h.numBuckets();
-    uint32_t actualValue   = h.total();
+    uint64_t expectedValue = h.numBuckets();
+    uint64_t actualValue   = h.total();
 
     QCOMPARE( actualValue, expectedValue );
 }
@@ -79,8 +79,8 @@ void TestHistogram::addSameSizedHistograms() {
 
    // Each bucket in h1 should contain 3, each bucket in h2 contains 2
    for( uint32_t i=0; i<h1.numBuckets(); i++ ) {
-       QCOMPARE( h1[i], static_cast<uint32_t>( 3 ) );
-       QCOMPARE( h2[i], static_cast<uint32_t>( 2 ) );
+       QCOMPARE( h1[i], static_cast<uint64_t>( 3 ) );
+       QCOMPARE( h2[i], static_cast<uint64_t>( 2 ) );
    }
 }
 
@@ -120,3 +120,78 @@ void TestHistogram::incrementInvalidBucket( ) {
 
     QVERIFY_EXCEPTION_THROWN( h.increment(10), std::invalid_argument);
 }
+
+// When a histogram is copied, the copy has the same counts and is independent of the original
+void TestHistogram::copyConstructCopiesCounts( ) {
+    Histogram h{10};
+    h.increment( 3 );
+    h.increment( 3 );
+
+    Histogram copy{ h };
+    QCOMPARE( copy.numBuckets(), static_cast<uint32_t>( 10 ) );
+    QCOMPARE( copy[3], static_cast<uint64_t>( 2 ) );
+    QCOMPARE( copy.total(), static_cast<uint64_t>( 2 ) );
+
+    copy.increment( 3 );
+    QCOMPARE( h[3], static_cast<uint64_t>( 2 ) );
+}
+
+// When a histogram is assigned, the target has the same counts, whatever its previous size
+void TestHistogram::assignCopiesCounts( ) {
+    Histogram h{10};
+    incrementBuckets( h );
+
+    Histogram sameSize{10};
+    sameSize = h;
+    QCOMPARE( sameSize.total(), static_cast<uint64_t>( 10 ) );
+
+    Histogram otherSize{3};
+    otherSize = h;
+    QCOMPARE( otherSize.numBuckets(), static_cast<uint32_t>( 10 ) );
+    QCOMPARE( otherSize.total(), static_cast<uint64_t>( 10 ) );
+
+    Histogram sum = h + h;
+    QCOMPARE( sum[9], static_cast<uint64_t>( 2 ) );
+}
+
+// When a histogram is moved, the target takes the counts and the source has no buckets
+void TestHistogram::moveTakesCounts( ) {
+    Histogram h{10};
+    h.increment( 7 );
+
+    Histogram moved{ std::move( h ) };
+    QCOMPARE( moved[7], static_cast<uint64_t>( 1 ) );
+    QCOMPARE( h.numBuckets(), static_cast<uint32_t>( 0 ) );
+
+    Histogram target{4};
+    target = std::move( moved );
+    QCOMPARE( target.numBuckets(), static_cast<uint32_t>( 10 ) );
+    QCOMPARE( target[7], static_cast<uint64_t>( 1 ) );
+}
+
+// When constructed from a FixedHistogram, the buckets are copied
+void TestHistogram::constructFromFixedHistogram( ) {
+    FixedHistogram<16> fixed;
+    fixed.increment( 15 );
+
+    Histogram h{ fixed };
+    QCOMPARE( h.numBuckets(), static_cast<uint32_t>( 16 ) );
+    QCOMPARE( h[15], static_cast<uint64_t>( 1 ) );
+}
+
+// When counts are subtracted, buckets fall by them; when a count is too large, throws a std::invalid_argument and buckets are unchanged
+void TestHistogram::subtractCounts( ) {
+    Histogram h{3};
+    incrementBuckets( h );
+    incrementBuckets( h );
+
+    const uint64_t counts[] = { 1, 0, 2 };
+    h.subtractCounts( counts, 3 );
+    QCOMPARE( h[0], static_cast<uint64_t>( 1 ) );
+    QCOMPARE( h[1], static_cast<uint64_t>( 2 ) );
+    QCOMPARE( h[2], static_cast<uint64_t>( 0 ) );
+
+    QVERIFY_EXCEPTION_THROWN( h.subtractCounts( counts, 3 ), std::invalid_argument );
+    QCOMPARE( h[0], static_cast<uint64_t>( 1 ) );
+    QVERIFY_EXCEPTION_THROWN( h.subtractCounts( counts, 2 ), std::invalid_argument );
+}
@@ -39,6 +39,21 @@ private slots:
 
     // When bucket out of range is incremented, thows a std::invalid_argument
     void incrementInvalidBucket( );
+
+    // When a histogram is copied, the copy has the same counts and is independent of the original
+    void copyConstructCopiesCounts( );
+
+    // When a histogram is assigned, the target has the same counts, whatever its previous size
+    void assignCopiesCounts( );
+
+    // When a histogram is moved, the target takes the counts and the source has no buckets
+    void moveTakesCounts( );
+
+    // When constructed from a FixedHistogram, the buckets are copied
+    void constructFromFixedHistogram( );
+
+    // When counts are subtracted, buckets fall by them; when a count is too large, throws a std::invalid_argument and buckets are unchanged
+    void subtractCounts( );
 };
 
 #endif
@@ -0,0 +1,198 @@
+#include <QtTest>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "test_histogram_job.h"
+#include "noise_image.h"
+
+// Compare a finished job's histograms with those counted synchronously
+void TestHistogramJob::compareWithSync( HistogramTool& tool, const QImage& image, const HistogramJob& job ) const {
+    Histogram red, green, blue;
+    tool.computeHistogram( image, red, green, blue );
+    for( uint32_t i = 0; i < 256; ++i ) {
+        QCOMPARE( job.red()[i], red[i] );
+        QCOMPARE( job.green()[i], green[i] );
+        QCOMPARE( job.blue()[i], blue[i] );
+    }
+}
+
+
+// When a job finishes, its histograms match computeHistogram and every pixel was reported done
+void TestHistogramJob::matchesComputeHistogram( ) {
+    HistogramTool tool{ 3 };
+    tool.setMinPixelsPerThread( 1 );
+    tool.setChunkRows( 3 );
+    QImage image = NoiseImage::make( 101, 67, QImage::Format_ARGB32 );
+
+    std::shared_ptr<HistogramJob> job = tool.computeHistogramAsync( image );
+    QCOMPARE( job->numPixels(), static_cast<uint64_t>( 101 * 67 ) );
+    QVERIFY( job->wait() == HistogramJob::State::Done );
+    QVERIFY( job->state() == HistogramJob::State::Done );
+    QCOMPARE( job->pixelsDone(), job->numPixels() );
+    QVERIFY( job->errorString().empty() );
+    compareWithSync( tool, image, *job );
+}
+
+
+// When a job finishes, its callback is called once on a worker, with the final state, before wait returns
+void TestHistogramJob::callsBackOnceOnWorker( ) {
+    HistogramTool tool{ 2 };
+    QImage image = NoiseImage::make( 64, 64, QImage::Format_RGB888 );
+    std::atomic<uint32_t> calls{ 0 };
+    std::atomic<bool> finalState{ false };
+    std::atomic<bool> onWorker{ false };
+    std::thread::id caller = std::this_thread::get_id();
+
+    std::shared_ptr<HistogramJob> job = tool.computeHistogramAsync( image, [&]( HistogramJob& finished ) {
+        calls++;
+        finalState = ( finished.state() == HistogramJob::State::Done && finished.pixelsDone() == finished.numPixels() );
+        onWorker = ( std::this_thread::get_id() != caller );
+    } );
+
+    QVERIFY( job->wait() == HistogramJob::State::Done );
+    QCOMPARE( calls.load(), static_cast<uint32_t>( 1 ) );
+    QVERIFY( finalState.load() );
+    QVERIFY( onWorker.load() );
+    QVERIFY( job->waitFor( std::chrono::milliseconds( 0 ) ) == HistogramJob::State::Done );
+    compareWithSync( tool, image, *job );
+}
+
+
+// When a job is cancelled before its tasks start, it finishes Cancelled with empty histograms
+void TestHistogramJob::cancelStopsJob( ) {
+    // One worker, held by the callback of a first job so the second can't start
+    HistogramTool tool{ 2 };
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool released = false;
+
+    std::shared_ptr<HistogramJob> blocker = tool.computeHistogramAsync( NoiseImage::make( 8, 8, QImage::Format_ARGB32 ), [&]( HistogramJob& ) {
+        std::unique_lock<std::mutex> lock{ mutex };
+        signal.wait( lock, [&]{ return released; } );
+    } );
+    std::shared_ptr<HistogramJob> job = tool.computeHistogramAsync( NoiseImage::make( 200, 200, QImage::Format_ARGB32 ) );
+
+    QVERIFY( job->waitFor( std::chrono::milliseconds( 10 ) ) == HistogramJob::State::Running );
+    job->cancel();
+    QVERIFY( job->cancelRequested() );
+    {
+        std::lock_guard<std::mutex> lock{ mutex };
+        released = true;
+    }
+    signal.notify_all();
+
+    QVERIFY( blocker->wait() == HistogramJob::State::Done );
+    QVERIFY( job->wait() == HistogramJob::State::Cancelled );
+    QCOMPARE( job->pixelsDone(), static_cast<uint64_t>( 0 ) );
+    QCOMPARE( job->red().total(), static_cast<uint64_t>( 0 ) );
+
+    // Cancelling a finished job changes nothing
+    blocker->cancel();
+    QVERIFY( blocker->state() == HistogramJob::State::Done );
+}
+
+
+// When many jobs are in flight on one tool, they all complete correctly
+void TestHistogramJob::manyJobsShareWorkers( ) {
+    HistogramTool tool{ 3 };
+    tool.setMinPixelsPerThread( 1 );
+    tool.setChunkRows( 4 );
+    std::vector<QImage> images;
+    std::vector<std::shared_ptr<HistogramJob>> jobs;
+    std::atomic<uint32_t> finished{ 0 };
+
+    for( int i = 0; i < 24; ++i ) {
+        images.push_back( NoiseImage::make( 40 + i, 30 + 2 * i, ( i % 2 ) ? QImage::Format_ARGB32 : QImage::Format_Grayscale8 ) );
+        jobs.push_back( tool.computeHistogramAsync( images.back(), [&]( HistogramJob& ) { finished++; } ) );
+    }
+
+    for( size_t i = 0; i < jobs.size(); ++i ) {
+        QVERIFY( jobs[i]->wait() == HistogramJob::State::Done );
+        compareWithSync( tool, images[i], *jobs[i] );
+    }
+    QCOMPARE( finished.load(), static_cast<uint32_t>( jobs.size() ) );
+}
+
+
+// When the tool has one thread, jobs still run in the background
+void TestHistogramJob::oneThreadRunsInBackground( ) {
+    HistogramTool tool{ 1 };
+    QImage image = NoiseImage::make( 50, 50, QImage::Format_ARGB32 );
+    std::atomic<bool> onWorker{ false };
+    std::thread::id caller = std::this_thread::get_id();
+
+    std::shared_ptr<HistogramJob> job = tool.computeHistogramAsync( image, [&]( HistogramJob& ) {
+        onWorker = ( std::this_thread::get_id() != caller );
+    } );
+
+    QVERIFY( job->wait() == HistogramJob::State::Done );
+    QVERIFY( onWorker.load() );
+    compareWithSync( tool, image, *job );
+}
+
+
+// When given a QImage which is then dropped, or one which must be converted, the job counts it
+void TestHistogramJob::keepsQImage( ) {
+    HistogramTool tool{ 2 };
+    QImage expected = NoiseImage::make( 70, 20, QImage::Format_ARGB32 );
+
+    std::shared_ptr<HistogramJob> job;
+    {
+        QImage image = expected.copy( QRect( 0, 0, 70, 20 ) );
+        job = tool.computeHistogramAsync( image );
+    }
+    QVERIFY( job->wait() == HistogramJob::State::Done );
+    compareWithSync( tool, expected, *job );
+
+    QImage indexed = NoiseImage::make( 16, 16, QImage::Format_Indexed8 );
+    job = tool.computeHistogramAsync( indexed );
+    QVERIFY( job->wait() == HistogramJob::State::Done );
+    compareWithSync( tool, indexed, *job );
+
+    QImage converted = NoiseImage::make( 16, 16, QImage::Format_RGB16 );
+    job = tool.computeHistogramAsync( converted );
+    QVERIFY( job->wait() == HistogramJob::State::Done );
+    compareWithSync( tool, converted, *job );
+}
+
+
+// When the tool is destroyed with jobs queued, they are cancelled and finish
+void TestHistogramJob::destroyingToolCancelsJobs( ) {
+    std::unique_ptr<HistogramTool> tool{ new HistogramTool{ 2 } };
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool entered = false;
+    bool released = false;
+
+    std::shared_ptr<HistogramJob> blocker = tool->computeHistogramAsync( NoiseImage::make( 8, 8, QImage::Format_ARGB32 ), [&]( HistogramJob& ) {
+        std::unique_lock<std::mutex> lock{ mutex };
+        entered = true;
+        signal.notify_all();
+        signal.wait( lock, [&]{ return released; } );
+    } );
+    {
+        std::unique_lock<std::mutex> lock{ mutex };
+        signal.wait( lock, [&]{ return entered; } );
+    }
+    std::shared_ptr<HistogramJob> job = tool->computeHistogramAsync( NoiseImage::make( 100, 100, QImage::Format_ARGB32 ) );
+
+    // Let the blocker go once the destructor has cancelled the queued job
+    std::thread releaser{ [&]{
+        while( ! job->cancelRequested() ) {
+            std::this_thread::yield();
+        }
+        std::lock_guard<std::mutex> lock{ mutex };
+        released = true;
+        signal.notify_all();
+    } };
+    tool.reset();
+    releaser.join();
+
+    QVERIFY( blocker->state() == HistogramJob::State::Done );
+    QVERIFY( job->state() == HistogramJob::State::Cancelled );
+}
@@ -0,0 +1,37 @@
+#ifndef TEST_HISTOGRAM_JOB_H
+#define TEST_HISTOGRAM_JOB_H
+
+#include <QtTest>
+#include "../src/histogram_tool.h"
+
+class TestHistogramJob : public QObject {
+    Q_OBJECT
+
+private:
+    // Compare a finished job's histograms with those counted synchronously
+    void compareWithSync( HistogramTool& tool, const QImage& image, const HistogramJob& job ) const;
+
+private slots:
+    // When a job finishes, its histograms match computeHistogram and every pixel was reported done
+    void matchesComputeHistogram( );
+
+    // When a job finishes, its callback is called once on a worker, with the final state, before wait returns
+    void callsBackOnceOnWorker( );
+
+    // When a job is cancelled before its tasks start, it finishes Cancelled with empty histograms
+    void cancelStopsJob( );
+
+    // When many jobs are in flight on one tool, they all complete correctly
+    void manyJobsShareWorkers( );
+
+    // When the tool has one thread, jobs still run in the background
+    void oneThreadRunsInBackground( );
+
+    // When given a QImage which is then dropped, or one which must be converted, the job counts it
+    void keepsQImage( );
+
+    // When the tool is destroyed with jobs queued, they are cancelled and finish
+    void destroyingToolCancelsJobs( );
+};
+
+#endif // TEST_HISTOGRAM_JOB_H
@@ -0,0 +1,145 @@
+#include <QtTest>
+
+#include "test_histogram_kernel.h"
+
+std::vector<QRgb> TestHistogramKernel::makePixels( size_t numPixels ) const {
+    std::vector<QRgb> pixels( numPixels );
+    uint32_t seed = 12345;
+    for( size_t i=0; i<numPixels; i++ ) {
+        seed = seed * 1664525 + 1013904223;
+        pixels[i] = seed;
+    }
+
+    // Include a flat run to exercise repeated buckets
+    for( size_t i=numPixels / 2; i<numPixels / 2 + 100 && i<numPixels; i++ ) {
+        pixels[i] = qRgb( 10, 20, 30 );
+    }
+    return pixels;
+}
+
+void TestHistogramKernel::checkKernel( KernelType type ) {
+    if( ! HistogramKernel::isSupported( type ) ) {
+        QVERIFY_EXCEPTION_THROWN( HistogramKernel k{type}, std::invalid_argument );
+        return;
+    }
+
+    HistogramKernel kernel{type};
+
+    // Odd lengths leave a tail which isn't a whole number of vectors
+    const size_t lengths[] = { 0, 1, 3, 15, 17, 1000, 4099 };
+    for( size_t numPixels : lengths ) {
+        std::vector<QRgb> pixels = makePixels( numPixels );
+
+        uint32_t expected[3][256] = { { 0 } };
+        for( QRgb rgb : pixels ) {
+            expected[0][qRed(rgb)]++;
+            expected[1][qGreen(rgb)]++;
+            expected[2][qBlue(rgb)]++;
+        }
+
+        // Kernels add to existing counts
+        uint32_t actual[3][256];
+        for( size_t i=0; i<256; i++ ) {
+            actual[0][i] = actual[1][i] = actual[2][i] = 1;
+        }
+        kernel( pixels.data(), numPixels, actual[0], actual[1], actual[2] );
+
+        for( size_t c=0; c<3; c++ ) {
+            for( size_t i=0; i<256; i++ ) {
+                QCOMPARE( actual[c][i], expected[c][i] + 1 );
+            }
+        }
+    }
+}
+
+// When counting with the scalar kernel, counts match a per-pixel count
+void TestHistogramKernel::scalarMatchesReference( ) {
+    checkKernel( KernelType::Scalar );
+}
+
+// When counting with the SSE4.2 kernel, counts match a per-pixel count
+void TestHistogramKernel::sse42MatchesReference( ) {
+    checkKernel( KernelType::SSE42 );
+}
+
+// When counting with the AVX2 kernel, counts match a per-pixel count
+void TestHistogramKernel::avx2MatchesReference( ) {
+    checkKernel( KernelType::AVX2 );
+}
+
+// When counting with the AVX-512 kernel, counts match a per-pixel count
+void TestHistogramKernel::avx512MatchesReference( ) {
+    checkKernel( KernelType::AVX512 );
+}
+
+// When the auto kernel is requested, the best available kernel is chosen
+void TestHistogramKernel::autoSelectsBestAvailable( ) {
+    HistogramKernel kernel;
+
+    QVERIFY( kernel.type() != KernelType::Auto );
+    QVERIFY( kernel.type() == HistogramKernel::bestAvailable() );
+    QVERIFY( HistogramKernel::isSupported( kernel.type() ) );
+}
+
+// When kernel names are parsed, they map back to the same type
+void TestHistogramKernel::namesRoundTrip( ) {
+    const KernelType all[] = { KernelType::Auto, KernelType::Scalar, KernelType::SSE42, KernelType::AVX2, KernelType::AVX512 };
+    for( KernelType type : all ) {
+        QVERIFY( HistogramKernel::fromName( HistogramKernel::nameOf( type ) ) == type );
+    }
+}
+
+// When an unknown kernel name is parsed, throws a std::invalid_argument
+void TestHistogramKernel::unknownNameThrows( ) {
+    QVERIFY_EXCEPTION_THROWN( HistogramKernel::fromName( "mmx" ), std::invalid_argument );
+}
+
+// When counting with a mask of channels, every kernel counts those channels and touches no others
+void TestHistogramKernel::channelMasksCountOnlyChosen( ) {
+    const KernelType all[] = { KernelType::Scalar, KernelType::SSE42, KernelType::AVX2, KernelType::AVX512 };
+    std::vector<QRgb> pixels = makePixels( 1003 );
+
+    uint32_t expected[3][256] = { { 0 } };
+    for( QRgb rgb : pixels ) {
+        expected[0][qRed(rgb)]++;
+        expected[1][qGreen(rgb)]++;
+        expected[2][qBlue(rgb)]++;
+    }
+
+    for( KernelType type : all ) {
+        if( ! HistogramKernel::isSupported( type ) ) {
+            continue;
+        }
+        HistogramKernel kernel{type};
+        for( uint32_t channels = 1; channels <= HistogramKernel::AllChannels; ++channels ) {
+            // Channels not chosen get null counts, so any store to them would crash
+            uint32_t actual[3][256] = { { 0 } };
+            uint32_t *outputs[3];
+            for( size_t c=0; c<3; c++ ) {
+                outputs[c] = ( channels & ( 1u << c ) ) ? actual[c] : nullptr;
+            }
+            kernel( pixels.data(), pixels.size(), outputs[0], outputs[1], outputs[2], channels );
+
+            for( size_t c=0; c<3; c++ ) {
+                for( size_t i=0; outputs[c] != nullptr && i<256; i++ ) {
+                    QCOMPARE( actual[c][i], expected[c][i] );
+                }
+            }
+        }
+    }
+}
+
+// When channel names are parsed, they map back to the same mask; bad names throw a std::invalid_argument
+void TestHistogramKernel::channelNamesRoundTrip( ) {
+    for( uint32_t channels = 1; channels <= HistogramKernel::AllChannels; ++channels ) {
+        QCOMPARE( HistogramKernel::channelsFromName( HistogramKernel::nameOfChannels( channels ) ), channels );
+    }
+    QCOMPARE( HistogramKernel::channelsFromName( "br" ), static_cast<uint32_t>( HistogramKernel::Red | HistogramKernel::Blue ) );
+    QCOMPARE( HistogramKernel::nameOfChannels( HistogramKernel::AllChannels ), std::string( "rgb" ) );
+
+    QVERIFY_EXCEPTION_THROWN( HistogramKernel::channelsFromName( "" ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( HistogramKernel::channelsFromName( "rr" ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( HistogramKernel::channelsFromName( "rgba" ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( HistogramKernel::checkChannels( 0 ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( HistogramKernel::checkChannels( 8 ), std::invalid_argument );
+}
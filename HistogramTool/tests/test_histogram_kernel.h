@@ -0,0 +1,47 @@
+#ifndef TEST_HISTOGRAM_KERNEL_H
+#define TEST_HISTOGRAM_KERNEL_H
+
+#include <QtTest>
+#include <vector>
+#include "../src/histogram_kernel.h"
+
+class TestHistogramKernel : public QObject {
+    Q_OBJECT
+
+private:
+    // Build a run of pseudo-random pixels
+    std::vector<QRgb> makePixels( size_t numPixels ) const;
+
+    // Check that a kernel matches a simple per-pixel count
+    void checkKernel( KernelType type );
+
+private slots:
+    // When counting with the scalar kernel, counts match a per-pixel count
+    void scalarMatchesReference( );
+
+    // When counting with the SSE4.2 kernel, counts match a per-pixel count
+    void sse42MatchesReference( );
+
+    // When counting with the AVX2 kernel, counts match a per-pixel count
+    void avx2MatchesReference( );
+
+    // When counting with the AVX-512 kernel, counts match a per-pixel count
+    void avx512MatchesReference( );
+
+    // When the auto kernel is requested, the best available kernel is chosen
+    void autoSelectsBestAvailable( );
+
+    // When kernel names are parsed, they map back to the same type
+    void namesRoundTrip( );
+
+    // When an unknown kernel name is parsed, throws a std::invalid_argument
+    void unknownNameThrows( );
+
+    // When counting with a mask of channels, every kernel counts those channels and touches no others
+    void channelMasksCountOnlyChosen( );
+
+    // When channel names are parsed, they map back to the same mask; bad names throw a std::invalid_argument
+    void channelNamesRoundTrip( );
+};
+
+#endif // TEST_HISTOGRAM_KERNEL_H
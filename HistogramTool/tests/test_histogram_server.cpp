@@ -0,0 +1,255 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QColor>
+#include <QFileInfo>
+#include <QImage>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "test_histogram_server.h"
+#include "../src/histogram_reader.h"
+
+std::string TestHistogramServer::expectedBody( const std::string& label, const Histogram& red, const Histogram& green,
+                                               const Histogram& blue, HistogramWriter::Format format ) {
+    std::ostringstream output;
+    HistogramWriter writer{ output, format };
+    writer.writeLabel( label );
+    writer.write( red );
+    writer.write( green );
+    writer.write( blue );
+    writer.flush();
+    return output.str();
+}
+
+// When an image file is requested, the response has its label and histograms in the format asked for
+void TestHistogramServer::answersFileRequests( ) {
+    QTemporaryDir dir;
+    std::string socketPath = dir.filePath( "socket" ).toStdString();
+    QString fileName = dir.filePath( "image.bmp" );
+    QImage image{ 30, 20, QImage::Format_RGB32 };
+    image.fill( QColor( 10, 20, 30 ) );
+    QVERIFY( image.save( fileName, "BMP" ) );
+
+    HistogramTool tool{ 2 };
+    Histogram red, green, blue;
+    tool.computeHistogram( image, red, green, blue );
+
+    HistogramServer server{ tool };
+    QVERIFY( server.listen( socketPath ) );
+    std::thread serving( [&]{ server.run(); } );
+
+    HistogramClient client;
+    QVERIFY( client.connect( socketPath ) );
+    QVERIFY( client.requestFile( "a", fileName.toStdString(), HistogramWriter::Format::Text ) );
+    QVERIFY( client.requestFile( "b", fileName.toStdString(), HistogramWriter::Format::BinaryDelta ) );
+
+    std::map<std::string, HistogramClient::Response> responses;
+    for( int i = 0; i < 2; ++i ) {
+        HistogramClient::Response response;
+        QVERIFY( client.receive( response ) );
+        responses[response.id] = response;
+    }
+    QVERIFY( responses["a"].ok );
+    QVERIFY( responses["a"].body == expectedBody( fileName.toStdString(), red, green, blue, HistogramWriter::Format::Text ) );
+    QVERIFY( responses["b"].ok );
+    QVERIFY( responses["b"].body == expectedBody( fileName.toStdString(), red, green, blue, HistogramWriter::Format::BinaryDelta ) );
+
+    server.stop();
+    serving.join();
+    QCOMPARE( server.requestsAnswered(), static_cast<uint64_t>( 2 ) );
+    QVERIFY( ! QFileInfo( QString::fromStdString( socketPath ) ).exists() );
+}
+
+// When pixels are passed by descriptor, they are counted where they lie
+void TestHistogramServer::answersPixelRequests( ) {
+    QTemporaryDir dir;
+    std::string socketPath = dir.filePath( "socket" ).toStdString();
+    std::string pixelsPath = dir.filePath( "pixels" ).toStdString();
+
+    const uint32_t width = 37, height = 11, stride = 40 * 4;
+    std::vector<uint8_t> pixels( stride * height );
+    for( size_t i = 0; i < pixels.size(); ++i ) {
+        pixels[i] = static_cast<uint8_t>( i * 31 + ( i >> 5 ) );
+    }
+    int fd = ::open( pixelsPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600 );
+    QVERIFY( fd >= 0 );
+    QVERIFY( ::write( fd, pixels.data(), pixels.size() ) == static_cast<ssize_t>( pixels.size() ) );
+
+    HistogramTool tool{ 2 };
+    Histogram red, green, blue;
+    tool.computeHistogram( ImageView{ pixels.data(), width, height, stride, PixelFormat::RGBA8888 }, red, green, blue );
+
+    HistogramServer server{ tool };
+    QVERIFY( server.listen( socketPath ) );
+    std::thread serving( [&]{ server.run(); } );
+
+    HistogramClient client;
+    QVERIFY( client.connect( socketPath ) );
+    QVERIFY( client.requestPixels( "frame-1", fd, width, height, stride, PixelFormat::RGBA8888, HistogramWriter::Format::Binary ) );
+    ::close( fd );
+
+    HistogramClient::Response response;
+    QVERIFY( client.receive( response ) );
+    QVERIFY( response.ok );
+    QVERIFY( response.id == "frame-1" );
+
+    std::istringstream body{ response.body };
+    HistogramReader reader{ body };
+    const Histogram *expected[] = { &red, &green, &blue };
+    for( const Histogram *channel : expected ) {
+        Histogram histogram;
+        QVERIFY( reader.read( histogram ) );
+        QVERIFY( reader.label() == "frame-1" );
+        for( size_t i = 0; i < 256; ++i ) {
+            QCOMPARE( histogram[i], ( *channel )[i] );
+        }
+    }
+
+    server.stop();
+    serving.join();
+}
+
+// When a request can't be answered, an error comes back and later requests are still answered
+void TestHistogramServer::reportsBadRequests( ) {
+    QTemporaryDir dir;
+    std::string socketPath = dir.filePath( "socket" ).toStdString();
+    QString fileName = dir.filePath( "image.bmp" );
+    QImage image{ 4, 4, QImage::Format_RGB32 };
+    image.fill( QColor( 1, 2, 3 ) );
+    QVERIFY( image.save( fileName, "BMP" ) );
+
+    HistogramTool tool{ 1 };
+    HistogramServer server{ tool };
+    QVERIFY( server.listen( socketPath ) );
+    std::thread serving( [&]{ server.run(); } );
+
+    HistogramClient client;
+    QVERIFY( client.connect( socketPath ) );
+    QVERIFY( client.requestFile( "missing", dir.filePath( "missing.png" ).toStdString(), HistogramWriter::Format::Text ) );
+    QVERIFY( client.requestPixels( "short", ::open( fileName.toStdString().c_str(), O_RDONLY ), 4000, 4000, 0, PixelFormat::RGBA8888, HistogramWriter::Format::Text ) );
+    QVERIFY( client.requestFile( "good", fileName.toStdString(), HistogramWriter::Format::Text ) );
+    QVERIFY_EXCEPTION_THROWN( client.requestFile( "two words", fileName.toStdString(), HistogramWriter::Format::Text ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( client.requestPixels( "nofd", -1, 4, 4, 0, PixelFormat::RGBA8888, HistogramWriter::Format::Text ), std::invalid_argument );
+
+    std::map<std::string, HistogramClient::Response> responses;
+    for( int i = 0; i < 3; ++i ) {
+        HistogramClient::Response response;
+        QVERIFY( client.receive( response ) );
+        responses[response.id] = response;
+    }
+    QVERIFY( ! responses["missing"].ok );
+    QVERIFY( ! responses["missing"].body.empty() );
+    QVERIFY( ! responses["short"].ok );
+    QVERIFY( responses["good"].ok );
+
+    server.stop();
+    serving.join();
+}
+
+// When several clients send many requests through a short queue, every one is answered exactly once
+void TestHistogramServer::pipelinesRequests( ) {
+    QTemporaryDir dir;
+    std::string socketPath = dir.filePath( "socket" ).toStdString();
+    std::vector<std::string> fileNames;
+    for( int i = 0; i < 5; ++i ) {
+        QString fileName = dir.filePath( QString::fromStdString( "image" + std::to_string( i ) + ".bmp" ) );
+        QImage image{ 64, 32, QImage::Format_RGB32 };
+        image.fill( QColor( i * 40, 0, 255 ) );
+        QVERIFY( image.save( fileName, "BMP" ) );
+        fileNames.push_back( fileName.toStdString() );
+    }
+
+    HistogramTool tool{ 2 };
+    HistogramServer server{ tool, 2, 1 };
+    QVERIFY( server.listen( socketPath ) );
+    std::thread serving( [&]{ server.run(); } );
+
+    const int numClients = 3, numRequests = 40;
+    std::vector<std::vector<int>> seen( numClients, std::vector<int>( numRequests, 0 ) );
+    std::vector<int> failures( numClients, 0 );
+    std::vector<std::thread> clients;
+    for( int c = 0; c < numClients; ++c ) {
+        clients.emplace_back( [&, c]{
+            HistogramClient client;
+            if( ! client.connect( socketPath ) ) {
+                failures[c]++;
+                return;
+            }
+            std::thread sender( [&]{
+                for( int r = 0; r < numRequests; ++r ) {
+                    client.requestFile( std::to_string( r ), fileNames[r % fileNames.size()], HistogramWriter::Format::BinaryDelta );
+                }
+                client.finishRequests();
+            } );
+
+            HistogramClient::Response response;
+            for( int r = 0; r < numRequests && client.receive( response ); ++r ) {
+                int id = std::atoi( response.id.c_str() );
+                if( ! response.ok || id < 0 || id >= numRequests ) {
+                    failures[c]++;
+                } else {
+                    seen[c][id]++;
+                }
+            }
+            sender.join();
+        } );
+    }
+    for( std::thread& client : clients ) {
+        client.join();
+    }
+
+    for( int c = 0; c < numClients; ++c ) {
+        QCOMPARE( failures[c], 0 );
+        for( int count : seen[c] ) {
+            QCOMPARE( count, 1 );
+        }
+    }
+
+    server.stop();
+    serving.join();
+    QCOMPARE( server.requestsAnswered(), static_cast<uint64_t>( numClients * numRequests ) );
+}
+
+// When a server is listening, another can't take its socket, but a stale socket file is replaced
+void TestHistogramServer::guardsTheSocket( ) {
+    QTemporaryDir dir;
+    std::string socketPath = dir.filePath( "socket" ).toStdString();
+
+    // Leave a socket file nobody listens on
+    sockaddr_un address;
+    std::memset( &address, 0, sizeof( address ) );
+    address.sun_family = AF_UNIX;
+    std::strcpy( address.sun_path, socketPath.c_str() );
+    int stale = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+    QVERIFY( ::bind( stale, reinterpret_cast<sockaddr *>( &address ), sizeof( address ) ) == 0 );
+    ::close( stale );
+
+    HistogramTool tool{ 1 };
+    HistogramServer server{ tool };
+    QVERIFY( server.listen( socketPath ) );
+
+    HistogramServer second{ tool };
+    QVERIFY( ! second.listen( socketPath ) );
+    QVERIFY( ! second.errorString().empty() );
+
+    HistogramServer tooLong{ tool };
+    QVERIFY( ! tooLong.listen( std::string( 200, 'x' ) ) );
+
+    HistogramClient client;
+    QVERIFY( ! client.connect( dir.filePath( "nobody" ).toStdString() ) );
+    QVERIFY( ! client.errorString().empty() );
+}
+
+// When zero decoders or queue capacity is given, throws a std::invalid_argument
+void TestHistogramServer::constructWithBadCounts( ) {
+    HistogramTool tool{ 1 };
+    QVERIFY_EXCEPTION_THROWN( HistogramServer( tool, 0, 4 ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( HistogramServer( tool, 1, 0 ), std::invalid_argument );
+}
@@ -0,0 +1,38 @@
+#ifndef TEST_HISTOGRAM_SERVER_H
+#define TEST_HISTOGRAM_SERVER_H
+
+#include <QtTest>
+#include <string>
+#include "../src/histogram_client.h"
+#include "../src/histogram_server.h"
+#include "../src/histogram_tool.h"
+
+class TestHistogramServer : public QObject {
+    Q_OBJECT
+
+private:
+    // The body a server should send for the given histograms
+    static std::string expectedBody( const std::string& label, const Histogram& red, const Histogram& green,
+                                     const Histogram& blue, HistogramWriter::Format format );
+
+private slots:
+    // When an image file is requested, the response has its label and histograms in the format asked for
+    void answersFileRequests( );
+
+    // When pixels are passed by descriptor, they are counted where they lie
+    void answersPixelRequests( );
+
+    // When a request can't be answered, an error comes back and later requests are still answered
+    void reportsBadRequests( );
+
+    // When several clients send many requests through a short queue, every one is answered exactly once
+    void pipelinesRequests( );
+
+    // When a server is listening, another can't take its socket, but a stale socket file is replaced
+    void guardsTheSocket( );
+
+    // When zero decoders or queue capacity is given, throws a std::invalid_argument
+    void constructWithBadCounts( );
+};
+
+#endif // TEST_HISTOGRAM_SERVER_H
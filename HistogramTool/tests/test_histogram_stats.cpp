@@ -0,0 +1,187 @@
+#include <QtTest>
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "test_histogram_stats.h"
+#include "../src/noise_source.h"
+
+// Statistics worked out one sample value at a time, and the Otsu threshold by trying every split
+HistogramStats::Summary TestHistogramStats::directSummary( const Histogram& histogram ) {
+    HistogramStats::Summary summary;
+    summary.total = histogram.total();
+    if( summary.total == 0 ) {
+        return summary;
+    }
+
+    double sum = 0;
+    for( uint32_t i = 0; i < histogram.numBuckets(); ++i ) {
+        sum += static_cast<double>( i ) * histogram[i];
+    }
+    summary.mean = sum / summary.total;
+    double squares = 0;
+    for( uint32_t i = 0; i < histogram.numBuckets(); ++i ) {
+        squares += ( i - summary.mean ) * ( i - summary.mean ) * histogram[i];
+    }
+    summary.standardDeviation = std::sqrt( squares / summary.total );
+    summary.percentile1 = HistogramStats::percentile( histogram, 1 );
+    summary.percentile99 = HistogramStats::percentile( histogram, 99 );
+
+    double best = 0;
+    for( uint32_t split = 0; split < histogram.numBuckets(); ++split ) {
+        double lowerCount = 0, lowerSum = 0, upperCount = 0, upperSum = 0;
+        for( uint32_t i = 0; i < histogram.numBuckets(); ++i ) {
+            ( i <= split ? lowerCount : upperCount ) += histogram[i];
+            ( i <= split ? lowerSum : upperSum ) += static_cast<double>( i ) * histogram[i];
+        }
+        if( lowerCount == 0 || upperCount == 0 ) {
+            continue;
+        }
+        double difference = lowerSum / lowerCount - upperSum / upperCount;
+        double between = lowerCount * upperCount * difference * difference;
+        // Relative tolerance so that splits equal but for rounding choose the first, as the stats do
+        if( between > best * ( 1 + 1e-12 ) ) {
+            best = between;
+            summary.otsuThreshold = split;
+        }
+    }
+    return summary;
+}
+
+// When a batch of varied histograms is worked out together, every statistic matches working it out directly
+void TestHistogramStats::matchesDirectComputation( ) {
+    // More than two lanes' worth, so a partial group is worked out too
+    std::vector<Histogram> histograms;
+    NoiseSource noise;
+    for( uint32_t h = 0; h < 2 * HistogramStats::LANES + 3; ++h ) {
+        std::vector<uint64_t> counts( 256 );
+        for( uint32_t i = 0; i < 256; ++i ) {
+            uint32_t state = noise.next();
+            // Two peaks of different widths, noise and some empty buckets
+            double near = std::exp( -std::pow( ( i - 40.0 - h ) / ( 8.0 + h ), 2 ) ) * 5000
+                        + std::exp( -std::pow( ( i - 180.0 + 2 * h ) / 20.0, 2 ) ) * 3000;
+            counts[i] = ( state % 7 == 0 ) ? 0 : static_cast<uint64_t>( near ) + state % ( 10 + h );
+        }
+        Histogram histogram;
+        histogram.addCounts( counts.data(), counts.size() );
+        histograms.push_back( histogram );
+    }
+
+    std::vector<const Histogram*> batch;
+    for( const Histogram& histogram : histograms ) {
+        batch.push_back( &histogram );
+    }
+    HistogramStats stats;
+    std::vector<HistogramStats::Summary> summaries;
+    stats.compute( batch, summaries );
+    QCOMPARE( summaries.size(), histograms.size() );
+
+    for( size_t h = 0; h < histograms.size(); ++h ) {
+        HistogramStats::Summary expected = directSummary( histograms[h] );
+        QCOMPARE( summaries[h].total, expected.total );
+        QVERIFY( std::fabs( summaries[h].mean - expected.mean ) < 1e-9 );
+        QVERIFY( std::fabs( summaries[h].standardDeviation - expected.standardDeviation ) < 1e-9 );
+        QCOMPARE( summaries[h].percentile1, expected.percentile1 );
+        QCOMPARE( summaries[h].percentile99, expected.percentile99 );
+        QCOMPARE( summaries[h].otsuThreshold, expected.otsuThreshold );
+
+        HistogramStats::Summary single = stats.compute( histograms[h] );
+        QCOMPARE( single.otsuThreshold, summaries[h].otsuThreshold );
+        QCOMPARE( single.mean, summaries[h].mean );
+    }
+}
+
+// When histograms are simple, the statistics are the known values, and empty histograms give 0s
+void TestHistogramStats::knownValues( ) {
+    HistogramStats stats;
+
+    // Two equal spikes; every split between them is as good, and the first is chosen
+    Histogram spikes;
+    for( int i = 0; i < 100; ++i ) {
+        spikes.increment( 10 );
+        spikes.increment( 200 );
+    }
+    HistogramStats::Summary summary = stats.compute( spikes );
+    QCOMPARE( summary.total, static_cast<uint64_t>( 200 ) );
+    QCOMPARE( summary.mean, 105.0 );
+    QCOMPARE( summary.standardDeviation, 95.0 );
+    QCOMPARE( summary.percentile1, static_cast<uint32_t>( 10 ) );
+    QCOMPARE( summary.percentile99, static_cast<uint32_t>( 200 ) );
+    QCOMPARE( summary.otsuThreshold, static_cast<uint32_t>( 10 ) );
+
+    // Nearest rank: 1 of 100 samples is the 1st percentile, and 99 of 100 the 99th
+    Histogram ramp;
+    for( uint32_t i = 0; i < 100; ++i ) {
+        ramp.increment( i + 50 );
+    }
+    summary = stats.compute( ramp );
+    QCOMPARE( summary.percentile1, static_cast<uint32_t>( 50 ) );
+    QCOMPARE( summary.percentile99, static_cast<uint32_t>( 148 ) );
+    QCOMPARE( summary.mean, 99.5 );
+
+    // One bucket has no split
+    Histogram flat;
+    flat.increment( 77 );
+    flat.increment( 77 );
+    summary = stats.compute( flat );
+    QCOMPARE( summary.mean, 77.0 );
+    QCOMPARE( summary.standardDeviation, 0.0 );
+    QCOMPARE( summary.percentile1, static_cast<uint32_t>( 77 ) );
+    QCOMPARE( summary.percentile99, static_cast<uint32_t>( 77 ) );
+    QCOMPARE( summary.otsuThreshold, static_cast<uint32_t>( 0 ) );
+
+    Histogram empty( 16 );
+    summary = stats.compute( empty );
+    QCOMPARE( summary.total, static_cast<uint64_t>( 0 ) );
+    QCOMPARE( summary.mean, 0.0 );
+    QCOMPARE( summary.standardDeviation, 0.0 );
+    QCOMPARE( summary.percentile1, static_cast<uint32_t>( 0 ) );
+    QCOMPARE( summary.percentile99, static_cast<uint32_t>( 0 ) );
+    QCOMPARE( summary.otsuThreshold, static_cast<uint32_t>( 0 ) );
+}
+
+// When the cumulative distribution and percentiles are asked for, they match the running sums
+void TestHistogramStats::cdfAndPercentiles( ) {
+    Histogram histogram( 8 );
+    const uint64_t counts[8] = { 0, 2, 0, 3, 0, 0, 5, 0 };
+    histogram.addCounts( counts, 8 );
+
+    std::vector<double> cdf;
+    HistogramStats::cdf( histogram, cdf );
+    QCOMPARE( cdf.size(), static_cast<size_t>( 8 ) );
+    const double expected[8] = { 0, 0.2, 0.2, 0.5, 0.5, 0.5, 1, 1 };
+    for( size_t i = 0; i < 8; ++i ) {
+        QVERIFY( std::fabs( cdf[i] - expected[i] ) < 1e-12 );
+    }
+
+    QCOMPARE( HistogramStats::percentile( histogram, 0 ), static_cast<uint32_t>( 1 ) );
+    QCOMPARE( HistogramStats::percentile( histogram, 20 ), static_cast<uint32_t>( 1 ) );
+    QCOMPARE( HistogramStats::percentile( histogram, 21 ), static_cast<uint32_t>( 3 ) );
+    QCOMPARE( HistogramStats::percentile( histogram, 50 ), static_cast<uint32_t>( 3 ) );
+    QCOMPARE( HistogramStats::percentile( histogram, 100 ), static_cast<uint32_t>( 6 ) );
+
+    Histogram empty( 8 );
+    HistogramStats::cdf( empty, cdf );
+    QCOMPARE( cdf[7], 0.0 );
+    QCOMPARE( HistogramStats::percentile( empty, 50 ), static_cast<uint32_t>( 0 ) );
+}
+
+// When histograms in a batch differ in size or percentiles are out of range, throws a std::invalid_argument
+void TestHistogramStats::invalidArguments( ) {
+    HistogramStats stats;
+    Histogram small( 16 ), large( 256 );
+    std::vector<HistogramStats::Summary> summaries;
+    std::vector<const Histogram*> mixed;
+    mixed.push_back( &small );
+    mixed.push_back( &large );
+    std::vector<const uint64_t*> counts( 1, small.data() );
+    QVERIFY_EXCEPTION_THROWN( stats.compute( mixed, summaries ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( stats.compute( counts, 0, summaries ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( HistogramStats::percentile( small, -1 ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( HistogramStats::percentile( small, 101 ), std::invalid_argument );
+
+    // An empty batch has no summaries
+    stats.compute( std::vector<const Histogram*>{}, summaries );
+    QVERIFY( summaries.empty() );
+}
@@ -0,0 +1,29 @@
+#ifndef TEST_HISTOGRAM_STATS_H
+#define TEST_HISTOGRAM_STATS_H
+
+#include <QtTest>
+#include "../src/histogram.h"
+#include "../src/histogram_stats.h"
+
+class TestHistogramStats : public QObject {
+    Q_OBJECT
+
+private:
+    // Statistics worked out one sample value at a time, and the Otsu threshold by trying every split
+    static HistogramStats::Summary directSummary( const Histogram& histogram );
+
+private slots:
+    // When a batch of varied histograms is worked out together, every statistic matches working it out directly
+    void matchesDirectComputation( );
+
+    // When histograms are simple, the statistics are the known values, and empty histograms give 0s
+    void knownValues( );
+
+    // When the cumulative distribution and percentiles are asked for, they match the running sums
+    void cdfAndPercentiles( );
+
+    // When histograms in a batch differ in size or percentiles are out of range, throws a std::invalid_argument
+    void invalidArguments( );
+};
+
+#endif // TEST_HISTOGRAM_STATS_H
@@ -1,5 +1,8 @@
 #include <QtTest>
 
+#include <cstring>
+#include <vector>
+
 #include "test_histogram_tool.h"
 
 QImage *TestHistogramTool::makeImage( QColor fillColour ) const {
@@ -11,6 +14,39 @@ QImage *TestHistogramTool::makeImage( QColor fillColour ) const {
 }
 
 
+// A 13x37 image of varied colours; 13 pixels leaves padding at the end of 8 and 24 bit scanlines
+QImage TestHistogramTool::makePatternImage( QImage::Format format ) const {
+    QImage image{ 13, 37, QImage::Format_ARGB32 };
+    for( int y = 0; y < image.height(); ++y ) {
+        for( int x = 0; x < image.width(); ++x ) {
+            image.setPixel( x, y, qRgb( x * 19, y * 7, ( x + y ) * 3 ) );
+        }
+    }
+    return image.convertToFormat( format );
+}
+
+
+// Histograms of image must match those of the image converted to ARGB32
+void TestHistogramTool::compareWithARGB32( const QImage& image ) const {
+    HistogramTool tool{2};
+    tool.setMinPixelsPerThread( 1 );
+    tool.setChunkRows( 5 );
+
+    Histogram red, green, blue;
+    tool.computeHistogram( image, red, green, blue );
+
+    Histogram expectedRed, expectedGreen, expectedBlue;
+    tool.computeHistogram( image.convertToFormat( QImage::Format_ARGB32 ), expectedRed, expectedGreen, expectedBlue );
+
+    QCOMPARE( red.total(), static_cast<uint64_t>( image.width() * image.height() ) );
+    for( uint32_t i = 0; i < 256; ++i ) {
+        QCOMPARE( red[i], expectedRed[i] );
+        QCOMPARE( green[i], expectedGreen[i] );
+        QCOMPARE( blue[i], expectedBlue[i] );
+    }
+}
+
+
 // When image is 256x256 and red, red[255] should be 65536
 void TestHistogramTool::red256x256( ) {
     QImage *image = makeImage( QColor( 255, 0, 0 ) );
@@ -18,7 +54,7 @@ void TestHistogramTool::red256x256( ) {
     Histogram red, green, blue;
     tool.computeHistogram(*image, red, green, blue);
 
-    uint32_t expected = 256 * 256;
+    uint64_t expected = 256 * 256;
 
     // Right number of pixels seen?
     QCOMPARE( red.total(), expected );
@@ -38,7 +74,7 @@ void TestHistogramTool::green256x256(  ) {
     Histogram red, green, blue;
     tool.computeHistogram(*image, red, green, blue);
 
-    uint32_t expected = 256 * 256;
+    uint64_t expected = 256 * 256;
 
     // Right number of pixels seen?
     QCOMPARE( red.total(), expected );
@@ -58,7 +94,7 @@ void TestHistogramTool::blue256x256( ) {
     Histogram red, green, blue;
     tool.computeHistogram(*image, red, green, blue);
 
-    uint32_t expected = 256 * 256;
+    uint64_t expected = 256 * 256;
 
     // Right number of pixels seen?
     QCOMPARE( red.total(), expected );
@@ -78,7 +114,7 @@ void TestHistogramTool::white256x256( ) {
     Histogram red, green, blue;
     tool.computeHistogram(*image, red, green, blue);
 
-    uint32_t expected = 256 * 256;
+    uint64_t expected = 256 * 256;
 
     // Right number of pixels seen?
     QCOMPARE( red.total(), expected );
@@ -98,7 +134,7 @@ void TestHistogramTool::white256x256_2_threads( ) {
     Histogram red, green, blue;
     tool.computeHistogram(*image, red, green, blue);
 
-    uint32_t expected = 256 * 256;
+    uint64_t expected = 256 * 256;
 
     // Right number of pixels seen?
     QCOMPARE( red.total(), expected );
@@ -119,7 +155,7 @@ void TestHistogramTool::white256x256_200_threads( ) {
     Histogram red, green, blue;
     tool.computeHistogram(*image, red, green, blue);
 
-    uint32_t expected = 256 * 256;
+    uint64_t expected = 256 * 256;
 
     // Right number of pixels seen?
     QCOMPARE( red.total(), expected );
@@ -144,7 +180,7 @@ void TestHistogramTool::grey256x256( ) {
     Histogram red, green, blue;
     tool.computeHistogram(image, red, green, blue);
 
-    uint32_t expected = 256 * 256;
+    uint64_t expected = 256 * 256;
 
     // Right number of pixels seen?
     QCOMPARE( red.total(), expected );
@@ -159,3 +195,418 @@ void TestHistogramTool::grey256x256( ) {
         QCOMPARE( blue[i],  expected);
     }
 }
+
+// When the tool is used for several images, each result is independent
+void TestHistogramTool::reusedAcrossImages( ) {
+    HistogramTool tool{4};
+    tool.setMinPixelsPerThread( 1024 );
+
+    const QColor colours[] = { QColor( 255, 0, 0 ), QColor( 0, 255, 0 ), QColor( 0, 0, 255 ) };
+    for( const QColor& colour : colours ) {
+        QImage *image = makeImage( colour );
+        Histogram red, green, blue;
+        tool.computeHistogram(*image, red, green, blue);
+        delete image;
+
+        uint64_t expected = 256 * 256;
+        QCOMPARE( red.total(), expected );
+        QCOMPARE( red[ colour.red() ], expected );
+        QCOMPARE( green[ colour.green() ], expected );
+        QCOMPARE( blue[ colour.blue() ], expected );
+    }
+}
+
+// When an image is small, it is processed on the calling thread only
+void TestHistogramTool::smallImageUsesOneThread( ) {
+    HistogramTool tool{8};
+
+    QCOMPARE( tool.threadsFor( 16 * 16 ), static_cast<uint32_t>( 1 ) );
+    QCOMPARE( tool.threadsFor( tool.minPixelsPerThread() * 2 ), static_cast<uint32_t>( 2 ) );
+    QCOMPARE( tool.threadsFor( tool.minPixelsPerThread() * 100 ), static_cast<uint32_t>( 8 ) );
+
+    QImage image{ 16, 16, QImage::Format_ARGB32 };
+    image.fill( QColor( 255, 255, 255 ) );
+    Histogram red, green, blue;
+    tool.computeHistogram(image, red, green, blue);
+
+    QCOMPARE( red[255], static_cast<uint64_t>( 256 ) );
+    QCOMPARE( green[255], static_cast<uint64_t>( 256 ) );
+    QCOMPARE( blue[255], static_cast<uint64_t>( 256 ) );
+}
+
+// When every thread is forced to take part, this should still work
+void TestHistogramTool::allThreadsOnSmallImage( ) {
+    HistogramTool tool{7};
+    tool.setMinPixelsPerThread( 0 );
+
+    QImage image{ 13, 11, QImage::Format_ARGB32 };
+    for( int y=0; y<image.height(); y++ ) {
+        for( int x=0; x<image.width(); x++ ) {
+            image.setPixelColor( x, y, QColor( x, y, x + y ) );
+        }
+    }
+    QCOMPARE( tool.threadsFor( 13 * 11 ), static_cast<uint32_t>( 7 ) );
+
+    Histogram red, green, blue;
+    tool.computeHistogram(image, red, green, blue);
+
+    QCOMPARE( red.total(), static_cast<uint64_t>( 13 * 11 ) );
+    QCOMPARE( red[0], static_cast<uint64_t>( 11 ) );
+    QCOMPARE( green[0], static_cast<uint64_t>( 13 ) );
+    QCOMPARE( blue[0], static_cast<uint64_t>( 1 ) );
+}
+
+// When constructed with zero threads, throws a std::invalid_argument
+void TestHistogramTool::constructWithZeroThreads( ) {
+    QVERIFY_EXCEPTION_THROWN( HistogramTool tool{0}, std::invalid_argument );
+}
+
+// When the image is cut into chunks, every chunk is processed by exactly one thread
+void TestHistogramTool::chunksCoverImage( ) {
+    HistogramTool tool{4};
+    tool.setMinPixelsPerThread( 0 );
+    tool.setChunkRows( 3 );
+
+    QImage image{ 17, 50, QImage::Format_ARGB32 };
+    for( int y=0; y<image.height(); y++ ) {
+        for( int x=0; x<image.width(); x++ ) {
+            image.setPixelColor( x, y, QColor( y, x, 0 ) );
+        }
+    }
+
+    Histogram red, green, blue;
+    tool.computeHistogram(image, red, green, blue);
+
+    // 50 rows in chunks of 3 is 17 chunks
+    std::vector<uint32_t> chunks = tool.chunksPerThread();
+    uint32_t totalChunks = 0;
+    for( uint32_t c : chunks ) {
+        totalChunks += c;
+    }
+    QCOMPARE( chunks.size(), static_cast<size_t>( 4 ) );
+    QCOMPARE( totalChunks, static_cast<uint32_t>( 17 ) );
+
+    // Every row counted once
+    for( size_t i=0; i<50; i++ ) {
+        QCOMPARE( red[i], static_cast<uint64_t>( 17 ) );
+    }
+    QCOMPARE( blue[0], static_cast<uint64_t>( 17 * 50 ) );
+}
+
+// When chunk size is automatic, chunks are sized to the default number of bytes
+void TestHistogramTool::automaticChunkRows( ) {
+    HistogramTool tool{2};
+    QImage image{ 256, 256, QImage::Format_ARGB32 };
+
+    QCOMPARE( tool.chunkRows(), static_cast<uint32_t>( 0 ) );
+    QCOMPARE( tool.chunkRowsFor( image ), static_cast<uint32_t>( HistogramTool::DEFAULT_CHUNK_BYTES / 1024 ) );
+
+    tool.setChunkRows( 7 );
+    QCOMPARE( tool.chunkRowsFor( image ), static_cast<uint32_t>( 7 ) );
+}
+
+// When the image is RGB888 with padded scanlines, counts match the image converted to ARGB32
+void TestHistogramTool::rgb888MatchesARGB32( ) {
+    compareWithARGB32( makePatternImage( QImage::Format_RGB888 ) );
+}
+
+// When the image is RGBX8888, counts match the image converted to ARGB32
+void TestHistogramTool::rgbx8888MatchesARGB32( ) {
+    compareWithARGB32( makePatternImage( QImage::Format_RGBX8888 ) );
+}
+
+// When the image is Grayscale8, red, green and blue counts all match the grey levels
+void TestHistogramTool::grayscale8MatchesARGB32( ) {
+    compareWithARGB32( makePatternImage( QImage::Format_Grayscale8 ) );
+}
+
+// When the image is Indexed8, counts match the colours in the colour table
+void TestHistogramTool::indexed8MatchesARGB32( ) {
+    QImage image{ 13, 37, QImage::Format_Indexed8 };
+    QVector<QRgb> colourTable;
+    for( int i = 0; i < 256; ++i ) {
+        colourTable.push_back( qRgb( i, 255 - i, ( i * 5 ) & 0xFF ) );
+    }
+    image.setColorTable( colourTable );
+    for( int y = 0; y < image.height(); ++y ) {
+        for( int x = 0; x < image.width(); ++x ) {
+            image.setPixel( x, y, static_cast<uint>( ( x * 11 + y ) & 0xFF ) );
+        }
+    }
+
+    compareWithARGB32( image );
+}
+
+// When an Indexed8 pixel is beyond the end of the colour table, it is counted as black
+void TestHistogramTool::indexed8OutsideColourTable( ) {
+    QImage image{ 4, 1, QImage::Format_Indexed8 };
+    QVector<QRgb> colourTable;
+    colourTable.push_back( qRgb( 10, 20, 30 ) );
+    image.setColorTable( colourTable );
+    image.setPixel( 0, 0, 0 );
+    image.setPixel( 1, 0, 0 );
+    image.setPixel( 2, 0, 1 );
+    image.setPixel( 3, 0, 200 );
+
+    HistogramTool tool{1};
+    Histogram red, green, blue;
+    tool.computeHistogram( image, red, green, blue );
+
+    QCOMPARE( red[10], static_cast<uint64_t>( 2 ) );
+    QCOMPARE( green[20], static_cast<uint64_t>( 2 ) );
+    QCOMPARE( blue[30], static_cast<uint64_t>( 2 ) );
+    QCOMPARE( red[0], static_cast<uint64_t>( 2 ) );
+    QCOMPARE( green[0], static_cast<uint64_t>( 2 ) );
+    QCOMPARE( blue[0], static_cast<uint64_t>( 2 ) );
+}
+
+// When counting into FixedHistograms, counts match those of Histograms
+void TestHistogramTool::fixedHistogramsMatch( ) {
+    QImage image = makePatternImage( QImage::Format_RGB888 );
+    ImageView view{ image.constBits(), static_cast<uint32_t>( image.width() ), static_cast<uint32_t>( image.height() ),
+                    image.bytesPerLine(), PixelFormat::RGB888 };
+
+    HistogramTool tool{2};
+    Histogram red, green, blue;
+    tool.computeHistogram( view, red, green, blue );
+
+    FixedHistogram<256> fixedRed, fixedGreen, fixedBlue;
+    tool.computeHistogram( view, fixedRed, fixedGreen, fixedBlue );
+
+    for( uint32_t i = 0; i < 256; ++i ) {
+        QCOMPARE( static_cast<uint64_t>( fixedRed[i] ), red[i] );
+        QCOMPARE( static_cast<uint64_t>( fixedGreen[i] ), green[i] );
+        QCOMPARE( static_cast<uint64_t>( fixedBlue[i] ), blue[i] );
+    }
+}
+
+// When an image has more than 2^32 pixels of one colour, the counts don't wrap
+void TestHistogramTool::countsBeyond32Bits( ) {
+    // One scanline repeated 65537 times by a zero stride; 65536 x 65537 pixels is just over 2^32
+    const uint32_t width = 65536;
+    const uint32_t height = 65537;
+    std::vector<QRgb> scanline( width, qRgb( 1, 2, 3 ) );
+    ImageView view{ reinterpret_cast<const uint8_t *>( scanline.data() ), width, height, 0, PixelFormat::ARGB32 };
+
+    HistogramTool tool{2};
+    Histogram red, green, blue;
+    tool.computeHistogram( view, red, green, blue );
+
+    uint64_t expected = static_cast<uint64_t>( width ) * height;
+    QVERIFY( expected > UINT32_MAX );
+    QCOMPARE( red[1], expected );
+    QCOMPARE( green[2], expected );
+    QCOMPARE( blue[3], expected );
+    QCOMPARE( red.total(), expected );
+}
+
+// When a raw buffer has padded scanlines, only the pixels are counted, in every layout
+void TestHistogramTool::rawBufferWithPaddedRows( ) {
+    // 5 pixels of red 10, green 20 + y, blue 30 per scanline, then padding of 0xEE to 32 bytes
+    const uint32_t width = 5;
+    const uint32_t height = 9;
+    const ptrdiff_t stride = 32;
+    HistogramTool tool{2};
+    tool.setMinPixelsPerThread( 1 );
+    tool.setChunkRows( 2 );
+
+    for( PixelFormat format : { PixelFormat::ARGB32, PixelFormat::RGBA8888, PixelFormat::RGB888, PixelFormat::BGR888 } ) {
+        std::vector<uint8_t> buffer( stride * height, 0xEE );
+        uint32_t bytesPerPixel = ImageView::bytesPerPixel( format );
+        for( uint32_t y = 0; y < height; ++y ) {
+            for( uint32_t x = 0; x < width; ++x ) {
+                uint8_t *pixel = &buffer[y * stride + x * bytesPerPixel];
+                uint8_t green = static_cast<uint8_t>( 20 + y );
+                if( format == PixelFormat::ARGB32 ) {
+                    uint32_t word = 0xFF000000u | ( 10u << 16 ) | ( static_cast<uint32_t>( green ) << 8 ) | 30u;
+                    std::memcpy( pixel, &word, sizeof( word ) );
+                } else if( format == PixelFormat::BGR888 ) {
+                    pixel[0] = 30;
+                    pixel[1] = green;
+                    pixel[2] = 10;
+                } else {
+                    pixel[0] = 10;
+                    pixel[1] = green;
+                    pixel[2] = 30;
+                }
+            }
+        }
+
+        FixedHistogram<256, uint64_t> red, green, blue;
+        tool.computeHistogram( ImageView{ buffer.data(), width, height, stride, format }, red, green, blue );
+        QCOMPARE( red[10], static_cast<uint64_t>( width * height ) );
+        QCOMPARE( blue[30], static_cast<uint64_t>( width * height ) );
+        QCOMPARE( red.total(), static_cast<uint64_t>( width * height ) );
+        for( uint32_t y = 0; y < height; ++y ) {
+            QCOMPARE( green[20 + y], static_cast<uint64_t>( width ) );
+        }
+    }
+
+    // Grey levels 0 to 6 in each scanline, padded with 0xEE
+    std::vector<uint8_t> grey( stride * height, 0xEE );
+    for( uint32_t y = 0; y < height; ++y ) {
+        for( uint32_t x = 0; x < 7; ++x ) {
+            grey[y * stride + x] = static_cast<uint8_t>( x );
+        }
+    }
+    FixedHistogram<256, uint64_t> red, green, blue;
+    tool.computeHistogram( ImageView{ grey.data(), 7, height, stride, PixelFormat::Grayscale8 }, red, green, blue );
+    QCOMPARE( red[0xEE], static_cast<uint64_t>( 0 ) );
+    for( uint32_t level = 0; level < 7; ++level ) {
+        QCOMPARE( red[level], static_cast<uint64_t>( height ) );
+        QCOMPARE( blue[level], static_cast<uint64_t>( height ) );
+    }
+}
+
+// When a sub-rectangle or bottom up view of a raw buffer is counted, only its pixels are counted
+void TestHistogramTool::rawSubViews( ) {
+    // 16x16 grey image whose level is x + 16 * y
+    const uint32_t side = 16;
+    std::vector<uint8_t> buffer( side * side );
+    for( uint32_t i = 0; i < side * side; ++i ) {
+        buffer[i] = static_cast<uint8_t>( i );
+    }
+    ImageView image{ buffer.data(), side, side, side, PixelFormat::Grayscale8 };
+    HistogramTool tool{3};
+    tool.setMinPixelsPerThread( 1 );
+    tool.setChunkRows( 1 );
+
+    Rect rect{ 3, 5, 4, 6 };
+    FixedHistogram<256, uint64_t> red, green, blue;
+    tool.computeHistogram( image.subView( rect ), red, green, blue );
+    QCOMPARE( red.total(), rect.numPixels() );
+    for( uint32_t level = 0; level < 256; ++level ) {
+        uint32_t x = level % side;
+        uint32_t y = level / side;
+        bool inside = x >= rect.x && x < rect.x + rect.width && y >= rect.y && y < rect.y + rect.height;
+        QCOMPARE( red[level], static_cast<uint64_t>( inside ? 1 : 0 ) );
+    }
+
+    // The same pixels bottom up: start at the last scanline and step backwards
+    ImageView flipped{ buffer.data() + ( side - 1 ) * side, side, side, -static_cast<ptrdiff_t>( side ), PixelFormat::Grayscale8 };
+    FixedHistogram<256, uint64_t> flippedRed, flippedGreen, flippedBlue;
+    tool.computeHistogram( flipped.subView( Rect{ 3, side - rect.y - rect.height, 4, 6 } ), flippedRed, flippedGreen, flippedBlue );
+    for( uint32_t level = 0; level < 256; ++level ) {
+        QCOMPARE( flippedRed[level], red[level] );
+    }
+}
+
+// When a view has pixels but no data, throws a std::invalid_argument
+void TestHistogramTool::viewWithoutData( ) {
+    HistogramTool tool{2};
+    Histogram red, green, blue;
+    ImageView view{ nullptr, 4, 4, 16, PixelFormat::ARGB32 };
+    QVERIFY( ! view.isValid() );
+    QVERIFY_EXCEPTION_THROWN( tool.computeHistogram( view, red, green, blue ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( tool.computeHistogramAsync( view ), std::invalid_argument );
+
+    // An empty view needs no data
+    tool.computeHistogram( ImageView{}, red, green, blue );
+    QCOMPARE( red.total(), static_cast<uint64_t>( 0 ) );
+}
+
+// When a mask of channels is given, those channels match a full count in any format and the others are untouched
+void TestHistogramTool::countsOnlyChosenChannels( ) {
+    HistogramTool tool{2};
+    tool.setMinPixelsPerThread( 1 );
+    tool.setChunkRows( 5 );
+
+    const QImage::Format formats[] = { QImage::Format_ARGB32, QImage::Format_RGBA8888, QImage::Format_RGB888, QImage::Format_Grayscale8 };
+    for( QImage::Format format : formats ) {
+        QImage image = makePatternImage( format );
+        Histogram all[3];
+        tool.computeHistogram( image, all[0], all[1], all[2] );
+
+        for( uint32_t channels = 1; channels <= HistogramKernel::AllChannels; ++channels ) {
+            Histogram chosen[3];
+            tool.computeHistogram( image, chosen[0], chosen[1], chosen[2], channels );
+            for( uint32_t c = 0; c < 3; ++c ) {
+                bool counted = ( channels & ( 1u << c ) ) != 0;
+                QCOMPARE( chosen[c].total(), counted ? all[c].total() : static_cast<uint64_t>( 0 ) );
+                for( uint32_t i = 0; counted && i < 256; ++i ) {
+                    QCOMPARE( chosen[c][i], all[c][i] );
+                }
+            }
+        }
+    }
+
+    Histogram red, green, blue;
+    QVERIFY_EXCEPTION_THROWN( tool.computeHistogram( makePatternImage( QImage::Format_ARGB32 ), red, green, blue, 0 ), std::invalid_argument );
+}
+
+// When dirty rectangles, some overlapping, are updated, the histograms match a recount of the new image
+void TestHistogramTool::updateMatchesRecount( ) {
+    const uint32_t width = 300, height = 200;
+    std::vector<QRgb> oldPixels( width * height ), newPixels;
+    for( uint32_t i = 0; i < oldPixels.size(); ++i ) {
+        oldPixels[i] = qRgb( i % 251, ( i / 7 ) % 256, ( i * 3 ) % 256 );
+    }
+    newPixels = oldPixels;
+
+    std::vector<Rect> dirty = { Rect{ 10, 10, 50, 40 }, Rect{ 40, 30, 100, 20 }, Rect{ 290, 190, 10, 10 }, Rect{ 45, 35, 5, 5 } };
+    for( const Rect& rect : dirty ) {
+        for( uint32_t y = rect.y; y < rect.y + rect.height; ++y ) {
+            for( uint32_t x = rect.x; x < rect.x + rect.width; ++x ) {
+                newPixels[y * width + x] = qRgb( 255 - x % 256, y % 256, 17 );
+            }
+        }
+    }
+    ImageView oldImage{ reinterpret_cast<const uint8_t *>( oldPixels.data() ), width, height, width * 4, PixelFormat::ARGB32 };
+    ImageView newImage{ reinterpret_cast<const uint8_t *>( newPixels.data() ), width, height, width * 4, PixelFormat::ARGB32 };
+
+    HistogramTool tool{2};
+    Histogram red, green, blue;
+    tool.computeHistogram( oldImage, red, green, blue );
+    QVERIFY( tool.updateHistogram( oldImage, newImage, dirty, red, green, blue, true ) );
+
+    Histogram expectedRed, expectedGreen, expectedBlue;
+    tool.computeHistogram( newImage, expectedRed, expectedGreen, expectedBlue );
+    for( uint32_t i = 0; i < 256; ++i ) {
+        QCOMPARE( red[i], expectedRed[i] );
+        QCOMPARE( green[i], expectedGreen[i] );
+        QCOMPARE( blue[i], expectedBlue[i] );
+    }
+}
+
+// When a changed pixel is outside the dirty rectangles, verification fails and the recount is returned
+void TestHistogramTool::verifyReplacesWrongUpdate( ) {
+    std::vector<QRgb> oldPixels( 64 * 64, qRgb( 10, 20, 30 ) ), newPixels = oldPixels;
+    newPixels[5] = qRgb( 200, 200, 200 );
+    newPixels[64 * 63] = qRgb( 100, 100, 100 );
+    ImageView oldImage{ reinterpret_cast<const uint8_t *>( oldPixels.data() ), 64, 64, 64 * 4, PixelFormat::ARGB32 };
+    ImageView newImage{ reinterpret_cast<const uint8_t *>( newPixels.data() ), 64, 64, 64 * 4, PixelFormat::ARGB32 };
+
+    HistogramTool tool{1};
+    Histogram red, green, blue;
+    tool.computeHistogram( oldImage, red, green, blue );
+    QVERIFY( ! tool.updateHistogram( oldImage, newImage, { Rect{ 0, 0, 8, 8 } }, red, green, blue, true ) );
+
+    QCOMPARE( red[200], static_cast<uint64_t>( 1 ) );
+    QCOMPARE( red[100], static_cast<uint64_t>( 1 ) );
+    QCOMPARE( red[10], static_cast<uint64_t>( 64 * 64 - 2 ) );
+}
+
+// When the histograms weren't computed from the old image, throws a std::invalid_argument and leaves them unchanged
+void TestHistogramTool::updateStaleHistograms( ) {
+    std::vector<QRgb> oldPixels( 16 * 16, qRgb( 1, 2, 3 ) ), newPixels( 16 * 16, qRgb( 4, 5, 6 ) );
+    ImageView oldImage{ reinterpret_cast<const uint8_t *>( oldPixels.data() ), 16, 16, 16 * 4, PixelFormat::ARGB32 };
+    ImageView newImage{ reinterpret_cast<const uint8_t *>( newPixels.data() ), 16, 16, 16 * 4, PixelFormat::ARGB32 };
+
+    HistogramTool tool{1};
+    Histogram red, green, blue;
+    tool.computeHistogram( newImage, red, green, blue );
+    QVERIFY_EXCEPTION_THROWN( tool.updateHistogram( oldImage, newImage, { Rect{ 0, 0, 4, 4 } }, red, green, blue ), std::invalid_argument );
+    QCOMPARE( red[4], static_cast<uint64_t>( 256 ) );
+    QCOMPARE( red[1], static_cast<uint64_t>( 0 ) );
+}
+
+// When the old and new images differ in size, throws a std::invalid_argument
+void TestHistogramTool::updateDifferentSizes( ) {
+    std::vector<QRgb> pixels( 16 * 16, qRgb( 1, 2, 3 ) );
+    ImageView oldImage{ reinterpret_cast<const uint8_t *>( pixels.data() ), 16, 16, 16 * 4, PixelFormat::ARGB32 };
+    ImageView newImage{ reinterpret_cast<const uint8_t *>( pixels.data() ), 16, 8, 16 * 4, PixelFormat::ARGB32 };
+
+    HistogramTool tool{1};
+    Histogram red, green, blue;
+    QVERIFY_EXCEPTION_THROWN( tool.updateHistogram( oldImage, newImage, { Rect{ 0, 0, 4, 4 } }, red, green, blue ), std::invalid_argument );
+}
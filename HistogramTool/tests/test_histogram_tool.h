@@ -9,6 +9,8 @@ class TestHistogramTool : public QObject {
 
 private:
     QImage *makeImage( QColor fillColour ) const;
+    QImage makePatternImage( QImage::Format format ) const;
+    void compareWithARGB32( const QImage& image ) const;
 
 private slots:
     // When image is 256x256 and red, red[255] should be 65536
@@ -31,6 +33,69 @@ private slots:
 
     // When we use grey scales, counts of red, green and blue values should all be 256
     void grey256x256( );
+
+    // When the tool is used for several images, each result is independent
+    void reusedAcrossImages( );
+
+    // When an image is small, it is processed on the calling thread only
+    void smallImageUsesOneThread( );
+
+    // When every thread is forced to take part, this should still work
+    void allThreadsOnSmallImage( );
+
+    // When constructed with zero threads, throws a std::invalid_argument
+    void constructWithZeroThreads( );
+
+    // When the image is cut into chunks, every chunk is processed by exactly one thread
+    void chunksCoverImage( );
+
+    // When chunk size is automatic, chunks are sized to the default number of bytes
+    void automaticChunkRows( );
+
+    // When the image is RGB888 with padded scanlines, counts match the image converted to ARGB32
+    void rgb888MatchesARGB32( );
+
+    // When the image is RGBX8888, counts match the image converted to ARGB32
+    void rgbx8888MatchesARGB32( );
+
+    // When the image is Grayscale8, red, green and blue counts all match the grey levels
+    void grayscale8MatchesARGB32( );
+
+    // When the image is Indexed8, counts match the colours in the colour table
+    void indexed8MatchesARGB32( );
+
+    // When an Indexed8 pixel is beyond the end of the colour table, it is counted as black
+    void indexed8OutsideColourTable( );
+
+    // When counting into FixedHistograms, counts match those of Histograms
+    void fixedHistogramsMatch( );
+
+    // When an image has more than 2^32 pixels of one colour, the counts don't wrap
+    void countsBeyond32Bits( );
+
+    // When a raw buffer has padded scanlines, only the pixels are counted, in every layout
+    void rawBufferWithPaddedRows( );
+
+    // When a sub-rectangle or bottom up view of a raw buffer is counted, only its pixels are counted
+    void rawSubViews( );
+
+    // When a view has pixels but no data, throws a std::invalid_argument
+    void viewWithoutData( );
+
+    // When a mask of channels is given, those channels match a full count in any format and the others are untouched
+    void countsOnlyChosenChannels( );
+
+    // When dirty rectangles, some overlapping, are updated, the histograms match a recount of the new image
+    void updateMatchesRecount( );
+
+    // When a changed pixel is outside the dirty rectangles, verification fails and the recount is returned
+    void verifyReplacesWrongUpdate( );
+
+    // When the histograms weren't computed from the old image, throws a std::invalid_argument and leaves them unchanged
+    void updateStaleHistograms( );
+
+    // When the old and new images differ in size, throws a std::invalid_argument
+    void updateDifferentSizes( );
 };
 
 #endif // TEST_HISTOGRAMMER_H
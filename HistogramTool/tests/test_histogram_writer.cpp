@@ -0,0 +1,284 @@
+#include <QtTest>
+#include <cstring>
+#include <sstream>
+
+#include "test_histogram_writer.h"
+
+Histogram TestHistogramWriter::makeHistogram( ) const {
+    Histogram histogram;
+    uint64_t counts[256];
+    for( size_t i = 0; i < 256; ++i ) {
+        counts[i] = ( i * 7919 ) % 1000 + i * i;
+    }
+    counts[0] = 0;
+    counts[1] = UINT64_MAX;
+    counts[2] = 0;
+    counts[3] = 10000000000ULL;
+    histogram.addCounts( counts, 256 );
+    return histogram;
+}
+
+void TestHistogramWriter::checkRoundTrip( HistogramWriter::Format format ) const {
+    Histogram first = makeHistogram();
+    Histogram second{ 3 };
+    second.increment( 2 );
+
+    std::stringstream stream;
+    {
+        HistogramWriter writer{ stream, format };
+        writer.writeLabel( "first.png" );
+        writer.write( first );
+        writer.write( first );
+        writer.writeLabel( "" );
+        writer.write( second );
+    }
+
+    HistogramReader reader{ stream };
+    Histogram histogram;
+    QVERIFY( reader.read( histogram ) );
+    QCOMPARE( reader.label(), std::string{ "first.png" } );
+    QCOMPARE( histogram.numBuckets(), static_cast<uint32_t>( 256 ) );
+    for( size_t i = 0; i < 256; ++i ) {
+        QCOMPARE( histogram[i], first[i] );
+    }
+    QVERIFY( reader.read( histogram ) );
+    QCOMPARE( reader.label(), std::string{ "first.png" } );
+    QCOMPARE( histogram[1], UINT64_MAX );
+
+    QVERIFY( reader.read( histogram ) );
+    QCOMPARE( reader.label(), std::string{ "" } );
+    QCOMPARE( histogram.numBuckets(), static_cast<uint32_t>( 3 ) );
+    QCOMPARE( histogram[2], static_cast<uint64_t>( 1 ) );
+    QCOMPARE( histogram.total(), static_cast<uint64_t>( 1 ) );
+
+    QVERIFY( ! reader.read( histogram ) );
+    QVERIFY( reader.errorString().empty() );
+    QCOMPARE( reader.isDelta(), format == HistogramWriter::Format::BinaryDelta );
+}
+
+// When writing text, the output is the same as operator<<
+void TestHistogramWriter::textMatchesStreamOperator( ) {
+    Histogram histogram = makeHistogram();
+    Histogram single{ 1 };
+    single.increment( 0 );
+
+    std::ostringstream expected;
+    expected << "label" << std::endl << histogram << single;
+
+    std::ostringstream output;
+    HistogramWriter writer{ output };
+    writer.writeLabel( "label" );
+    writer.write( histogram );
+    writer.write( single );
+    QVERIFY( writer.flush() );
+
+    QCOMPARE( output.str(), expected.str() );
+}
+
+// When the buffer is smaller than the output, it is passed on in pieces and the output is unchanged
+void TestHistogramWriter::smallBufferSameOutput( ) {
+    Histogram histogram = makeHistogram();
+    const HistogramWriter::Format formats[] = { HistogramWriter::Format::Text, HistogramWriter::Format::Binary, HistogramWriter::Format::BinaryDelta };
+
+    for( HistogramWriter::Format format : formats ) {
+        std::ostringstream large, small;
+        {
+            HistogramWriter writer{ large, format };
+            HistogramWriter smallWriter{ small, format, 1 };
+            for( int i = 0; i < 5; ++i ) {
+                writer.writeLabel( "image" );
+                writer.write( histogram );
+                smallWriter.writeLabel( "image" );
+                smallWriter.write( histogram );
+            }
+        }
+        QCOMPARE( small.str(), large.str() );
+    }
+}
+
+// When writing binary, histograms and labels are read back unchanged
+void TestHistogramWriter::binaryRoundTrip( ) {
+    checkRoundTrip( HistogramWriter::Format::Binary );
+}
+
+// When writing delta encoded binary, histograms and labels are read back unchanged
+void TestHistogramWriter::deltaRoundTrip( ) {
+    checkRoundTrip( HistogramWriter::Format::BinaryDelta );
+}
+
+// When counts are close together, delta encoding is much smaller than fixed width
+void TestHistogramWriter::deltaIsSmaller( ) {
+    Histogram histogram;
+    uint64_t counts[256];
+    for( size_t i = 0; i < 256; ++i ) {
+        counts[i] = 1000000 + ( i % 2 ) * 50;
+    }
+    histogram.addCounts( counts, 256 );
+
+    std::ostringstream binary, delta;
+    {
+        HistogramWriter binaryWriter{ binary, HistogramWriter::Format::Binary };
+        HistogramWriter deltaWriter{ delta, HistogramWriter::Format::BinaryDelta };
+        binaryWriter.write( histogram );
+        deltaWriter.write( histogram );
+    }
+
+    QCOMPARE( binary.str().size(), HistogramWriter::HEADER_BYTES + HistogramWriter::RECORD_HEADER_BYTES + 4 + 256 * 8 );
+    QVERIFY( delta.str().size() < binary.str().size() / 4 );
+}
+
+// When a FixedHistogram is written, the output is the same as for a Histogram
+void TestHistogramWriter::fixedHistogramSameOutput( ) {
+    FixedHistogram<256, uint64_t> fixed;
+    for( size_t i = 0; i < 256; ++i ) {
+        for( size_t n = 0; n < i % 5; ++n ) {
+            fixed.increment( i );
+        }
+    }
+    Histogram histogram{ fixed };
+
+    std::ostringstream fromFixed, fromHistogram;
+    {
+        HistogramWriter fixedWriter{ fromFixed, HistogramWriter::Format::BinaryDelta };
+        HistogramWriter writer{ fromHistogram, HistogramWriter::Format::BinaryDelta };
+        fixedWriter.write( fixed );
+        writer.write( histogram );
+    }
+    QCOMPARE( fromFixed.str(), fromHistogram.str() );
+}
+
+// When the stream isn't a histogram file, reading fails with a reason
+void TestHistogramWriter::readRejectsBadHeader( ) {
+    std::istringstream text{ "1, 2, 3\n" };
+    HistogramReader reader{ text };
+    Histogram histogram;
+    QVERIFY( ! reader.read( histogram ) );
+    QVERIFY( ! reader.errorString().empty() );
+
+    std::istringstream empty{ "" };
+    HistogramReader emptyReader{ empty };
+    QVERIFY( ! emptyReader.read( histogram ) );
+    QVERIFY( ! emptyReader.errorString().empty() );
+}
+
+// When the stream ends part way through a record, reading fails with a reason
+void TestHistogramWriter::readRejectsTruncatedRecord( ) {
+    std::ostringstream output;
+    {
+        HistogramWriter writer{ output, HistogramWriter::Format::Binary };
+        writer.write( makeHistogram() );
+        writer.write( makeHistogram() );
+    }
+    std::string bytes = output.str();
+
+    std::istringstream truncated{ bytes.substr( 0, bytes.size() - 3 ) };
+    HistogramReader reader{ truncated };
+    Histogram histogram;
+    QVERIFY( reader.read( histogram ) );
+    QVERIFY( ! reader.read( histogram ) );
+    QVERIFY( ! reader.errorString().empty() );
+}
+
+// When a record claims more bytes than the stream holds, reading fails with a reason, whatever its type
+void TestHistogramWriter::readRejectsOverlongRecord( ) {
+    std::ostringstream output;
+    {
+        HistogramWriter writer{ output, HistogramWriter::Format::Binary };
+        writer.flush();
+    }
+    const uint8_t types[] = { HistogramWriter::RECORD_LABEL, HistogramWriter::RECORD_HISTOGRAM, HistogramWriter::RECORD_JOINT, 200 };
+    for( uint8_t type : types ) {
+        // A record header claiming 4GB, then a few bytes of body
+        std::string bytes = output.str();
+        bytes += static_cast<char>( type );
+        bytes += std::string( 4, static_cast<char>( 0xFF ) );
+        bytes += std::string( 10, '\0' );
+
+        std::istringstream input{ bytes };
+        HistogramReader reader{ input };
+        Histogram histogram;
+        QVERIFY( ! reader.read( histogram ) );
+        QCOMPARE( reader.errorString(), std::string{ "Histogram file ends part way through a record" } );
+    }
+}
+
+// When the format name is unknown, throws std::invalid_argument
+void TestHistogramWriter::formatFromBadName( ) {
+    QVERIFY( HistogramWriter::formatFromName( "delta" ) == HistogramWriter::Format::BinaryDelta );
+    QVERIFY_EXCEPTION_THROWN( HistogramWriter::formatFromName( "csv" ), std::invalid_argument );
+}
+
+// When a joint histogram is written, only the bins hit are, and readers of histograms skip the record
+void TestHistogramWriter::writesJointHistograms( ) {
+    const uint32_t pixels[] = { 0xFF000000u, 0xFF000000u, 0xFF0000FFu, 0xFFFF0000u };
+    HistogramTool tool{ 1 };
+    JointHistogram joint{ tool, 16 };
+    joint.compute( ImageView{ reinterpret_cast<const uint8_t *>( pixels ), 2, 2, 8, PixelFormat::ARGB32 } );
+
+    std::ostringstream text;
+    {
+        HistogramWriter writer{ text };
+        writer.write( joint );
+    }
+    QCOMPARE( text.str(), std::string{ "joint 16: 0 0 0 2, 0 0 15 1, 15 0 0 1\n" } );
+
+    // Keys 0, 15 and 3840 take 12 bytes each, or a byte or two of gap and a byte of count when delta encoded
+    const HistogramWriter::Format formats[] = { HistogramWriter::Format::Binary, HistogramWriter::Format::BinaryDelta };
+    const size_t bodyBytes[] = { 8 + 3 * 12, 8 + 2 + 2 + 3 };
+    for( size_t i = 0; i < 2; ++i ) {
+        std::stringstream stream;
+        {
+            HistogramWriter writer{ stream, formats[i] };
+            writer.write( joint );
+            writer.write( makeHistogram() );
+        }
+        std::string bytes = stream.str();
+        QCOMPARE( static_cast<uint8_t>( bytes[HistogramWriter::HEADER_BYTES] ), HistogramWriter::RECORD_JOINT );
+        QCOMPARE( static_cast<size_t>( static_cast<uint8_t>( bytes[HistogramWriter::HEADER_BYTES + 1] ) ), bodyBytes[i] );
+
+        HistogramReader reader{ stream };
+        Histogram histogram;
+        QVERIFY( reader.read( histogram ) );
+        QCOMPARE( histogram[3], static_cast<uint64_t>( 10000000000ULL ) );
+    }
+}
+
+// When statistics are written, text names each one and a binary stats record is skipped by the reader
+void TestHistogramWriter::writesStatistics( ) {
+    HistogramStats::Summary summary;
+    summary.total = 200;
+    summary.mean = 105.5;
+    summary.standardDeviation = 95;
+    summary.percentile1 = 10;
+    summary.percentile99 = 200;
+    summary.otsuThreshold = 12;
+
+    std::ostringstream text;
+    {
+        HistogramWriter writer{ text };
+        writer.write( summary );
+    }
+    QCOMPARE( text.str(), std::string{ "total 200, mean 105.5, sd 95, p1 10, p99 200, otsu 12\n" } );
+
+    const HistogramWriter::Format formats[] = { HistogramWriter::Format::Binary, HistogramWriter::Format::BinaryDelta };
+    for( HistogramWriter::Format format : formats ) {
+        std::stringstream stream;
+        {
+            HistogramWriter writer{ stream, format };
+            writer.write( summary );
+            writer.write( makeHistogram() );
+        }
+        std::string bytes = stream.str();
+        QCOMPARE( static_cast<uint8_t>( bytes[HistogramWriter::HEADER_BYTES] ), HistogramWriter::RECORD_STATS );
+        QCOMPARE( static_cast<uint8_t>( bytes[HistogramWriter::HEADER_BYTES + 1] ), static_cast<uint8_t>( 36 ) );
+
+        double mean = 0;
+        std::memcpy( &mean, bytes.data() + HistogramWriter::HEADER_BYTES + HistogramWriter::RECORD_HEADER_BYTES + 8, sizeof( mean ) );
+        QCOMPARE( mean, 105.5 );
+
+        HistogramReader reader{ stream };
+        Histogram histogram;
+        QVERIFY( reader.read( histogram ) );
+        QCOMPARE( histogram[3], static_cast<uint64_t>( 10000000000ULL ) );
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef TEST_HISTOGRAM_WRITER_H
+#define TEST_HISTOGRAM_WRITER_H
+
+#include <QtTest>
+#include <string>
+#include "../src/histogram_writer.h"
+#include "../src/histogram_reader.h"
+#include "../src/joint_histogram.h"
+
+class TestHistogramWriter : public QObject {
+    Q_OBJECT
+
+private:
+    // A histogram with a mix of small, large, rising and falling counts
+    Histogram makeHistogram( ) const;
+
+    // Write labels and histograms in the given format and read them back
+    void checkRoundTrip( HistogramWriter::Format format ) const;
+
+private slots:
+    // When writing text, the output is the same as operator<<
+    void textMatchesStreamOperator( );
+
+    // When the buffer is smaller than the output, it is passed on in pieces and the output is unchanged
+    void smallBufferSameOutput( );
+
+    // When writing binary, histograms and labels are read back unchanged
+    void binaryRoundTrip( );
+
+    // When writing delta encoded binary, histograms and labels are read back unchanged
+    void deltaRoundTrip( );
+
+    // When counts are close together, delta encoding is much smaller than fixed width
+    void deltaIsSmaller( );
+
+    // When a FixedHistogram is written, the output is the same as for a Histogram
+    void fixedHistogramSameOutput( );
+
+    // When the stream isn't a histogram file, reading fails with a reason
+    void readRejectsBadHeader( );
+
+    // When the stream ends part way through a record, reading fails with a reason
+    void readRejectsTruncatedRecord( );
+
+    // When a record claims more bytes than the stream holds, reading fails with a reason, whatever its type
+    void readRejectsOverlongRecord( );
+
+    // When the format name is unknown, throws std::invalid_argument
+    void formatFromBadName( );
+
+    // When a joint histogram is written, only the bins hit are, and readers of histograms skip the record
+    void writesJointHistograms( );
+
+    // When statistics are written, text names each one and a binary stats record is skipped by the reader
+    void writesStatistics( );
+};
+
+#endif // TEST_HISTOGRAM_WRITER_H
@@ -0,0 +1,191 @@
+#include <QtTest>
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "test_joint_histogram.h"
+#include "../src/noise_source.h"
+
+// Noise of the given format in a padded buffer, with the colour of each pixel as ARGB32 and a colour table for Indexed8
+ImageView TestJointHistogram::makeNoiseView( uint32_t width, uint32_t height, PixelFormat format, std::vector<uint8_t>& buffer,
+                                             std::vector<uint32_t>& colours, std::vector<uint32_t>& colourTable ) {
+    const uint32_t bytesPerPixel = ImageView::bytesPerPixel( format );
+    const uint32_t stride = ( width * bytesPerPixel + 7 ) & ~3u;
+    buffer.assign( static_cast<size_t>( stride ) * height, 0xEE );
+    colours.clear();
+    colourTable.clear();
+    for( uint32_t i = 0; i < 256; ++i ) {
+        colourTable.push_back( 0xFF000000u | ( i * 2654435761u >> 8 ) );
+    }
+
+    NoiseSource noise;
+    for( uint32_t y = 0; y < height; ++y ) {
+        for( uint32_t x = 0; x < width; ++x ) {
+            uint32_t state = noise.next();
+            // Runs of a few alike pixels, as in real images
+            uint32_t colour = ( x % 3 == 0 || colours.empty() ) ? state : colours.back();
+            uint8_t *pixel = &buffer[ static_cast<size_t>( y ) * stride + x * bytesPerPixel ];
+            uint8_t red = static_cast<uint8_t>( colour >> 16 ), green = static_cast<uint8_t>( colour >> 8 ), blue = static_cast<uint8_t>( colour );
+
+            switch( format ) {
+                case PixelFormat::ARGB32:
+                    std::memcpy( pixel, &colour, sizeof( colour ) );
+                    break;
+                case PixelFormat::RGBA8888:
+                    pixel[3] = static_cast<uint8_t>( colour >> 24 );
+                    // Fall through
+                case PixelFormat::RGB888:
+                    pixel[0] = red;
+                    pixel[1] = green;
+                    pixel[2] = blue;
+                    break;
+                case PixelFormat::BGR888:
+                    pixel[0] = blue;
+                    pixel[1] = green;
+                    pixel[2] = red;
+                    break;
+                case PixelFormat::Grayscale8:
+                    pixel[0] = blue;
+                    colour = 0xFF000000u | ( blue * 0x010101u );
+                    break;
+                case PixelFormat::Indexed8:
+                    pixel[0] = blue;
+                    colour = colourTable[blue];
+                    break;
+            }
+            colours.push_back( colour );
+        }
+    }
+    return ImageView{ buffer.data(), width, height, stride, format, colourTable.data(), static_cast<uint32_t>( colourTable.size() ) };
+}
+
+
+// Counts of each key when every colour is counted one at a time
+std::map<uint32_t, uint64_t> TestJointHistogram::countColours( const JointHistogram& joint, const std::vector<uint32_t>& colours ) {
+    std::map<uint32_t, uint64_t> counts;
+    for( uint32_t colour : colours ) {
+        counts[ joint.keyOf( static_cast<uint8_t>( colour >> 16 ), static_cast<uint8_t>( colour >> 8 ), static_cast<uint8_t>( colour ) ) ]++;
+    }
+    return counts;
+}
+
+
+// When counted densely or sparsely in any format and number of bins, every bin matches counting pixel by pixel
+void TestJointHistogram::matchesPerPixelKeys( ) {
+    HistogramTool tool{ 3 };
+    tool.setMinPixelsPerThread( 1 );
+    tool.setChunkRows( 5 );
+
+    const PixelFormat formats[] = { PixelFormat::ARGB32, PixelFormat::RGBA8888, PixelFormat::RGB888,
+                                    PixelFormat::BGR888, PixelFormat::Grayscale8, PixelFormat::Indexed8 };
+    const uint32_t bins[] = { 16, 32, 64 };
+    std::vector<uint8_t> buffer;
+    std::vector<uint32_t> colours, colourTable;
+
+    for( PixelFormat format : formats ) {
+        // Wider than a block, so scanlines are counted a block at a time
+        ImageView view = makeNoiseView( 1031, 29, format, buffer, colours, colourTable );
+        for( uint32_t binsPerChannel : bins ) {
+            for( size_t denseLimit : { static_cast<size_t>( 64 ) * 1024 * 1024, static_cast<size_t>( 1 ) } ) {
+                JointHistogram joint{ tool, binsPerChannel, denseLimit };
+                QVERIFY( joint.storage() == ( ( denseLimit > 1 ) ? JointHistogram::Storage::Dense : JointHistogram::Storage::Sparse ) );
+                joint.compute( view );
+
+                std::map<uint32_t, uint64_t> expected = countColours( joint, colours );
+                QCOMPARE( joint.keys().size(), expected.size() );
+                size_t i = 0;
+                for( const auto& bin : expected ) {
+                    QCOMPARE( joint.keys()[i], bin.first );
+                    QCOMPARE( joint.counts()[i], bin.second );
+                    i++;
+                }
+                QCOMPARE( joint.total(), view.numPixels() );
+            }
+        }
+    }
+}
+
+
+// When an image is counted twice, counts are added, and reset empties them
+void TestJointHistogram::addsUntilReset( ) {
+    HistogramTool tool{ 2 };
+    tool.setMinPixelsPerThread( 1 );
+    std::vector<uint8_t> buffer;
+    std::vector<uint32_t> colours, colourTable;
+    ImageView view = makeNoiseView( 200, 100, PixelFormat::ARGB32, buffer, colours, colourTable );
+
+    for( size_t denseLimit : { static_cast<size_t>( 64 ) * 1024 * 1024, static_cast<size_t>( 1 ) } ) {
+        JointHistogram joint{ tool, 64, denseLimit };
+        joint.compute( view );
+        std::vector<uint32_t> keys = joint.keys();
+        std::vector<uint64_t> counts = joint.counts();
+
+        joint.compute( view );
+        QVERIFY( joint.keys() == keys );
+        for( size_t i = 0; i < counts.size(); ++i ) {
+            QCOMPARE( joint.counts()[i], 2 * counts[i] );
+            QCOMPARE( joint.count( keys[i] ), 2 * counts[i] );
+        }
+        QCOMPARE( joint.total(), static_cast<uint64_t>( 2 * 200 * 100 ) );
+
+        joint.reset();
+        QVERIFY( joint.keys().empty() );
+        QCOMPARE( joint.total(), static_cast<uint64_t>( 0 ) );
+        QCOMPARE( joint.count( keys[0] ), static_cast<uint64_t>( 0 ) );
+
+        // An empty image adds nothing
+        joint.compute( ImageView{} );
+        QCOMPARE( joint.total(), static_cast<uint64_t>( 0 ) );
+    }
+}
+
+
+// When neighbouring pixels are alike, runs are counted correctly across blocks and scanlines
+void TestJointHistogram::countsRuns( ) {
+    HistogramTool tool{ 2 };
+    tool.setMinPixelsPerThread( 1 );
+    tool.setChunkRows( 3 );
+
+    // Left half one colour, right half another which quantizes to the same bin at 16 bins but not 64
+    const uint32_t width = 1500, height = 7;
+    std::vector<uint32_t> pixels( width * height );
+    for( uint32_t i = 0; i < pixels.size(); ++i ) {
+        pixels[i] = ( i % width < width / 2 ) ? 0xFF102030u : 0xFF1C2C3Cu;
+    }
+    ImageView view{ reinterpret_cast<const uint8_t *>( pixels.data() ), width, height, width * 4, PixelFormat::ARGB32 };
+
+    for( size_t denseLimit : { static_cast<size_t>( 64 ) * 1024 * 1024, static_cast<size_t>( 1 ) } ) {
+        JointHistogram coarse{ tool, 16, denseLimit };
+        coarse.compute( view );
+        QCOMPARE( coarse.keys().size(), static_cast<size_t>( 1 ) );
+        QCOMPARE( coarse.count( coarse.keyOf( 0x10, 0x20, 0x30 ) ), static_cast<uint64_t>( width * height ) );
+
+        JointHistogram fine{ tool, 64, denseLimit };
+        fine.compute( view );
+        QCOMPARE( fine.keys().size(), static_cast<size_t>( 2 ) );
+        QCOMPARE( fine.count( fine.keyOf( 0x10, 0x20, 0x30 ) ), static_cast<uint64_t>( width / 2 * height ) );
+        QCOMPARE( fine.count( fine.keyOf( 0x1C, 0x2C, 0x3C ) ), static_cast<uint64_t>( width / 2 * height ) );
+    }
+}
+
+
+// When keys and bins are converted, they round trip; bad numbers of bins throw a std::invalid_argument
+void TestJointHistogram::keysAndBins( ) {
+    HistogramTool tool{ 1 };
+    JointHistogram joint{ tool, 32 };
+    QCOMPARE( joint.binsPerChannel(), static_cast<uint32_t>( 32 ) );
+    QCOMPARE( joint.keyOf( 0xFF, 0, 0 ), static_cast<uint32_t>( 31 << 10 ) );
+    QCOMPARE( joint.keyOf( 0x08, 0x10, 0x18 ), static_cast<uint32_t>( ( 1 << 10 ) | ( 2 << 5 ) | 3 ) );
+
+    uint32_t red = 0, green = 0, blue = 0;
+    joint.binsOf( joint.keyOf( 0x08, 0x10, 0xFF ), red, green, blue );
+    QCOMPARE( red, static_cast<uint32_t>( 1 ) );
+    QCOMPARE( green, static_cast<uint32_t>( 2 ) );
+    QCOMPARE( blue, static_cast<uint32_t>( 31 ) );
+
+    QCOMPARE( JointHistogram::binsFromName( "64" ), static_cast<uint32_t>( 64 ) );
+    QVERIFY_EXCEPTION_THROWN( JointHistogram::binsFromName( "48" ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( JointHistogram( tool, 128 ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( JointHistogram( tool, 0 ), std::invalid_argument );
+}
@@ -0,0 +1,35 @@
+#ifndef TEST_JOINT_HISTOGRAM_H
+#define TEST_JOINT_HISTOGRAM_H
+
+#include <QtTest>
+#include <map>
+#include <vector>
+#include "../src/histogram_tool.h"
+#include "../src/joint_histogram.h"
+
+class TestJointHistogram : public QObject {
+    Q_OBJECT
+
+private:
+    // Noise of the given format in a padded buffer, with the colour of each pixel as ARGB32 and a colour table for Indexed8
+    static ImageView makeNoiseView( uint32_t width, uint32_t height, PixelFormat format, std::vector<uint8_t>& buffer,
+                                    std::vector<uint32_t>& colours, std::vector<uint32_t>& colourTable );
+
+    // Counts of each key when every colour is counted one at a time
+    static std::map<uint32_t, uint64_t> countColours( const JointHistogram& joint, const std::vector<uint32_t>& colours );
+
+private slots:
+    // When counted densely or sparsely in any format and number of bins, every bin matches counting pixel by pixel
+    void matchesPerPixelKeys( );
+
+    // When an image is counted twice, counts are added, and reset empties them
+    void addsUntilReset( );
+
+    // When neighbouring pixels are alike, runs are counted correctly across blocks and scanlines
+    void countsRuns( );
+
+    // When keys and bins are converted, they round trip; bad numbers of bins throw a std::invalid_argument
+    void keysAndBins( );
+};
+
+#endif // TEST_JOINT_HISTOGRAM_H
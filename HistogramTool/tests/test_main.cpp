@@ -2,13 +2,70 @@
 
 #include "test_histogram.h"
 #include "test_histogram_tool.h"
+#include "test_histogram_kernel.h"
+#include "test_rgb_accumulator.h"
+#include "test_worker_pool.h"
+#include "test_streaming_histogram.h"
+#include "test_batch_histogram.h"
+#include "test_mapped_raster.h"
+#include "test_fixed_histogram.h"
+#include "test_tiled_histogram.h"
+#include "test_region_histogram_index.h"
+#include "test_sampled_histogram.h"
+#include "test_trace.h"
+#include "test_histogram_writer.h"
+#include "test_numa_topology.h"
+#include "test_auto_tuner.h"
+#include "test_histogram_server.h"
+#include "test_histogram_job.h"
+#include "test_derived_channels.h"
+#include "test_joint_histogram.h"
+#include "test_histogram_stats.h"
 
 int main( int argc, char * argv[] ) {
     TestHistogram       t1;
     TestHistogramTool   t2;
+    TestHistogramKernel t3;
+    TestRgbAccumulator  t4;
+    TestWorkerPool      t5;
+    TestStreamingHistogram t6;
+    TestBatchHistogram  t7;
+    TestMappedRaster    t8;
+    TestFixedHistogram  t9;
+    TestTiledHistogram  t10;
+    TestRegionHistogramIndex t11;
+    TestSampledHistogram t12;
+    TestTrace           t13;
+    TestHistogramWriter t14;
+    TestNumaTopology    t15;
+    TestAutoTuner       t16;
+    TestHistogramServer t17;
+    TestHistogramJob    t18;
+    TestDerivedChannels t19;
+    TestJointHistogram  t20;
+    TestHistogramStats  t21;
 
     QTest::qExec( &t1 );
     QTest::qExec(&t2 );
+    QTest::qExec( &t3 );
+    QTest::qExec( &t4 );
+    QTest::qExec( &t5 );
+    QTest::qExec( &t6 );
+    QTest::qExec( &t7 );
+    QTest::qExec( &t8 );
+    QTest::qExec( &t9 );
+    QTest::qExec( &t10 );
+    QTest::qExec( &t11 );
+    QTest::qExec( &t12 );
+    QTest::qExec( &t13 );
+    QTest::qExec( &t14 );
+    QTest::qExec( &t15 );
+    QTest::qExec( &t16 );
+    QTest::qExec( &t17 );
+    QTest::qExec( &t18 );
+    QTest::qExec( &t19 );
+    QTest::qExec( &t20 );
+    QTest::qExec( &t21 );
 
     return 0;
 }
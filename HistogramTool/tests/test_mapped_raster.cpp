@@ -0,0 +1,231 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <fstream>
+
+#include "test_mapped_raster.h"
+
+void TestMappedRaster::writeFile( const std::string& fileName, const std::string& bytes ) const {
+    std::ofstream file{ fileName, std::ios::binary };
+    file.write( bytes.data(), static_cast<std::streamsize>( bytes.size() ) );
+}
+
+QRgb TestMappedRaster::colourAt( uint32_t x, uint32_t y ) const {
+    return qRgb( static_cast<int>( x * 40 ), static_cast<int>( y * 60 ), static_cast<int>( 200 - x - y ) );
+}
+
+void TestMappedRaster::checkHistogram( const MappedRaster& raster, uint32_t width, uint32_t height ) const {
+    QCOMPARE( raster.view().width, width );
+    QCOMPARE( raster.view().height, height );
+
+    HistogramTool tool{1};
+    Histogram red, green, blue;
+    tool.computeHistogram( raster.view(), red, green, blue );
+
+    Histogram expectedRed, expectedGreen, expectedBlue;
+    for( uint32_t y = 0; y < height; y++ ) {
+        for( uint32_t x = 0; x < width; x++ ) {
+            expectedRed.increment( qRed( colourAt( x, y ) ) );
+            expectedGreen.increment( qGreen( colourAt( x, y ) ) );
+            expectedBlue.increment( qBlue( colourAt( x, y ) ) );
+        }
+    }
+
+    for( size_t i = 0; i < 256; i++ ) {
+        QCOMPARE( red[i], expectedRed[i] );
+        QCOMPARE( green[i], expectedGreen[i] );
+        QCOMPARE( blue[i], expectedBlue[i] );
+    }
+}
+
+// When a binary PPM with a comment is mapped, its pixels are counted
+void TestMappedRaster::mapsPpm( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "image.ppm" ).toStdString();
+
+    std::string bytes = "P6\n# made by a test\n5 3\n255\n";
+    for( uint32_t y = 0; y < 3; y++ ) {
+        for( uint32_t x = 0; x < 5; x++ ) {
+            bytes += static_cast<char>( qRed( colourAt( x, y ) ) );
+            bytes += static_cast<char>( qGreen( colourAt( x, y ) ) );
+            bytes += static_cast<char>( qBlue( colourAt( x, y ) ) );
+        }
+    }
+    writeFile( fileName, bytes );
+
+    QVERIFY( MappedRaster::isMappable( fileName ) );
+    MappedRaster raster;
+    QVERIFY( raster.open( fileName ) );
+    QVERIFY( raster.view().format == PixelFormat::RGB888 );
+    checkHistogram( raster, 5, 3 );
+}
+
+// When a PAM of depth 4 is mapped, its pixels are counted as RGBA
+void TestMappedRaster::mapsPam( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "image.pam" ).toStdString();
+
+    std::string bytes = "P7\nWIDTH 4\nHEIGHT 2\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+    for( uint32_t y = 0; y < 2; y++ ) {
+        for( uint32_t x = 0; x < 4; x++ ) {
+            bytes += static_cast<char>( qRed( colourAt( x, y ) ) );
+            bytes += static_cast<char>( qGreen( colourAt( x, y ) ) );
+            bytes += static_cast<char>( qBlue( colourAt( x, y ) ) );
+            bytes += static_cast<char>( 128 );
+        }
+    }
+    writeFile( fileName, bytes );
+
+    MappedRaster raster;
+    QVERIFY( raster.open( fileName ) );
+    QVERIFY( raster.view().format == PixelFormat::RGBA8888 );
+    checkHistogram( raster, 4, 2 );
+}
+
+// Build a BMP of width x height at the given depth, bottom up, with an optional palette
+static std::string makeBmp( uint32_t width, uint32_t height, uint16_t bitsPerPixel, const std::string& palette, const std::string& pixels ) {
+    auto u32 = []( uint32_t v ) {
+        std::string s;
+        for( int i = 0; i < 4; i++ ) {
+            s += static_cast<char>( ( v >> ( 8 * i ) ) & 0xFF );
+        }
+        return s;
+    };
+    auto u16 = []( uint16_t v ) {
+        return std::string{ static_cast<char>( v & 0xFF ), static_cast<char>( v >> 8 ) };
+    };
+
+    uint32_t pixelOffset = 14 + 40 + static_cast<uint32_t>( palette.size() );
+    std::string bytes = "BM" + u32( pixelOffset + static_cast<uint32_t>( pixels.size() ) ) + u32( 0 ) + u32( pixelOffset );
+    bytes += u32( 40 ) + u32( width ) + u32( height ) + u16( 1 ) + u16( bitsPerPixel ) + u32( 0 )
+           + u32( static_cast<uint32_t>( pixels.size() ) ) + u32( 2835 ) + u32( 2835 )
+           + u32( static_cast<uint32_t>( palette.size() / 4 ) ) + u32( 0 );
+    return bytes + palette + pixels;
+}
+
+// When a bottom up 24 bit BMP is mapped, the view starts at the top scanline and skips the padding
+void TestMappedRaster::mapsBottomUpBmp( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "image.bmp" ).toStdString();
+
+    // 5 pixels of 3 bytes is padded to 16 bytes per scanline. Padding is filled with 0xFF to be noticed
+    std::string pixels;
+    for( uint32_t row = 0; row < 3; row++ ) {
+        uint32_t y = 2 - row;
+        for( uint32_t x = 0; x < 5; x++ ) {
+            pixels += static_cast<char>( qBlue( colourAt( x, y ) ) );
+            pixels += static_cast<char>( qGreen( colourAt( x, y ) ) );
+            pixels += static_cast<char>( qRed( colourAt( x, y ) ) );
+        }
+        pixels += std::string( 1, static_cast<char>( 0xFF ) );
+    }
+    writeFile( fileName, makeBmp( 5, 3, 24, "", pixels ) );
+
+    MappedRaster raster;
+    QVERIFY( raster.open( fileName ) );
+    QVERIFY( raster.view().format == PixelFormat::BGR888 );
+    QVERIFY( raster.view().bytesPerLine == -16 );
+
+    // First scanline of the view is the top of the image, the last in the file
+    const uint8_t *top = raster.view().row( 0 );
+    QCOMPARE( static_cast<int>( top[2] ), qRed( colourAt( 0, 0 ) ) );
+    QCOMPARE( static_cast<int>( top[1] ), qGreen( colourAt( 0, 0 ) ) );
+
+    checkHistogram( raster, 5, 3 );
+}
+
+// When an 8 bit BMP is mapped, pixels are counted through its palette
+void TestMappedRaster::mapsPalettedBmp( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "paletted.bmp" ).toStdString();
+
+    // One palette entry per pixel, in B, G, R, 0 order
+    std::string palette;
+    for( uint32_t y = 0; y < 2; y++ ) {
+        for( uint32_t x = 0; x < 3; x++ ) {
+            palette += static_cast<char>( qBlue( colourAt( x, y ) ) );
+            palette += static_cast<char>( qGreen( colourAt( x, y ) ) );
+            palette += static_cast<char>( qRed( colourAt( x, y ) ) );
+            palette += '\0';
+        }
+    }
+
+    // 3 pixels padded to 4 bytes per scanline, bottom up
+    std::string pixels;
+    for( uint32_t row = 0; row < 2; row++ ) {
+        uint32_t y = 1 - row;
+        for( uint32_t x = 0; x < 3; x++ ) {
+            pixels += static_cast<char>( y * 3 + x );
+        }
+        pixels += '\0';
+    }
+    writeFile( fileName, makeBmp( 3, 2, 8, palette, pixels ) );
+
+    MappedRaster raster;
+    QVERIFY( raster.open( fileName ) );
+    QVERIFY( raster.view().format == PixelFormat::Indexed8 );
+    QCOMPARE( raster.view().colourCount, static_cast<uint32_t>( 6 ) );
+    checkHistogram( raster, 3, 2 );
+}
+
+// When raw data with padded scanlines is mapped, only the pixels are counted
+void TestMappedRaster::mapsRawWithStride( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "image.raw" ).toStdString();
+
+    // 3 RGBA pixels in a 16 byte stride
+    std::string bytes;
+    for( uint32_t y = 0; y < 4; y++ ) {
+        for( uint32_t x = 0; x < 3; x++ ) {
+            bytes += static_cast<char>( qRed( colourAt( x, y ) ) );
+            bytes += static_cast<char>( qGreen( colourAt( x, y ) ) );
+            bytes += static_cast<char>( qBlue( colourAt( x, y ) ) );
+            bytes += static_cast<char>( 255 );
+        }
+        bytes += std::string( 4, static_cast<char>( 0xFF ) );
+    }
+    writeFile( fileName, bytes );
+
+    MappedRaster raster;
+    QVERIFY( raster.openRaw( fileName, 3, 4, 16 ) );
+    QCOMPARE( raster.mappedBytes(), static_cast<size_t>( 64 ) );
+    checkHistogram( raster, 3, 4 );
+
+    // One scanline too many
+    QVERIFY( ! raster.openRaw( fileName, 3, 5, 16 ) );
+    QVERIFY( ! raster.errorString().empty() );
+}
+
+// When the file is shorter than its header says, open fails
+void TestMappedRaster::rejectsTruncatedFile( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "short.ppm" ).toStdString();
+    writeFile( fileName, "P6 100 100 255\n" + std::string( 300, 'x' ) );
+
+    MappedRaster raster;
+    QVERIFY( ! raster.open( fileName ) );
+    QVERIFY( raster.errorString().find( "too small" ) != std::string::npos );
+    QCOMPARE( raster.mappedBytes(), static_cast<size_t>( 0 ) );
+}
+
+// When the PPM is 16 bit, open fails
+void TestMappedRaster::rejectsSixteenBitPpm( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "deep.ppm" ).toStdString();
+    writeFile( fileName, "P6 1 1 65535\n" + std::string( 6, 'x' ) );
+
+    MappedRaster raster;
+    QVERIFY( ! raster.open( fileName ) );
+}
+
+// When the file is not a raster, it is not mappable
+void TestMappedRaster::otherFilesNotMappable( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "text.txt" ).toStdString();
+    writeFile( fileName, "hello" );
+
+    QVERIFY( ! MappedRaster::isMappable( fileName ) );
+    QVERIFY( ! MappedRaster::isMappable( dir.filePath( "missing.ppm" ).toStdString() ) );
+
+    MappedRaster raster;
+    QVERIFY( ! raster.open( fileName ) );
+}
@@ -0,0 +1,49 @@
+#ifndef TEST_MAPPED_RASTER_H
+#define TEST_MAPPED_RASTER_H
+
+#include <QtTest>
+#include <string>
+#include <vector>
+#include "../src/mapped_raster.h"
+#include "../src/histogram_tool.h"
+
+class TestMappedRaster : public QObject {
+    Q_OBJECT
+
+private:
+    // Write bytes to a file
+    void writeFile( const std::string& fileName, const std::string& bytes ) const;
+
+    // Colour of pixel (x, y) in the test images
+    QRgb colourAt( uint32_t x, uint32_t y ) const;
+
+    // Check that the histogram of a mapped raster matches width x height pixels of colourAt()
+    void checkHistogram( const MappedRaster& raster, uint32_t width, uint32_t height ) const;
+
+private slots:
+    // When a binary PPM with a comment is mapped, its pixels are counted
+    void mapsPpm( );
+
+    // When a PAM of depth 4 is mapped, its pixels are counted as RGBA
+    void mapsPam( );
+
+    // When a bottom up 24 bit BMP is mapped, the view starts at the top scanline and skips the padding
+    void mapsBottomUpBmp( );
+
+    // When an 8 bit BMP is mapped, pixels are counted through its palette
+    void mapsPalettedBmp( );
+
+    // When raw data with padded scanlines is mapped, only the pixels are counted
+    void mapsRawWithStride( );
+
+    // When the file is shorter than its header says, open fails
+    void rejectsTruncatedFile( );
+
+    // When the PPM is 16 bit, open fails
+    void rejectsSixteenBitPpm( );
+
+    // When the file is not a raster, it is not mappable
+    void otherFilesNotMappable( );
+};
+
+#endif // TEST_MAPPED_RASTER_H
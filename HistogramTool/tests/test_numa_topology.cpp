@@ -0,0 +1,126 @@
+#include <QtTest>
+
+#include "test_numa_topology.h"
+
+void TestNumaTopology::checkMatchesPlain( const NumaTopology& topology, uint32_t numThreads, uint32_t chunkRows ) const {
+    const uint32_t width = 101, height = 257;
+    std::vector<uint8_t> pixels( static_cast<size_t>( width ) * height * 4 );
+    for( size_t i = 0; i < pixels.size(); ++i ) {
+        pixels[i] = static_cast<uint8_t>( ( i * 131 ) ^ ( i >> 7 ) );
+    }
+    ImageView image{ pixels.data(), width, height, width * 4, PixelFormat::RGBA8888 };
+
+    HistogramTool plain{ numThreads };
+    plain.setMinPixelsPerThread( 1 );
+    plain.setChunkRows( chunkRows );
+    Histogram red, green, blue;
+    plain.computeHistogram( image, red, green, blue );
+
+    HistogramTool numa{ numThreads };
+    numa.setMinPixelsPerThread( 1 );
+    numa.setChunkRows( chunkRows );
+    numa.setNumaTopology( topology );
+    QVERIFY( numa.numaAware() );
+
+    // Twice, as the counts are reused
+    for( int pass = 0; pass < 2; ++pass ) {
+        Histogram numaRed, numaGreen, numaBlue;
+        numa.computeHistogram( image, numaRed, numaGreen, numaBlue );
+        for( size_t i = 0; i < 256; ++i ) {
+            QCOMPARE( numaRed[i], red[i] );
+            QCOMPARE( numaGreen[i], green[i] );
+            QCOMPARE( numaBlue[i], blue[i] );
+        }
+    }
+
+    uint32_t chunks = 0;
+    for( uint32_t done : numa.chunksPerThread() ) {
+        chunks += done;
+    }
+    QCOMPARE( chunks, ( height + chunkRows - 1 ) / chunkRows );
+}
+
+// When a CPU list has single CPUs and ranges, every CPU is listed once, ascending
+void TestNumaTopology::parsesCpuLists( ) {
+    std::vector<uint32_t> cpus;
+    QVERIFY( NumaTopology::parseCpuList( "8,0-3, 10-11,2\n", cpus ) );
+    QVERIFY( cpus == ( std::vector<uint32_t>{ 0, 1, 2, 3, 8, 10, 11 } ) );
+
+    QVERIFY( NumaTopology::parseCpuList( "", cpus ) );
+    QVERIFY( cpus.empty() );
+}
+
+// When a CPU list is malformed, parsing fails
+void TestNumaTopology::rejectsBadCpuLists( ) {
+    std::vector<uint32_t> cpus{ 5 };
+    QVERIFY( ! NumaTopology::parseCpuList( "3-1", cpus ) );
+    QVERIFY( ! NumaTopology::parseCpuList( "a", cpus ) );
+    QVERIFY( ! NumaTopology::parseCpuList( "1-", cpus ) );
+    QVERIFY( cpus == std::vector<uint32_t>{ 5 } );
+}
+
+// When nodes are given, CPUs are found in their node and spread takes one from each node in turn
+void TestNumaTopology::spreadsCpusOverNodes( ) {
+    NumaTopology topology{ { { 0, 1, 2 }, { 4, 3 } }, { 0, 2 } };
+    QCOMPARE( topology.numNodes(), static_cast<uint32_t>( 2 ) );
+    QCOMPARE( topology.nodeOfCpu( 1 ), static_cast<uint32_t>( 0 ) );
+    QCOMPARE( topology.nodeOfCpu( 3 ), static_cast<uint32_t>( 1 ) );
+    QCOMPARE( topology.nodeFromSystem( 2 ), static_cast<uint32_t>( 1 ) );
+    QCOMPARE( topology.nodeFromSystem( 1 ), static_cast<uint32_t>( 2 ) );
+    QCOMPARE( topology.nodeFromSystem( -1 ), static_cast<uint32_t>( 2 ) );
+    QVERIFY( topology.cpusOf( 1 ) == ( std::vector<uint32_t>{ 3, 4 } ) );
+    QVERIFY( topology.spreadCpus() == ( std::vector<uint32_t>{ 0, 3, 1, 4, 2 } ) );
+    QVERIFY_EXCEPTION_THROWN( topology.cpusOf( 2 ), std::invalid_argument );
+}
+
+// When a node has no CPUs or a CPU is in two nodes, throws a std::invalid_argument
+void TestNumaTopology::constructWithBadNodes( ) {
+    typedef std::vector<std::vector<uint32_t>> Nodes;
+    QVERIFY_EXCEPTION_THROWN( NumaTopology( Nodes{} ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( NumaTopology( Nodes{ { 0 }, {} } ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( NumaTopology( Nodes{ { 0, 1 }, { 1 } } ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( NumaTopology( Nodes{ { 0 } }, { 0, 1 } ), std::invalid_argument );
+}
+
+// When detected, there is at least one node and every CPU belongs to one
+void TestNumaTopology::detectsThisMachine( ) {
+    NumaTopology topology = NumaTopology::detect();
+    QVERIFY( topology.numNodes() >= 1 );
+    size_t numCpus = 0;
+    for( uint32_t node = 0; node < topology.numNodes(); ++node ) {
+        QVERIFY( ! topology.cpusOf( node ).empty() );
+        for( uint32_t cpu : topology.cpusOf( node ) ) {
+            QCOMPARE( topology.nodeOfCpu( cpu ), node );
+        }
+        numCpus += topology.cpusOf( node ).size();
+    }
+    QCOMPARE( topology.spreadCpus().size(), numCpus );
+}
+
+// When pages have been touched, their nodes are found or the system says it can't tell
+void TestNumaTopology::findsNodesOfPages( ) {
+    std::vector<uint8_t> memory( 1 << 20, 1 );
+    std::vector<const void *> addresses{ memory.data(), memory.data() + memory.size() / 2 };
+    std::vector<int> nodes;
+    if( NumaTopology::nodesOfPages( addresses, nodes ) ) {
+        QCOMPARE( nodes.size(), addresses.size() );
+        NumaTopology topology = NumaTopology::detect();
+        for( int node : nodes ) {
+            QVERIFY( node < 0 || topology.nodeFromSystem( node ) < topology.numNodes() );
+        }
+    } else {
+        QVERIFY( nodes.empty() );
+    }
+}
+
+// When the tool is NUMA aware with one or more nodes, histograms match those counted without
+void TestNumaTopology::numaCountsMatch( ) {
+    checkMatchesPlain( NumaTopology::detect(), 4, 3 );
+    checkMatchesPlain( NumaTopology{ { { 0 } } }, 1, 16 );
+
+    // Pretend nodes; the pages are on none of them so chunks are shared out and tasks steal
+    NumaTopology fake{ { { 0 }, { 1 }, { 2 } }, { 100, 101, 102 } };
+    checkMatchesPlain( fake, 2, 5 );
+    checkMatchesPlain( fake, 5, 1 );
+    checkMatchesPlain( fake, 7, 300 );
+}
@@ -0,0 +1,39 @@
+#ifndef TEST_NUMA_TOPOLOGY_H
+#define TEST_NUMA_TOPOLOGY_H
+
+#include <QtTest>
+#include <vector>
+#include "../src/numa_topology.h"
+#include "../src/histogram_tool.h"
+
+class TestNumaTopology : public QObject {
+    Q_OBJECT
+
+private:
+    // Check that a NUMA aware tool gives the same histogram as a plain one
+    void checkMatchesPlain( const NumaTopology& topology, uint32_t numThreads, uint32_t chunkRows ) const;
+
+private slots:
+    // When a CPU list has single CPUs and ranges, every CPU is listed once, ascending
+    void parsesCpuLists( );
+
+    // When a CPU list is malformed, parsing fails
+    void rejectsBadCpuLists( );
+
+    // When nodes are given, CPUs are found in their node and spread takes one from each node in turn
+    void spreadsCpusOverNodes( );
+
+    // When a node has no CPUs or a CPU is in two nodes, throws a std::invalid_argument
+    void constructWithBadNodes( );
+
+    // When detected, there is at least one node and every CPU belongs to one
+    void detectsThisMachine( );
+
+    // When pages have been touched, their nodes are found or the system says it can't tell
+    void findsNodesOfPages( );
+
+    // When the tool is NUMA aware with one or more nodes, histograms match those counted without
+    void numaCountsMatch( );
+};
+
+#endif // TEST_NUMA_TOPOLOGY_H
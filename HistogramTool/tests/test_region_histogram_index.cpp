@@ -0,0 +1,123 @@
+#include <QtTest>
+
+#include "test_region_histogram_index.h"
+
+std::vector<uint8_t> TestRegionHistogramIndex::makePixels( uint32_t width, uint32_t height, uint32_t bytesPerPixel ) const {
+    std::vector<uint8_t> pixels( static_cast<size_t>( width ) * height * bytesPerPixel );
+    for( size_t i = 0; i < pixels.size(); i++ ) {
+        pixels[i] = static_cast<uint8_t>( ( i * 131 ) ^ ( i >> 7 ) );
+    }
+    return pixels;
+}
+
+std::vector<Rect> TestRegionHistogramIndex::makeRects( uint32_t width, uint32_t height ) const {
+    std::vector<Rect> rects = {
+        Rect{ 0, 0, width, height },
+        Rect{ 0, 0, 16, 16 },
+        Rect{ 3, 5, 40, 33 },
+        Rect{ 17, 1, 1, height - 1 },
+        Rect{ 9, 9, 0, 0 },
+        Rect{ width - 21, height - 13, 21, 13 }
+    };
+    for( uint32_t i = 0; i < 20; i++ ) {
+        uint32_t x = ( i * 37 ) % width;
+        uint32_t y = ( i * 53 ) % height;
+        rects.push_back( Rect{ x, y, ( i * 71 ) % ( width - x ) + 1, ( i * 29 ) % ( height - y ) + 1 } );
+    }
+    return rects;
+}
+
+void TestRegionHistogramIndex::checkRects( const ImageView& image, uint32_t blockSize ) const {
+    HistogramTool tool{3};
+    RegionHistogramIndex index{ tool, blockSize };
+    index.build( image );
+
+    for( const Rect& rect : makeRects( image.width, image.height ) ) {
+        Histogram red, green, blue;
+        index.query( rect, red, green, blue );
+
+        Histogram expectedRed, expectedGreen, expectedBlue;
+        tool.computeHistogram( image.subView( rect ), expectedRed, expectedGreen, expectedBlue );
+
+        for( uint32_t i = 0; i < 256; i++ ) {
+            QCOMPARE( red[i], expectedRed[i] );
+            QCOMPARE( green[i], expectedGreen[i] );
+            QCOMPARE( blue[i], expectedBlue[i] );
+        }
+        QCOMPARE( red.total(), rect.numPixels() );
+    }
+}
+
+// When rectangles of an ARGB32 image are queried, the histograms match counting their pixels
+void TestRegionHistogramIndex::argb32RegionsMatch( ) {
+    std::vector<uint8_t> pixels = makePixels( 128, 96, 4 );
+    ImageView image{ pixels.data(), 128, 96, 128 * 4, PixelFormat::ARGB32 };
+    checkRects( image, 16 );
+}
+
+// When rectangles of a Grayscale8 image with partial blocks are queried, the histograms match counting their pixels
+void TestRegionHistogramIndex::grayscaleRegionsMatch( ) {
+    std::vector<uint8_t> pixels = makePixels( 101, 77, 1 );
+    ImageView image{ pixels.data(), 101, 77, 101, PixelFormat::Grayscale8 };
+    checkRects( image, 8 );
+}
+
+// When rectangles are queried in a batch, each result matches the single query
+void TestRegionHistogramIndex::batchMatchesSingleQueries( ) {
+    std::vector<uint8_t> pixels = makePixels( 90, 70, 3 );
+    ImageView image{ pixels.data(), 90, 70, 90 * 3, PixelFormat::RGB888 };
+
+    HistogramTool tool{4};
+    RegionHistogramIndex index{ tool, 16 };
+    index.build( image );
+
+    std::vector<Rect> rects = makeRects( 90, 70 );
+    std::vector<RegionHistogram> results = index.query( rects );
+    QCOMPARE( results.size(), rects.size() );
+
+    for( size_t r = 0; r < rects.size(); r++ ) {
+        Histogram red, green, blue;
+        index.query( rects[r], red, green, blue );
+        for( uint32_t i = 0; i < 256; i++ ) {
+            QCOMPARE( results[r].red[i], red[i] );
+            QCOMPARE( results[r].green[i], green[i] );
+            QCOMPARE( results[r].blue[i], blue[i] );
+        }
+    }
+}
+
+// When a rectangle extends past the image, throws a std::invalid_argument
+void TestRegionHistogramIndex::rectOutsideImage( ) {
+    std::vector<uint8_t> pixels = makePixels( 20, 20, 4 );
+    ImageView image{ pixels.data(), 20, 20, 80, PixelFormat::ARGB32 };
+
+    HistogramTool tool{1};
+    RegionHistogramIndex index{ tool, 4 };
+    index.build( image );
+
+    Histogram red, green, blue;
+    QVERIFY_EXCEPTION_THROWN( index.query( Rect{ 10, 0, 11, 5 }, red, green, blue ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( index.query( std::vector<Rect>{ Rect{ 0, 0, 1, 1 }, Rect{ 0, 19, 1, 2 } } ), std::invalid_argument );
+}
+
+// When the block size is 0, throws a std::invalid_argument
+void TestRegionHistogramIndex::constructWithZeroBlockSize( ) {
+    HistogramTool tool{1};
+    QVERIFY_EXCEPTION_THROWN( RegionHistogramIndex( tool, 0 ), std::invalid_argument );
+}
+
+// When a memory budget is given, the index of the chosen block size fits within it
+void TestRegionHistogramIndex::blockSizeFitsBudget( ) {
+    std::vector<uint8_t> pixels = makePixels( 300, 200, 1 );
+    ImageView image{ pixels.data(), 300, 200, 300, PixelFormat::Grayscale8 };
+    const size_t budget = 300 * 1024;
+
+    uint32_t blockSize = RegionHistogramIndex::blockSizeFor( 300, 200, budget );
+    QCOMPARE( blockSize, static_cast<uint32_t>( 32 ) );
+
+    HistogramTool tool{1};
+    RegionHistogramIndex index{ tool, blockSize };
+    index.build( image );
+    QVERIFY( index.memoryBytes() <= budget );
+    QVERIFY( RegionHistogramIndex::blockSizeFor( 300, 200, budget / 2 ) > blockSize );
+}
@@ -0,0 +1,41 @@
+#ifndef TEST_REGION_HISTOGRAM_INDEX_H
+#define TEST_REGION_HISTOGRAM_INDEX_H
+
+#include <QtTest>
+#include <vector>
+#include "../src/region_histogram_index.h"
+
+class TestRegionHistogramIndex : public QObject {
+    Q_OBJECT
+
+private:
+    // Fill an image of the given size and bytes per pixel with a pattern
+    std::vector<uint8_t> makePixels( uint32_t width, uint32_t height, uint32_t bytesPerPixel ) const;
+
+    // A spread of rectangles within an image: aligned, unaligned, thin, empty and the whole image
+    std::vector<Rect> makeRects( uint32_t width, uint32_t height ) const;
+
+    // Check that each rectangle's histogram from the index matches counting its pixels directly
+    void checkRects( const ImageView& image, uint32_t blockSize ) const;
+
+private slots:
+    // When rectangles of an ARGB32 image are queried, the histograms match counting their pixels
+    void argb32RegionsMatch( );
+
+    // When rectangles of a Grayscale8 image with partial blocks are queried, the histograms match counting their pixels
+    void grayscaleRegionsMatch( );
+
+    // When rectangles are queried in a batch, each result matches the single query
+    void batchMatchesSingleQueries( );
+
+    // When a rectangle extends past the image, throws a std::invalid_argument
+    void rectOutsideImage( );
+
+    // When the block size is 0, throws a std::invalid_argument
+    void constructWithZeroBlockSize( );
+
+    // When a memory budget is given, the index of the chosen block size fits within it
+    void blockSizeFitsBudget( );
+};
+
+#endif // TEST_REGION_HISTOGRAM_INDEX_H
@@ -0,0 +1,72 @@
+#include <QtTest>
+
+#include "test_rgb_accumulator.h"
+
+// When constructed, all counts are zero
+void TestRgbAccumulator::constructEmpty( ) {
+    RgbAccumulator acc;
+
+    for( int c=0; c<RgbAccumulator::NumChannels; c++ ) {
+        for( size_t i=0; i<256; i++ ) {
+            QCOMPARE( acc.counts( static_cast<RgbAccumulator::Channel>( c ) )[i], static_cast<uint32_t>( 0 ) );
+        }
+    }
+}
+
+// When accumulators are added, every channel's counts are summed
+void TestRgbAccumulator::addAccumulators( ) {
+    RgbAccumulator a, b;
+
+    for( int c=0; c<RgbAccumulator::NumChannels; c++ ) {
+        for( size_t i=0; i<256; i++ ) {
+            a.counts( static_cast<RgbAccumulator::Channel>( c ) )[i] = static_cast<uint32_t>( i );
+            b.counts( static_cast<RgbAccumulator::Channel>( c ) )[i] = static_cast<uint32_t>( c );
+        }
+    }
+
+    a += b;
+
+    for( int c=0; c<RgbAccumulator::NumChannels; c++ ) {
+        for( size_t i=0; i<256; i++ ) {
+            QCOMPARE( a.counts( static_cast<RgbAccumulator::Channel>( c ) )[i], static_cast<uint32_t>( i + c ) );
+        }
+    }
+}
+
+// When added to Histograms, red, green and blue counts are transferred
+void TestRgbAccumulator::addToHistograms( ) {
+    RgbAccumulator acc;
+    acc.counts( RgbAccumulator::Red )[1] = 10;
+    acc.counts( RgbAccumulator::Green )[2] = 20;
+    acc.counts( RgbAccumulator::Blue )[3] = 30;
+    acc.counts( RgbAccumulator::Alpha )[4] = 40;
+
+    Histogram red, green, blue;
+    red.increment( 1 );
+    acc.addTo( red, green, blue );
+
+    QCOMPARE( red[1], static_cast<uint64_t>( 11 ) );
+    QCOMPARE( green[2], static_cast<uint64_t>( 20 ) );
+    QCOMPARE( blue[3], static_cast<uint64_t>( 30 ) );
+    QCOMPARE( red.total() + green.total() + blue.total(), static_cast<uint64_t>( 61 ) );
+}
+
+// When added to Histograms without 256 buckets, throws a std::invalid_argument
+void TestRgbAccumulator::addToWrongSizedHistograms( ) {
+    RgbAccumulator acc;
+    Histogram red{10}, green, blue;
+
+    QVERIFY_EXCEPTION_THROWN( acc.addTo( red, green, blue ), std::invalid_argument );
+}
+
+// When allocated as an array, each accumulator starts on its own cache line
+void TestRgbAccumulator::arrayIsCacheAligned( ) {
+    RgbAccumulatorArray accumulators{ 5 };
+
+    QCOMPARE( accumulators.size(), static_cast<size_t>( 5 ) );
+    for( size_t i=0; i<accumulators.size(); i++ ) {
+        uintptr_t address = reinterpret_cast<uintptr_t>( &accumulators[i] );
+        QCOMPARE( address % RgbAccumulator::CACHE_LINE_SIZE, static_cast<uintptr_t>( 0 ) );
+        QCOMPARE( accumulators[i].counts( RgbAccumulator::Blue )[255], static_cast<uint32_t>( 0 ) );
+    }
+}
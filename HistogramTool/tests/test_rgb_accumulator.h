@@ -0,0 +1,27 @@
+#ifndef TEST_RGB_ACCUMULATOR_H
+#define TEST_RGB_ACCUMULATOR_H
+
+#include <QtTest>
+#include "../src/rgb_accumulator.h"
+
+class TestRgbAccumulator : public QObject {
+    Q_OBJECT
+
+private slots:
+    // When constructed, all counts are zero
+    void constructEmpty( );
+
+    // When accumulators are added, every channel's counts are summed
+    void addAccumulators( );
+
+    // When added to Histograms, red, green and blue counts are transferred
+    void addToHistograms( );
+
+    // When added to Histograms without 256 buckets, throws a std::invalid_argument
+    void addToWrongSizedHistograms( );
+
+    // When allocated as an array, each accumulator starts on its own cache line
+    void arrayIsCacheAligned( );
+};
+
+#endif // TEST_RGB_ACCUMULATOR_H
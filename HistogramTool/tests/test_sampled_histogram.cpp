@@ -0,0 +1,142 @@
+#include <QtTest>
+
+#include "test_sampled_histogram.h"
+
+std::vector<uint8_t> TestSampledHistogram::makeNoise( uint32_t width, uint32_t height ) const {
+    std::vector<uint8_t> pixels( static_cast<size_t>( width ) * height * 3 );
+    uint32_t state = 12345;
+    for( size_t i = 0; i < pixels.size(); i++ ) {
+        state = state * 1664525 + 1013904223;
+        // Skew the values so buckets hold very different counts
+        uint32_t value = state >> 24;
+        pixels[i] = static_cast<uint8_t>( ( value * value ) >> 8 );
+    }
+    return pixels;
+}
+
+// When the whole image is sampled, the estimate is exact and the intervals are closed on it
+void TestSampledHistogram::fullFractionIsExact( ) {
+    std::vector<uint8_t> pixels = makeNoise( 100, 60 );
+    ImageView image{ pixels.data(), 100, 60, 300, PixelFormat::RGB888 };
+
+    HistogramTool tool{2};
+    Histogram red, green, blue;
+    tool.computeHistogram( image, red, green, blue );
+
+    SampledHistogram sampler{ tool };
+    Histogram sampledRed, sampledGreen, sampledBlue;
+    sampler.compute( image, 1.0, sampledRed, sampledGreen, sampledBlue );
+    QCOMPARE( sampler.numSamples(), static_cast<uint64_t>( 6000 ) );
+
+    Histogram lower, upper;
+    sampler.interval( RgbAccumulator::Green, lower, upper );
+    for( uint32_t i = 0; i < 256; i++ ) {
+        QCOMPARE( sampledRed[i], red[i] );
+        QCOMPARE( sampledBlue[i], blue[i] );
+        QCOMPARE( lower[i], green[i] );
+        QCOMPARE( upper[i], green[i] );
+    }
+}
+
+// When a jittered sample is taken, nearly every bucket's exact count lies within its interval
+void TestSampledHistogram::jitteredIntervalsHoldExactCounts( ) {
+    std::vector<uint8_t> pixels = makeNoise( 1024, 1024 );
+    ImageView image{ pixels.data(), 1024, 1024, 1024 * 3, PixelFormat::RGB888 };
+
+    HistogramTool tool{4};
+    Histogram red, green, blue;
+    tool.computeHistogram( image, red, green, blue );
+
+    SampledHistogram sampler{ tool, SampledHistogram::Method::Jittered };
+    Histogram sampledRed, sampledGreen, sampledBlue;
+    sampler.compute( image, 0.04, sampledRed, sampledGreen, sampledBlue );
+    QCOMPARE( sampler.numSamples(), static_cast<uint64_t>( 205 * 205 ) );
+
+    Histogram lower, upper;
+    sampler.interval( RgbAccumulator::Red, lower, upper );
+    uint32_t covered = 0;
+    for( uint32_t i = 0; i < 256; i++ ) {
+        QVERIFY( lower[i] <= sampledRed[i] && sampledRed[i] <= upper[i] );
+        if( lower[i] <= red[i] && red[i] <= upper[i] ) {
+            covered++;
+        }
+    }
+    // 95% intervals; allow for chance
+    QVERIFY( covered >= 230 );
+}
+
+// When a strided sample is taken, one pixel is read per cell and the estimates add up to the image
+void TestSampledHistogram::stridedSamplesEachCell( ) {
+    // Each pixel's grey level is its column, so the centres of 4 pixel cells are columns 2, 6, 10 ...
+    std::vector<uint8_t> pixels( 64 * 10 );
+    for( size_t i = 0; i < pixels.size(); i++ ) {
+        pixels[i] = static_cast<uint8_t>( i % 64 );
+    }
+    ImageView image{ pixels.data(), 64, 10, 64, PixelFormat::Grayscale8 };
+
+    HistogramTool tool{1};
+    SampledHistogram sampler{ tool, SampledHistogram::Method::Strided };
+    Histogram red, green, blue;
+    sampler.compute( image, 1.0 / 16, red, green, blue );
+
+    QCOMPARE( sampler.numSamples(), static_cast<uint64_t>( 16 * 3 ) );
+    // Three samples in each sampled column, each standing for 640 / 48 pixels
+    QCOMPARE( red[2], static_cast<uint64_t>( 40 ) );
+    QCOMPARE( red[3], static_cast<uint64_t>( 0 ) );
+    QCOMPARE( blue[62], static_cast<uint64_t>( 40 ) );
+    QCOMPARE( green.total(), static_cast<uint64_t>( 640 ) );
+}
+
+// When random tiles are sampled, about the fraction asked for is counted
+void TestSampledHistogram::randomTilesSampleFraction( ) {
+    std::vector<uint8_t> pixels = makeNoise( 2048, 1024 );
+    ImageView image{ pixels.data(), 2048, 1024, 2048 * 3, PixelFormat::RGB888 };
+
+    HistogramTool tool{3};
+    SampledHistogram sampler{ tool, SampledHistogram::Method::RandomTiles };
+    Histogram red, green, blue;
+    sampler.compute( image, 0.25, red, green, blue );
+
+    QCOMPARE( sampler.numSamples() % ( 64 * 64 ), static_cast<uint64_t>( 0 ) );
+    QVERIFY( sampler.sampledFraction() > 0.15 && sampler.sampledFraction() < 0.35 );
+
+    uint64_t total = red.total();
+    QVERIFY( total > 2048 * 1024 - 256 && total < 2048 * 1024 + 256 );
+}
+
+// When the number of threads changes, the same pixels are sampled
+void TestSampledHistogram::sameSampleForAnyThreads( ) {
+    std::vector<uint8_t> pixels = makeNoise( 500, 300 );
+    ImageView image{ pixels.data(), 500, 300, 1500, PixelFormat::RGB888 };
+
+    HistogramTool oneThread{1}, fourThreads{4};
+    SampledHistogram single{ oneThread }, several{ fourThreads };
+    Histogram red1, green1, blue1, red4, green4, blue4;
+    single.compute( image, 0.1, red1, green1, blue1 );
+    several.compute( image, 0.1, red4, green4, blue4 );
+
+    for( uint32_t i = 0; i < 256; i++ ) {
+        QCOMPARE( red4[i], red1[i] );
+        QCOMPARE( green4[i], green1[i] );
+        QCOMPARE( blue4[i], blue1[i] );
+    }
+}
+
+// When a target error is given, the fraction gives enough samples and is at most 1
+void TestSampledHistogram::fractionForTargetError( ) {
+    double fraction = SampledHistogram::fractionForError( 1000000, 0.01 );
+    QVERIFY( fraction > 0.0096 && fraction < 0.0097 );
+    QCOMPARE( SampledHistogram::fractionForError( 1000, 0.01 ), 1.0 );
+}
+
+// When the fraction or target error isn't positive, throws a std::invalid_argument
+void TestSampledHistogram::rejectsNonPositiveFraction( ) {
+    std::vector<uint8_t> pixels = makeNoise( 10, 10 );
+    ImageView image{ pixels.data(), 10, 10, 30, PixelFormat::RGB888 };
+
+    HistogramTool tool{1};
+    SampledHistogram sampler{ tool };
+    Histogram red, green, blue;
+    QVERIFY_EXCEPTION_THROWN( sampler.compute( image, 0, red, green, blue ), std::invalid_argument );
+    QVERIFY_EXCEPTION_THROWN( SampledHistogram::fractionForError( 100, 0 ), std::invalid_argument );
+}
@@ -0,0 +1,38 @@
+#ifndef TEST_SAMPLED_HISTOGRAM_H
+#define TEST_SAMPLED_HISTOGRAM_H
+
+#include <QtTest>
+#include <vector>
+#include "../src/sampled_histogram.h"
+
+class TestSampledHistogram : public QObject {
+    Q_OBJECT
+
+private:
+    // Fill an RGB888 image of the given size with noise
+    std::vector<uint8_t> makeNoise( uint32_t width, uint32_t height ) const;
+
+private slots:
+    // When the whole image is sampled, the estimate is exact and the intervals are closed on it
+    void fullFractionIsExact( );
+
+    // When a jittered sample is taken, nearly every bucket's exact count lies within its interval
+    void jitteredIntervalsHoldExactCounts( );
+
+    // When a strided sample is taken, one pixel is read per cell and the estimates add up to the image
+    void stridedSamplesEachCell( );
+
+    // When random tiles are sampled, about the fraction asked for is counted
+    void randomTilesSampleFraction( );
+
+    // When the number of threads changes, the same pixels are sampled
+    void sameSampleForAnyThreads( );
+
+    // When a target error is given, the fraction gives enough samples and is at most 1
+    void fractionForTargetError( );
+
+    // When the fraction or target error isn't positive, throws a std::invalid_argument
+    void rejectsNonPositiveFraction( );
+};
+
+#endif // TEST_SAMPLED_HISTOGRAM_H
@@ -0,0 +1,77 @@
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "test_streaming_histogram.h"
+
+QImage TestStreamingHistogram::makeImage( int width, int height ) const {
+    QImage image{ width, height, QImage::Format_RGB32 };
+    for( int y=0; y<height; y++ ) {
+        for( int x=0; x<width; x++ ) {
+            image.setPixelColor( x, y, QColor( y % 256, 0, 255 ) );
+        }
+    }
+    return image;
+}
+
+void TestStreamingHistogram::checkMatchesFullLoad( const QString& fileName, uint32_t bandRows, uint32_t minBands ) {
+    HistogramTool tool{2};
+
+    QImage whole;
+    QVERIFY( whole.load( fileName ) );
+    Histogram expectedRed, expectedGreen, expectedBlue;
+    tool.computeHistogram( whole.convertToFormat( QImage::Format_ARGB32 ), expectedRed, expectedGreen, expectedBlue );
+
+    StreamingHistogram stream{ tool, bandRows };
+    Histogram red, green, blue;
+    QVERIFY( stream.compute( fileName, red, green, blue ) );
+    QVERIFY( stream.numBands() >= minBands );
+
+    for( size_t i=0; i<256; i++ ) {
+        QCOMPARE( red[i], expectedRed[i] );
+        QCOMPARE( green[i], expectedGreen[i] );
+        QCOMPARE( blue[i], expectedBlue[i] );
+    }
+}
+
+// When a file which supports clipping is streamed, it is read in several bands
+void TestStreamingHistogram::streamsInBands( ) {
+    QTemporaryDir dir;
+    QString fileName = dir.filePath( "bands.jpg" );
+    QVERIFY( makeImage( 64, 100 ).save( fileName, "JPG", 100 ) );
+
+    if( ! StreamingHistogram::canStream( fileName ) ) {
+        QSKIP( "JPEG handler does not support clip rectangles" );
+    }
+
+    // 100 rows in bands of 16 is 7 bands, the last one short
+    checkMatchesFullLoad( fileName, 16, 7 );
+
+    HistogramTool tool{1};
+    StreamingHistogram stream{ tool, 16 };
+    Histogram red, green, blue;
+    QVERIFY( stream.compute( fileName, red, green, blue ) );
+    QCOMPARE( stream.numBands(), static_cast<uint32_t>( 7 ) );
+    QCOMPARE( red.total(), static_cast<uint64_t>( 64 * 100 ) );
+    QVERIFY( stream.peakBandBytes() <= static_cast<size_t>( 64 * 4 * 16 ) );
+}
+
+// When a file which doesn't support clipping is streamed, it is read in one band
+void TestStreamingHistogram::fallsBackToSingleBand( ) {
+    QTemporaryDir dir;
+    QString fileName = dir.filePath( "whole.bmp" );
+    QVERIFY( makeImage( 30, 40 ).save( fileName ) );
+
+    QVERIFY( ! StreamingHistogram::canStream( fileName ) );
+    checkMatchesFullLoad( fileName, 4, 1 );
+}
+
+// When the file doesn't exist, compute fails with an error
+void TestStreamingHistogram::missingFileFails( ) {
+    HistogramTool tool{1};
+    StreamingHistogram stream{ tool };
+    Histogram red, green, blue;
+
+    QVERIFY( ! stream.compute( "/no/such/image.jpg", red, green, blue ) );
+    QVERIFY( ! stream.errorString().empty() );
+    QCOMPARE( red.total(), static_cast<uint64_t>( 0 ) );
+}
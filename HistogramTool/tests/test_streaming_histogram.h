@@ -0,0 +1,28 @@
+#ifndef TEST_STREAMING_HISTOGRAM_H
+#define TEST_STREAMING_HISTOGRAM_H
+
+#include <QtTest>
+#include "../src/streaming_histogram.h"
+
+class TestStreamingHistogram : public QObject {
+    Q_OBJECT
+
+private:
+    // Build an image whose rows each have a distinct colour
+    QImage makeImage( int width, int height ) const;
+
+    // Check that streaming a file gives the same histogram as loading it whole
+    void checkMatchesFullLoad( const QString& fileName, uint32_t bandRows, uint32_t minBands );
+
+private slots:
+    // When a file which supports clipping is streamed, it is read in several bands
+    void streamsInBands( );
+
+    // When a file which doesn't support clipping is streamed, it is read in one band
+    void fallsBackToSingleBand( );
+
+    // When the file doesn't exist, compute fails with an error
+    void missingFileFails( );
+};
+
+#endif // TEST_STREAMING_HISTOGRAM_H
@@ -0,0 +1,122 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <fstream>
+
+#include "test_tiled_histogram.h"
+#include "../src/mapped_raster.h"
+
+std::vector<uint8_t> TestTiledHistogram::makePixels( uint32_t width, uint32_t height ) const {
+    std::vector<uint8_t> pixels( static_cast<size_t>( width ) * height * 3 );
+    for( size_t i = 0; i < pixels.size(); i++ ) {
+        pixels[i] = static_cast<uint8_t>( ( i * 37 ) ^ ( i >> 5 ) );
+    }
+    return pixels;
+}
+
+void TestTiledHistogram::checkBudget( const ImageView& image, size_t memoryBudget ) const {
+    HistogramTool tool{2};
+    Histogram red, green, blue;
+    tool.computeHistogram( image, red, green, blue );
+
+    TiledHistogram tiled{ tool, memoryBudget };
+    Histogram tiledRed, tiledGreen, tiledBlue;
+    tiled.compute( image, tiledRed, tiledGreen, tiledBlue );
+
+    for( uint32_t i = 0; i < 256; i++ ) {
+        QCOMPARE( tiledRed[i], red[i] );
+        QCOMPARE( tiledGreen[i], green[i] );
+        QCOMPARE( tiledBlue[i], blue[i] );
+    }
+    QCOMPARE( tiledRed.total(), image.numPixels() );
+}
+
+// When the memory budget holds several scanlines, tiles are whole scanlines and the histogram matches
+void TestTiledHistogram::bandsOfScanlinesMatch( ) {
+    std::vector<uint8_t> pixels = makePixels( 50, 23 );
+    ImageView image{ pixels.data(), 50, 23, 150, PixelFormat::RGB888 };
+
+    HistogramTool tool{1};
+    TiledHistogram tiled{ tool, 150 * 4 };
+    uint32_t tileWidth, tileRows;
+    tiled.tileSize( image, tileWidth, tileRows );
+    QCOMPARE( tileWidth, static_cast<uint32_t>( 50 ) );
+    QCOMPARE( tileRows, static_cast<uint32_t>( 4 ) );
+
+    checkBudget( image, 150 * 4 );
+}
+
+// When the memory budget is smaller than a scanline, scanlines are split and the histogram matches
+void TestTiledHistogram::partialScanlinesMatch( ) {
+    std::vector<uint8_t> pixels = makePixels( 50, 7 );
+    ImageView image{ pixels.data(), 50, 7, 150, PixelFormat::RGB888 };
+
+    HistogramTool tool{1};
+    TiledHistogram tiled{ tool, 64 };
+    uint32_t tileWidth, tileRows;
+    tiled.tileSize( image, tileWidth, tileRows );
+    QCOMPARE( tileWidth, static_cast<uint32_t>( 21 ) );
+    QCOMPARE( tileRows, static_cast<uint32_t>( 1 ) );
+
+    Histogram red, green, blue;
+    tiled.compute( image, red, green, blue );
+    QCOMPARE( tiled.numTiles(), static_cast<uint64_t>( 3 * 7 ) );
+
+    checkBudget( image, 64 );
+}
+
+// When the image is counted, every band is reported exactly once, in order
+void TestTiledHistogram::reportsEveryBand( ) {
+    std::vector<uint8_t> pixels = makePixels( 10, 11 );
+    ImageView image{ pixels.data(), 10, 11, 30, PixelFormat::RGB888 };
+
+    HistogramTool tool{1};
+    TiledHistogram tiled{ tool, 30 * 3 };
+    Histogram red, green, blue;
+    uint32_t nextRow = 0;
+    tiled.compute( image, red, green, blue, [&nextRow]( uint32_t firstRow, uint32_t numRows ) {
+        QCOMPARE( firstRow, nextRow );
+        nextRow += numRows;
+    } );
+
+    QCOMPARE( nextRow, static_cast<uint32_t>( 11 ) );
+    QCOMPARE( tiled.numTiles(), static_cast<uint64_t>( 4 ) );
+}
+
+// When the memory budget is 0, throws a std::invalid_argument
+void TestTiledHistogram::constructWithZeroBudget( ) {
+    HistogramTool tool{1};
+    QVERIFY_EXCEPTION_THROWN( TiledHistogram( tool, 0 ), std::invalid_argument );
+}
+
+// When a band of a mapped raster is released, its pixels can still be counted
+void TestTiledHistogram::releasedBandsStillReadable( ) {
+    QTemporaryDir dir;
+    std::string fileName = dir.filePath( "image.raw" ).toStdString();
+
+    // Tall enough that bands span several pages
+    std::vector<uint8_t> pixels = makePixels( 512, 64 );
+    {
+        std::ofstream file{ fileName, std::ios::binary };
+        file.write( reinterpret_cast<const char *>( pixels.data() ), static_cast<std::streamsize>( pixels.size() ) );
+    }
+
+    MappedRaster raster;
+    QVERIFY( raster.openRaw( fileName, 512, 64, 0, PixelFormat::RGB888 ) );
+
+    HistogramTool tool{2};
+    TiledHistogram tiled{ tool, 512 * 3 * 8 };
+    Histogram red, green, blue;
+    tiled.compute( raster.view(), red, green, blue, [&raster]( uint32_t firstRow, uint32_t numRows ) {
+        raster.release( firstRow, numRows );
+    } );
+
+    // Count again after every band has been released
+    Histogram againRed, againGreen, againBlue;
+    tool.computeHistogram( raster.view(), againRed, againGreen, againBlue );
+    for( uint32_t i = 0; i < 256; i++ ) {
+        QCOMPARE( againRed[i], red[i] );
+        QCOMPARE( againGreen[i], green[i] );
+        QCOMPARE( againBlue[i], blue[i] );
+    }
+    QCOMPARE( red.total(), static_cast<uint64_t>( 512 * 64 ) );
+}
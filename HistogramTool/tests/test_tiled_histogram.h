@@ -0,0 +1,35 @@
+#ifndef TEST_TILED_HISTOGRAM_H
+#define TEST_TILED_HISTOGRAM_H
+
+#include <QtTest>
+#include <vector>
+#include "../src/tiled_histogram.h"
+
+class TestTiledHistogram : public QObject {
+    Q_OBJECT
+
+private:
+    // Fill an RGB888 image of the given size with a pattern of colours
+    std::vector<uint8_t> makePixels( uint32_t width, uint32_t height ) const;
+
+    // Check that tiles of the given budget give the same histogram as counting the image whole
+    void checkBudget( const ImageView& image, size_t memoryBudget ) const;
+
+private slots:
+    // When the memory budget holds several scanlines, tiles are whole scanlines and the histogram matches
+    void bandsOfScanlinesMatch( );
+
+    // When the memory budget is smaller than a scanline, scanlines are split and the histogram matches
+    void partialScanlinesMatch( );
+
+    // When the image is counted, every band is reported exactly once, in order
+    void reportsEveryBand( );
+
+    // When the memory budget is 0, throws a std::invalid_argument
+    void constructWithZeroBudget( );
+
+    // When a band of a mapped raster is released, its pixels can still be counted
+    void releasedBandsStillReadable( );
+};
+
+#endif // TEST_TILED_HISTOGRAM_H
@@ -0,0 +1,140 @@
+#include <QtTest>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "test_trace.h"
+#include "../src/histogram_tool.h"
+
+// When a scope ends, one event is recorded with its name, pixels and a time within the scope
+void TestTrace::scopeRecordsEvent( ) {
+#ifdef HISTOGRAM_NO_TRACE
+    QSKIP( "Tracing is compiled out" );
+#endif
+    Trace trace;
+    uint64_t before = Trace::now();
+    {
+        TraceScope scope{ &trace, "phase", 10 };
+        scope.setPixels( 42 );
+    }
+    uint64_t after = Trace::now();
+
+    std::vector<TraceEvent> events = trace.events();
+    QCOMPARE( events.size(), static_cast<size_t>( 1 ) );
+    QCOMPARE( std::string{ events[0].name }, std::string{ "phase" } );
+    QCOMPARE( events[0].pixels, static_cast<uint64_t>( 42 ) );
+    QCOMPARE( events[0].thread, static_cast<uint32_t>( 0 ) );
+    QVERIFY( events[0].duration <= after - before );
+    QVERIFY( ! events[0].hasCounters );
+}
+
+// When a scope is given no trace, nothing is recorded and nothing fails
+void TestTrace::nullTraceIgnored( ) {
+    Trace trace;
+    {
+        TraceScope scope{ nullptr, "phase" };
+        scope.setPixels( 1 );
+    }
+    QVERIFY( trace.events().empty() );
+}
+
+// When a tool with a trace counts an image, each thread's scan and the merge are recorded and the
+// scans' pixels add up to the image
+void TestTrace::toolRecordsScans( ) {
+#ifdef HISTOGRAM_NO_TRACE
+    QSKIP( "Tracing is compiled out" );
+#endif
+    std::vector<uint8_t> pixels( 64 * 40 * 3, 7 );
+    ImageView image{ pixels.data(), 64, 40, 64 * 3, PixelFormat::RGB888 };
+
+    Trace trace;
+    HistogramTool tool{3};
+    tool.setMinPixelsPerThread( 1 );
+    tool.setChunkRows( 4 );
+    tool.setTrace( &trace );
+    QCOMPARE( tool.trace(), &trace );
+
+    Histogram red, green, blue;
+    tool.computeHistogram( image, red, green, blue );
+
+    uint64_t scans = 0, merges = 0, scannedPixels = 0;
+    for( const TraceEvent& event : trace.events() ) {
+        if( std::string{ event.name } == "scan" ) {
+            scans++;
+            scannedPixels += event.pixels;
+        } else if( std::string{ event.name } == "merge" ) {
+            merges++;
+        }
+    }
+    QCOMPARE( scans, static_cast<uint64_t>( 3 ) );
+    QCOMPARE( merges, static_cast<uint64_t>( 1 ) );
+    QCOMPARE( scannedPixels, image.numPixels() );
+
+    // No longer traced
+    tool.setTrace( nullptr );
+    trace.clear();
+    tool.computeHistogram( image, red, green, blue );
+    QVERIFY( trace.events().empty() );
+}
+
+// When scopes end on other threads, each thread gets its own small id
+void TestTrace::threadsGetIds( ) {
+#ifdef HISTOGRAM_NO_TRACE
+    QSKIP( "Tracing is compiled out" );
+#endif
+    Trace trace;
+    {
+        TraceScope scope{ &trace, "main" };
+    }
+    std::thread other{ [&trace]( ) {
+        TraceScope first{ &trace, "other" };
+    } };
+    other.join();
+    {
+        TraceScope scope{ &trace, "main" };
+    }
+
+    std::vector<TraceEvent> events = trace.events();
+    QCOMPARE( events.size(), static_cast<size_t>( 3 ) );
+    QCOMPARE( events[0].thread, static_cast<uint32_t>( 0 ) );
+    QCOMPARE( events[1].thread, static_cast<uint32_t>( 1 ) );
+    QCOMPARE( events[2].thread, static_cast<uint32_t>( 0 ) );
+}
+
+// When exported as a Chrome trace, every event and its pixels are written
+void TestTrace::chromeTraceHasEvents( ) {
+#ifdef HISTOGRAM_NO_TRACE
+    QSKIP( "Tracing is compiled out" );
+#endif
+    Trace trace;
+    {
+        TraceScope scope{ &trace, "load" };
+    }
+    {
+        TraceScope scope{ &trace, "scan", 1234 };
+    }
+
+    std::ostringstream output;
+    trace.writeChromeTrace( output );
+    std::string json = output.str();
+    QVERIFY( json.find( "\"traceEvents\":[" ) != std::string::npos );
+    QVERIFY( json.find( "\"name\":\"load\"" ) != std::string::npos );
+    QVERIFY( json.find( "\"name\":\"scan\"" ) != std::string::npos );
+    QVERIFY( json.find( "\"pixels\":1234" ) != std::string::npos );
+    QVERIFY( json.find( "\"ph\":\"X\"" ) != std::string::npos );
+
+    std::ostringstream summary;
+    trace.writeSummary( summary );
+    QVERIFY( summary.str().find( "load" ) != std::string::npos );
+    QVERIFY( summary.str().find( "Mpixels/s" ) != std::string::npos );
+}
+
+// When cleared, no events are left
+void TestTrace::clearForgetsEvents( ) {
+    Trace trace;
+    {
+        TraceScope scope{ &trace, "phase" };
+    }
+    trace.clear();
+    QVERIFY( trace.events().empty() );
+}
@@ -0,0 +1,31 @@
+#ifndef TEST_TRACE_H
+#define TEST_TRACE_H
+
+#include <QtTest>
+#include "../src/trace.h"
+
+class TestTrace : public QObject {
+    Q_OBJECT
+
+private slots:
+    // When a scope ends, one event is recorded with its name, pixels and a time within the scope
+    void scopeRecordsEvent( );
+
+    // When a scope is given no trace, nothing is recorded and nothing fails
+    void nullTraceIgnored( );
+
+    // When a tool with a trace counts an image, each thread's scan and the merge are recorded and the
+    // scans' pixels add up to the image
+    void toolRecordsScans( );
+
+    // When scopes end on other threads, each thread gets its own small id
+    void threadsGetIds( );
+
+    // When exported as a Chrome trace, every event and its pixels are written
+    void chromeTraceHasEvents( );
+
+    // When cleared, no events are left
+    void clearForgetsEvents( );
+};
+
+#endif // TEST_TRACE_H
@@ -0,0 +1,179 @@
+#include <QtTest>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "test_worker_pool.h"
+
+// When a job is run, every task index is run exactly once
+void TestWorkerPool::runsEveryTaskOnce( ) {
+    WorkerPool pool{ 3 };
+    std::vector<std::atomic<uint32_t>> runs( 4 );
+    for( auto& r : runs ) {
+        r = 0;
+    }
+
+    pool.run( 4, [&]( uint32_t task ) { runs[task]++; } );
+
+    for( auto& r : runs ) {
+        QCOMPARE( r.load(), static_cast<uint32_t>( 1 ) );
+    }
+}
+
+// When there are more tasks than workers, all tasks still run
+void TestWorkerPool::runsMoreTasksThanWorkers( ) {
+    WorkerPool pool{ 2 };
+    std::atomic<uint32_t> total{ 0 };
+
+    pool.run( 50, [&]( uint32_t task ) { total += task; } );
+
+    QCOMPARE( total.load(), static_cast<uint32_t>( 49 * 50 / 2 ) );
+}
+
+// When the pool has no workers, tasks run on the caller
+void TestWorkerPool::runsWithoutWorkers( ) {
+    WorkerPool pool{ 0 };
+    std::thread::id caller = std::this_thread::get_id();
+    uint32_t count = 0;
+    bool allOnCaller = true;
+
+    pool.run( 5, [&]( uint32_t ) {
+        count++;
+        allOnCaller = allOnCaller && ( std::this_thread::get_id() == caller );
+    } );
+
+    QCOMPARE( pool.numWorkers(), static_cast<uint32_t>( 0 ) );
+    QCOMPARE( count, static_cast<uint32_t>( 5 ) );
+    QVERIFY( allOnCaller );
+}
+
+// When jobs are run repeatedly, the same pool handles them all
+void TestWorkerPool::reusedAcrossJobs( ) {
+    WorkerPool pool{ 4 };
+    std::atomic<uint32_t> total{ 0 };
+
+    for( int job=0; job<1000; job++ ) {
+        pool.run( 5, [&]( uint32_t ) { total++; } );
+    }
+
+    QCOMPARE( total.load(), static_cast<uint32_t>( 5000 ) );
+}
+
+// When a task throws, the exception is rethrown to the caller
+void TestWorkerPool::propagatesExceptions( ) {
+    WorkerPool pool{ 2 };
+
+    QVERIFY_EXCEPTION_THROWN( pool.run( 3, []( uint32_t task ) {
+        if( task == 2 ) {
+            throw std::runtime_error( "task failed" );
+        }
+    } ), std::runtime_error );
+
+    // Pool is still usable afterwards
+    std::atomic<uint32_t> total{ 0 };
+    pool.run( 3, [&]( uint32_t ) { total++; } );
+    QCOMPARE( total.load(), static_cast<uint32_t>( 3 ) );
+}
+
+// When a job is run placed, task i always runs on worker i - 1 and task 0 on the caller
+void TestWorkerPool::placedTasksRunOnTheirWorker( ) {
+    WorkerPool pool{ 3 };
+    std::thread::id caller = std::this_thread::get_id();
+    std::vector<std::thread::id> first( 4 ), later( 4 );
+
+    pool.runPlaced( 4, [&]( uint32_t task ) {
+        first[task] = std::this_thread::get_id();
+    } );
+    for( int job = 0; job < 100; job++ ) {
+        // Unplaced jobs in between may run on any worker
+        pool.run( 4, []( uint32_t ) { } );
+        pool.runPlaced( 4, [&]( uint32_t task ) {
+            later[task] = std::this_thread::get_id();
+        } );
+        for( uint32_t task = 0; task < 4; ++task ) {
+            QVERIFY( later[task] == first[task] );
+        }
+    }
+
+    QVERIFY( first[0] == caller );
+    for( uint32_t a = 0; a < 4; ++a ) {
+        for( uint32_t b = a + 1; b < 4; ++b ) {
+            QVERIFY( first[a] != first[b] );
+        }
+    }
+}
+
+// When a placed job has more tasks than threads, throws a std::invalid_argument
+void TestWorkerPool::placedTooManyTasks( ) {
+    WorkerPool pool{ 2 };
+    QVERIFY_EXCEPTION_THROWN( pool.runPlaced( 4, []( uint32_t ) { } ), std::invalid_argument );
+
+    std::atomic<uint32_t> total{ 0 };
+    pool.runPlaced( 3, [&]( uint32_t ) { total++; } );
+    QCOMPARE( total.load(), static_cast<uint32_t>( 3 ) );
+}
+
+// When work is posted, it runs on a worker while the caller carries on; a pool without workers throws
+void TestWorkerPool::postRunsInBackground( ) {
+    WorkerPool pool{ 1 };
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool released = false;
+    bool ran = false;
+    std::thread::id ranOn;
+
+    pool.post( [&]{
+        std::unique_lock<std::mutex> lock{ mutex };
+        signal.wait( lock, [&]{ return released; } );
+        ran = true;
+        ranOn = std::this_thread::get_id();
+        signal.notify_all();
+    } );
+
+    // The work waits for us, so post must have returned before it ran
+    {
+        std::unique_lock<std::mutex> lock{ mutex };
+        QVERIFY( ! ran );
+        released = true;
+        signal.notify_all();
+        signal.wait( lock, [&]{ return ran; } );
+    }
+    QVERIFY( ranOn != std::this_thread::get_id() );
+
+    WorkerPool empty{ 0 };
+    QVERIFY_EXCEPTION_THROWN( empty.post( []{} ), std::logic_error );
+}
+
+// When workers are pinned to a CPU this process may use, they run on it
+void TestWorkerPool::pinnedWorkersRunOnTheirCpu( ) {
+#ifndef __linux__
+    QSKIP( "Pinning is only supported on Linux" );
+#else
+    cpu_set_t mask;
+    CPU_ZERO( &mask );
+    QVERIFY( sched_getaffinity( 0, sizeof( mask ), &mask ) == 0 );
+    uint32_t cpu = 0;
+    while( ! CPU_ISSET( cpu, &mask ) ) {
+        cpu++;
+    }
+
+    WorkerPool pool{ 2 };
+    QVERIFY( pool.pinWorkers( { cpu } ) );
+    std::atomic<uint32_t> onCpu{ 0 };
+    pool.runPlaced( 3, [&]( uint32_t task ) {
+        if( task > 0 && sched_getcpu() == static_cast<int>( cpu ) ) {
+            onCpu++;
+        }
+    } );
+    QCOMPARE( onCpu.load(), static_cast<uint32_t>( 2 ) );
+    QVERIFY_EXCEPTION_THROWN( pool.pinWorkers( {} ), std::invalid_argument );
+#endif
+}
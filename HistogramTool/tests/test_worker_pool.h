@@ -0,0 +1,39 @@
+#ifndef TEST_WORKER_POOL_H
+#define TEST_WORKER_POOL_H
+
+#include <QtTest>
+#include "../src/worker_pool.h"
+
+class TestWorkerPool : public QObject {
+    Q_OBJECT
+
+private slots:
+    // When a job is run, every task index is run exactly once
+    void runsEveryTaskOnce( );
+
+    // When there are more tasks than workers, all tasks still run
+    void runsMoreTasksThanWorkers( );
+
+    // When the pool has no workers, tasks run on the caller
+    void runsWithoutWorkers( );
+
+    // When jobs are run repeatedly, the same pool handles them all
+    void reusedAcrossJobs( );
+
+    // When a task throws, the exception is rethrown to the caller
+    void propagatesExceptions( );
+
+    // When a job is run placed, task i always runs on worker i - 1 and task 0 on the caller
+    void placedTasksRunOnTheirWorker( );
+
+    // When a placed job has more tasks than threads, throws a std::invalid_argument
+    void placedTooManyTasks( );
+
+    // When work is posted, it runs on a worker while the caller carries on; a pool without workers throws
+    void postRunsInBackground( );
+
+    // When workers are pinned to a CPU this process may use, they run on it
+    void pinnedWorkersRunOnTheirCpu( );
+};
+
+#endif // TEST_WORKER_POOL_H
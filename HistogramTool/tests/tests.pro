@@ -5,11 +5,51 @@ TEMPLATE = app
 SOURCES += \
     test_histogram.cpp \
     test_histogram_tool.cpp \
+    test_histogram_kernel.cpp \
+    test_rgb_accumulator.cpp \
+    test_worker_pool.cpp \
+    test_streaming_histogram.cpp \
+    test_batch_histogram.cpp \
+    test_mapped_raster.cpp \
+    test_fixed_histogram.cpp \
+    test_tiled_histogram.cpp \
+    test_region_histogram_index.cpp \
+    test_sampled_histogram.cpp \
+    test_trace.cpp \
+    test_histogram_writer.cpp \
+    test_numa_topology.cpp \
+    test_auto_tuner.cpp \
+    test_histogram_server.cpp \
+    test_histogram_job.cpp \
+    noise_image.cpp \
+    test_derived_channels.cpp \
+    test_joint_histogram.cpp \
+    test_histogram_stats.cpp \
     test_main.cpp
 
 HEADERS += \
     test_histogram.h \
-    test_histogram_tool.h
+    test_histogram_tool.h \
+    test_histogram_kernel.h \
+    test_rgb_accumulator.h \
+    test_worker_pool.h \
+    test_streaming_histogram.h \
+    test_batch_histogram.h \
+    test_mapped_raster.h \
+    test_fixed_histogram.h \
+    test_tiled_histogram.h \
+    test_region_histogram_index.h \
+    test_sampled_histogram.h \
+    test_trace.h \
+    test_histogram_writer.h \
+    test_numa_topology.h \
+    test_auto_tuner.h \
+    test_histogram_server.h \
+    test_histogram_job.h \
+    noise_image.h \
+    test_derived_channels.h \
+    test_joint_histogram.h \
+    test_histogram_stats.h
 
 INCLUDEPATH += ../src/
 DEPENDPATH += $${INCLUDEPATH} # force rebuild if the headers change
@@ -24,3 +64,6 @@ TARGET = TestHistogramTool
 HISTO_LIB = ../src/libHistogramTool.a
 LIBS += $${HISTO_LIB}
 PRE_TARGETDEPS += $${HISTO_LIB}
+
+# qmake CONFIG+=notrace compiles tracing out
+notrace: DEFINES += HISTOGRAM_NO_TRACE